@@ -0,0 +1,204 @@
+/* ISMRMRD Asynchronous Dataset Writer */
+
+/**
+ * @file async_dataset.h
+ */
+
+#pragma once
+#ifndef ISMRMRD_ASYNC_DATASET_H
+#define ISMRMRD_ASYNC_DATASET_H
+
+#include "ismrmrd/dataset.h"
+
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace ISMRMRD {
+
+/// What an append does when the queue of an AsyncDataset is full
+enum class AsyncQueuePolicy {
+    BLOCK,  ///< wait for the writer to make room
+    DROP,   ///< discard the new object and count it as dropped
+    GROW    ///< queue it anyway, the capacity then only bounds the size of a batch
+};
+
+/// Counters kept by an AsyncDataset since it was opened
+struct AsyncDatasetStats {
+    uint64_t queued;    ///< objects accepted by the append calls
+    uint64_t written;   ///< objects written to the file
+    uint64_t dropped;   ///< objects discarded by AsyncQueuePolicy::DROP
+    uint64_t failed;    ///< objects whose write failed
+    uint64_t batches;   ///< batches taken off the queue by the writer
+    size_t depth;       ///< objects in the queue when the stats were taken
+    size_t max_depth;   ///< the deepest the queue has been
+};
+
+/**
+ * Writes to a Dataset from a background thread.
+ *
+ * The append calls move their object into a bounded queue and return, a dedicated
+ * writer thread drains the queue in batches and writes runs of acquisitions with a
+ * single appendAcquisitions call. Objects are written in the order they were queued.
+ * Pass objects with std::move to hand over their buffers instead of copying them.
+ *
+ * A failed write doesn't stop the writer. The first error is kept and rethrown by the
+ * next call on the producer side, or by close(). The destructor writes whatever is still
+ * queued but can't report errors, call close() to see them.
+ *
+ * The writer thread is the only one using the file. Its calls hold the DatasetLock like
+ * those of any other Dataset, so direct C or HDF5 calls elsewhere should take it too.
+ */
+class EXPORTISMRMRD AsyncDataset {
+public:
+    AsyncDataset(const char* filename, const char* groupname, bool create_file_if_needed = true,
+                 size_t capacity = 1024, AsyncQueuePolicy policy = AsyncQueuePolicy::BLOCK);
+    AsyncDataset(const char* filename, const char* groupname, const ISMRMRD_DatasetOptions &options,
+                 bool create_file_if_needed = true, size_t capacity = 1024,
+                 AsyncQueuePolicy policy = AsyncQueuePolicy::BLOCK);
+    ~AsyncDataset();
+
+    // The append calls return false when AsyncQueuePolicy::DROP discarded the object
+    bool writeHeader(const std::string &xmlstring);
+    bool appendAcquisition(Acquisition acq);
+    bool appendWaveform(Waveform wav);
+    template <typename T> bool appendImage(const std::string &var, Image<T> im);
+    // Images and arrays of any data type, the buffers of im and arr are moved into the
+    // queue and they are left empty, as after ismrmrd_init_image and ismrmrd_init_ndarray
+    bool appendImage(const std::string &var, ISMRMRD_Image *im);
+    bool appendNDArray(const std::string &var, ISMRMRD_NDArray *arr);
+
+    // Waits until everything queued so far is written
+    void flush();
+    // Flushes, stops the writer and closes the file
+    void close();
+
+    AsyncDatasetStats getStats();
+
+private:
+    AsyncDataset(const AsyncDataset &);
+    AsyncDataset & operator= (const AsyncDataset &);
+
+    // A queued write, run on the writer thread
+    struct Item {
+        virtual ~Item() {}
+        virtual void write(Dataset &dataset) = 0;
+        // The acquisition to batch with its neighbours, or NULL
+        virtual Acquisition *acquisition() { return NULL; }
+    };
+    struct HeaderItem;
+    struct AcquisitionItem;
+    struct WaveformItem;
+    template <typename T> struct ImageItem;
+    struct RawImageItem;
+    struct RawArrayItem;
+
+    void start();
+    bool push(Item *item);
+    void run();
+    void write_batch(std::deque<Item *> &batch);
+    void rethrow();
+
+    std::unique_ptr<Dataset> dataset_;
+    size_t capacity_;
+    AsyncQueuePolicy policy_;
+
+    std::mutex mutex_;
+    std::condition_variable work_;      // signalled when items are queued or the writer must stop
+    std::condition_variable progress_;  // signalled when the writer takes or finishes items
+    std::deque<Item *> queue_;
+    uint64_t done_;                     // items written or failed
+    bool stopping_;
+    std::exception_ptr error_;
+    AsyncDatasetStats stats_;
+    std::thread writer_;
+};
+
+template <typename T> struct AsyncDataset::ImageItem : public AsyncDataset::Item {
+    ImageItem(const std::string &var, Image<T> &&im) : var(var), im(std::move(im)) {}
+    void write(Dataset &dataset) { dataset.appendImage(var, im); }
+    std::string var;
+    Image<T> im;
+};
+
+template <typename T> bool AsyncDataset::appendImage(const std::string &var, Image<T> im)
+{
+    return push(new ImageItem<T>(var, std::move(im)));
+}
+
+/// Counters kept by a PrefetchingAcquisitionReader since it was opened
+struct PrefetchStats {
+    uint64_t acquisitions;   ///< acquisitions handed to the consumer
+    uint64_t blocks;         ///< blocks read by the background thread
+    double read_seconds;     ///< time the background thread spent reading
+    double stall_seconds;    ///< time the consumer spent waiting for a block
+    uint64_t stalls;         ///< calls that had to wait for a block
+};
+
+/**
+ * Reads the acquisitions of a Dataset ahead of the consumer.
+ *
+ * A background thread reads blocks of block_size acquisitions into a ring, up to depth
+ * blocks ahead of the block the consumer is on, so that the reads overlap with whatever
+ * the consumer does with the acquisitions. The acquisitions of a block are swapped out
+ * to the consumer, which hands the buffers of its own acquisition back to the ring. Once
+ * the ring has gone round, a read reuses the buffers and doesn't allocate.
+ *
+ * The stall time in the stats is the time the consumer waited on the reader, a value
+ * close to the read time means the consumer is I/O bound.
+ *
+ * A read error ends the stream, it is thrown by next() after the acquisitions read
+ * before it. As with AsyncDataset, direct C or HDF5 calls elsewhere should hold the
+ * DatasetLock.
+ */
+class EXPORTISMRMRD PrefetchingAcquisitionReader {
+public:
+    PrefetchingAcquisitionReader(const char* filename, const char* groupname,
+                                 uint32_t block_size = 256, size_t depth = 4);
+    ~PrefetchingAcquisitionReader();
+
+    uint32_t getNumberOfAcquisitions() const;
+
+    // Swaps the next acquisition into acq, returns false at the end
+    bool next(Acquisition &acq);
+    // Swaps the rest of the current block, or the next block, into block, returns false at the end
+    bool nextBlock(std::vector<Acquisition> &block);
+
+    PrefetchStats getStats();
+
+private:
+    PrefetchingAcquisitionReader(const PrefetchingAcquisitionReader &);
+    PrefetchingAcquisitionReader & operator= (const PrefetchingAcquisitionReader &);
+
+    bool acquire();
+    void release();
+    void run();
+
+    std::unique_ptr<Dataset> dataset_;
+    uint32_t number_of_acquisitions_;
+    uint32_t block_size_;
+
+    std::mutex mutex_;
+    std::condition_variable filled_;    // signalled when a block is read or the reader ends
+    std::condition_variable emptied_;   // signalled when the consumer gives a block back
+    std::vector<std::vector<Acquisition> > ring_;
+    size_t head_;                       // the block the consumer is on
+    size_t count_;                      // blocks read and not yet given back
+    size_t position_;                   // the next acquisition within the head block
+    uint64_t delivered_;                // acquisitions handed out, only touched by the consumer
+    bool holding_;                      // whether the consumer is on the head block
+    bool finished_;
+    bool stopping_;
+    std::exception_ptr error_;
+    PrefetchStats stats_;
+    std::thread reader_;
+};
+
+} // namespace ISMRMRD
+
+#endif // ISMRMRD_ASYNC_DATASET_H
@@ -0,0 +1,156 @@
+/* ISMRMRD Capture File Format */
+
+/**
+ * @file capture.h
+ */
+
+#pragma once
+#ifndef ISMRMRD_CAPTURE_H
+#define ISMRMRD_CAPTURE_H
+
+#include "ismrmrd/dataset.h"
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+namespace ISMRMRD {
+
+/// The kinds of record in a capture file
+enum class CaptureRecordType : uint32_t {
+    HEADER = 1,         ///< the XML header
+    ACQUISITION = 2,    ///< AcquisitionHeader, trajectory and data
+    WAVEFORM = 3,       ///< WaveformHeader and data
+    IMAGE = 4,          ///< ImageHeader, variable name, attribute string and data
+    INDEX = 5           ///< the index footer written by close()
+};
+
+/// Where a record starts in a capture file
+struct CaptureIndexEntry {
+    uint64_t offset;    ///< of the record frame from the start of the file
+    uint32_t type;      ///< a CaptureRecordType
+    uint32_t reserved;
+};
+
+/**
+ * Writes a capture file, a plain append-only container meant for recording at full rate.
+ *
+ * A capture file starts with a magic number and a version, followed by records that each
+ * have a frame of their type and payload length. Records are assembled in a large buffer
+ * and written with few sequential writes, and a record larger than the buffer is written
+ * straight from the buffers of its object. close() appends an index of all records and a
+ * trailer pointing at it. Samples are stored in the byte order of the writer.
+ *
+ * A file whose writer didn't get to close() still reads, see CaptureReader. flush() bounds
+ * how much is lost when the writer dies. A CaptureWriter must not be shared between threads.
+ */
+class EXPORTISMRMRD CaptureWriter {
+public:
+    CaptureWriter(const char *filename, size_t buffer_size = 4 << 20);
+    // Closes the file, errors are only reported by an explicit close
+    ~CaptureWriter();
+
+    void writeHeader(const std::string &xmlstring);
+    void appendAcquisition(const Acquisition &acq);
+    void appendWaveform(const Waveform &wav);
+    template <typename T> void appendImage(const std::string &var, const Image<T> &im);
+    void appendImage(const std::string &var, const ISMRMRD_Image *im);
+
+    // Writes the buffered records to the file
+    void flush();
+    // Writes the index footer and closes the file
+    void close();
+
+    // The number of bytes written so far, including those still buffered
+    uint64_t getSize() const;
+
+private:
+    CaptureWriter(const CaptureWriter &);
+    CaptureWriter & operator= (const CaptureWriter &);
+
+    // A part of a record payload
+    struct Piece {
+        const void *data;
+        size_t size;
+    };
+
+    void append(CaptureRecordType type, const Piece *pieces, size_t count);
+    void append_image(const std::string &var, const ISMRMRD_ImageHeader &head, const char *attributes,
+                      const void *data, size_t size);
+    void write(const void *data, size_t size);
+    void write_buffer();
+
+    std::FILE *file_;
+    std::vector<char> buffer_;
+    size_t used_;
+    uint64_t size_;
+    std::vector<CaptureIndexEntry> index_;
+};
+
+template <typename T> void CaptureWriter::appendImage(const std::string &var, const Image<T> &im)
+{
+    append_image(var, im.getHead(), im.getAttributeString(), im.getDataPtr(), im.getDataSize());
+}
+
+/**
+ * Reads a capture file written by CaptureWriter.
+ *
+ * The index footer is read when the file is opened, after which each record is found in
+ * constant time by its kind and number. When the footer is missing or damaged, e.g. because
+ * the writer was killed, the records are scanned from the start instead and the index is
+ * rebuilt from every complete record, a torn record at the end is left out.
+ */
+class EXPORTISMRMRD CaptureReader {
+public:
+    CaptureReader(const char *filename);
+    ~CaptureReader();
+
+    // Whether the index was rebuilt by a scan because the footer was unusable
+    bool isRecovered() const;
+    // All records in the order they were written
+    const std::vector<CaptureIndexEntry> &getIndex() const;
+
+    // Returns false when the file has no header
+    bool readHeader(std::string &xmlstring);
+    uint32_t getNumberOfAcquisitions() const;
+    void readAcquisition(uint32_t index, Acquisition &acq);
+    uint32_t getNumberOfWaveforms() const;
+    void readWaveform(uint32_t index, Waveform &wav);
+    // Images are numbered across all variables, var is set to that of the image read
+    uint32_t getNumberOfImages() const;
+    template <typename T> void readImage(uint32_t index, std::string &var, Image<T> &im);
+    void readImage(uint32_t index, std::string &var, ISMRMRD_Image *im);
+
+private:
+    CaptureReader(const CaptureReader &);
+    CaptureReader & operator= (const CaptureReader &);
+
+    bool read_footer();
+    void scan();
+    void add(const CaptureIndexEntry &entry);
+    uint64_t seek_record(const std::vector<uint64_t> &offsets, uint32_t index, CaptureRecordType type);
+    uint64_t read_image_header(uint32_t index, std::string &var, ISMRMRD_ImageHeader &head,
+                               std::string &attributes);
+    void seek(uint64_t offset);
+    void read(void *data, size_t size);
+
+    std::FILE *file_;
+    uint64_t size_;
+    bool recovered_;
+    std::vector<CaptureIndexEntry> index_;
+    std::vector<uint64_t> headers_;
+    std::vector<uint64_t> acquisitions_;
+    std::vector<uint64_t> waveforms_;
+    std::vector<uint64_t> images_;
+};
+
+// Copies every record of a capture file into a dataset, appending to what it holds
+EXPORTISMRMRD void convertCaptureToDataset(CaptureReader &capture, Dataset &dataset);
+// Copies the header, acquisitions and waveforms of a dataset, and the images of the listed
+// variables, into a capture file
+EXPORTISMRMRD void convertDatasetToCapture(Dataset &dataset, const std::vector<std::string> &image_vars,
+                                           CaptureWriter &capture);
+
+} // namespace ISMRMRD
+
+#endif // ISMRMRD_CAPTURE_H
@@ -18,6 +18,217 @@ namespace ISMRMRD {
 extern "C" {
 #endif
 
+/* The open HDF5 handles of a dataset, private to the library */
+struct ISMRMRD_DatasetCache;
+
+/**
+ *   How the record axis of an extensible dataset grows as records are appended.
+ */
+enum ISMRMRD_GrowthPolicies {
+    ISMRMRD_GROWTH_EXACT = 0,   /**< extend by exactly the number of records appended */
+    ISMRMRD_GROWTH_GEOMETRIC,   /**< double the allocated extent whenever it is full */
+    ISMRMRD_GROWTH_HINT         /**< allocate capacity_hint acquisitions up front, then double */
+};
+
+/**
+ *   The filters applied to the variables of a dataset when they are created.
+ */
+enum ISMRMRD_CompressionProfiles {
+    ISMRMRD_COMPRESSION_NONE = 0,  /**< no filters */
+    ISMRMRD_COMPRESSION_FAST,      /**< byte shuffle and deflate level 1 */
+    ISMRMRD_COMPRESSION_MAX,       /**< byte shuffle and deflate level 9 */
+    ISMRMRD_COMPRESSION_CXFLOAT    /**< the complex float codec for ISMRMRD_CXFLOAT data, fast for the rest */
+};
+
+/**
+ *   How a dataset takes part in HDF5 single writer, multiple reader (SWMR) access, which
+ *   lets readers follow a file while it is being written. Needs HDF5 1.10 or later.
+ */
+enum ISMRMRD_SwmrModes {
+    ISMRMRD_SWMR_NONE = 0,  /**< plain access */
+    ISMRMRD_SWMR_WRITE,     /**< the latest file format, SWMR writing starts with ismrmrd_begin_swmr_write */
+    ISMRMRD_SWMR_READ       /**< read only, extents are refreshed whenever records are counted */
+};
+
+/**
+ *   The HDF5 filter id of the complex float codec. It is not registered with The HDF
+ *   Group but picked from the range HDF5 leaves for unregistered filters, away from the
+ *   start of that range where other private filters tend to be. As another filter may
+ *   still use the id, the codec stores ISMRMRD_FILTER_CXFLOAT_CODEC and its version as
+ *   the client data of the filter and refuses chunks of datasets without them.
+ */
+#define ISMRMRD_FILTER_CXFLOAT 46153
+#define ISMRMRD_FILTER_CXFLOAT_CODEC 0x434d5349u /* "ISMC" */
+
+/**
+ *   Options used when datasets are created and extended through an ISMRMRD_Dataset.
+ *
+ *   Chunking only applies to variables created with these options, existing
+ *   variables keep their layout. HDF5 allocates whole chunks, so automatic chunking
+ *   never makes an uncompressed chunk longer than the records a variable is created with:
+ *   a variable started with one record keeps a record per chunk, a batched append or the
+ *   hint policy give it longer chunks. Compressed variables get chunks of about 512 KiB,
+ *   their unwritten records compress to next to nothing. The samples of image and array variables with a record
+ *   per chunk and no compression are written and read as whole chunks, skipping the
+ *   HDF5 type conversion and selection code. Automatic chunking gives records of 512 KiB
+ *   or more a chunk each, a chunk length of 1 does so for any size.
+ *
+ *   The samples of acquisitions are variable length, which HDF5 keeps unfiltered in the
+ *   global heap. Acquisitions created with a compression profile instead leave those
+ *   fields of their records empty and keep their samples in datasets of their own, which
+ *   take the profile: acquisition_samples holds the data as complex floats, one
+ *   acquisition after the other, acquisition_trajectories the trajectories as floats and
+ *   acquisition_offsets where each acquisition starts in both. Only readers built with
+ *   this version of the library find the samples there. Repacking puts them back into
+ *   the records.
+ *
+ *   With the geometric and hint policies the allocated extent can run ahead of the
+ *   records written, it is trimmed back when the dataset is closed. Until then other
+ *   readers of the file see the unwritten records as zeros.
+ *
+ *   With mantissa_bits set the float and complex float samples of images and arrays are
+ *   rounded to that many mantissa bits before they are written, a relative error of at
+ *   most 2^-(mantissa_bits+1). The rounded low bits are zero, which the compression
+ *   profiles store compactly. The samples of acquisitions are rounded as well when they
+ *   are compressed, which keeps them apart from their headers; their trajectories and the
+ *   samples of uncompressed acquisitions are written at full precision.
+ *
+ *   The swmr mode applies when the file is opened. Files opened for SWMR writing use
+ *   the HDF5 1.10 file format, which older versions of HDF5 can't read.
+ *
+ *   With in_memory the file is kept in memory by the HDF5 core driver, opening an
+ *   existing file reads all of it. The filename still identifies the file, datasets
+ *   open at the same time need different names. Without backing_store nothing is
+ *   written to disk, with it the file is written out when the dataset is closed.
+ *   Neither mode can be combined with SWMR access.
+ *
+ *   The cache options apply when the file is opened. Each variable has a raw data chunk
+ *   cache of its own, HDF5 defaults to 1 MiB and 521 slots, so a chunk of a larger image
+ *   is read again, and decompressed again, by every partial read. Give the cache at least
+ *   a chunk's worth of bytes per variable read that way, and about a hundred times as many
+ *   slots as the chunks it holds, ideally a prime number. The metadata cache holds chunk
+ *   indexes and object headers, it is shared by the file and sized adaptively unless
+ *   metadata_cache_bytes fixes its size.
+ */
+typedef struct ISMRMRD_DatasetOptions {
+    uint32_t chunk_length;   /**< Records per chunk, 0 picks up to 512 KiB, capped by the first extent */
+    uint16_t growth_policy;  /**< One of ISMRMRD_GrowthPolicies */
+    uint32_t capacity_hint;  /**< Expected number of acquisitions for ISMRMRD_GROWTH_HINT */
+    bool index_acquisitions; /**< Keep the acquisition index up to date while appending */
+    uint16_t compression;    /**< One of ISMRMRD_CompressionProfiles, for variables without their own */
+    uint16_t mantissa_bits;  /**< Mantissa bits kept in float image, array and compressed acquisition samples, 0 keeps all 23 */
+    uint16_t swmr;           /**< One of ISMRMRD_SwmrModes */
+    bool in_memory;          /**< Keep the file in memory with the HDF5 core driver */
+    bool backing_store;      /**< With in_memory, write the file to disk when it is closed */
+    uint32_t memory_increment; /**< With in_memory, bytes the memory grows by at a time, 0 picks 64 KiB */
+    size_t chunk_cache_slots;  /**< Hash table slots of each chunk cache, 0 keeps the HDF5 default */
+    size_t chunk_cache_bytes;  /**< Bytes of each chunk cache, 0 keeps the HDF5 default */
+    double chunk_cache_w0;     /**< Preemption weight of fully read or written chunks in [0, 1], negative keeps the HDF5 default */
+    size_t metadata_cache_bytes; /**< Fixed size of the metadata cache, 0 keeps the adaptive default */
+} ISMRMRD_DatasetOptions;
+
+/**
+ *   The state of the caches of an open dataset, see ismrmrd_get_cache_stats.
+ *
+ *   HDF5 counts hits and misses of the metadata cache only, there is no way to query those
+ *   of the chunk caches, whose settings are reported instead.
+ */
+typedef struct ISMRMRD_CacheStats {
+    double metadata_hit_rate;      /**< Metadata cache hits per access since the last reset, 0 without accesses */
+    size_t metadata_cache_bytes;   /**< Bytes held by the metadata cache */
+    size_t metadata_cache_max_bytes; /**< The size the metadata cache may grow to */
+    uint32_t metadata_cache_entries; /**< Entries in the metadata cache */
+    size_t chunk_cache_slots;      /**< The chunk cache settings in effect for the variables of the file */
+    size_t chunk_cache_bytes;
+    double chunk_cache_w0;
+} ISMRMRD_CacheStats;
+
+/**
+ *   The attribute holding the mantissa bits kept in a variable written with the
+ *   mantissa_bits option.
+ */
+#define ISMRMRD_MANTISSA_BITS_ATTRIBUTE "mantissa_bits"
+
+/**
+ *   The encoding counters compared by an ISMRMRD_AcquisitionQuery.
+ */
+enum ISMRMRD_QueryFields {
+    ISMRMRD_QUERY_KSPACE_ENCODE_STEP_1 = 1 << 0,
+    ISMRMRD_QUERY_KSPACE_ENCODE_STEP_2 = 1 << 1,
+    ISMRMRD_QUERY_AVERAGE = 1 << 2,
+    ISMRMRD_QUERY_SLICE = 1 << 3,
+    ISMRMRD_QUERY_CONTRAST = 1 << 4,
+    ISMRMRD_QUERY_PHASE = 1 << 5,
+    ISMRMRD_QUERY_REPETITION = 1 << 6,
+    ISMRMRD_QUERY_SET = 1 << 7,
+    ISMRMRD_QUERY_SEGMENT = 1 << 8
+};
+
+/**
+ *   Selects acquisitions by their encoding counters and flags.
+ *
+ *   Flag masks are built with ismrmrd_set_flag.
+ */
+typedef struct ISMRMRD_AcquisitionQuery {
+    uint32_t fields;               /**< ISMRMRD_QueryFields to compare, the other counters match anything */
+    ISMRMRD_EncodingCounters idx;  /**< The values of the compared counters */
+    uint64_t flags_set;            /**< Flags that must all be set */
+    uint64_t flags_clear;          /**< Flags that must all be clear */
+} ISMRMRD_AcquisitionQuery;
+
+/**
+ *   Called on the headers that pass the flag masks of an ISMRMRD_AcquisitionFilter,
+ *   returns true to read the acquisition.
+ */
+typedef bool (*ISMRMRD_AcquisitionPredicate)(const ISMRMRD_AcquisitionHeader *head, void *predicate_data);
+
+/**
+ *   Selects acquisitions by their headers before their payloads are read.
+ *
+ *   Flag masks are built with ismrmrd_set_flag.
+ */
+typedef struct ISMRMRD_AcquisitionFilter {
+    uint64_t flags_include;                /**< When non-zero, at least one of these flags must be set */
+    uint64_t flags_exclude;                /**< Flags that must all be clear */
+    ISMRMRD_AcquisitionPredicate predicate; /**< Optional test on the rest of the header */
+    void *predicate_data;                  /**< Passed on to predicate */
+} ISMRMRD_AcquisitionFilter;
+
+/**
+ *   A block of an image together with a subset of its channels, see ismrmrd_read_image_region.
+ *
+ *   first and count are in x, y, z order, a count of 0 takes the rest of the axis.
+ *   Channels are listed in increasing order, a NULL list reads all of them.
+ */
+typedef struct ISMRMRD_ImageRegion {
+    uint16_t first[3];          /**< The first x, y and z of the block */
+    uint16_t count[3];          /**< The size of the block along x, y and z */
+    const uint16_t *channels;   /**< The channels to read, or NULL */
+    uint16_t nchannels;         /**< The number of channels listed */
+} ISMRMRD_ImageRegion;
+
+/**
+ *   A block of an array, see ismrmrd_read_array_region.
+ *
+ *   The entries are in the order of the dimensions of the array, fastest first.
+ *   A count of 0 takes as many elements as fit from the offset to the end of the
+ *   dimension, a stride of 0 is taken as 1.
+ */
+typedef struct ISMRMRD_ArrayRegion {
+    size_t offset[ISMRMRD_NDARRAY_MAXDIM];  /**< The first element along each dimension */
+    size_t count[ISMRMRD_NDARRAY_MAXDIM];   /**< The number of elements to read along each dimension */
+    size_t stride[ISMRMRD_NDARRAY_MAXDIM];  /**< The step between elements along each dimension */
+} ISMRMRD_ArrayRegion;
+
+/**
+ *   Where the records of a dataset written by ismrmrd_repack_dataset lie in the file.
+ */
+typedef struct ISMRMRD_StorageExtent {
+    uint64_t offset;        /**< The file offset of the first record */
+    uint64_t record_size;   /**< The bytes from the start of one record to the next */
+    uint32_t count;         /**< The number of records */
+} ISMRMRD_StorageExtent;
+
 /**
  *   Interface for accessing an ISMRMRD Data Set stored on disk in HDF5 format.
  *
@@ -26,13 +237,25 @@ extern "C" {
  *   XML configuration is stored in the variable groupname/xml and the
  *   Acquisitions are stored in the variable groupname/data.
  *
+ *   HDF5 handles for the acquisitions, waveforms and every image or array variable
+ *   are opened on first use and kept open, with their extents cached, until the
+ *   dataset is closed. A file should therefore only be written through one
+ *   ISMRMRD_Dataset at a time.
  */
 typedef struct ISMRMRD_Dataset {
     char *filename;
     char *groupname;
     hid_t fileid;
+    struct ISMRMRD_DatasetCache *cache; /**< Open HDF5 dataset handles (private) */
+    ISMRMRD_DatasetOptions options;     /**< Set by ismrmrd_init_dataset, may be changed before writing */
 } ISMRMRD_Dataset;
 
+/**
+ * Sets the default dataset options: automatic chunk length, exact growth, no compression,
+ * full precision, no SWMR access and a file on disk.
+ */
+EXPORTISMRMRD int ismrmrd_init_dataset_options(ISMRMRD_DatasetOptions *options);
+
 /**
  * Initializes an ISMRMRD dataset structure
  *
@@ -45,12 +268,100 @@ EXPORTISMRMRD int ismrmrd_init_dataset(ISMRMRD_Dataset *dset, const char *filena
  */
 EXPORTISMRMRD int ismrmrd_open_dataset(ISMRMRD_Dataset *dset, const bool create_if_neded);
 
+/**
+ * Opens an ISMRMRD dataset from a file image, the bytes of an HDF5 file held in memory.
+ *
+ * The image is copied, the caller keeps the buffer. The dataset is kept in memory as with
+ * the in_memory option and the filename only identifies it, changes are never written
+ * to disk. Use this to parse a file received over a pipe or a socket.
+ */
+EXPORTISMRMRD int ismrmrd_open_dataset_image(ISMRMRD_Dataset *dset, const void *image, size_t size);
+
 /**
  * Closes all references to the underlying HDF5 file.
  *
  */
 EXPORTISMRMRD int ismrmrd_close_dataset(ISMRMRD_Dataset *dset);
 
+/**
+ * Takes and releases the lock that serializes the Dataset calls of all threads, the one
+ * held by a C++ DatasetLock.
+ *
+ * The C functions don't take it themselves. C code calling them or HDF5 while other
+ * threads use Datasets should hold it around those calls. The lock is recursive, each
+ * ismrmrd_lock_datasets needs an ismrmrd_unlock_datasets on the same thread.
+ */
+EXPORTISMRMRD void ismrmrd_lock_datasets(void);
+EXPORTISMRMRD void ismrmrd_unlock_datasets(void);
+
+/**
+ * Copies the file of an open dataset into buffer, after flushing it.
+ *
+ * With a NULL buffer only the size of the image is returned in size. Otherwise size is
+ * the size of buffer on input and of the image on output. The image can be sent elsewhere
+ * and opened with ismrmrd_open_dataset_image. Capacity reserved by the growth policy is
+ * part of the image, see ISMRMRD_DatasetOptions.
+ */
+EXPORTISMRMRD int ismrmrd_get_dataset_image(const ISMRMRD_Dataset *dset, void *buffer, size_t *size);
+
+/**
+ * Reports the sizes and settings of the caches of an open dataset and the hit rate of its
+ * metadata cache since it was opened or last reset.
+ */
+EXPORTISMRMRD int ismrmrd_get_cache_stats(const ISMRMRD_Dataset *dset, ISMRMRD_CacheStats *stats);
+
+/**
+ * Starts counting the metadata cache hit rate afresh, e.g. after a warm-up read.
+ */
+EXPORTISMRMRD int ismrmrd_reset_cache_stats(const ISMRMRD_Dataset *dset);
+
+/**
+ *  Starts SWMR writing on a dataset opened with the ISMRMRD_SWMR_WRITE mode.
+ *
+ *  SWMR readers are only guaranteed to see the objects that existed when SWMR writing
+ *  started, so the header and every variable should have been written to before this
+ *  call, the acquisitions and waveforms included. Capacity reserved by the growth policy is given back and the
+ *  extents grow exactly from then on, so that readers never see unwritten records.
+ *  Readers should open the file after this call.
+ */
+EXPORTISMRMRD int ismrmrd_begin_swmr_write(ISMRMRD_Dataset *dset);
+
+/**
+ *  Closes and reopens the file of a dataset opened as an ISMRMRD_SWMR_READ reader,
+ *  keeping its options. Fails for any other dataset.
+ *
+ *  HDF5 doesn't support variable length data with SWMR: a reader keeps the parts of the
+ *  global heap it has read cached, and reading records added to them since then fails.
+ *  A SWMR reader recovers from such a failure by reopening the file, which drops the
+ *  cache, and reading again once the writer has flushed. The C++ Dataset does this itself.
+ */
+EXPORTISMRMRD int ismrmrd_reopen_dataset(ISMRMRD_Dataset *dset);
+
+/**
+ *  Flushes the records written so far to the file, so that SWMR readers can see them.
+ */
+EXPORTISMRMRD int ismrmrd_flush_dataset(const ISMRMRD_Dataset *dset);
+
+/**
+ *  Registers the complex float codec with HDF5.
+ *
+ *  Opening a dataset registers it, call this to read files written with
+ *  ISMRMRD_COMPRESSION_CXFLOAT through the plain HDF5 API.
+ */
+EXPORTISMRMRD int ismrmrd_register_cxfloat_filter(void);
+
+/**
+ *  Sets the compression profile of the variable varname, overriding the compression option.
+ *
+ *  Use "data" for the acquisitions. The profile applies to the HDF5 datasets the variable
+ *  creates from then on, existing ones keep their filters. Acquisitions created with a
+ *  profile keep their samples in datasets that take it, see ISMRMRD_DatasetOptions.
+ *  Waveforms are never compressed and setting a profile for "waveforms" fails: their data
+ *  are variable length, HDF5 stores those unfiltered in the global heap, and only their
+ *  headers would be.
+ */
+EXPORTISMRMRD int ismrmrd_set_compression(const ISMRMRD_Dataset *dset, const char *varname, uint16_t profile);
+
 /**
  *  Writes the XML header string to the dataset.
  *
@@ -74,13 +385,89 @@ EXPORTISMRMRD char * ismrmrd_read_header(const ISMRMRD_Dataset *dset);
  */
 EXPORTISMRMRD int ismrmrd_append_acquisition(const ISMRMRD_Dataset *dset, const ISMRMRD_Acquisition *acq);
 
+/**
+ *  Appends a block of nacqs acquisitions to the dataset.
+ *
+ *  The dataset is extended once and all acquisitions are written with a single HDF5 write,
+ *  which is much faster than calling ismrmrd_append_acquisition for each of them.
+ */
+EXPORTISMRMRD int ismrmrd_append_acquisitions(const ISMRMRD_Dataset *dset, const ISMRMRD_Acquisition *acqs, uint32_t nacqs);
+
 /**
  *  Reads the acquisition with the specified index from the dataset.
  */
 EXPORTISMRMRD int ismrmrd_read_acquisition(const ISMRMRD_Dataset *dset, uint32_t index, ISMRMRD_Acquisition *acq);
 
+/**
+ *  Reads count consecutive acquisitions starting at index first.
+ *
+ *  The block is selected as one contiguous hyperslab and read with a single HDF5 call.
+ *  acqs must point to count initialized acquisitions.
+ */
+EXPORTISMRMRD int ismrmrd_read_acquisitions(const ISMRMRD_Dataset *dset, uint32_t first, uint32_t count, ISMRMRD_Acquisition *acqs);
+
+/**
+ *  Reads only the headers of count consecutive acquisitions starting at index first.
+ *
+ *  The trajectories and data are not read, which makes this a cheap way to scan flags,
+ *  encoding counters and time stamps. heads must have room for count headers.
+ */
+EXPORTISMRMRD int ismrmrd_read_acquisition_headers(const ISMRMRD_Dataset *dset, uint32_t first, uint32_t count, ISMRMRD_AcquisitionHeader *heads);
+
+/**
+ *  Reads the count acquisitions whose indices are listed, in increasing order, in records.
+ *
+ *  Runs of consecutive records become one hyperslab each and the whole list is read as a
+ *  single selection.
+ */
+EXPORTISMRMRD int ismrmrd_read_acquisition_list(const ISMRMRD_Dataset *dset, const uint32_t *records, uint32_t count, ISMRMRD_Acquisition *acqs);
+
+/**
+ *  Initializes a filter that passes every acquisition.
+ */
+EXPORTISMRMRD int ismrmrd_init_acquisition_filter(ISMRMRD_AcquisitionFilter *filter);
+
+/**
+ *  Reads the acquisitions among the count starting at index first that pass filter.
+ *
+ *  The headers are scanned first and only the trajectories and data of the matches are
+ *  read, as a single selection with a hyperslab per run of consecutive matches.
+ *  acqs must point to count initialized acquisitions, of which the first *nmatched are
+ *  filled. When records isn't NULL it must have room for count indices and receives the
+ *  indices of the matches.
+ */
+EXPORTISMRMRD int ismrmrd_read_acquisitions_filtered(const ISMRMRD_Dataset *dset, uint32_t first, uint32_t count,
+                                                     const ISMRMRD_AcquisitionFilter *filter, ISMRMRD_Acquisition *acqs,
+                                                     uint32_t *records, uint32_t *nmatched);
+
+/**
+ *  Initializes a query that matches every acquisition.
+ */
+EXPORTISMRMRD int ismrmrd_init_acquisition_query(ISMRMRD_AcquisitionQuery *query);
+
+/**
+ *  Writes the acquisition index, the flags and encoding counters of every acquisition,
+ *  to groupname/acquisition_index in one pass over the headers.
+ *
+ *  With the index_acquisitions option set the index is also kept up to date while appending.
+ */
+EXPORTISMRMRD int ismrmrd_build_acquisition_index(const ISMRMRD_Dataset *dset);
+
+/**
+ *  Finds the acquisitions matching query.
+ *
+ *  The indices of the matches are returned in increasing order in *records, which is
+ *  malloc'ed and must be freed by the caller. The index is read into memory by the first
+ *  query, acquisitions it doesn't cover are indexed from their headers.
+ */
+EXPORTISMRMRD int ismrmrd_find_acquisitions(const ISMRMRD_Dataset *dset, const ISMRMRD_AcquisitionQuery *query,
+                                            uint32_t **records, uint32_t *count);
+
 /**
  *  Return the number of acquisitions in the dataset.
+ *
+ *  With the ISMRMRD_SWMR_READ mode the extent is refreshed, so the count includes the
+ *  acquisitions the writer has flushed since the last call.
  */
 EXPORTISMRMRD uint32_t ismrmrd_get_number_of_acquisitions(const ISMRMRD_Dataset *dset);
 
@@ -123,6 +510,22 @@ EXPORTISMRMRD int ismrmrd_append_image(const ISMRMRD_Dataset *dset, const char *
 EXPORTISMRMRD int ismrmrd_read_image(const ISMRMRD_Dataset *dset, const char *varname,
                                      const uint32_t index, ISMRMRD_Image *im);
 
+/**
+ *   Initializes a region that covers a whole image.
+ */
+EXPORTISMRMRD int ismrmrd_init_image_region(ISMRMRD_ImageRegion *region);
+
+/**
+ *   Reads a block and a subset of the channels of an image stored with appendImage.
+ *
+ *   Only the selected samples are read from the file. The header of the result describes
+ *   the region: the matrix size and channels are those read, and the field of view and
+ *   position are those of the block. The attribute string is read whole.
+ */
+EXPORTISMRMRD int ismrmrd_read_image_region(const ISMRMRD_Dataset *dset, const char *varname,
+                                            const uint32_t index, const ISMRMRD_ImageRegion *region,
+                                            ISMRMRD_Image *im);
+
 /**
  *  Return the number of images in the variable varname in the dataset.
  */
@@ -148,40 +551,175 @@ EXPORTISMRMRD int ismrmrd_append_array(const ISMRMRD_Dataset *dset, const char *
 EXPORTISMRMRD int ismrmrd_read_array(const ISMRMRD_Dataset *dataset, const char *varname,
                                      const uint32_t index, ISMRMRD_NDArray *arr);
 
+/**
+ *  Reads the number of dimensions, the dimensions and the data type of the arrays in
+ *  the variable varname, without reading any data.
+ */
+EXPORTISMRMRD int ismrmrd_read_array_properties(const ISMRMRD_Dataset *dset, const char *varname,
+                                                uint16_t *ndim, size_t dims[ISMRMRD_NDARRAY_MAXDIM],
+                                                uint16_t *data_type);
+
+/**
+ *   Initializes a region that covers a whole array.
+ */
+EXPORTISMRMRD int ismrmrd_init_array_region(ISMRMRD_ArrayRegion *region);
+
+/**
+ *  Reads a block of an array, only the selected elements are read from the file.
+ *
+ *  The result has the number of dimensions of the stored array and the counts of
+ *  the region as its dimensions.
+ */
+EXPORTISMRMRD int ismrmrd_read_array_region(const ISMRMRD_Dataset *dset, const char *varname,
+                                            const uint32_t index, const ISMRMRD_ArrayRegion *region,
+                                            ISMRMRD_NDArray *arr);
+
 /**
  *  Return the number of arrays in the variable varname in the dataset.
  */
 EXPORTISMRMRD uint32_t ismrmrd_get_number_of_arrays(const ISMRMRD_Dataset *dset, const char *varname);
 
+/**
+ *  Reads the mantissa bits kept in the samples of the image or array variable varname,
+ *  or in those of the acquisitions when varname is "data".
+ *
+ *  bits is set to 0 when the samples were written at full precision.
+ */
+EXPORTISMRMRD int ismrmrd_read_mantissa_bits(const ISMRMRD_Dataset *dset, const char *varname, uint16_t *bits);
+
+/**
+ *  Writes the group of the dataset to a new file, laid out for read-only use.
+ *
+ *  Datasets of fixed size records are stored contiguously with the types of the
+ *  structs they hold, so that they can be read straight from a memory mapping of
+ *  the file, see ismrmrd_locate_acquisitions. Acquisitions are stored as fixed size
+ *  records padded to the longest trajectory and data, unless that would take more
+ *  than twice the room of the samples. Waveforms, image attributes and anything
+ *  else of variable length are copied as they are.
+ *
+ *  This library reads the repacked file like any other, but can't append to it.
+ */
+EXPORTISMRMRD int ismrmrd_repack_dataset(const ISMRMRD_Dataset *dset, const char *filename);
+
+/**
+ *  Locates the acquisitions of a repacked dataset in the file.
+ *
+ *  Each record starts with the acquisition header, the trajectory and data follow at
+ *  traj_offset and data_offset within the record. traj_offset is 0 when no acquisition
+ *  has a trajectory. Fails when the acquisitions are not stored that way.
+ */
+EXPORTISMRMRD int ismrmrd_locate_acquisitions(const ISMRMRD_Dataset *dset, ISMRMRD_StorageExtent *records,
+                                              uint64_t *traj_offset, uint64_t *data_offset);
+
+/**
+ *  Locates the headers and data of the images in the variable varname of a repacked dataset.
+ */
+EXPORTISMRMRD int ismrmrd_locate_images(const ISMRMRD_Dataset *dset, const char *varname,
+                                        ISMRMRD_StorageExtent *headers, ISMRMRD_StorageExtent *data);
+
+/**
+ *  Locates the arrays in the variable varname of a repacked dataset.
+ */
+EXPORTISMRMRD int ismrmrd_locate_arrays(const ISMRMRD_Dataset *dset, const char *varname,
+                                        ISMRMRD_StorageExtent *arrays);
+
     
 #ifdef __cplusplus
 } /* extern "C" */
 
+//  Holds the lock that serializes the Dataset calls of all threads
+//
+//  HDF5 can't be called from several threads at once unless it was built thread safe, and
+//  even then it runs one call at a time, so every Dataset call holds this lock while it
+//  runs. Code that calls the C functions or HDF5 directly while other threads use Datasets
+//  should hold a DatasetLock around those calls, C code ismrmrd_lock_datasets. It can be
+//  held across Dataset calls.
+class EXPORTISMRMRD DatasetLock {
+public:
+    DatasetLock();
+    ~DatasetLock();
+private:
+    DatasetLock(const DatasetLock &);
+    DatasetLock & operator= (const DatasetLock &);
+};
+
 //  ISMRMRD Dataset C++ Interface
+//
+//  Datasets can be shared between threads, see DatasetLock. The error stack is kept per
+//  thread, so the exception thrown by a call describes that call. Threads reading the
+//  acquisitions of a shared Dataset should each use an AcquisitionCursor.
 class EXPORTISMRMRD Dataset {
 public:
     // Constructor and destructor
     Dataset(const char* filename, const char* groupname, bool create_file_if_needed = true);
+    Dataset(const char* filename, const char* groupname, const ISMRMRD_DatasetOptions &options,
+            bool create_file_if_needed = true);
+    // Opens a file image held in memory, see ismrmrd_open_dataset_image
+    Dataset(const char* filename, const char* groupname, const void *image, size_t size);
     ~Dataset();
     
     // Methods
     // XML Header
+    // With ISMRMRD_GROWTH_HINT and no capacity hint, the hint is taken from the encodingLimits
     void writeHeader(const std::string &xmlstring);
     void readHeader(std::string& xmlstring);
+    // Compression of a variable created after this call, one of ISMRMRD_CompressionProfiles
+    void setCompression(const std::string &var, uint16_t profile);
     // Acquisitions
     void appendAcquisition(const Acquisition &acq);
+    void appendAcquisitions(const std::vector<Acquisition> &acqs);
     void readAcquisition(uint32_t index, Acquisition &acq);
+    void readAcquisitions(uint32_t first, uint32_t count, std::vector<Acquisition> &acqs);
+    void readAcquisitionHeaders(uint32_t first, uint32_t count, std::vector<AcquisitionHeader> &heads);
+    void readAcquisitions(const std::vector<uint32_t> &records, std::vector<Acquisition> &acqs);
+    // Reads the acquisitions in [first, first+count) that pass filter, optionally with their indices
+    void readAcquisitions(uint32_t first, uint32_t count, const ISMRMRD_AcquisitionFilter &filter,
+                          std::vector<Acquisition> &acqs, std::vector<uint32_t> *records = NULL);
+    void buildAcquisitionIndex();
+    std::vector<uint32_t> findAcquisitions(const ISMRMRD_AcquisitionQuery &query);
     uint32_t getNumberOfAcquisitions();
+    // Waits until there are at least count acquisitions or the timeout runs out, returns the number there are.
+    // Meant for the ISMRMRD_SWMR_READ mode, other threads can use the Dataset while this one waits.
+    // In that mode reads of acquisitions, waveforms and images past the writer's extent fail at once,
+    // reads that HDF5 fails are tried again for a while without holding the lock, see ismrmrd_reopen_dataset.
+    uint32_t waitForAcquisitions(uint32_t count, uint32_t timeout_ms);
+    // SWMR writing, see ismrmrd_begin_swmr_write
+    void beginSWMRWrite();
+    // Makes the records written so far visible to SWMR readers
+    void flush();
+    // Copies the file into image, e.g. to send an in-memory dataset elsewhere
+    void getFileImage(std::vector<char> &image);
+    // Writes the group to a new file laid out for MappedDataset, see ismrmrd_repack_dataset
+    void repack(const char *filename);
+    // Cache sizes, settings and the metadata hit rate, see ISMRMRD_DatasetOptions for the settings
+    ISMRMRD_CacheStats getCacheStats();
+    void resetCacheStats();
     // Images
     template <typename T> void appendImage(const std::string &var, const Image<T> &im);
     void appendImage(const std::string &var, const ISMRMRD_Image *im);
     template <typename T> void readImage(const std::string &var, uint32_t index, Image<T> &im);
+    // Reads an image of whatever type it was stored with, im is made consistent with its header
+    void readImage(const std::string &var, uint32_t index, ISMRMRD_Image *im);
+    // Reads [x0, x1) x [y0, y1) x [z0, z1) of the listed channels, all of them when the list is empty
+    template <typename T> void readImageRegion(const std::string &var, uint32_t index,
+                                               uint16_t x0, uint16_t x1, uint16_t y0, uint16_t y1,
+                                               uint16_t z0, uint16_t z1, const std::vector<uint16_t> &channels,
+                                               Image<T> &im);
     uint32_t getNumberOfImages(const std::string &var);
     // NDArrays
     template <typename T> void appendNDArray(const std::string &var, const NDArray<T> &arr);
     void appendNDArray(const std::string &var, const ISMRMRD_NDArray *arr);
     template <typename T> void readNDArray(const std::string &var, uint32_t index, NDArray<T> &arr);
+    // The dimensions and data type of the arrays in var, without reading data
+    void readNDArrayProperties(const std::string &var, std::vector<size_t> &dims, uint16_t &data_type);
+    // Reads a block of an array, see ISMRMRD_ArrayRegion. Dimensions past the end of a
+    // vector are read whole, an empty stride reads every element.
+    template <typename T> void readNDArrayRegion(const std::string &var, uint32_t index,
+                                                 const std::vector<size_t> &offset, const std::vector<size_t> &count,
+                                                 const std::vector<size_t> &stride, NDArray<T> &arr);
     uint32_t getNumberOfNDArrays(const std::string &var);
+    // Mantissa bits kept in the samples of an image or array variable or of "data", 0 for full precision
+    uint16_t readMantissaBits(const std::string &var);
 
     //Waveforms
     void appendWaveform(const Waveform &wav);
@@ -191,6 +729,28 @@ protected:
     ISMRMRD_Dataset dset_;
 };
 
+//  Reads a range of the acquisitions of a Dataset in blocks, with a position and buffers of
+//  its own. The end of the range is fixed when the cursor is made.
+class EXPORTISMRMRD AcquisitionCursor {
+public:
+    AcquisitionCursor(Dataset &dataset, uint32_t first = 0, uint32_t count = UINT32_MAX,
+                      uint32_t block_size = 256);
+
+    // Swaps the next acquisition into acq, returns false at the end of the range
+    bool next(Acquisition &acq);
+    // The index of the acquisition the next call to next() returns
+    uint32_t position() const;
+    void seek(uint32_t index);
+
+private:
+    Dataset &dataset_;
+    uint32_t position_;
+    uint32_t end_;
+    uint32_t block_size_;
+    size_t block_position_;
+    std::vector<Acquisition> block_;
+};
+
 } /* ISMRMRD namespace */
 #endif
 
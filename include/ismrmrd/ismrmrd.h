@@ -410,6 +410,7 @@ EXPORTISMRMRD char *ismrmrd_strerror(int code);
 /** @} */
 
 /** Populates parameters (if non-NULL) with error information
+ * Errors are kept per thread, this pops the errors pushed by the calling thread.
  * @returns true if there was error information to return, false otherwise */
 bool ismrmrd_pop_error(char **file, int *line, char **func,
         int *code, char **msg);
@@ -439,6 +440,8 @@ EXPORTISMRMRD void ismrmrd_quaternion_to_directions(float const quat[4], float r
 
 /// Construct exception message from ISMRMRD error stack
 std::string build_exception_string(void);
+/// The same, also setting hdf5 to whether any of the errors came from HDF5
+std::string build_exception_string(bool *hdf5);
 
 /// Some typedefs to beautify the namespace
 typedef  ISMRMRD_EncodingCounters EncodingCounters;
@@ -507,6 +510,9 @@ public:
     Acquisition(uint16_t num_samples, uint16_t active_channels=1, uint16_t trajectory_dimensions=0);
     Acquisition(const Acquisition &other);
     Acquisition & operator= (const Acquisition &other);
+    // Moves take over the data buffers and leave other empty
+    Acquisition(Acquisition &&other);
+    Acquisition & operator= (Acquisition &&other);
     ~Acquisition();
 
     // Accessors and mutators
@@ -641,6 +647,9 @@ public:
           uint16_t matrix_size_z = 1, uint16_t channels = 1);
     Image(const Image &other);
     Image & operator= (const Image &other);
+    // Moves take over the data and attribute buffers and leave other empty
+    Image(Image &&other);
+    Image & operator= (Image &&other);
     ~Image();
 
     // Image dimensions
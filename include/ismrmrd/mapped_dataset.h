@@ -0,0 +1,93 @@
+/* ISMRMRD Memory Mapped Dataset Reader */
+
+/**
+ * @file mapped_dataset.h
+ */
+
+#pragma once
+#ifndef ISMRMRD_MAPPED_DATASET_H
+#define ISMRMRD_MAPPED_DATASET_H
+
+#include "ismrmrd/dataset.h"
+
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace ISMRMRD {
+
+/// An acquisition in a MappedDataset, it points into the mapping and is valid while the dataset is open
+struct MappedAcquisition {
+    const AcquisitionHeader *head;
+    const float *traj;              ///< trajectory_dimensions floats per sample, NULL without a trajectory
+    const complex_float_t *data;    ///< number_of_samples samples for each channel in turn
+};
+
+/// An image in a MappedDataset, valid while the dataset is open
+template <typename T> struct MappedImage {
+    const ImageHeader *head;
+    const T *data;                  ///< x fastest, then y, z and channel
+};
+
+/**
+ * Reads a file written by Dataset::repack through a read-only memory mapping.
+ *
+ * The places of the acquisitions, and of the images or arrays of a variable, are looked
+ * up in the file once. After that an acquisition, image or array is a pointer into the
+ * mapping, found by arithmetic on its index, without any HDF5 call or copy.
+ *
+ * Opening fails when the acquisitions have not been repacked, e.g. because their sizes
+ * vary too much. Image and array variables are checked on first use. Waveforms and image
+ * attributes are not mapped, read them with a Dataset.
+ */
+class EXPORTISMRMRD MappedDataset {
+public:
+    MappedDataset(const char* filename, const char* groupname);
+    ~MappedDataset();
+
+    uint32_t getNumberOfAcquisitions() const;
+    MappedAcquisition acquisition(uint32_t index) const;
+
+    uint32_t getNumberOfImages(const std::string &var);
+    template <typename T> MappedImage<T> image(const std::string &var, uint32_t index);
+
+    uint32_t getNumberOfNDArrays(const std::string &var);
+    // The dimensions of the arrays in var, fastest first
+    std::vector<size_t> getNDArrayDims(const std::string &var);
+    template <typename T> const T *ndarray(const std::string &var, uint32_t index);
+
+private:
+    MappedDataset(const MappedDataset &);
+    MappedDataset & operator= (const MappedDataset &);
+
+    // The place in the file and the shape of an image or array variable
+    struct Variable {
+        ISMRMRD_StorageExtent headers;  // images only
+        ISMRMRD_StorageExtent data;
+        uint16_t data_type;
+        std::vector<size_t> dims;       // arrays only
+    };
+
+    const Variable &images(const std::string &var);
+    const Variable &arrays(const std::string &var);
+    const char *record(const ISMRMRD_StorageExtent &extent, uint32_t index) const;
+    const void *image_data(const std::string &var, uint32_t index, uint16_t data_type, const ImageHeader **head);
+    const void *ndarray_data(const std::string &var, uint32_t index, uint16_t data_type);
+    void close();
+
+    ISMRMRD_Dataset dset_;
+    const char *base_;
+    size_t size_;
+    ISMRMRD_StorageExtent acquisitions_;
+    uint64_t traj_offset_;
+    uint64_t data_offset_;
+
+    std::mutex mutex_;                  // guards the variables
+    std::map<std::string, Variable> images_;
+    std::map<std::string, Variable> arrays_;
+};
+
+} // namespace ISMRMRD
+
+#endif // ISMRMRD_MAPPED_DATASET_H
@@ -0,0 +1,83 @@
+/* ISMRMRD Stream Serialization */
+
+/**
+ * @file serialization.h
+ */
+
+#pragma once
+#ifndef ISMRMRD_SERIALIZATION_H
+#define ISMRMRD_SERIALIZATION_H
+
+#include "ismrmrd/ismrmrd.h"
+#include "ismrmrd/waveform.h"
+
+#include <istream>
+#include <ostream>
+#include <string>
+
+namespace ISMRMRD {
+
+/**
+ * The ids that frame the messages of a stream.
+ *
+ * A message is its id as a uint16_t followed by its payload, in the byte order of the
+ * writer. Each id names one payload layout, a layout that changes gets a new id so that
+ * older readers reject it rather than misread it.
+ *
+ *   HEADER       uint32_t length, the XML header
+ *   CLOSE        no payload, the end of the stream
+ *   ACQUISITION  AcquisitionHeader, trajectory, data
+ *   IMAGE        ImageHeader, uint64_t attribute length, attribute string, data
+ *   WAVEFORM     WaveformHeader, data
+ *   NDARRAY      uint16_t data type, uint16_t ndim, uint64_t dims[ndim], data
+ */
+enum class MessageId : uint16_t {
+    HEADER = 3,
+    CLOSE = 4,
+    ACQUISITION = 1008,
+    IMAGE = 1022,
+    WAVEFORM = 1026,
+    NDARRAY = 1030
+};
+
+// The largest payload a reader accepts. The stream carries no message lengths, so the sizes
+// in headers are checked against this before anything is allocated for them.
+const uint64_t MAX_MESSAGE_PAYLOAD = uint64_t(1) << 30;
+
+// Writing: each object is written straight from its buffers, without copying it first.
+// Failures throw std::runtime_error.
+EXPORTISMRMRD void serialize(const std::string &xmlstring, std::ostream &os);
+EXPORTISMRMRD void serialize(const Acquisition &acq, std::ostream &os);
+EXPORTISMRMRD void serialize(const Waveform &wav, std::ostream &os);
+template <typename T> EXPORTISMRMRD void serialize(const Image<T> &im, std::ostream &os);
+EXPORTISMRMRD void serialize(const ISMRMRD_Image *im, std::ostream &os);
+template <typename T> EXPORTISMRMRD void serialize(const NDArray<T> &arr, std::ostream &os);
+EXPORTISMRMRD void serialize(const ISMRMRD_NDArray *arr, std::ostream &os);
+EXPORTISMRMRD void serializeClose(std::ostream &os);
+
+// Reads the id of the next message, returns false at the end of the stream
+EXPORTISMRMRD bool readMessageId(std::istream &is, MessageId &id);
+
+// Reading a whole message, which must be of the kind of the object. The buffers of the
+// object are reused when they are large enough. Images and arrays must match the data
+// type of T, the ISMRMRD_Image and ISMRMRD_NDArray versions take any type.
+EXPORTISMRMRD void deserialize(std::istream &is, std::string &xmlstring);
+EXPORTISMRMRD void deserialize(std::istream &is, Acquisition &acq);
+EXPORTISMRMRD void deserialize(std::istream &is, Waveform &wav);
+template <typename T> EXPORTISMRMRD void deserialize(std::istream &is, Image<T> &im);
+EXPORTISMRMRD void deserialize(std::istream &is, ISMRMRD_Image *im);
+template <typename T> EXPORTISMRMRD void deserialize(std::istream &is, NDArray<T> &arr);
+EXPORTISMRMRD void deserialize(std::istream &is, ISMRMRD_NDArray *arr);
+
+// Reading the payload of a message whose id readMessageId returned
+EXPORTISMRMRD void deserializePayload(std::istream &is, std::string &xmlstring);
+EXPORTISMRMRD void deserializePayload(std::istream &is, Acquisition &acq);
+EXPORTISMRMRD void deserializePayload(std::istream &is, Waveform &wav);
+template <typename T> EXPORTISMRMRD void deserializePayload(std::istream &is, Image<T> &im);
+EXPORTISMRMRD void deserializePayload(std::istream &is, ISMRMRD_Image *im);
+template <typename T> EXPORTISMRMRD void deserializePayload(std::istream &is, NDArray<T> &arr);
+EXPORTISMRMRD void deserializePayload(std::istream &is, ISMRMRD_NDArray *arr);
+
+} // namespace ISMRMRD
+
+#endif // ISMRMRD_SERIALIZATION_H
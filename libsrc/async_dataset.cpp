@@ -0,0 +1,429 @@
+#include "ismrmrd/async_dataset.h"
+
+#include <algorithm>
+#include <chrono>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+namespace ISMRMRD {
+//
+// AsyncDataset class implementation
+//
+struct AsyncDataset::HeaderItem : public AsyncDataset::Item {
+    HeaderItem(const std::string &xml) : xml(xml) {}
+    void write(Dataset &dataset) { dataset.writeHeader(xml); }
+    std::string xml;
+};
+
+struct AsyncDataset::AcquisitionItem : public AsyncDataset::Item {
+    AcquisitionItem(Acquisition &&acq) : acq(std::move(acq)) {}
+    void write(Dataset &dataset) { dataset.appendAcquisition(acq); }
+    Acquisition *acquisition() { return &acq; }
+    Acquisition acq;
+};
+
+struct AsyncDataset::WaveformItem : public AsyncDataset::Item {
+    WaveformItem(Waveform &&wav) : wav(std::move(wav)) {}
+    void write(Dataset &dataset) { dataset.appendWaveform(wav); }
+    Waveform wav;
+};
+
+struct AsyncDataset::RawImageItem : public AsyncDataset::Item {
+    // takes over the buffers of source
+    RawImageItem(const std::string &var, ISMRMRD_Image *source) : var(var), im(*source) {
+        ismrmrd_init_image(source);
+    }
+    ~RawImageItem() { ismrmrd_cleanup_image(&im); }
+    void write(Dataset &dataset) { dataset.appendImage(var, &im); }
+    std::string var;
+    ISMRMRD_Image im;
+};
+
+struct AsyncDataset::RawArrayItem : public AsyncDataset::Item {
+    RawArrayItem(const std::string &var, ISMRMRD_NDArray *source) : var(var), arr(*source) {
+        ismrmrd_init_ndarray(source);
+    }
+    ~RawArrayItem() { ismrmrd_cleanup_ndarray(&arr); }
+    void write(Dataset &dataset) { dataset.appendNDArray(var, &arr); }
+    std::string var;
+    ISMRMRD_NDArray arr;
+};
+
+// Constructors
+AsyncDataset::AsyncDataset(const char* filename, const char* groupname, bool create_file_if_needed,
+        size_t capacity, AsyncQueuePolicy policy)
+    : dataset_(new Dataset(filename, groupname, create_file_if_needed))
+    , capacity_(capacity > 0 ? capacity : 1)
+    , policy_(policy)
+{
+    start();
+}
+
+AsyncDataset::AsyncDataset(const char* filename, const char* groupname, const ISMRMRD_DatasetOptions &options,
+        bool create_file_if_needed, size_t capacity, AsyncQueuePolicy policy)
+    : dataset_(new Dataset(filename, groupname, options, create_file_if_needed))
+    , capacity_(capacity > 0 ? capacity : 1)
+    , policy_(policy)
+{
+    start();
+}
+
+// Destructor
+AsyncDataset::~AsyncDataset()
+{
+    try {
+        close();
+    } catch (...) {
+        // errors are only reported by an explicit close
+    }
+}
+
+// The file is opened by the constructor so that open errors are thrown to the caller
+void AsyncDataset::start()
+{
+    done_ = 0;
+    stopping_ = false;
+    stats_ = AsyncDatasetStats();
+    writer_ = std::thread(&AsyncDataset::run, this);
+}
+
+bool AsyncDataset::writeHeader(const std::string &xmlstring)
+{
+    return push(new HeaderItem(xmlstring));
+}
+
+bool AsyncDataset::appendAcquisition(Acquisition acq)
+{
+    return push(new AcquisitionItem(std::move(acq)));
+}
+
+bool AsyncDataset::appendWaveform(Waveform wav)
+{
+    return push(new WaveformItem(std::move(wav)));
+}
+
+bool AsyncDataset::appendImage(const std::string &var, ISMRMRD_Image *im)
+{
+    if (im == NULL) {
+        throw std::runtime_error("Image pointer should not be NULL");
+    }
+    return push(new RawImageItem(var, im));
+}
+
+bool AsyncDataset::appendNDArray(const std::string &var, ISMRMRD_NDArray *arr)
+{
+    if (arr == NULL) {
+        throw std::runtime_error("Array pointer should not be NULL");
+    }
+    return push(new RawArrayItem(var, arr));
+}
+
+bool AsyncDataset::push(Item *item)
+{
+    std::unique_ptr<Item> owned(item);
+    std::unique_lock<std::mutex> lock(mutex_);
+    rethrow();
+    if (stopping_) {
+        throw std::runtime_error("AsyncDataset has been closed");
+    }
+
+    if (queue_.size() >= capacity_) {
+        if (policy_ == AsyncQueuePolicy::DROP) {
+            stats_.dropped++;
+            return false;
+        }
+        if (policy_ == AsyncQueuePolicy::BLOCK) {
+            // close() wakes blocked producers, the writer may already be gone
+            progress_.wait(lock, [this] { return queue_.size() < capacity_ || stopping_; });
+            rethrow();
+            if (stopping_) {
+                throw std::runtime_error("AsyncDataset has been closed");
+            }
+        }
+    }
+
+    queue_.push_back(owned.release());
+    stats_.queued++;
+    if (queue_.size() > stats_.max_depth) {
+        stats_.max_depth = queue_.size();
+    }
+    work_.notify_one();
+    return true;
+}
+
+void AsyncDataset::flush()
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    uint64_t target = stats_.queued;
+    progress_.wait(lock, [this, target] { return done_ >= target; });
+    rethrow();
+}
+
+void AsyncDataset::close()
+{
+    if (writer_.joinable()) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stopping_ = true;
+        }
+        work_.notify_one();
+        progress_.notify_all();
+        writer_.join();
+        dataset_.reset();
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    // the writer drains the queue before it stops, anything left was never written
+    for (size_t n = 0; n < queue_.size(); n++) {
+        delete queue_[n];
+    }
+    queue_.clear();
+    rethrow();
+}
+
+AsyncDatasetStats AsyncDataset::getStats()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    AsyncDatasetStats stats = stats_;
+    stats.depth = queue_.size();
+    return stats;
+}
+
+// Throws and clears the pending writer error, called with the mutex held
+void AsyncDataset::rethrow()
+{
+    if (error_) {
+        std::exception_ptr error = error_;
+        error_ = std::exception_ptr();
+        std::rethrow_exception(error);
+    }
+}
+
+// The writer thread, which drains the queue until close() and then writes what is left
+void AsyncDataset::run()
+{
+    std::deque<Item *> batch;
+    std::unique_lock<std::mutex> lock(mutex_);
+    for (;;) {
+        work_.wait(lock, [this] { return !queue_.empty() || stopping_; });
+        if (queue_.empty()) {
+            break;
+        }
+        while (!queue_.empty() && batch.size() < capacity_) {
+            batch.push_back(queue_.front());
+            queue_.pop_front();
+        }
+        stats_.batches++;
+        // blocked producers can go on while the batch is written
+        progress_.notify_all();
+
+        lock.unlock();
+        write_batch(batch);
+        lock.lock();
+        progress_.notify_all();
+    }
+}
+
+// Writes and deletes the items of a batch, a run of acquisitions takes a single append
+void AsyncDataset::write_batch(std::deque<Item *> &batch)
+{
+    std::vector<Acquisition> acqs;
+    while (!batch.empty()) {
+        size_t count = 1;
+        std::exception_ptr error;
+        try {
+            if (batch.front()->acquisition() != NULL) {
+                acqs.clear();
+                for (count = 0; count < batch.size() && batch[count]->acquisition() != NULL; count++) {
+                    acqs.push_back(std::move(*batch[count]->acquisition()));
+                }
+                dataset_->appendAcquisitions(acqs);
+            } else {
+                batch.front()->write(*dataset_);
+            }
+        } catch (...) {
+            error = std::current_exception();
+        }
+
+        for (size_t n = 0; n < count; n++) {
+            delete batch.front();
+            batch.pop_front();
+        }
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        done_ += count;
+        if (error) {
+            stats_.failed += count;
+            if (!error_) {
+                error_ = error;
+            }
+        } else {
+            stats_.written += count;
+        }
+    }
+}
+
+//
+// PrefetchingAcquisitionReader class implementation
+//
+static double seconds_since(const std::chrono::steady_clock::time_point &start)
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Constructor
+PrefetchingAcquisitionReader::PrefetchingAcquisitionReader(const char* filename, const char* groupname,
+        uint32_t block_size, size_t depth)
+    : dataset_(new Dataset(filename, groupname, false))
+    , block_size_(block_size > 0 ? block_size : 1)
+    // one more block than the depth, for the one the consumer is on
+    , ring_((depth > 0 ? depth : 1) + 1)
+    , head_(0)
+    , count_(0)
+    , position_(0)
+    , delivered_(0)
+    , holding_(false)
+    , finished_(false)
+    , stopping_(false)
+    , stats_()
+{
+    number_of_acquisitions_ = dataset_->getNumberOfAcquisitions();
+    reader_ = std::thread(&PrefetchingAcquisitionReader::run, this);
+}
+
+// Destructor
+PrefetchingAcquisitionReader::~PrefetchingAcquisitionReader()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    emptied_.notify_one();
+    reader_.join();
+}
+
+uint32_t PrefetchingAcquisitionReader::getNumberOfAcquisitions() const
+{
+    return number_of_acquisitions_;
+}
+
+bool PrefetchingAcquisitionReader::next(Acquisition &acq)
+{
+    if (!acquire()) {
+        return false;
+    }
+    std::swap(acq, ring_[head_][position_++]);
+    delivered_++;
+    return true;
+}
+
+bool PrefetchingAcquisitionReader::nextBlock(std::vector<Acquisition> &block)
+{
+    if (!acquire()) {
+        return false;
+    }
+    std::vector<Acquisition> &current = ring_[head_];
+    if (position_ == 0) {
+        // the consumer's vector takes the place of the block in the ring
+        std::swap(block, current);
+    } else {
+        block.resize(current.size() - position_);
+        for (size_t n = 0; n < block.size(); n++) {
+            std::swap(block[n], current[position_ + n]);
+        }
+    }
+    position_ = current.size();
+    delivered_ += block.size();
+    return true;
+}
+
+PrefetchStats PrefetchingAcquisitionReader::getStats()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    PrefetchStats stats = stats_;
+    stats.acquisitions = delivered_;
+    return stats;
+}
+
+// Moves the consumer on to a block with acquisitions left, returns false at the end
+bool PrefetchingAcquisitionReader::acquire()
+{
+    if (holding_ && position_ < ring_[head_].size()) {
+        return true;
+    }
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (holding_) {
+        release();
+    }
+    if (count_ == 0 && !finished_) {
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        filled_.wait(lock, [this] { return count_ > 0 || finished_; });
+        stats_.stall_seconds += seconds_since(start);
+        stats_.stalls++;
+    }
+    if (count_ == 0) {
+        if (error_) {
+            std::exception_ptr error = error_;
+            error_ = std::exception_ptr();
+            std::rethrow_exception(error);
+        }
+        return false;
+    }
+    holding_ = true;
+    position_ = 0;
+    return true;
+}
+
+// Gives the head block back to the reader, called with the mutex held
+void PrefetchingAcquisitionReader::release()
+{
+    head_ = (head_ + 1) % ring_.size();
+    count_--;
+    holding_ = false;
+    emptied_.notify_one();
+}
+
+// The reader thread. It only touches the blocks outside the range from head_ to
+// head_ + count_, which belong to the consumer.
+void PrefetchingAcquisitionReader::run()
+{
+    uint32_t first = 0;
+    while (first < number_of_acquisitions_) {
+        size_t tail;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            emptied_.wait(lock, [this] { return count_ < ring_.size() || stopping_; });
+            if (stopping_) {
+                return;
+            }
+            tail = (head_ + count_) % ring_.size();
+        }
+
+        uint32_t count = std::min(block_size_, number_of_acquisitions_ - first);
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        std::exception_ptr error;
+        try {
+            dataset_->readAcquisitions(first, count, ring_[tail]);
+        } catch (...) {
+            error = std::current_exception();
+        }
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        stats_.read_seconds += seconds_since(start);
+        if (error) {
+            error_ = error;
+            break;
+        }
+        stats_.blocks++;
+        count_++;
+        first += count;
+        filled_.notify_one();
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    finished_ = true;
+    filled_.notify_one();
+}
+
+} // namespace ISMRMRD
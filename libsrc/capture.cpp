@@ -0,0 +1,641 @@
+#include "ismrmrd/capture.h"
+
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+
+namespace ISMRMRD {
+
+// The layout of a capture file: a file header, the records, each behind a frame, and
+// after close() an INDEX record of CaptureIndexEntry and a trailer pointing at it
+static const char CAPTURE_MAGIC[8] = {'I', 'S', 'M', 'R', 'M', 'R', 'D', 'C'};
+static const char CAPTURE_TRAILER_MAGIC[8] = {'I', 'S', 'M', 'R', 'M', 'R', 'D', 'X'};
+static const uint32_t CAPTURE_VERSION = 1;
+
+struct CaptureFileHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t reserved;
+};
+
+struct CaptureFrame {
+    uint32_t type;
+    uint32_t reserved;
+    uint64_t length;    // of the payload that follows
+};
+
+struct CaptureTrailer {
+    uint64_t index_offset;
+    char magic[8];
+};
+
+static bool is_record_type(uint32_t type)
+{
+    return type >= static_cast<uint32_t>(CaptureRecordType::HEADER) &&
+           type <= static_cast<uint32_t>(CaptureRecordType::INDEX);
+}
+
+// 64 bit file positions
+static int seek_file(std::FILE *file, uint64_t offset, int origin)
+{
+#ifdef _WIN32
+    return _fseeki64(file, static_cast<__int64>(offset), origin);
+#else
+    return fseeko(file, static_cast<off_t>(offset), origin);
+#endif
+}
+
+static uint64_t tell_file(std::FILE *file)
+{
+#ifdef _WIN32
+    return static_cast<uint64_t>(_ftelli64(file));
+#else
+    return static_cast<uint64_t>(ftello(file));
+#endif
+}
+
+// The sizes of the payloads headers describe, without overflow, so a corrupt header is
+// caught by comparing with the record length before anything is allocated
+static uint64_t acquisition_payload_size(const ISMRMRD_AcquisitionHeader &head)
+{
+    return uint64_t(head.number_of_samples) *
+           (uint64_t(head.trajectory_dimensions) * sizeof(float) + uint64_t(head.active_channels) * sizeof(complex_float_t));
+}
+
+static uint64_t waveform_data_size(const ISMRMRD_WaveformHeader &head)
+{
+    return uint64_t(head.number_of_samples) * head.channels * sizeof(uint32_t);
+}
+
+// UINT64_MAX for an unknown data type
+static uint64_t image_data_size(const ISMRMRD_ImageHeader &head)
+{
+    uint64_t elements = uint64_t(head.matrix_size[0]) * head.matrix_size[1] * head.matrix_size[2] * head.channels;
+    uint64_t element_size = ismrmrd_sizeof_data_type(head.data_type);
+    if (element_size == 0 || elements > UINT64_MAX / element_size) {
+        return UINT64_MAX;
+    }
+    return elements * element_size;
+}
+
+//
+// CaptureWriter class implementation
+//
+CaptureWriter::CaptureWriter(const char *filename, size_t buffer_size)
+    : file_(NULL)
+    , buffer_(buffer_size > sizeof(CaptureFrame) ? buffer_size : sizeof(CaptureFrame))
+    , used_(0)
+    , size_(0)
+{
+    file_ = std::fopen(filename, "wb");
+    if (file_ == NULL) {
+        throw std::runtime_error(std::string("Failed to create capture file ") + filename);
+    }
+    // records are assembled in buffer_, stdio buffering would only add a copy
+    std::setvbuf(file_, NULL, _IONBF, 0);
+
+    CaptureFileHeader header;
+    memcpy(header.magic, CAPTURE_MAGIC, sizeof(header.magic));
+    header.version = CAPTURE_VERSION;
+    header.reserved = 0;
+    memcpy(&buffer_[0], &header, sizeof(header));
+    used_ = sizeof(header);
+    size_ = sizeof(header);
+}
+
+CaptureWriter::~CaptureWriter()
+{
+    try {
+        close();
+    } catch (...) {
+        // errors are only reported by an explicit close
+    }
+}
+
+void CaptureWriter::writeHeader(const std::string &xmlstring)
+{
+    Piece piece = {xmlstring.data(), xmlstring.size()};
+    append(CaptureRecordType::HEADER, &piece, 1);
+}
+
+void CaptureWriter::appendAcquisition(const Acquisition &acq)
+{
+    Piece pieces[3] = {
+        {&acq.getHead(), sizeof(ISMRMRD_AcquisitionHeader)},
+        {acq.getTrajPtr(), acq.getTrajSize()},
+        {acq.getDataPtr(), acq.getDataSize()}
+    };
+    append(CaptureRecordType::ACQUISITION, pieces, 3);
+}
+
+void CaptureWriter::appendWaveform(const Waveform &wav)
+{
+    Piece pieces[2] = {
+        {&wav.head, sizeof(ISMRMRD_WaveformHeader)},
+        {wav.data, static_cast<size_t>(ismrmrd_size_of_waveform_data(&wav))}
+    };
+    append(CaptureRecordType::WAVEFORM, pieces, 2);
+}
+
+void CaptureWriter::appendImage(const std::string &var, const ISMRMRD_Image *im)
+{
+    if (im == NULL) {
+        throw std::runtime_error("Image pointer should not be NULL");
+    }
+    append_image(var, im->head, im->attribute_string, im->data, ismrmrd_size_of_image_data(im));
+}
+
+void CaptureWriter::append_image(const std::string &var, const ISMRMRD_ImageHeader &head,
+                                 const char *attributes, const void *data, size_t size)
+{
+    uint32_t var_length = static_cast<uint32_t>(var.size());
+    Piece pieces[5] = {
+        {&head, sizeof(ISMRMRD_ImageHeader)},
+        {&var_length, sizeof(var_length)},
+        {var.data(), var.size()},
+        {attributes, attributes != NULL ? head.attribute_string_len : 0},
+        {data, size}
+    };
+    append(CaptureRecordType::IMAGE, pieces, 5);
+}
+
+void CaptureWriter::flush()
+{
+    write_buffer();
+    if (file_ != NULL && std::fflush(file_) != 0) {
+        throw std::runtime_error("Failed to flush the capture file");
+    }
+}
+
+void CaptureWriter::close()
+{
+    if (file_ == NULL) {
+        return;
+    }
+    CaptureTrailer trailer;
+    trailer.index_offset = size_;
+    memcpy(trailer.magic, CAPTURE_TRAILER_MAGIC, sizeof(trailer.magic));
+
+    // the index doesn't list itself
+    std::vector<CaptureIndexEntry> index;
+    index.swap(index_);
+    Piece piece = {index.empty() ? NULL : &index[0], index.size() * sizeof(CaptureIndexEntry)};
+    append(CaptureRecordType::INDEX, &piece, 1);
+    write(&trailer, sizeof(trailer));
+    write_buffer();
+
+    std::FILE *file = file_;
+    file_ = NULL;
+    if (std::fclose(file) != 0) {
+        throw std::runtime_error("Failed to close the capture file");
+    }
+}
+
+uint64_t CaptureWriter::getSize() const
+{
+    return size_;
+}
+
+void CaptureWriter::append(CaptureRecordType type, const Piece *pieces, size_t count)
+{
+    if (file_ == NULL) {
+        throw std::runtime_error("The capture file is closed");
+    }
+    CaptureFrame frame;
+    frame.type = static_cast<uint32_t>(type);
+    frame.reserved = 0;
+    frame.length = 0;
+    for (size_t n = 0; n < count; n++) {
+        frame.length += pieces[n].size;
+    }
+    CaptureIndexEntry entry = {size_, frame.type, 0};
+
+    write(&frame, sizeof(frame));
+    for (size_t n = 0; n < count; n++) {
+        write(pieces[n].data, pieces[n].size);
+    }
+    // only a record that was written in full goes in the index
+    index_.push_back(entry);
+}
+
+// Appends to the buffer, data that doesn't fit after a flush of the buffer goes straight to the file
+void CaptureWriter::write(const void *data, size_t size)
+{
+    size_ += size;
+    if (size > buffer_.size() - used_) {
+        write_buffer();
+        if (size > buffer_.size()) {
+            if (std::fwrite(data, 1, size, file_) != size) {
+                throw std::runtime_error("Failed to write to the capture file");
+            }
+            return;
+        }
+    }
+    if (size > 0) {
+        memcpy(&buffer_[used_], data, size);
+        used_ += size;
+    }
+}
+
+void CaptureWriter::write_buffer()
+{
+    if (used_ == 0 || file_ == NULL) {
+        return;
+    }
+    size_t used = used_;
+    used_ = 0;
+    if (std::fwrite(&buffer_[0], 1, used, file_) != used) {
+        throw std::runtime_error("Failed to write to the capture file");
+    }
+}
+
+//
+// CaptureReader class implementation
+//
+CaptureReader::CaptureReader(const char *filename)
+    : file_(NULL)
+    , size_(0)
+    , recovered_(false)
+{
+    file_ = std::fopen(filename, "rb");
+    if (file_ == NULL) {
+        throw std::runtime_error(std::string("Failed to open capture file ") + filename);
+    }
+    CaptureFileHeader header;
+    if (seek_file(file_, 0, SEEK_END) != 0 || (size_ = tell_file(file_)) < sizeof(header)) {
+        std::fclose(file_);
+        throw std::runtime_error("Not a capture file");
+    }
+    seek(0);
+    read(&header, sizeof(header));
+    if (memcmp(header.magic, CAPTURE_MAGIC, sizeof(header.magic)) != 0 || header.version != CAPTURE_VERSION) {
+        std::fclose(file_);
+        throw std::runtime_error("Not a capture file, or one of another version or byte order");
+    }
+
+    if (!read_footer()) {
+        scan();
+    }
+}
+
+CaptureReader::~CaptureReader()
+{
+    std::fclose(file_);
+}
+
+bool CaptureReader::isRecovered() const
+{
+    return recovered_;
+}
+
+const std::vector<CaptureIndexEntry> &CaptureReader::getIndex() const
+{
+    return index_;
+}
+
+bool CaptureReader::readHeader(std::string &xmlstring)
+{
+    if (headers_.empty()) {
+        return false;
+    }
+    uint64_t length = seek_record(headers_, 0, CaptureRecordType::HEADER);
+    xmlstring.resize(static_cast<size_t>(length));
+    if (length > 0) {
+        read(&xmlstring[0], xmlstring.size());
+    }
+    return true;
+}
+
+uint32_t CaptureReader::getNumberOfAcquisitions() const
+{
+    return static_cast<uint32_t>(acquisitions_.size());
+}
+
+void CaptureReader::readAcquisition(uint32_t index, Acquisition &acq)
+{
+    uint64_t length = seek_record(acquisitions_, index, CaptureRecordType::ACQUISITION);
+    AcquisitionHeader head;
+    if (length < sizeof(ISMRMRD_AcquisitionHeader)) {
+        throw std::runtime_error("Corrupt acquisition record in the capture file");
+    }
+    read(&head, sizeof(ISMRMRD_AcquisitionHeader));
+    if (length - sizeof(ISMRMRD_AcquisitionHeader) != acquisition_payload_size(head)) {
+        throw std::runtime_error("Corrupt acquisition record in the capture file");
+    }
+    // reuses the buffers of acq when the shape hasn't changed
+    acq.setHead(head);
+    read(acq.getTrajPtr(), acq.getTrajSize());
+    read(acq.getDataPtr(), acq.getDataSize());
+}
+
+uint32_t CaptureReader::getNumberOfWaveforms() const
+{
+    return static_cast<uint32_t>(waveforms_.size());
+}
+
+void CaptureReader::readWaveform(uint32_t index, Waveform &wav)
+{
+    uint64_t length = seek_record(waveforms_, index, CaptureRecordType::WAVEFORM);
+    if (length < sizeof(ISMRMRD_WaveformHeader)) {
+        throw std::runtime_error("Corrupt waveform record in the capture file");
+    }
+    ISMRMRD_WaveformHeader head;
+    read(&head, sizeof(ISMRMRD_WaveformHeader));
+    if (length - sizeof(ISMRMRD_WaveformHeader) != waveform_data_size(head)) {
+        throw std::runtime_error("Corrupt waveform record in the capture file");
+    }
+    wav.head = head;
+    if (ismrmrd_make_consistent_waveform(&wav) != ISMRMRD_NOERROR) {
+        throw std::runtime_error(build_exception_string());
+    }
+    read(wav.data, ismrmrd_size_of_waveform_data(&wav));
+}
+
+uint32_t CaptureReader::getNumberOfImages() const
+{
+    return static_cast<uint32_t>(images_.size());
+}
+
+template <typename T> void CaptureReader::readImage(uint32_t index, std::string &var, Image<T> &im)
+{
+    ImageHeader head;
+    std::string attributes;
+    uint64_t length = read_image_header(index, var, head, attributes);
+    if (head.data_type != im.getDataType()) {
+        throw std::runtime_error("The image is of a different type");
+    }
+    if (length != image_data_size(head)) {
+        throw std::runtime_error("Corrupt image record in the capture file");
+    }
+    im.setHead(head);
+    im.setAttributeString(attributes);
+    read(im.getDataPtr(), im.getDataSize());
+}
+
+// Specific instantiations
+template EXPORTISMRMRD void CaptureReader::readImage(uint32_t index, std::string &var, Image<uint16_t> &im);
+template EXPORTISMRMRD void CaptureReader::readImage(uint32_t index, std::string &var, Image<int16_t> &im);
+template EXPORTISMRMRD void CaptureReader::readImage(uint32_t index, std::string &var, Image<uint32_t> &im);
+template EXPORTISMRMRD void CaptureReader::readImage(uint32_t index, std::string &var, Image<int32_t> &im);
+template EXPORTISMRMRD void CaptureReader::readImage(uint32_t index, std::string &var, Image<float> &im);
+template EXPORTISMRMRD void CaptureReader::readImage(uint32_t index, std::string &var, Image<double> &im);
+template EXPORTISMRMRD void CaptureReader::readImage(uint32_t index, std::string &var, Image<complex_float_t> &im);
+template EXPORTISMRMRD void CaptureReader::readImage(uint32_t index, std::string &var, Image<complex_double_t> &im);
+
+void CaptureReader::readImage(uint32_t index, std::string &var, ISMRMRD_Image *im)
+{
+    if (im == NULL) {
+        throw std::runtime_error("Image pointer should not be NULL");
+    }
+    ISMRMRD_ImageHeader head;
+    std::string attributes;
+    uint64_t length = read_image_header(index, var, head, attributes);
+    if (length != image_data_size(head)) {
+        throw std::runtime_error("Corrupt image record in the capture file");
+    }
+    im->head = head;
+    if (ismrmrd_make_consistent_image(im) != ISMRMRD_NOERROR) {
+        throw std::runtime_error(build_exception_string());
+    }
+    size_t size = ismrmrd_size_of_image_data(im);
+    if (!attributes.empty()) {
+        memcpy(im->attribute_string, attributes.c_str(), attributes.size() + 1);
+    }
+    read(im->data, size);
+}
+
+// Reads the header, variable and attributes of an image, returns the length of its data
+uint64_t CaptureReader::read_image_header(uint32_t index, std::string &var, ISMRMRD_ImageHeader &head,
+                                          std::string &attributes)
+{
+    uint64_t length = seek_record(images_, index, CaptureRecordType::IMAGE);
+    uint32_t var_length = 0;
+    if (length < sizeof(ISMRMRD_ImageHeader) + sizeof(var_length)) {
+        throw std::runtime_error("Corrupt image record in the capture file");
+    }
+    read(&head, sizeof(ISMRMRD_ImageHeader));
+    read(&var_length, sizeof(var_length));
+    length -= sizeof(ISMRMRD_ImageHeader) + sizeof(var_length);
+    if (uint64_t(var_length) + head.attribute_string_len > length) {
+        throw std::runtime_error("Corrupt image record in the capture file");
+    }
+    var.resize(var_length);
+    if (var_length > 0) {
+        read(&var[0], var_length);
+    }
+    attributes.resize(head.attribute_string_len);
+    if (head.attribute_string_len > 0) {
+        read(&attributes[0], head.attribute_string_len);
+    }
+    return length - var_length - head.attribute_string_len;
+}
+
+// Loads the index written by close(), returns false when it isn't there or doesn't add up
+bool CaptureReader::read_footer()
+{
+    CaptureTrailer trailer;
+    CaptureFrame frame;
+    if (size_ < sizeof(CaptureFileHeader) + sizeof(frame) + sizeof(trailer)) {
+        return false;
+    }
+    seek(size_ - sizeof(trailer));
+    read(&trailer, sizeof(trailer));
+    if (memcmp(trailer.magic, CAPTURE_TRAILER_MAGIC, sizeof(trailer.magic)) != 0 ||
+            trailer.index_offset < sizeof(CaptureFileHeader) ||
+            trailer.index_offset > size_ - sizeof(trailer) - sizeof(frame)) {
+        return false;
+    }
+    seek(trailer.index_offset);
+    read(&frame, sizeof(frame));
+    if (frame.type != static_cast<uint32_t>(CaptureRecordType::INDEX) ||
+            frame.length != size_ - sizeof(trailer) - sizeof(frame) - trailer.index_offset ||
+            frame.length % sizeof(CaptureIndexEntry) != 0) {
+        return false;
+    }
+    std::vector<CaptureIndexEntry> index(static_cast<size_t>(frame.length / sizeof(CaptureIndexEntry)));
+    if (!index.empty()) {
+        read(&index[0], static_cast<size_t>(frame.length));
+    }
+    for (size_t n = 0; n < index.size(); n++) {
+        if (index[n].offset < sizeof(CaptureFileHeader) || index[n].offset >= trailer.index_offset ||
+                !is_record_type(index[n].type)) {
+            index_.clear();
+            headers_.clear();
+            acquisitions_.clear();
+            waveforms_.clear();
+            images_.clear();
+            return false;
+        }
+        add(index[n]);
+    }
+    return true;
+}
+
+// Rebuilds the index from the frames, up to the first one that is incomplete or not a frame
+void CaptureReader::scan()
+{
+    recovered_ = true;
+    uint64_t offset = sizeof(CaptureFileHeader);
+    CaptureFrame frame;
+    while (size_ - offset >= sizeof(frame)) {
+        seek(offset);
+        read(&frame, sizeof(frame));
+        if (!is_record_type(frame.type) || frame.type == static_cast<uint32_t>(CaptureRecordType::INDEX) ||
+                frame.length > size_ - offset - sizeof(frame)) {
+            break;
+        }
+        CaptureIndexEntry entry = {offset, frame.type, 0};
+        add(entry);
+        offset += sizeof(frame) + frame.length;
+    }
+}
+
+void CaptureReader::add(const CaptureIndexEntry &entry)
+{
+    index_.push_back(entry);
+    switch (static_cast<CaptureRecordType>(entry.type)) {
+    case CaptureRecordType::HEADER:
+        headers_.push_back(entry.offset);
+        break;
+    case CaptureRecordType::ACQUISITION:
+        acquisitions_.push_back(entry.offset);
+        break;
+    case CaptureRecordType::WAVEFORM:
+        waveforms_.push_back(entry.offset);
+        break;
+    case CaptureRecordType::IMAGE:
+        images_.push_back(entry.offset);
+        break;
+    default:
+        break;
+    }
+}
+
+// Positions the file at the payload of a record, returns the payload length
+uint64_t CaptureReader::seek_record(const std::vector<uint64_t> &offsets, uint32_t index, CaptureRecordType type)
+{
+    if (index >= offsets.size()) {
+        throw std::out_of_range("Index out of range");
+    }
+    CaptureFrame frame;
+    seek(offsets[index]);
+    read(&frame, sizeof(frame));
+    if (frame.type != static_cast<uint32_t>(type) || frame.length > size_ - offsets[index] - sizeof(frame)) {
+        throw std::runtime_error("Corrupt record in the capture file");
+    }
+    return frame.length;
+}
+
+void CaptureReader::seek(uint64_t offset)
+{
+    if (seek_file(file_, offset, SEEK_SET) != 0) {
+        throw std::runtime_error("Failed to seek in the capture file");
+    }
+}
+
+void CaptureReader::read(void *data, size_t size)
+{
+    if (size > 0 && std::fread(data, 1, size, file_) != size) {
+        throw std::runtime_error("Failed to read from the capture file");
+    }
+}
+
+//
+// Conversions
+//
+void convertCaptureToDataset(CaptureReader &capture, Dataset &dataset)
+{
+    std::string xml;
+    if (capture.readHeader(xml)) {
+        dataset.writeHeader(xml);
+    }
+
+    // acquisitions go in blocks, the others one by one in the order they were captured
+    const size_t block_size = 256;
+    std::vector<Acquisition> block;
+    block.reserve(block_size);
+    uint32_t acquisition = 0, waveform = 0, image = 0;
+    Waveform wav;
+    ISMRMRD_Image im;
+    ismrmrd_init_image(&im);
+    std::string var;
+    try {
+        const std::vector<CaptureIndexEntry> &index = capture.getIndex();
+        for (size_t n = 0; n < index.size(); n++) {
+            CaptureRecordType type = static_cast<CaptureRecordType>(index[n].type);
+            if (type == CaptureRecordType::ACQUISITION) {
+                block.resize(block.size() + 1);
+                capture.readAcquisition(acquisition++, block.back());
+                if (block.size() < block_size) {
+                    continue;
+                }
+            }
+            if (!block.empty()) {
+                dataset.appendAcquisitions(block);
+                block.clear();
+            }
+            if (type == CaptureRecordType::WAVEFORM) {
+                capture.readWaveform(waveform++, wav);
+                dataset.appendWaveform(wav);
+            }
+            else if (type == CaptureRecordType::IMAGE) {
+                capture.readImage(image++, var, &im);
+                dataset.appendImage(var, &im);
+            }
+        }
+        if (!block.empty()) {
+            dataset.appendAcquisitions(block);
+        }
+    } catch (...) {
+        ismrmrd_cleanup_image(&im);
+        throw;
+    }
+    ismrmrd_cleanup_image(&im);
+}
+
+void convertDatasetToCapture(Dataset &dataset, const std::vector<std::string> &image_vars, CaptureWriter &capture)
+{
+    std::string xml;
+    bool has_header = true;
+    try {
+        dataset.readHeader(xml);
+    } catch (std::runtime_error &) {
+        // a dataset without a header makes a capture without one
+        has_header = false;
+    }
+    if (has_header) {
+        capture.writeHeader(xml);
+    }
+
+    uint32_t count = dataset.getNumberOfAcquisitions();
+    Acquisition acq;
+    AcquisitionCursor cursor(dataset, 0, count);
+    while (cursor.next(acq)) {
+        capture.appendAcquisition(acq);
+    }
+
+    count = dataset.getNumberOfWaveforms();
+    Waveform wav;
+    for (uint32_t n = 0; n < count; n++) {
+        dataset.readWaveform(n, wav);
+        capture.appendWaveform(wav);
+    }
+
+    ISMRMRD_Image im;
+    ismrmrd_init_image(&im);
+    try {
+        for (size_t v = 0; v < image_vars.size(); v++) {
+            count = dataset.getNumberOfImages(image_vars[v]);
+            for (uint32_t n = 0; n < count; n++) {
+                dataset.readImage(image_vars[v], n, &im);
+                capture.appendImage(image_vars[v], &im);
+            }
+        }
+    } catch (...) {
+        ismrmrd_cleanup_image(&im);
+        throw;
+    }
+    ismrmrd_cleanup_image(&im);
+}
+
+} // namespace ISMRMRD
@@ -14,6 +14,12 @@
 #include <ismrmrd/waveform.h>
 #include "ismrmrd/dataset.h"
 
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <pthread.h>
+#endif
+
 #ifdef __cplusplus
 namespace ISMRMRD {
 extern "C" {
@@ -129,6 +135,317 @@ static char * append_to_path(const ISMRMRD_Dataset *dset,
     return newpath;
 }
 
+/******************************************************/
+/* Private (Static) Functions for open dataset handles */
+/******************************************************/
+
+/* New datasets get chunks of at most this size unless a chunk length is set in the options.
+ * It is half of HDF5's default chunk cache, so the chunk being appended to stays cached
+ * even when variable length records take more room in the file than in memory. */
+#define ISMRMRD_AUTO_CHUNK_BYTES (512 * 1024)
+
+/* An open HDF5 dataset together with its current extent */
+typedef struct ISMRMRD_DatasetHandle {
+    char *path;
+    hid_t dataset;
+    hid_t filespace;
+    int rank;
+    hsize_t dims[ISMRMRD_NDARRAY_MAXDIM + 1];  /* dims[0] is the allocated extent */
+    hsize_t count;       /* the number of records written, at most dims[0] */
+    hid_t filetype;      /* the datatype stored in the file */
+    uint16_t data_type;  /* the matching ndarray data type, 0 until first needed */
+    uint16_t mantissa_bits; /* the precision recorded in the file, 0 until first recorded */
+    int direct_chunks;   /* 1 when each chunk is one unfiltered record, -1 when not, 0 until checked */
+    hid_t direct_type;   /* the memory type found to match the file type for direct chunks */
+    int fixed_records;   /* 1 when the acquisitions are repacked to fixed size records, -1 when not, 0 until checked */
+    hid_t fixed_type;    /* the native type of those records */
+    int separate_samples; /* 1 when the acquisition samples are kept in datasets of their own, -1 when not, 0 until checked */
+    bool writer;   /* the extent has been changed through this handle */
+    struct ISMRMRD_DatasetHandle *next;
+} ISMRMRD_DatasetHandle;
+
+/* Handles kept open for the lifetime of an ISMRMRD_Dataset */
+struct ISMRMRD_DatasetCache {
+    char *datapath;                    /* groupname/data */
+    char *waveformpath;                /* groupname/waveforms */
+    char *indexpath;                   /* groupname/acquisition_index */
+    char *samplepath;                  /* groupname/acquisition_samples */
+    char *trajpath;                    /* groupname/acquisition_trajectories */
+    char *offsetpath;                  /* groupname/acquisition_offsets */
+    struct HDF5_IndexEntry *index;     /* the acquisition index, read by the first query */
+    uint32_t index_count;              /* the number of acquisitions in index */
+    ISMRMRD_DatasetHandle *data;       /* the acquisitions */
+    ISMRMRD_DatasetHandle *waveforms;  /* the waveforms */
+    ISMRMRD_DatasetHandle *vars;       /* image and array variables */
+    hid_t xfer;                        /* transfer properties using the buffers below */
+    hid_t vlen_xfer;                   /* the same, with a vlen memory manager */
+    void *tconv_buf;                   /* type conversion buffer */
+    void *bkg_buf;                     /* background buffer */
+    struct ISMRMRD_CompressionSetting *compression; /* per variable compression profiles */
+    bool shares_hdf5types;             /* counted among the users of the shared types */
+};
+
+/* A compression profile that overrides the dataset option for one variable */
+typedef struct ISMRMRD_CompressionSetting {
+    char *path;
+    uint16_t profile;
+    struct ISMRMRD_CompressionSetting *next;
+} ISMRMRD_CompressionSetting;
+
+static void free_compression_settings(const ISMRMRD_Dataset *dset) {
+    ISMRMRD_CompressionSetting *setting = dset->cache->compression, *next;
+
+    while (setting != NULL) {
+        next = setting->next;
+        free(setting->path);
+        free(setting);
+        setting = next;
+    }
+    dset->cache->compression = NULL;
+}
+
+/* HDF5 allocates a conversion buffer and a cleared background buffer of this size in
+ * every read or write that converts types, unless it is handed buffers that it can reuse.
+ * For small records that allocation costs more than the I/O itself. */
+#define ISMRMRD_CONVERSION_BUFFER_BYTES (1024 * 1024)
+
+static void close_transfer_properties(const ISMRMRD_Dataset *dset) {
+    struct ISMRMRD_DatasetCache *cache = dset->cache;
+
+    if (cache->xfer >= 0) {
+        H5Pclose(cache->xfer);
+    }
+    if (cache->vlen_xfer >= 0) {
+        H5Pclose(cache->vlen_xfer);
+    }
+    /* the buffers are only released after the property lists that refer to them */
+    free(cache->tconv_buf);
+    free(cache->bkg_buf);
+    cache->xfer = cache->vlen_xfer = -1;
+    cache->tconv_buf = cache->bkg_buf = NULL;
+}
+
+static hid_t create_transfer_properties(const ISMRMRD_Dataset *dset) {
+    hid_t xfer = H5Pcreate(H5P_DATASET_XFER);
+    if (xfer < 0 || H5Pset_buffer(xfer, ISMRMRD_CONVERSION_BUFFER_BYTES,
+            dset->cache->tconv_buf, dset->cache->bkg_buf) < 0) {
+        H5Ewalk2(H5E_DEFAULT, H5E_WALK_UPWARD, walk_hdf5_errors, NULL);
+        if (xfer >= 0) {
+            H5Pclose(xfer);
+        }
+        return -1;
+    }
+    return xfer;
+}
+
+/* The transfer properties for reads and writes, H5P_DEFAULT if they can't be set up */
+static hid_t get_transfer_properties(const ISMRMRD_Dataset *dset, const bool vlen) {
+    struct ISMRMRD_DatasetCache *cache = dset->cache;
+
+    if (cache->xfer < 0) {
+        cache->tconv_buf = malloc(ISMRMRD_CONVERSION_BUFFER_BYTES);
+        cache->bkg_buf = malloc(ISMRMRD_CONVERSION_BUFFER_BYTES);
+        if (cache->tconv_buf == NULL || cache->bkg_buf == NULL) {
+            free(cache->tconv_buf);
+            free(cache->bkg_buf);
+            cache->tconv_buf = cache->bkg_buf = NULL;
+            return H5P_DEFAULT;
+        }
+        cache->xfer = create_transfer_properties(dset);
+        cache->vlen_xfer = create_transfer_properties(dset);
+        if (cache->xfer < 0 || cache->vlen_xfer < 0) {
+            /* try again next time */
+            close_transfer_properties(dset);
+            return H5P_DEFAULT;
+        }
+    }
+    return vlen ? cache->vlen_xfer : cache->xfer;
+}
+
+static int refresh_handle(ISMRMRD_DatasetHandle *handle) {
+    if (handle->filespace >= 0) {
+        H5Sclose(handle->filespace);
+    }
+    handle->filespace = H5Dget_space(handle->dataset);
+    if (handle->filespace < 0) {
+        H5Ewalk2(H5E_DEFAULT, H5E_WALK_UPWARD, walk_hdf5_errors, NULL);
+        return ISMRMRD_PUSH_ERR(ISMRMRD_HDF5ERROR, "Failed to get dataspace");
+    }
+    handle->rank = H5Sget_simple_extent_ndims(handle->filespace);
+    if (handle->rank < 1 || handle->rank > ISMRMRD_NDARRAY_MAXDIM + 1) {
+        return ISMRMRD_PUSH_ERR(ISMRMRD_FILEERROR, "Dimensions are incorrect.");
+    }
+    if (H5Sget_simple_extent_dims(handle->filespace, handle->dims, NULL) < 0) {
+        H5Ewalk2(H5E_DEFAULT, H5E_WALK_UPWARD, walk_hdf5_errors, NULL);
+        return ISMRMRD_PUSH_ERR(ISMRMRD_HDF5ERROR, "Failed to get dataset extent");
+    }
+    /* only the writer knows how much of a grown extent is in use */
+    if (!handle->writer) {
+        handle->count = handle->dims[0];
+    }
+    return ISMRMRD_NOERROR;
+}
+
+/* Gives back the capacity reserved by the growth policy but never written */
+static void trim_handle(ISMRMRD_DatasetHandle *handle) {
+    hsize_t dims[ISMRMRD_NDARRAY_MAXDIM + 1];
+
+    if (!handle->writer || handle->count >= handle->dims[0]) {
+        return;
+    }
+    memcpy(dims, handle->dims, handle->rank * sizeof(hsize_t));
+    dims[0] = handle->count;
+    if (H5Dset_extent(handle->dataset, dims) < 0) {
+        H5Ewalk2(H5E_DEFAULT, H5E_WALK_UPWARD, walk_hdf5_errors, NULL);
+        ISMRMRD_PUSH_ERR(ISMRMRD_HDF5ERROR, "Failed to trim dataset");
+        return;
+    }
+    handle->dims[0] = handle->count;
+}
+
+static void free_handle(ISMRMRD_DatasetHandle *handle) {
+    if (handle->dataset >= 0) {
+        trim_handle(handle);
+    }
+    if (handle->fixed_records > 0) {
+        H5Tclose(handle->fixed_type);
+    }
+    if (handle->filetype >= 0) {
+        H5Tclose(handle->filetype);
+    }
+    if (handle->filespace >= 0) {
+        H5Sclose(handle->filespace);
+    }
+    if (handle->dataset >= 0) {
+        H5Dclose(handle->dataset);
+    }
+    free(handle->path);
+    free(handle);
+}
+
+/* The acquisitions and waveforms have their own slots, everything else lives in a list */
+static ISMRMRD_DatasetHandle **handle_slot(const ISMRMRD_Dataset *dset, const char *path) {
+    if (strcmp(path, dset->cache->datapath) == 0) {
+        return &dset->cache->data;
+    }
+    if (strcmp(path, dset->cache->waveformpath) == 0) {
+        return &dset->cache->waveforms;
+    }
+    return NULL;
+}
+
+static ISMRMRD_DatasetHandle *add_handle(const ISMRMRD_Dataset *dset, const char *path, hid_t dataset) {
+    ISMRMRD_DatasetHandle *handle, **slot;
+
+    handle = (ISMRMRD_DatasetHandle *) calloc(1, sizeof(*handle));
+    if (handle == NULL) {
+        H5Dclose(dataset);
+        ISMRMRD_PUSH_ERR(ISMRMRD_MEMORYERROR, "Failed to malloc dataset handle");
+        return NULL;
+    }
+    handle->dataset = dataset;
+    handle->filespace = -1;
+    handle->filetype = H5Dget_type(dataset);
+    if (handle->filetype < 0) {
+        H5Ewalk2(H5E_DEFAULT, H5E_WALK_UPWARD, walk_hdf5_errors, NULL);
+        free_handle(handle);
+        ISMRMRD_PUSH_ERR(ISMRMRD_HDF5ERROR, "Failed to get dataset datatype");
+        return NULL;
+    }
+    handle->path = (char *) malloc(strlen(path) + 1);
+    if (handle->path == NULL) {
+        free_handle(handle);
+        ISMRMRD_PUSH_ERR(ISMRMRD_MEMORYERROR, "Failed to malloc dataset handle path");
+        return NULL;
+    }
+    strcpy(handle->path, path);
+    if (refresh_handle(handle) != ISMRMRD_NOERROR) {
+        free_handle(handle);
+        return NULL;
+    }
+
+    slot = handle_slot(dset, path);
+    if (slot != NULL) {
+        *slot = handle;
+    }
+    else {
+        handle->next = dset->cache->vars;
+        dset->cache->vars = handle;
+    }
+    return handle;
+}
+
+/* Returns the open handle for path, opening it on first use, or NULL if there is no such dataset */
+static ISMRMRD_DatasetHandle *find_handle(const ISMRMRD_Dataset *dset, const char *path) {
+    ISMRMRD_DatasetHandle *handle, **slot;
+    hid_t dataset;
+
+    slot = handle_slot(dset, path);
+    if (slot != NULL) {
+        handle = *slot;
+    }
+    else {
+        for (handle = dset->cache->vars; handle != NULL; handle = handle->next) {
+            if (strcmp(handle->path, path) == 0) {
+                break;
+            }
+        }
+    }
+    if (handle != NULL) {
+        return handle;
+    }
+
+    if (!link_exists(dset, path)) {
+        return NULL;
+    }
+    dataset = H5Dopen2(dset->fileid, path, H5P_DEFAULT);
+    if (dataset < 0) {
+        H5Ewalk2(H5E_DEFAULT, H5E_WALK_UPWARD, walk_hdf5_errors, NULL);
+        ISMRMRD_PUSH_ERR(ISMRMRD_FILEERROR, "Failed to open dataset");
+        return NULL;
+    }
+    return add_handle(dset, path, dataset);
+}
+
+static void drop_handle(const ISMRMRD_Dataset *dset, const char *path) {
+    ISMRMRD_DatasetHandle **slot, **link, *handle;
+
+    slot = handle_slot(dset, path);
+    if (slot != NULL) {
+        if (*slot != NULL) {
+            free_handle(*slot);
+            *slot = NULL;
+        }
+        return;
+    }
+    for (link = &dset->cache->vars; *link != NULL; link = &(*link)->next) {
+        if (strcmp((*link)->path, path) == 0) {
+            handle = *link;
+            *link = handle->next;
+            free_handle(handle);
+            return;
+        }
+    }
+}
+
+static void close_handles(ISMRMRD_Dataset *dset) {
+    ISMRMRD_DatasetHandle *handle;
+
+    if (dset->cache->data != NULL) {
+        free_handle(dset->cache->data);
+        dset->cache->data = NULL;
+    }
+    if (dset->cache->waveforms != NULL) {
+        free_handle(dset->cache->waveforms);
+        dset->cache->waveforms = NULL;
+    }
+    while (dset->cache->vars != NULL) {
+        handle = dset->cache->vars;
+        dset->cache->vars = handle->next;
+        free_handle(handle);
+    }
+}
+
 static int delete_var(const ISMRMRD_Dataset *dset, const char *var) {
     int status = ISMRMRD_NOERROR;
     herr_t h5status;
@@ -139,6 +456,7 @@ static int delete_var(const ISMRMRD_Dataset *dset, const char *var) {
     }
 
     path = make_path(dset, var);
+    drop_handle(dset, path);
     if (link_exists(dset, path)) {
         h5status = H5Ldelete(dset->fileid, path, H5P_DEFAULT);
         if (h5status < 0) {
@@ -160,46 +478,79 @@ typedef struct HDF5_Acquisiton
     hvl_t data;
 } HDF5_Acquisition;
 
+/* Where the samples of an acquisition start when they are kept apart from the records,
+ * in complex samples and trajectory floats */
+typedef struct HDF5_SampleOffsets
+{
+    uint64_t data;
+    uint64_t traj;
+} HDF5_SampleOffsets;
+
 typedef struct HDF5_Waveform
 {
     ISMRMRD_WaveformHeader head;
     hvl_t data;
 } HDF5_Waveform;
 
+/* One row of the acquisition index, the fields of a header that queries look at */
+typedef struct HDF5_IndexEntry
+{
+    uint64_t flags;
+    ISMRMRD_EncodingCounters idx;
+} HDF5_IndexEntry;
+
 static hid_t get_hdf5type_uint16(void) {
-    hid_t datatype = H5Tcopy(H5T_NATIVE_UINT16);
-    return datatype;
+    return H5T_NATIVE_UINT16;
 }
 
 static hid_t get_hdf5type_int16(void) {
-    hid_t datatype = H5Tcopy(H5T_NATIVE_INT16);
-    return datatype;
+    return H5T_NATIVE_INT16;
 }
 
 static hid_t get_hdf5type_uint32(void) {
-    hid_t datatype = H5Tcopy(H5T_NATIVE_UINT32);
-    return datatype;
+    return H5T_NATIVE_UINT32;
 }
     
 static hid_t get_hdf5type_int32(void) {
-    hid_t datatype = H5Tcopy(H5T_NATIVE_INT32);
-    return datatype;
+    return H5T_NATIVE_INT32;
 }
 
 static hid_t get_hdf5type_float(void) {
-    hid_t datatype = H5Tcopy(H5T_NATIVE_FLOAT);
-    return datatype;
+    return H5T_NATIVE_FLOAT;
 }
 
 static hid_t get_hdf5type_double(void) {
-    hid_t datatype = H5Tcopy(H5T_NATIVE_DOUBLE);
-    return datatype;
+    return H5T_NATIVE_DOUBLE;
 }
 
-/* TODO for all get_hdf5type_xxx functions:
+/* The compound and string types are shared by all datasets. They are built when the first
+ * dataset is initialized and closed with the last one, under a lock, so no dataset sees
+ * them half built and none of them is left over after the HDF5 library is closed. */
+enum {
+    HDF5TYPE_COMPLEXFLOAT,
+    HDF5TYPE_COMPLEXDOUBLE,
+    HDF5TYPE_XMLHEADER,
+    HDF5TYPE_ENCODING,
+    HDF5TYPE_ACQUISITIONHEADER,
+    HDF5TYPE_ACQUISITION,
+    HDF5TYPE_ACQUISITION_HEAD,
+    HDF5TYPE_ACQUISITION_TRAJ,
+    HDF5TYPE_ACQUISITION_DATA,
+    HDF5TYPE_IMAGEHEADER,
+    HDF5TYPE_IMAGE_ATTRIBUTE_STRING,
+    HDF5TYPE_WAVEFORMHEADER,
+    HDF5TYPE_WAVEFORM,
+    HDF5TYPE_INDEX_ENTRY,
+    HDF5TYPE_SAMPLE_OFFSETS,
+    HDF5TYPE_COUNT
+};
+static hid_t shared_hdf5types[HDF5TYPE_COUNT];
+static unsigned int shared_hdf5type_users = 0;
+
+/* TODO for all build_hdf5type_xxx functions:
  *      Check return code of each H5Tinsert call */
 
-static hid_t get_hdf5type_complexfloat(void) {
+static hid_t build_hdf5type_complexfloat(void) {
     hid_t datatype;
     herr_t h5status;
     datatype = H5Tcreate(H5T_COMPOUND, sizeof(complex_float_t));
@@ -215,8 +566,12 @@ static hid_t get_hdf5type_complexfloat(void) {
     }
     return datatype;
 }
+
+static hid_t get_hdf5type_complexfloat(void) {
+    return shared_hdf5types[HDF5TYPE_COMPLEXFLOAT];
+}
     
-static hid_t get_hdf5type_complexdouble(void) {
+static hid_t build_hdf5type_complexdouble(void) {
     hid_t datatype;
     herr_t h5status;
     datatype = H5Tcreate(H5T_COMPOUND, sizeof(complex_double_t));
@@ -233,7 +588,11 @@ static hid_t get_hdf5type_complexdouble(void) {
     return datatype;
 }
 
-static hid_t get_hdf5type_xmlheader(void) {
+static hid_t get_hdf5type_complexdouble(void) {
+    return shared_hdf5types[HDF5TYPE_COMPLEXDOUBLE];
+}
+
+static hid_t build_hdf5type_xmlheader(void) {
     hid_t datatype = H5Tcopy(H5T_C_S1);
     herr_t h5status = H5Tset_size(datatype, H5T_VARIABLE);
     if (h5status < 0) {
@@ -243,7 +602,11 @@ static hid_t get_hdf5type_xmlheader(void) {
     return datatype;
 }
 
-static hid_t get_hdf5type_encoding(void) {
+static hid_t get_hdf5type_xmlheader(void) {
+    return shared_hdf5types[HDF5TYPE_XMLHEADER];
+}
+
+static hid_t build_hdf5type_encoding(void) {
     hid_t datatype;
     herr_t h5status;
     hsize_t arraydims[] = {ISMRMRD_USER_INTS};
@@ -267,9 +630,13 @@ static hid_t get_hdf5type_encoding(void) {
     return datatype;
 }
 
+static hid_t get_hdf5type_encoding(void) {
+    return shared_hdf5types[HDF5TYPE_ENCODING];
+}
+
 
 
-static hid_t get_hdf5type_acquisitionheader(void) {
+static hid_t build_hdf5type_acquisitionheader(void) {
     hid_t datatype;
     herr_t h5status;
     hsize_t arraydims[1];
@@ -314,7 +681,6 @@ static hid_t get_hdf5type_acquisitionheader(void) {
     
     vartype = get_hdf5type_encoding();
     h5status = H5Tinsert(datatype, "idx", HOFFSET(ISMRMRD_AcquisitionHeader, idx), vartype);
-    H5Tclose(vartype);
     
     arraydims[0] = ISMRMRD_USER_INTS;
     vartype = H5Tarray_create2(H5T_NATIVE_INT32, 1, arraydims);
@@ -334,25 +700,26 @@ static hid_t get_hdf5type_acquisitionheader(void) {
     return datatype;   
 }
 
-static hid_t get_hdf5type_acquisition(void) {
+static hid_t get_hdf5type_acquisitionheader(void) {
+    return shared_hdf5types[HDF5TYPE_ACQUISITIONHEADER];
+}
+
+static hid_t build_hdf5type_acquisition(void) {
     hid_t datatype, vartype, vlvartype;
     herr_t h5status;
     
     datatype = H5Tcreate(H5T_COMPOUND, sizeof(HDF5_Acquisition));
     vartype = get_hdf5type_acquisitionheader();
     h5status = H5Tinsert(datatype, "head", HOFFSET(HDF5_Acquisition, head), vartype);
-    H5Tclose(vartype);
     vartype =  get_hdf5type_float();
     vlvartype = H5Tvlen_create(vartype);
     h5status = H5Tinsert(datatype, "traj", HOFFSET(HDF5_Acquisition, traj), vlvartype);
-    H5Tclose(vartype);
     H5Tclose(vlvartype);
     
     /* Store acquisition data as an array of floats */
     vartype = get_hdf5type_float();
     vlvartype = H5Tvlen_create(vartype);
     h5status = H5Tinsert(datatype, "data", HOFFSET(HDF5_Acquisition, data), vlvartype);
-    H5Tclose(vartype);
     H5Tclose(vlvartype);
     
     if (h5status < 0) {
@@ -362,7 +729,52 @@ static hid_t get_hdf5type_acquisition(void) {
     return datatype;
 }
 
-static hid_t get_hdf5type_imageheader(void) {
+static hid_t get_hdf5type_acquisition(void) {
+    return shared_hdf5types[HDF5TYPE_ACQUISITION];
+}
+
+/* Single field subsets of the acquisition type, for reading the parts of a record separately */
+static hid_t build_hdf5type_acquisition_head(void) {
+    hid_t datatype = H5Tcreate(H5T_COMPOUND, sizeof(ISMRMRD_AcquisitionHeader));
+    herr_t h5status = H5Tinsert(datatype, "head", 0, get_hdf5type_acquisitionheader());
+    if (h5status < 0) {
+        ISMRMRD_PUSH_ERR(ISMRMRD_FILEERROR, "Failed get acquisition head data type");
+    }
+    return datatype;
+}
+
+static hid_t get_hdf5type_acquisition_head(void) {
+    return shared_hdf5types[HDF5TYPE_ACQUISITION_HEAD];
+}
+
+static hid_t build_hdf5type_acquisition_vlen(const char *name) {
+    hid_t datatype = H5Tcreate(H5T_COMPOUND, sizeof(hvl_t));
+    hid_t vlvartype = H5Tvlen_create(get_hdf5type_float());
+    herr_t h5status = H5Tinsert(datatype, name, 0, vlvartype);
+    H5Tclose(vlvartype);
+    if (h5status < 0) {
+        ISMRMRD_PUSH_ERR(ISMRMRD_FILEERROR, "Failed get acquisition payload data type");
+    }
+    return datatype;
+}
+
+static hid_t build_hdf5type_acquisition_traj(void) {
+    return build_hdf5type_acquisition_vlen("traj");
+}
+
+static hid_t get_hdf5type_acquisition_traj(void) {
+    return shared_hdf5types[HDF5TYPE_ACQUISITION_TRAJ];
+}
+
+static hid_t build_hdf5type_acquisition_data(void) {
+    return build_hdf5type_acquisition_vlen("data");
+}
+
+static hid_t get_hdf5type_acquisition_data(void) {
+    return shared_hdf5types[HDF5TYPE_ACQUISITION_DATA];
+}
+
+static hid_t build_hdf5type_imageheader(void) {
     hid_t datatype;
     herr_t h5status;
     hsize_t arraydims[1];
@@ -424,7 +836,11 @@ static hid_t get_hdf5type_imageheader(void) {
     return datatype;   
 }
 
-static hid_t get_hdf5type_image_attribute_string(void) {
+static hid_t get_hdf5type_imageheader(void) {
+    return shared_hdf5types[HDF5TYPE_IMAGEHEADER];
+}
+
+static hid_t build_hdf5type_image_attribute_string(void) {
     hid_t datatype = H5Tcopy(H5T_C_S1);
     herr_t h5status = H5Tset_size(datatype, H5T_VARIABLE);
     if (h5status < 0) {
@@ -434,9 +850,13 @@ static hid_t get_hdf5type_image_attribute_string(void) {
     return datatype;
 }
 
+static hid_t get_hdf5type_image_attribute_string(void) {
+    return shared_hdf5types[HDF5TYPE_IMAGE_ATTRIBUTE_STRING];
+}
 
 
-static hid_t get_hdf5type_waveformheader(void) {
+
+static hid_t build_hdf5type_waveformheader(void) {
     hid_t datatype;
     herr_t h5status;
 
@@ -460,7 +880,11 @@ static hid_t get_hdf5type_waveformheader(void) {
 
 }
 
-static hid_t get_hdf5type_waveform(void) {
+static hid_t get_hdf5type_waveformheader(void) {
+    return shared_hdf5types[HDF5TYPE_WAVEFORMHEADER];
+}
+
+static hid_t build_hdf5type_waveform(void) {
     hid_t datatype, vartype, vlvartype;
     herr_t h5status;
 
@@ -470,11 +894,9 @@ static hid_t get_hdf5type_waveform(void) {
 	if (h5status < 0) {
 		ISMRMRD_PUSH_ERR(ISMRMRD_FILEERROR, "Failed get waveform header data type");
 	}
-    H5Tclose(vartype);
 	vartype = get_hdf5type_uint32();
     vlvartype = H5Tvlen_create(vartype);
     h5status = H5Tinsert(datatype, "data", HOFFSET(HDF5_Waveform, data), vlvartype);
-    H5Tclose(vartype);
     H5Tclose(vlvartype);
 
     /* Store acquisition data as an array of floats */
@@ -485,6 +907,123 @@ static hid_t get_hdf5type_waveform(void) {
 
     return datatype;
 }
+
+static hid_t get_hdf5type_waveform(void) {
+    return shared_hdf5types[HDF5TYPE_WAVEFORM];
+}
+static hid_t build_hdf5type_index_entry(void) {
+    hid_t datatype;
+    herr_t h5status;
+
+    datatype = H5Tcreate(H5T_COMPOUND, sizeof(HDF5_IndexEntry));
+    h5status = H5Tinsert(datatype, "flags", HOFFSET(HDF5_IndexEntry, flags), H5T_NATIVE_UINT64);
+    h5status = H5Tinsert(datatype, "idx", HOFFSET(HDF5_IndexEntry, idx), get_hdf5type_encoding());
+    if (h5status < 0) {
+        ISMRMRD_PUSH_ERR(ISMRMRD_FILEERROR, "Failed get index entry data type");
+    }
+    return datatype;
+}
+
+static hid_t get_hdf5type_index_entry(void) {
+    return shared_hdf5types[HDF5TYPE_INDEX_ENTRY];
+}
+
+static hid_t build_hdf5type_sample_offsets(void) {
+    hid_t datatype;
+    herr_t h5status;
+
+    datatype = H5Tcreate(H5T_COMPOUND, sizeof(HDF5_SampleOffsets));
+    h5status = H5Tinsert(datatype, "data", HOFFSET(HDF5_SampleOffsets, data), H5T_NATIVE_UINT64);
+    h5status = H5Tinsert(datatype, "traj", HOFFSET(HDF5_SampleOffsets, traj), H5T_NATIVE_UINT64);
+    if (h5status < 0) {
+        ISMRMRD_PUSH_ERR(ISMRMRD_FILEERROR, "Failed get sample offsets data type");
+    }
+    return datatype;
+}
+
+static hid_t get_hdf5type_sample_offsets(void) {
+    return shared_hdf5types[HDF5TYPE_SAMPLE_OFFSETS];
+}
+
+/* In the order of the enum, later types are made of earlier ones */
+static hid_t (*const shared_hdf5type_builders[HDF5TYPE_COUNT])(void) = {
+    build_hdf5type_complexfloat,
+    build_hdf5type_complexdouble,
+    build_hdf5type_xmlheader,
+    build_hdf5type_encoding,
+    build_hdf5type_acquisitionheader,
+    build_hdf5type_acquisition,
+    build_hdf5type_acquisition_head,
+    build_hdf5type_acquisition_traj,
+    build_hdf5type_acquisition_data,
+    build_hdf5type_imageheader,
+    build_hdf5type_image_attribute_string,
+    build_hdf5type_waveformheader,
+    build_hdf5type_waveform,
+    build_hdf5type_index_entry,
+    build_hdf5type_sample_offsets
+};
+
+#ifdef _WIN32
+static SRWLOCK shared_hdf5types_lock = SRWLOCK_INIT;
+
+static void lock_shared_hdf5types(void) {
+    AcquireSRWLockExclusive(&shared_hdf5types_lock);
+}
+
+static void unlock_shared_hdf5types(void) {
+    ReleaseSRWLockExclusive(&shared_hdf5types_lock);
+}
+#else
+static pthread_mutex_t shared_hdf5types_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static void lock_shared_hdf5types(void) {
+    pthread_mutex_lock(&shared_hdf5types_lock);
+}
+
+static void unlock_shared_hdf5types(void) {
+    pthread_mutex_unlock(&shared_hdf5types_lock);
+}
+#endif
+
+static void close_shared_hdf5types(const int count) {
+    int n;
+    for (n = 0; n < count; n++) {
+        H5Tclose(shared_hdf5types[n]);
+        shared_hdf5types[n] = -1;
+    }
+}
+
+/* Counts a user of the shared types, building them for the first one */
+static int acquire_shared_hdf5types(void) {
+    int status = ISMRMRD_NOERROR;
+    int n;
+
+    lock_shared_hdf5types();
+    for (n = 0; shared_hdf5type_users == 0 && n < HDF5TYPE_COUNT; n++) {
+        shared_hdf5types[n] = shared_hdf5type_builders[n]();
+        if (shared_hdf5types[n] < 0) {
+            H5Ewalk2(H5E_DEFAULT, H5E_WALK_UPWARD, walk_hdf5_errors, NULL);
+            status = ISMRMRD_PUSH_ERR(ISMRMRD_HDF5ERROR, "Failed to build shared datatype");
+            close_shared_hdf5types(n);
+            break;
+        }
+    }
+    if (status == ISMRMRD_NOERROR) {
+        shared_hdf5type_users++;
+    }
+    unlock_shared_hdf5types();
+    return status;
+}
+
+static void release_shared_hdf5types(void) {
+    lock_shared_hdf5types();
+    if (shared_hdf5type_users > 0 && --shared_hdf5type_users == 0) {
+        close_shared_hdf5types(HDF5TYPE_COUNT);
+    }
+    unlock_shared_hdf5types();
+}
+
 static hid_t get_hdf5type_ndarray(uint16_t data_type) {
     
     hid_t hdfdatatype = -1;
@@ -528,49 +1067,41 @@ static uint16_t get_ndarray_data_type(hid_t hdf5type) {
     if (H5Tequal(hdf5type, t)) {
         dtype = ISMRMRD_USHORT;
     }
-    H5Tclose(t);
 
     t = get_hdf5type_int16();
     if (H5Tequal(hdf5type, t)) {
         dtype = ISMRMRD_SHORT;
     }
-    H5Tclose(t);
 
     t = get_hdf5type_uint32();
     if (H5Tequal(hdf5type, t)) {
         dtype = ISMRMRD_UINT;
     }
-    H5Tclose(t);
 
     t = get_hdf5type_int32();
     if (H5Tequal(hdf5type, t)) {
         dtype = ISMRMRD_INT;
     }
-    H5Tclose(t);
 
     t = get_hdf5type_float();
     if (H5Tequal(hdf5type, t)) {
         dtype = ISMRMRD_FLOAT;
     }
-    H5Tclose(t);
 
     t = get_hdf5type_double();
     if (H5Tequal(hdf5type, t)) {
         dtype = ISMRMRD_DOUBLE;
     }
-    H5Tclose(t);
 
     t = get_hdf5type_complexfloat();
     if (H5Tequal(hdf5type, t)) {
         dtype = ISMRMRD_CXFLOAT;
     }
-    H5Tclose(t);
 
     t = get_hdf5type_complexdouble();
     if (H5Tequal(hdf5type, t)) {
         dtype = ISMRMRD_CXDOUBLE;
     }
-    H5Tclose(t);
 
     if (dtype == 0) {
         //ISMRMRD_PUSH_ERR(ISMRMRD_TYPEERROR, "Failed to get data type from HDF5 data type.");
@@ -579,734 +1110,2871 @@ static uint16_t get_ndarray_data_type(hid_t hdf5type) {
     return dtype;
 }
 
-static uint32_t get_number_of_elements(const ISMRMRD_Dataset *dset, const char * path)
+/* The extent to allocate when a dataset holding allocated records needs room for needed */
+static hsize_t grow_extent(const ISMRMRD_Dataset *dset, const char *path,
+        const hsize_t allocated, const hsize_t needed)
 {
-    herr_t h5status;
-    uint32_t num;
+    hsize_t extent = needed;
+
+    switch (dset->options.growth_policy) {
+        case ISMRMRD_GROWTH_HINT:
+            /* the hint counts acquisitions, so it only sizes the data variable */
+            if (strcmp(path, dset->cache->datapath) == 0 && dset->options.capacity_hint > extent) {
+                extent = dset->options.capacity_hint;
+                break;
+            }
+            /* past the hint the extent doubles */
+            /* fall through */
+        case ISMRMRD_GROWTH_GEOMETRIC:
+            if (2 * allocated > extent) {
+                extent = 2 * allocated;
+            }
+            break;
+        default:
+            break;
+    }
+    return extent;
+}
 
-    if (NULL == dset) {
-        ISMRMRD_PUSH_ERR(ISMRMRD_RUNTIMEERROR, "NULL Dataset parameter");
-        return 0;
+/* The number of records in each chunk of a new dataset that starts with extent records.
+ * HDF5 allocates whole chunks, so the automatic length of unfiltered chunks never exceeds
+ * the first extent, and such a variable written one record at a time keeps one record per
+ * chunk. Filtered chunks are stored compressed, their unwritten records cost next to nothing. */
+static hsize_t get_chunk_length(const ISMRMRD_Dataset *dset, const hid_t datatype,
+        const uint16_t ndim, const size_t *dims, const hsize_t extent, const bool filtered)
+{
+    size_t record_size;
+    hsize_t length;
+    int n;
+
+    if (dset->options.chunk_length > 0) {
+        return dset->options.chunk_length;
     }
 
-    if (link_exists(dset, path)) {
-        hid_t dataset, dataspace;
-        hsize_t rank, *dims, *maxdims;
-        dataset = H5Dopen2(dset->fileid, path, H5P_DEFAULT);
-        dataspace = H5Dget_space(dataset);
-        rank = H5Sget_simple_extent_ndims(dataspace);
-        dims = (hsize_t *) malloc(rank*sizeof(hsize_t));
-        maxdims = (hsize_t *) malloc(rank*sizeof(hsize_t));
-        h5status = H5Sget_simple_extent_dims(dataspace, dims, maxdims);
-        num = dims[0];
-        free(dims);
-        free(maxdims);
-        h5status = H5Sclose(dataspace);
-        h5status= H5Dclose(dataset);
-        if (h5status < 0) {
-            H5Ewalk2(H5E_DEFAULT, H5E_WALK_UPWARD, walk_hdf5_errors, NULL);
-            ISMRMRD_PUSH_ERR(ISMRMRD_FILEERROR,
-                    "Failed to get number of elements in vector.");
-        }
+    record_size = H5Tget_size(datatype);
+    for (n = 0; n < ndim; n++) {
+        record_size *= dims[n];
     }
-    else {
-        /* none */
-        num = 0;
+    if (record_size == 0 || record_size >= ISMRMRD_AUTO_CHUNK_BYTES) {
+        return 1;
     }
-    
-    return num;
+    length = ISMRMRD_AUTO_CHUNK_BYTES / record_size;
+    return (!filtered && extent < length) ? extent : length;
 }
 
-static int append_element(const ISMRMRD_Dataset * dset, const char * path,
-        void * elem, const hid_t datatype,
-        const uint16_t ndim, const size_t *dims)
+/* The profile of the variable holding path, or the dataset option. The datasets that hold
+ * the samples of the acquisitions take the profile of the acquisitions. Waveforms are
+ * never compressed. */
+static uint16_t get_compression(const ISMRMRD_Dataset *dset, const char *path)
 {
-    hid_t dataset, dataspace, props, filespace, memspace;
-    herr_t h5status = 0;
-    hsize_t *hdfdims = NULL, *ext_dims = NULL, *offset = NULL, *maxdims = NULL, *chunk_dims = NULL;
-    int n = 0, rank = 0;
-    
-    if (NULL == dset) {
-        return ISMRMRD_PUSH_ERR(ISMRMRD_RUNTIMEERROR, "NULL Dataset parameter");
+    ISMRMRD_CompressionSetting *setting;
+    size_t len;
+
+    if (strcmp(path, dset->cache->waveformpath) == 0) {
+        return ISMRMRD_COMPRESSION_NONE;
+    }
+    if (strcmp(path, dset->cache->samplepath) == 0 || strcmp(path, dset->cache->trajpath) == 0 ||
+            strcmp(path, dset->cache->offsetpath) == 0) {
+        path = dset->cache->datapath;
     }
 
-    /* Check the path and find rank */
-    if (link_exists(dset, path)) {
-        /* open dataset */
-        dataset = H5Dopen2(dset->fileid, path, H5P_DEFAULT);
-        /* TODO check that the header dataset's datatype is correct */
-        dataspace = H5Dget_space(dataset);
-        rank = H5Sget_simple_extent_ndims(dataspace);
-        if (rank != ndim + 1) {
-            return ISMRMRD_PUSH_ERR(ISMRMRD_FILEERROR, "Dimensions are incorrect.");
+    for (setting = dset->cache->compression; setting != NULL; setting = setting->next) {
+        len = strlen(setting->path);
+        if (strncmp(path, setting->path, len) == 0 && (path[len] == '\0' || path[len] == '/')) {
+            return setting->profile;
         }
-    } else {
-        dataset   = -1; /* will be initialized below */
-        dataspace = -1; /* will be initialized below */
-        rank = ndim + 1;
+    }
+    return dset->options.compression;
+}
+
+/* Shuffling the bytes of each element first lets deflate find the runs in the high order
+ * bytes. Both filters ship with HDF5, so stock tools read the result. When deflate isn't
+ * available the variable is written uncompressed. */
+static int set_compression_filters(hid_t props, const uint16_t profile, const hid_t datatype)
+{
+    unsigned level;
+    herr_t h5status;
+
+    switch (profile) {
+        case ISMRMRD_COMPRESSION_NONE:
+            return ISMRMRD_NOERROR;
+        case ISMRMRD_COMPRESSION_FAST:
+            level = 1;
+            break;
+        case ISMRMRD_COMPRESSION_MAX:
+            level = 9;
+            break;
+        case ISMRMRD_COMPRESSION_CXFLOAT:
+            if (H5Tequal(datatype, get_hdf5type_complexfloat()) > 0) {
+                h5status = H5Pset_filter(props, ISMRMRD_FILTER_CXFLOAT, H5Z_FLAG_MANDATORY, 0, NULL);
+                if (h5status < 0) {
+                    H5Ewalk2(H5E_DEFAULT, H5E_WALK_UPWARD, walk_hdf5_errors, NULL);
+                    return ISMRMRD_PUSH_ERR(ISMRMRD_HDF5ERROR, "Failed to set compression filters.");
+                }
+                return ISMRMRD_NOERROR;
+            }
+            level = 1;
+            break;
+        default:
+            return ISMRMRD_PUSH_ERR(ISMRMRD_TYPEERROR, "Unknown compression profile.");
+    }
+
+    if (H5Zfilter_avail(H5Z_FILTER_DEFLATE) <= 0) {
+        return ISMRMRD_NOERROR;
+    }
+    h5status = H5Pset_shuffle(props);
+    if (h5status >= 0) {
+        h5status = H5Pset_deflate(props, level);
+    }
+    if (h5status < 0) {
+        H5Ewalk2(H5E_DEFAULT, H5E_WALK_UPWARD, walk_hdf5_errors, NULL);
+        return ISMRMRD_PUSH_ERR(ISMRMRD_HDF5ERROR, "Failed to set compression filters.");
+    }
+    return ISMRMRD_NOERROR;
+}
+
+static uint32_t get_number_of_elements(const ISMRMRD_Dataset *dset, const char * path)
+{
+    ISMRMRD_DatasetHandle *handle;
+
+    if (NULL == dset) {
+        ISMRMRD_PUSH_ERR(ISMRMRD_RUNTIMEERROR, "NULL Dataset parameter");
+        return 0;
+    }
+
+    handle = find_handle(dset, path);
+    if (handle == NULL) {
+        /* none */
+        return 0;
+    }
+
+#if H5_VERSION_GE(1, 10, 0)
+    /* a SWMR reader has to reload the dataset to see the writer's new extent */
+    if (dset->options.swmr == ISMRMRD_SWMR_READ && H5Drefresh(handle->dataset) < 0) {
+        H5Ewalk2(H5E_DEFAULT, H5E_WALK_UPWARD, walk_hdf5_errors, NULL);
+        ISMRMRD_PUSH_ERR(ISMRMRD_HDF5ERROR, "Failed to refresh dataset.");
+        return 0;
+    }
+#endif
+    /* pick up elements appended through another handle on the same file */
+    if (!handle->writer && refresh_handle(handle) != ISMRMRD_NOERROR) {
+        ISMRMRD_PUSH_ERR(ISMRMRD_FILEERROR, "Failed to get number of elements in vector.");
+        return 0;
+    }
+
+    return (uint32_t) handle->count;
+}
+
+#if H5_VERSION_GE(1, 10, 3)
+/* Whether the records of a handle can be moved as raw chunks with H5Dwrite_chunk and
+ * H5Dread_chunk: each chunk holds exactly one record, no filters are applied and the
+ * memory type is the type in the file, so no conversion or selection is needed. */
+static bool use_direct_chunks(ISMRMRD_DatasetHandle *handle, const hid_t datatype)
+{
+    hsize_t chunk_dims[ISMRMRD_NDARRAY_MAXDIM + 1];
+    hid_t props;
+    int n;
+
+    if (handle->direct_chunks == 0) {
+        handle->direct_chunks = -1;
+        props = H5Dget_create_plist(handle->dataset);
+        if (props >= 0 && H5Pget_layout(props) == H5D_CHUNKED && H5Pget_nfilters(props) == 0 &&
+                H5Pget_chunk(props, handle->rank, chunk_dims) == handle->rank && chunk_dims[0] == 1) {
+            handle->direct_chunks = 1;
+            for (n = 1; n < handle->rank; n++) {
+                if (chunk_dims[n] != handle->dims[n]) {
+                    handle->direct_chunks = -1;
+                }
+            }
+        }
+        if (props >= 0) {
+            H5Pclose(props);
+        }
+    }
+    if (handle->direct_chunks < 0) {
+        return false;
+    }
+    /* the types compared are shared, comparing them once is enough */
+    if (datatype == handle->direct_type) {
+        return true;
+    }
+    /* variable length records and strings hold references to the heap rather than the data */
+    if (H5Tdetect_class(datatype, H5T_VLEN) == 0 && H5Tis_variable_str(datatype) == 0 &&
+            H5Tequal(handle->filetype, datatype) > 0) {
+        handle->direct_type = datatype;
+        return true;
+    }
+    return false;
+}
+
+/* The bytes in one record of a handle */
+static size_t get_record_size(const ISMRMRD_DatasetHandle *handle, const hid_t datatype)
+{
+    size_t size = H5Tget_size(datatype);
+    int n;
+
+    for (n = 1; n < handle->rank; n++) {
+        size *= handle->dims[n];
+    }
+    return size;
+}
+#endif
+
+static int append_elements(const ISMRMRD_Dataset * dset, const char * path,
+        void * elems, const uint32_t nelems, const hid_t datatype,
+        const uint16_t ndim, const size_t *dims)
+{
+    ISMRMRD_DatasetHandle *handle;
+    hid_t dataset, dataspace, props, memspace;
+    herr_t h5status = 0;
+    hsize_t hdfdims[ISMRMRD_NDARRAY_MAXDIM + 1], ext_dims[ISMRMRD_NDARRAY_MAXDIM + 1];
+    hsize_t offset[ISMRMRD_NDARRAY_MAXDIM + 1], maxdims[ISMRMRD_NDARRAY_MAXDIM + 1];
+    hsize_t chunk_dims[ISMRMRD_NDARRAY_MAXDIM + 1];
+    int n = 0, rank = ndim + 1;
+
+    if (NULL == dset) {
+        return ISMRMRD_PUSH_ERR(ISMRMRD_RUNTIMEERROR, "NULL Dataset parameter");
+    }
+    if (ndim > ISMRMRD_NDARRAY_MAXDIM) {
+        return ISMRMRD_PUSH_ERR(ISMRMRD_RUNTIMEERROR, "Too many dimensions.");
+    }
+    if (nelems == 0) {
+        return ISMRMRD_NOERROR;
     }
 
-    hdfdims = (hsize_t *) malloc(rank * sizeof(hsize_t));
-    maxdims = (hsize_t *) malloc(rank * sizeof(hsize_t));
-    offset = (hsize_t *) malloc(rank * sizeof(hsize_t));
-    ext_dims = (hsize_t *) malloc(rank * sizeof(hsize_t));
-    chunk_dims = (hsize_t *) malloc(rank * sizeof(hsize_t));
+    ext_dims[0] = nelems;
+    for (n = 0; n < ndim; n++) {
+        offset[n + 1] = 0;
+        ext_dims[n + 1] = dims[n];
+    }
 
     /* extend or create if needed, and select the last block */
-    if (link_exists(dset, path)) {
-        h5status = H5Sget_simple_extent_dims(dataspace, hdfdims, maxdims);
+    handle = find_handle(dset, path);
+    if (handle != NULL) {
+        /* the cached extent is only trusted once this handle owns it */
+        if (!handle->writer && refresh_handle(handle) != ISMRMRD_NOERROR) {
+            return ISMRMRD_PUSH_ERR(ISMRMRD_FILEERROR, "Failed to get dataset extent.");
+        }
+        if (handle->rank != rank) {
+            return ISMRMRD_PUSH_ERR(ISMRMRD_FILEERROR, "Dimensions are incorrect.");
+        }
         for (n = 0; n<ndim; n++) {
-            if (dims[n] != hdfdims[n+1]) {
-                free(hdfdims);
-                free(ext_dims);
-                free(offset);
-                free(maxdims);
-                free(chunk_dims);
+            if (dims[n] != handle->dims[n+1]) {
                 return ISMRMRD_PUSH_ERR(ISMRMRD_FILEERROR, "Dimensions are incorrect.");
             }
         }
-        /* extend it by one */
-        hdfdims[0] += 1;
-        h5status = H5Dset_extent(dataset, hdfdims);
-        /* Select the last block */
-        ext_dims[0] = 1;
-        for (n = 0; n < ndim; n++) {
-            offset[n + 1] = 0;
-            ext_dims[n + 1] = dims[n];
+        /* extend it once the allocated records are used up */
+        offset[0] = handle->count;
+        if (handle->count + nelems > handle->dims[0]) {
+            memcpy(hdfdims, handle->dims, rank * sizeof(hsize_t));
+            hdfdims[0] = grow_extent(dset, path, handle->dims[0], handle->count + nelems);
+            h5status = H5Dset_extent(handle->dataset, hdfdims);
+            if (h5status < 0) {
+                H5Ewalk2(H5E_DEFAULT, H5E_WALK_UPWARD, walk_hdf5_errors, NULL);
+                return ISMRMRD_PUSH_ERR(ISMRMRD_HDF5ERROR, "Failed to extend dataset");
+            }
+            if (refresh_handle(handle) != ISMRMRD_NOERROR) {
+                return ISMRMRD_PUSH_ERR(ISMRMRD_FILEERROR, "Failed to get dataset extent.");
+            }
         }
     } else {
-        hdfdims[0] = 1;
+        hdfdims[0] = grow_extent(dset, path, 0, nelems);
         maxdims[0] = H5S_UNLIMITED;
-        ext_dims[0] = 1;
-        chunk_dims[0] = 1;
         for (n = 0; n < ndim; n++) {
             hdfdims[n + 1] = dims[n];
             maxdims[n + 1] = dims[n];
-            offset[n + 1] = 0;
-            ext_dims[n + 1] = dims[n];
             chunk_dims[n + 1] = dims[n];
         }
         dataspace = H5Screate_simple(rank, hdfdims, maxdims);
         props = H5Pcreate(H5P_DATASET_CREATE);
+        if (set_compression_filters(props, get_compression(dset, path), datatype) != ISMRMRD_NOERROR) {
+            H5Sclose(dataspace);
+            H5Pclose(props);
+            return ISMRMRD_PUSH_ERR(ISMRMRD_FILEERROR, "Failed to create dataset");
+        }
         /* enable chunking so that the dataset is extensible */
+        chunk_dims[0] = get_chunk_length(dset, datatype, ndim, dims, hdfdims[0], H5Pget_nfilters(props) > 0);
         h5status = H5Pset_chunk (props, rank, chunk_dims);
         /* create */
         dataset = H5Dcreate2(dset->fileid, path, datatype, dataspace, H5P_DEFAULT, props,  H5P_DEFAULT);
+        H5Sclose(dataspace);
         if (dataset < 0) {
-            free(hdfdims);
-            free(ext_dims);
-            free(offset);
-            free(maxdims);
-            free(chunk_dims);
+            H5Pclose(props);
             H5Ewalk2(H5E_DEFAULT, H5E_WALK_UPWARD, walk_hdf5_errors, NULL);
             return ISMRMRD_PUSH_ERR(ISMRMRD_FILEERROR, "Failed to create dataset");
         }
         h5status = H5Pclose(props);
         if (h5status < 0) {
-            free(hdfdims);
-            free(ext_dims);
-            free(offset);
-            free(maxdims);
-            free(chunk_dims);
+            H5Dclose(dataset);
             H5Ewalk2(H5E_DEFAULT, H5E_WALK_UPWARD, walk_hdf5_errors, NULL);
             return ISMRMRD_PUSH_ERR(ISMRMRD_FILEERROR, "Failed to close property list");
         }
+        handle = add_handle(dset, path, dataset);
+        if (handle == NULL) {
+            return ISMRMRD_PUSH_ERR(ISMRMRD_FILEERROR, "Failed to open dataset");
+        }
+        offset[0] = 0;
+    }
+    handle->writer = true;
+    handle->count = offset[0] + nelems;
+
+#if H5_VERSION_GE(1, 10, 3)
+    /* records the size of a chunk go to the file as they are */
+    if (use_direct_chunks(handle, datatype)) {
+        size_t record_size = get_record_size(handle, datatype);
+        uint32_t e;
+        for (e = 0; e < nelems && h5status >= 0; e++) {
+            h5status = H5Dwrite_chunk(handle->dataset, H5P_DEFAULT, 0, offset, record_size,
+                    (const char *) elems + e * record_size);
+            offset[0]++;
+        }
+        if (h5status < 0) {
+            H5Ewalk2(H5E_DEFAULT, H5E_WALK_UPWARD, walk_hdf5_errors, NULL);
+            return ISMRMRD_PUSH_ERR(ISMRMRD_HDF5ERROR, "Failed to write dataset");
+        }
+        return ISMRMRD_NOERROR;
     }
+#endif
 
     /* Select the last block */
-    offset[0] = hdfdims[0]-1;
-    filespace = H5Dget_space(dataset);
-    h5status  = H5Sselect_hyperslab (filespace, H5S_SELECT_SET, offset, NULL, ext_dims, NULL);
-	
-	if (h5status < 0) {
-	
-		H5Ewalk2(H5E_DEFAULT, H5E_WALK_UPWARD, walk_hdf5_errors, NULL);
-		return ISMRMRD_PUSH_ERR(ISMRMRD_HDF5ERROR, "Failed to select hyperslab");
-	}
+    h5status  = H5Sselect_hyperslab (handle->filespace, H5S_SELECT_SET, offset, NULL, ext_dims, NULL);
+    if (h5status < 0) {
+        H5Ewalk2(H5E_DEFAULT, H5E_WALK_UPWARD, walk_hdf5_errors, NULL);
+        return ISMRMRD_PUSH_ERR(ISMRMRD_HDF5ERROR, "Failed to select hyperslab");
+    }
     memspace = H5Screate_simple(rank, ext_dims, NULL);
 
-    free(hdfdims);
-    free(ext_dims);
-    free(offset);
-    free(maxdims);
-    free(chunk_dims);
-
     /* Write it */
-    /* since this is a 1 element array we can just pass the pointer to the header */
-    h5status = H5Dwrite(dataset, datatype, memspace, filespace, H5P_DEFAULT, elem);
+    /* the elements are contiguous in memory, so the whole block goes in one call */
+    h5status = H5Dwrite(handle->dataset, datatype, memspace, handle->filespace,
+            get_transfer_properties(dset, false), elems);
     if (h5status < 0) {
+        H5Sclose(memspace);
         H5Ewalk2(H5E_DEFAULT, H5E_WALK_UPWARD, walk_hdf5_errors, NULL);
         return ISMRMRD_PUSH_ERR(ISMRMRD_HDF5ERROR, "Failed to write dataset");
     }
 
     /* Clean up */
-    h5status = H5Sclose(dataspace);
-    if (h5status < 0) {
-        H5Ewalk2(H5E_DEFAULT, H5E_WALK_UPWARD, walk_hdf5_errors, NULL);
-        return ISMRMRD_PUSH_ERR(ISMRMRD_HDF5ERROR, "Failed to close dataspace");
-    }
-    h5status = H5Sclose(filespace);
-    if (h5status < 0) {
-        H5Ewalk2(H5E_DEFAULT, H5E_WALK_UPWARD, walk_hdf5_errors, NULL);
-        return ISMRMRD_PUSH_ERR(ISMRMRD_HDF5ERROR, "Failed to close filespace");
-    }
     h5status = H5Sclose(memspace);
     if (h5status < 0) {
         H5Ewalk2(H5E_DEFAULT, H5E_WALK_UPWARD, walk_hdf5_errors, NULL);
         return ISMRMRD_PUSH_ERR(ISMRMRD_HDF5ERROR, "Failed to close memspace");
     }
-    h5status = H5Dclose(dataset);
-    if (h5status < 0) {
-        H5Ewalk2(H5E_DEFAULT, H5E_WALK_UPWARD, walk_hdf5_errors, NULL);
-        return ISMRMRD_PUSH_ERR(ISMRMRD_HDF5ERROR, "Failed to close dataset");
-    }
 
     return ISMRMRD_NOERROR;
 }
 
+static int append_element(const ISMRMRD_Dataset * dset, const char * path,
+        void * elem, const hid_t datatype,
+        const uint16_t ndim, const size_t *dims)
+{
+    return append_elements(dset, path, elem, 1, datatype, ndim, dims);
+}
+
 static int get_array_properties(const ISMRMRD_Dataset *dset, const char *path,
         uint16_t *ndim, size_t dims[ISMRMRD_NDARRAY_MAXDIM],
         uint16_t *data_type)
 {
-    hid_t dataset, filespace, hdf5type;
-    hsize_t *hdfdims = NULL;
-    herr_t h5status = 0;
-    int rank, n;
+    ISMRMRD_DatasetHandle *handle;
+    int n;
 
     if (NULL == dset) {
         return ISMRMRD_PUSH_ERR(ISMRMRD_RUNTIMEERROR, "Dataset pointer should not be NULL.");
     }
 
     /* Check path existence */
-    if (!link_exists(dset, path)) {
+    handle = find_handle(dset, path);
+    if (handle == NULL) {
         return ISMRMRD_PUSH_ERR(ISMRMRD_FILEERROR, "Path to element not found.");
     }
+    if (!handle->writer && refresh_handle(handle) != ISMRMRD_NOERROR) {
+        return ISMRMRD_PUSH_ERR(ISMRMRD_FILEERROR, "Failed to get dataset extent.");
+    }
 
-    /* open dataset */
-    dataset = H5Dopen2(dset->fileid, path, H5P_DEFAULT);
+    /* the data type of a variable never changes, only look it up once */
+    if (handle->data_type == 0) {
+        handle->data_type = get_ndarray_data_type(handle->filetype);
+    }
 
-    /* get the data type */
-    hdf5type = H5Dget_type(dataset);
+    /* set the return values - permute dimensions, leaving out the record axis */
+    *data_type = handle->data_type;
+    *ndim = (uint16_t) (handle->rank - 1);
+    for (n=0; n<handle->rank-1; n++) {
+        dims[n] = handle->dims[handle->rank-n-1];
+    }
 
-    /* get the file space */
-    filespace = H5Dget_space(dataset);
+    return ISMRMRD_NOERROR;
 
-    /* get the rank */
-    rank = H5Sget_simple_extent_ndims(filespace);
+}
 
-    /* get the dimensions */
-    hdfdims = (hsize_t *)malloc(rank * sizeof(*hdfdims));
-    h5status = H5Sget_simple_extent_dims(filespace, hdfdims, NULL);
+/* Selects nelems records from first, or the nelems records listed in increasing order.
+ * Each run of consecutive records is OR'd into the selection as one hyperslab. */
+static int select_records(ISMRMRD_DatasetHandle *handle, const uint32_t first,
+        const uint32_t nelems, const uint32_t *records)
+{
+    hsize_t offset[ISMRMRD_NDARRAY_MAXDIM + 1], count[ISMRMRD_NDARRAY_MAXDIM + 1];
+    H5S_seloper_t op = H5S_SELECT_SET;
+    herr_t h5status = 0;
+    uint32_t n, run;
+    int d;
 
-    /* set the return values - permute dimensions */
-    *data_type = get_ndarray_data_type(hdf5type);
-    *ndim = rank;
-    for (n=0; n<rank; n++) {
-        dims[n] = hdfdims[rank-n-1];
+    for (d=1; d< handle->rank; d++) {
+        offset[d] = 0;
+        count[d] = handle->dims[d];
     }
 
-    free(hdfdims);
-
-    /* clean up */
-    h5status = H5Tclose(hdf5type);
-    if (h5status < 0) {
-        H5Ewalk2(H5E_DEFAULT, H5E_WALK_UPWARD, walk_hdf5_errors, NULL);
-        return ISMRMRD_PUSH_ERR(ISMRMRD_FILEERROR, "Failed to close datatype.");
+    if (records == NULL) {
+        offset[0] = first;
+        count[0] = nelems;
+        h5status = H5Sselect_hyperslab(handle->filespace, H5S_SELECT_SET, offset, NULL, count, NULL);
     }
-    h5status = H5Sclose(filespace);
-    if (h5status < 0) {
-        H5Ewalk2(H5E_DEFAULT, H5E_WALK_UPWARD, walk_hdf5_errors, NULL);
-        return ISMRMRD_PUSH_ERR(ISMRMRD_HDF5ERROR, "Failed to close filespace");
+    for (n = 0; records != NULL && n < nelems && h5status >= 0; n += run) {
+        for (run = 1; n + run < nelems && records[n + run] == records[n] + run; run++);
+        if (n + run < nelems && records[n + run] < records[n] + run) {
+            return ISMRMRD_PUSH_ERR(ISMRMRD_RUNTIMEERROR, "Records must be listed in increasing order.");
+        }
+        offset[0] = records[n];
+        count[0] = run;
+        h5status = H5Sselect_hyperslab(handle->filespace, op, offset, NULL, count, NULL);
+        op = H5S_SELECT_OR;
     }
-    h5status = H5Dclose(dataset);
     if (h5status < 0) {
         H5Ewalk2(H5E_DEFAULT, H5E_WALK_UPWARD, walk_hdf5_errors, NULL);
-        return ISMRMRD_PUSH_ERR(ISMRMRD_HDF5ERROR, "Failed to close dataset.");
+        return ISMRMRD_PUSH_ERR(ISMRMRD_HDF5ERROR, "Failed to select hyperslab");
     }
-
     return ISMRMRD_NOERROR;
-
 }
 
-int read_element(const ISMRMRD_Dataset *dset, const char *path, void *elem,
-        const hid_t datatype, const uint32_t index)
+#if H5_VERSION_GE(1, 10, 3)
+/* Reads the records of a handle that passed use_direct_chunks one chunk at a time. Returns
+ * false when a chunk can't be read that way, e.g. because it was never written, and the
+ * caller falls back to H5Dread, which fills such records in. */
+static bool read_direct_chunks(ISMRMRD_DatasetHandle *handle, void *elems, const hid_t datatype,
+        const uint32_t first, const uint32_t nelems, const uint32_t *records)
 {
-    hid_t dataset, filespace, memspace;
-    hsize_t *hdfdims = NULL, *offset = NULL, *count = NULL;
+    hsize_t offset[ISMRMRD_NDARRAY_MAXDIM + 1], chunk_size;
+    size_t record_size = get_record_size(handle, datatype);
+    uint32_t filters = 0;
     herr_t h5status = 0;
-    int rank = 0;
+    uint32_t e;
     int n;
-    int ret_code = ISMRMRD_NOERROR;
 
+    for (n = 1; n < handle->rank; n++) {
+        offset[n] = 0;
+    }
+    for (e = 0; e < nelems && h5status >= 0; e++) {
+        offset[0] = (records != NULL) ? records[e] : first + e;
+        H5E_BEGIN_TRY {
+            h5status = H5Dget_chunk_storage_size(handle->dataset, offset, &chunk_size);
+            if (h5status >= 0 && chunk_size == record_size) {
+                h5status = H5Dread_chunk(handle->dataset, H5P_DEFAULT, offset, &filters,
+                        (char *) elems + e * record_size);
+            } else {
+                h5status = -1;
+            }
+        } H5E_END_TRY;
+    }
+    return h5status >= 0;
+}
+#endif
+
+/* Checks that a handle holds at least end records. The dataset may have grown through
+ * another handle since it was opened, or through the writer of a SWMR reader. */
+static int check_extent(const ISMRMRD_Dataset *dset, ISMRMRD_DatasetHandle *handle, const hsize_t end)
+{
+    if (end <= handle->count) {
+        return ISMRMRD_NOERROR;
+    }
+    if (handle->writer) {
+        return ISMRMRD_PUSH_ERR(ISMRMRD_FILEERROR, "Index out of range.");
+    }
+#if H5_VERSION_GE(1, 10, 0)
+    if (dset->options.swmr == ISMRMRD_SWMR_READ && H5Drefresh(handle->dataset) < 0) {
+        H5Ewalk2(H5E_DEFAULT, H5E_WALK_UPWARD, walk_hdf5_errors, NULL);
+        return ISMRMRD_PUSH_ERR(ISMRMRD_HDF5ERROR, "Failed to refresh dataset.");
+    }
+#else
+    (void)dset;
+#endif
+    if (refresh_handle(handle) != ISMRMRD_NOERROR || end > handle->count) {
+        return ISMRMRD_PUSH_ERR(ISMRMRD_FILEERROR, "Index out of range.");
+    }
+    return ISMRMRD_NOERROR;
+}
+
+/* Reads nelems records from first, or the records listed in records when it isn't NULL,
+ * into a contiguous block */
+static int read_elements(const ISMRMRD_Dataset *dset, const char *path, void *elems,
+        const hid_t datatype, const uint32_t first, const uint32_t nelems,
+        const uint32_t *records, const hid_t xfer)
+{
+    ISMRMRD_DatasetHandle *handle;
+    hid_t memspace, properties = xfer;
+    hsize_t count[ISMRMRD_NDARRAY_MAXDIM + 1], last;
+    herr_t h5status = 0;
+    int n;
 
     if (NULL == dset) {
         return ISMRMRD_PUSH_ERR(ISMRMRD_RUNTIMEERROR, "Dataset pointer should not be NULL.");
     }
 
     /* Check path existence */
-    if (!link_exists(dset, path)) {
+    handle = find_handle(dset, path);
+    if (handle == NULL) {
         return ISMRMRD_PUSH_ERR(ISMRMRD_FILEERROR, "Path to element not found.");
     }
 
-    /* open dataset */
-    dataset = H5Dopen2(dset->fileid, path, H5P_DEFAULT);
-
     /* TODO check that the dataset's datatype is correct */
-    filespace = H5Dget_space(dataset);
-
-    rank = H5Sget_simple_extent_ndims(filespace);
-
-    hdfdims = (hsize_t *)malloc(rank * sizeof(*hdfdims));
-    offset = (hsize_t *)malloc(rank * sizeof(*offset));
-    count = (hsize_t *)malloc(rank * sizeof(*count));
-
-    h5status = H5Sget_simple_extent_dims(filespace, hdfdims, NULL);
-
-    if (index >= hdfdims[0]) {
-        ret_code = ISMRMRD_PUSH_ERR(ISMRMRD_FILEERROR, "Index out of range.");
-        goto cleanup;
+    if (nelems == 0) {
+        return ISMRMRD_PUSH_ERR(ISMRMRD_FILEERROR, "Index out of range.");
+    }
+    last = (records != NULL) ? records[nelems - 1] : (hsize_t) first + nelems - 1;
+    if (check_extent(dset, handle, last + 1) != ISMRMRD_NOERROR) {
+        return ISMRMRD_FILEERROR;
     }
 
-    offset[0] = index;
-    count[0] = 1;
-    for (n=1; n< rank; n++) {
-        offset[n] = 0;
-        count[n] = hdfdims[n];
+#if H5_VERSION_GE(1, 10, 3)
+    if (use_direct_chunks(handle, datatype) && read_direct_chunks(handle, elems, datatype, first, nelems, records)) {
+        return ISMRMRD_NOERROR;
     }
+#endif
 
-    h5status = H5Sselect_hyperslab(filespace, H5S_SELECT_SET, offset, NULL, count, NULL);
+    if (select_records(handle, first, nelems, records) != ISMRMRD_NOERROR) {
+        return ISMRMRD_PUSH_ERR(ISMRMRD_FILEERROR, "Failed to select records.");
+    }
+    /* HDF5 won't convert records larger than a conversion buffer it was handed, but
+     * enlarges one it allocates itself */
+    if (properties != H5P_DEFAULT && H5Tget_size(handle->filetype) > ISMRMRD_CONVERSION_BUFFER_BYTES &&
+            H5Tequal(handle->filetype, datatype) <= 0) {
+        properties = H5P_DEFAULT;
+    }
+    count[0] = nelems;
+    for (n=1; n< handle->rank; n++) {
+        count[n] = handle->dims[n];
+    }
 
-    /* create space for one */
-    memspace = H5Screate_simple(rank, count, NULL);
+    /* create space for the contiguous block */
+    memspace = H5Screate_simple(handle->rank, count, NULL);
 
-    h5status = H5Dread(dataset, datatype, memspace, filespace, H5P_DEFAULT, elem);
+    h5status = H5Dread(handle->dataset, datatype, memspace, handle->filespace, properties, elems);
     if (h5status < 0) {
+        H5Sclose(memspace);
         H5Ewalk2(H5E_DEFAULT, H5E_WALK_UPWARD, walk_hdf5_errors, NULL);
-        ret_code = ISMRMRD_PUSH_ERR(ISMRMRD_HDF5ERROR, "Failed to read from dataset.");
-        goto cleanup;
+        return ISMRMRD_PUSH_ERR(ISMRMRD_HDF5ERROR, "Failed to read from dataset.");
     }
 
-    h5status = H5Sclose(filespace);
-    if (h5status < 0) {
-        H5Ewalk2(H5E_DEFAULT, H5E_WALK_UPWARD, walk_hdf5_errors, NULL);
-        ret_code = ISMRMRD_PUSH_ERR(ISMRMRD_HDF5ERROR, "Failed to close filespace.");
-        goto cleanup;
-    }
     h5status = H5Sclose(memspace);
     if (h5status < 0) {
         H5Ewalk2(H5E_DEFAULT, H5E_WALK_UPWARD, walk_hdf5_errors, NULL);
-        ret_code = ISMRMRD_PUSH_ERR(ISMRMRD_HDF5ERROR, "Failed to close memspace.");
-        goto cleanup;
-    }
-    h5status = H5Dclose(dataset);
-    if (h5status < 0) {
-        H5Ewalk2(H5E_DEFAULT, H5E_WALK_UPWARD, walk_hdf5_errors, NULL);
-        ret_code = ISMRMRD_PUSH_ERR(ISMRMRD_HDF5ERROR, "Failed to close dataset.");
-        goto cleanup;
+        return ISMRMRD_PUSH_ERR(ISMRMRD_HDF5ERROR, "Failed to close memspace.");
     }
 
-cleanup:
-    free(count);
-    free(offset);
-    free(hdfdims);
-    return ret_code;
+    return ISMRMRD_NOERROR;
 }
 
-/********************/
-/* Public functions */
-/********************/
-int ismrmrd_init_dataset(ISMRMRD_Dataset *dset, const char *filename,
-        const char *groupname)
+int read_element(const ISMRMRD_Dataset *dset, const char *path, void *elem,
+        const hid_t datatype, const uint32_t index)
 {
-    if (NULL == dset) {
-        return ISMRMRD_PUSH_ERR(ISMRMRD_RUNTIMEERROR, "NULL Dataset parameter");
-    }
+    return read_elements(dset, path, elem, datatype, index, 1, NULL, get_transfer_properties(dset, false));
+}
 
-    /* Disable HDF5 automatic error prenting */
-    H5Eset_auto2(H5E_DEFAULT, NULL, NULL);
+/* Hands the payload buffers of acquisitions made consistent with their headers to HDF5,
+ * so variable length fields are decoded in place instead of into fresh mallocs.
+ * HDF5 converts the records in order and doesn't allocate empty sequences. */
+typedef struct ISMRMRD_VlenBuffers {
+    ISMRMRD_Acquisition *acqs;
+    uint32_t count;
+    uint32_t next;
+    bool data;   /* hand out the data buffers rather than the trajectories */
+} ISMRMRD_VlenBuffers;
+
+static size_t vlen_buffer_size(const ISMRMRD_VlenBuffers *buffers, const uint32_t n) {
+    if (buffers->data) {
+        return ismrmrd_size_of_acquisition_data(&buffers->acqs[n]);
+    }
+    return ismrmrd_size_of_acquisition_traj(&buffers->acqs[n]);
+}
 
-    dset->filename = (char *) malloc(strlen(filename) + 1);
-    if (dset->filename == NULL) {
-        return ISMRMRD_PUSH_ERR(ISMRMRD_MEMORYERROR, "Failed to malloc dataset filename");
+static void *vlen_buffer_alloc(size_t size, void *info) {
+    ISMRMRD_VlenBuffers *buffers = (ISMRMRD_VlenBuffers *) info;
+    ISMRMRD_Acquisition *acq;
+
+    while (buffers->next < buffers->count && vlen_buffer_size(buffers, buffers->next) == 0) {
+        buffers->next++;
     }
-    strcpy(dset->filename, filename);
+    if (buffers->next < buffers->count && vlen_buffer_size(buffers, buffers->next) == size) {
+        acq = &buffers->acqs[buffers->next++];
+        return buffers->data ? (void *) acq->data : (void *) acq->traj;
+    }
+    /* the file doesn't match the headers, stop handing out buffers and let the caller copy */
+    buffers->count = 0;
+    return malloc(size);
+}
 
-    dset->groupname = (char *) malloc(strlen(groupname) + 1);
-    if (dset->groupname == NULL) {
-        return ISMRMRD_PUSH_ERR(ISMRMRD_MEMORYERROR, "Failed to malloc dataset groupname");
+static void vlen_buffer_free(void *ptr, void *info) {
+    ISMRMRD_VlenBuffers *buffers = (ISMRMRD_VlenBuffers *) info;
+    uint32_t n;
+
+    for (n = 0; n < buffers->next; n++) {
+        if (ptr == buffers->acqs[n].traj || ptr == buffers->acqs[n].data) {
+            return;
+        }
     }
-    strcpy(dset->groupname, groupname);
+    free(ptr);
+}
 
-    dset->fileid = 0;
-    return ISMRMRD_NOERROR;
+/* Objects in a repacked file, and the fields of a repacked acquisition, start on
+ * multiples of this, so samples mapped into memory are aligned for their type */
+#define ISMRMRD_REPACK_ALIGNMENT 8
+
+static hsize_t align_repacked(const hsize_t size) {
+    return (size + ISMRMRD_REPACK_ALIGNMENT - 1) / ISMRMRD_REPACK_ALIGNMENT * ISMRMRD_REPACK_ALIGNMENT;
 }
 
-int ismrmrd_open_dataset(ISMRMRD_Dataset *dset, const bool create_if_needed) {
-    /* TODO add a mode for clobbering the dataset if it exists. */
-    hid_t fileid;
+/* The type of repacked acquisitions: the header, then the trajectory and the data padded
+ * to the longest in the file, each aligned */
+static hid_t build_hdf5type_repacked_acquisition(const hsize_t traj_length, const hsize_t data_length)
+{
+    hsize_t traj_offset, data_offset;
+    hid_t datatype, arraytype;
+    herr_t h5status;
 
-    if (NULL == dset) {
-        ISMRMRD_PUSH_ERR(ISMRMRD_RUNTIMEERROR, "NULL Dataset parameter");
-        return false;
+    traj_offset = align_repacked(sizeof(ISMRMRD_AcquisitionHeader));
+    data_offset = align_repacked(traj_offset + traj_length * sizeof(float));
+    datatype = H5Tcreate(H5T_COMPOUND, align_repacked(data_offset + data_length * sizeof(float)));
+    h5status = H5Tinsert(datatype, "head", 0, get_hdf5type_acquisitionheader());
+    if (traj_length > 0) {
+        arraytype = H5Tarray_create2(get_hdf5type_float(), 1, &traj_length);
+        h5status = H5Tinsert(datatype, "traj", traj_offset, arraytype);
+        H5Tclose(arraytype);
+    }
+    arraytype = H5Tarray_create2(get_hdf5type_float(), 1, &data_length);
+    h5status = H5Tinsert(datatype, "data", data_offset, arraytype);
+    H5Tclose(arraytype);
+    if (h5status < 0) {
+        H5Ewalk2(H5E_DEFAULT, H5E_WALK_UPWARD, walk_hdf5_errors, NULL);
+        ISMRMRD_PUSH_ERR(ISMRMRD_HDF5ERROR, "Failed get repacked acquisition data type");
+        H5Tclose(datatype);
+        return -1;
     }
+    return datatype;
+}
 
-    /* Try opening the file */
-    /* Note the is_hdf5 function doesn't work well when trying to open multiple files */
-    fileid = H5Fopen(dset->filename, H5F_ACC_RDWR, H5P_DEFAULT);
+/* The number of floats in the field name of acquisitions repacked to fixed size records,
+ * see ismrmrd_repack_dataset, or 0 when the field is variable length or missing */
+static hsize_t get_fixed_field_length(const hid_t filetype, const char *name)
+{
+    hid_t fieldtype;
+    hsize_t length = 0;
+    int index;
 
-    if (fileid > 0) {
-        dset->fileid = fileid;
+    index = H5Tget_member_index(filetype, name);
+    if (index < 0) {
+        return 0;
     }
-    else if (create_if_needed == false) {
-        /*Try opening the file as read-only*/
-        fileid = H5Fopen(dset->filename, H5F_ACC_RDONLY, H5P_DEFAULT);
-        if (fileid > 0) {
-            dset->fileid = fileid;
-        }
-        else{
-            H5Ewalk2(H5E_DEFAULT, H5E_WALK_UPWARD, walk_hdf5_errors, NULL);
-            /* Some sort of error opening the file - Maybe it doesn't exist? */
-            return ISMRMRD_PUSH_ERR(ISMRMRD_FILEERROR, "Failed to open file.");
-        }
+    fieldtype = H5Tget_member_type(filetype, (unsigned) index);
+    if (fieldtype >= 0 && H5Tget_class(fieldtype) == H5T_ARRAY && H5Tget_array_ndims(fieldtype) == 1) {
+        H5Tget_array_dims2(fieldtype, &length);
     }
-    else {
-        /* Try creating a new file using the default properties. */
-        /* this will be readwrite */
-        fileid = H5Fcreate(dset->filename, H5F_ACC_TRUNC, H5P_DEFAULT, H5P_DEFAULT);
-        if (fileid > 0) {
-            dset->fileid = fileid;
-        }
-        else {
-            /* Error opening the file */
-            H5Ewalk2(H5E_DEFAULT, H5E_WALK_UPWARD, walk_hdf5_errors, NULL);
-            return ISMRMRD_PUSH_ERR(ISMRMRD_FILEERROR, "Failed to open file.");
-        }
+    if (fieldtype >= 0) {
+        H5Tclose(fieldtype);
     }
-    /* Open the existing dataset */
-    /* ensure that /groupname exists */
-    create_link(dset, dset->groupname);
-
-    return ISMRMRD_NOERROR;
+    return length;
 }
 
-int ismrmrd_close_dataset(ISMRMRD_Dataset *dset) {
-    herr_t h5status;
+/* Reads one fixed size field of a block of acquisitions and copies it to their buffers */
+static int read_fixed_acquisition_payload(const ISMRMRD_Dataset *dset, ISMRMRD_Acquisition *acqs,
+        const uint32_t first, const uint32_t count, const uint32_t *records,
+        const hsize_t length, const bool data)
+{
+    hid_t arraytype, datatype;
+    float *block;
+    int status;
+    uint32_t n;
+    size_t size;
 
-    if (NULL == dset) {
-        ISMRMRD_PUSH_ERR(ISMRMRD_RUNTIMEERROR, "NULL Dataset parameter");
-        return false;
+    block = (float *) malloc(count * length * sizeof(float));
+    if (block == NULL) {
+        return ISMRMRD_PUSH_ERR(ISMRMRD_MEMORYERROR, "Failed to malloc acquisition block.");
+    }
+    arraytype = H5Tarray_create2(get_hdf5type_float(), 1, &length);
+    datatype = H5Tcreate(H5T_COMPOUND, length * sizeof(float));
+    if (arraytype < 0 || datatype < 0 || H5Tinsert(datatype, data ? "data" : "traj", 0, arraytype) < 0) {
+        H5Ewalk2(H5E_DEFAULT, H5E_WALK_UPWARD, walk_hdf5_errors, NULL);
+        status = ISMRMRD_PUSH_ERR(ISMRMRD_HDF5ERROR, "Failed to get acquisition payload data type");
+    }
+    else {
+        status = read_elements(dset, dset->cache->datapath, block, datatype, first, count, records,
+                get_transfer_properties(dset, false));
+    }
+    if (status == ISMRMRD_NOERROR) {
+        /* records are padded to the longest one in the file */
+        for (n = 0; n < count; n++) {
+            size = data ? ismrmrd_size_of_acquisition_data(&acqs[n]) : ismrmrd_size_of_acquisition_traj(&acqs[n]);
+            if (size > length * sizeof(float)) {
+                size = length * sizeof(float);
+            }
+            if (size > 0) {
+                memcpy(data ? (void *) acqs[n].data : (void *) acqs[n].traj, block + n * length, size);
+            }
+        }
+    }
+    if (datatype >= 0) {
+        H5Tclose(datatype);
+    }
+    if (arraytype >= 0) {
+        H5Tclose(arraytype);
     }
+    free(block);
+    return status;
+}
 
-    if (dset->filename != NULL) {
-        free(dset->filename);
-        dset->filename = NULL;
+/* Reads one variable length field of a block of acquisitions into their own buffers */
+static int read_acquisition_payload(const ISMRMRD_Dataset *dset, ISMRMRD_Acquisition *acqs,
+        const uint32_t first, const uint32_t count, const uint32_t *records,
+        hvl_t *payload, const bool data)
+{
+    ISMRMRD_VlenBuffers buffers;
+    ISMRMRD_DatasetHandle *handle;
+    hsize_t length;
+    hid_t xfer;
+    int status;
+    uint32_t n;
+    size_t size, len;
+    void *dest;
+
+    buffers.acqs = acqs;
+    buffers.count = count;
+    buffers.next = 0;
+    buffers.data = data;
+
+    /* nothing to read, e.g. no trajectories */
+    for (n = 0; n < count; n++) {
+        if (vlen_buffer_size(&buffers, n) > 0) {
+            break;
+        }
+    }
+    if (n == count) {
+        return ISMRMRD_NOERROR;
     }
 
-    if (dset->groupname != NULL) {
-        free(dset->groupname);
-        dset->groupname = NULL;
+    handle = find_handle(dset, dset->cache->datapath);
+    if (handle == NULL) {
+        return ISMRMRD_PUSH_ERR(ISMRMRD_FILEERROR, "Path to element not found.");
+    }
+    length = get_fixed_field_length(handle->filetype, data ? "data" : "traj");
+    if (length > 0) {
+        return read_fixed_acquisition_payload(dset, acqs, first, count, records, length, data);
     }
 
-    /* Check for a valid fileid before trying to close the file */
-    if (dset->fileid > 0) {
-        h5status = H5Fclose (dset->fileid);
-        dset->fileid = 0;
-        if (h5status < 0) {
-            H5Ewalk2(H5E_DEFAULT, H5E_WALK_UPWARD, walk_hdf5_errors, NULL);
-            return ISMRMRD_PUSH_ERR(ISMRMRD_FILEERROR, "Failed to close dataset.");
+    xfer = get_transfer_properties(dset, true);
+    if (xfer == H5P_DEFAULT) {
+        xfer = H5Pcreate(H5P_DATASET_XFER);
+    }
+    if (xfer < 0 || H5Pset_vlen_mem_manager(xfer, vlen_buffer_alloc, &buffers, vlen_buffer_free, &buffers) < 0) {
+        H5Ewalk2(H5E_DEFAULT, H5E_WALK_UPWARD, walk_hdf5_errors, NULL);
+        if (xfer >= 0 && xfer != dset->cache->vlen_xfer) {
+            H5Pclose(xfer);
         }
+        return ISMRMRD_PUSH_ERR(ISMRMRD_HDF5ERROR, "Failed to set vlen memory manager.");
+    }
+    memset(payload, 0, count * sizeof(hvl_t));
+    status = read_elements(dset, dset->cache->datapath, payload,
+            data ? get_hdf5type_acquisition_data() : get_hdf5type_acquisition_traj(),
+            first, count, records, xfer);
+    if (xfer != dset->cache->vlen_xfer) {
+        H5Pclose(xfer);
     }
 
-    return ISMRMRD_NOERROR;
+    /* copy whatever didn't land in place, the file has to match the headers */
+    for (n = 0; n < count; n++) {
+        dest = data ? (void *) acqs[n].data : (void *) acqs[n].traj;
+        if (payload[n].p == dest) {
+            continue;
+        }
+        size = vlen_buffer_size(&buffers, n);
+        len = payload[n].len * sizeof(float);
+        if (status == ISMRMRD_NOERROR && len != size) {
+            status = ISMRMRD_PUSH_ERR(ISMRMRD_FILEERROR, "Acquisition samples don't match their header.");
+        }
+        if (status == ISMRMRD_NOERROR && len > 0) {
+            memcpy(dest, payload[n].p, len);
+        }
+        /* leaves the buffers of the acquisitions alone */
+        if (payload[n].p != NULL) {
+            vlen_buffer_free(payload[n].p, &buffers);
+        }
+    }
+    return status;
 }
 
-int ismrmrd_write_header(const ISMRMRD_Dataset *dset, const char *xmlstring) {
-    hid_t dataset, dataspace, datatype, props;
-    hsize_t dims[] = {1};
-    herr_t h5status;
-    void *buff[1];
-    char * path;
-
-    if (dset==NULL) {
-        return ISMRMRD_PUSH_ERR(ISMRMRD_RUNTIMEERROR, "Dataset pointer should not be NULL.");
+/* Whether the samples of the acquisitions are kept in datasets of their own, which the
+ * compression profiles can filter. That is decided when the acquisitions are created:
+ * with a compression profile for them they leave the variable length fields of their
+ * records empty and append their samples to the samples and trajectories datasets, the
+ * offsets dataset holds where the samples of each record start. */
+static bool samples_apart(const ISMRMRD_Dataset *dset, ISMRMRD_DatasetHandle *handle)
+{
+    if (handle == NULL) {
+        return get_compression(dset, dset->cache->datapath) != ISMRMRD_COMPRESSION_NONE;
     }
-
-    if (xmlstring==NULL) {
-        return ISMRMRD_PUSH_ERR(ISMRMRD_RUNTIMEERROR, "xmlstring should not be NULL.");
+    if (handle->separate_samples == 0) {
+        handle->separate_samples = link_exists(dset, dset->cache->offsetpath) ? 1 : -1;
     }
+    return handle->separate_samples > 0;
+}
 
-    /* The path to the xml header */
-    path = make_path(dset, "xml");
-
-    /* Delete the old header if it exists */
-    h5status = delete_var(dset, "xml");
+/* Reads the samples of count acquisitions starting at the given offsets, in elements of
+ * datatype, into their data or trajectory buffers. The samples of consecutive records lie
+ * one after the other, so each run of them is OR'd into the selection as one hyperslab. */
+static int read_sample_runs(const ISMRMRD_Dataset *dset, const char *path, const hid_t datatype,
+        const HDF5_SampleOffsets *offsets, ISMRMRD_Acquisition *acqs, const uint32_t count, const bool data)
+{
+    ISMRMRD_DatasetHandle *handle;
+    H5S_seloper_t op = H5S_SELECT_SET;
+    hsize_t start, length, run_start = 0, run_length = 0, end = 0, total = 0;
+    size_t element_size = H5Tget_size(datatype);
+    hid_t memspace;
+    herr_t h5status = 0;
+    char *block = NULL, *dest = NULL;
+    uint32_t n, filled = 0;
 
-    /* Create a new dataset for the xmlstring */
-    /* i.e. create the memory type, data space, and data set */
-    dataspace = H5Screate_simple(1, dims, NULL);
-    datatype = get_hdf5type_xmlheader();
-    props = H5Pcreate (H5P_DATASET_CREATE);
-    dataset = H5Dcreate2(dset->fileid, path, datatype, dataspace, H5P_DEFAULT, props,  H5P_DEFAULT);
-    free(path);
+    for (n = 0; n < count; n++) {
+        length = (data ? ismrmrd_size_of_acquisition_data(&acqs[n]) : ismrmrd_size_of_acquisition_traj(&acqs[n])) / element_size;
+        if (length == 0) {
+            continue;
+        }
+        start = data ? offsets[n].data : offsets[n].traj;
+        if (start < end) {
+            return ISMRMRD_PUSH_ERR(ISMRMRD_FILEERROR, "Acquisition samples overlap.");
+        }
+        end = start + length;
+        total += length;
+        filled++;
+        dest = data ? (char *) acqs[n].data : (char *) acqs[n].traj;
+    }
+    /* nothing to read, e.g. no trajectories */
+    if (total == 0) {
+        return ISMRMRD_NOERROR;
+    }
 
-    /* Write it out */
-    /* We have to wrap the xmlstring in an array */
-    buff[0] = (void *) xmlstring;  /* safe to get rid of const the type */
-    h5status = H5Dwrite(dataset, datatype, H5S_ALL, H5S_ALL, H5P_DEFAULT, buff);
-    if (h5status < 0) {
-        H5Ewalk2(H5E_DEFAULT, H5E_WALK_UPWARD, walk_hdf5_errors, NULL);
-        return ISMRMRD_PUSH_ERR(ISMRMRD_HDF5ERROR, "Failed to write xml string to dataset");
+    handle = find_handle(dset, path);
+    if (handle == NULL) {
+        return ISMRMRD_PUSH_ERR(ISMRMRD_FILEERROR, "Path to element not found.");
+    }
+    if (handle->rank != 1) {
+        return ISMRMRD_PUSH_ERR(ISMRMRD_FILEERROR, "Dimensions are incorrect.");
+    }
+    if (check_extent(dset, handle, end) != ISMRMRD_NOERROR) {
+        return ISMRMRD_FILEERROR;
     }
 
-    /* Clean up */
-    h5status = H5Pclose(props);
-    if (h5status < 0) {
-        H5Ewalk2(H5E_DEFAULT, H5E_WALK_UPWARD, walk_hdf5_errors, NULL);
-        return ISMRMRD_PUSH_ERR(ISMRMRD_FILEERROR, "Failed to close property list.");
+    for (n = 0; n < count && h5status >= 0; n++) {
+        length = (data ? ismrmrd_size_of_acquisition_data(&acqs[n]) : ismrmrd_size_of_acquisition_traj(&acqs[n])) / element_size;
+        start = data ? offsets[n].data : offsets[n].traj;
+        if (length > 0 && run_length > 0 && start != run_start + run_length) {
+            h5status = H5Sselect_hyperslab(handle->filespace, op, &run_start, NULL, &run_length, NULL);
+            op = H5S_SELECT_OR;
+            run_length = 0;
+        }
+        if (length > 0 && run_length == 0) {
+            run_start = start;
+        }
+        run_length += length;
     }
-    h5status = H5Tclose(datatype);
-    if (h5status < 0) {
-        H5Ewalk2(H5E_DEFAULT, H5E_WALK_UPWARD, walk_hdf5_errors, NULL);
-        return ISMRMRD_PUSH_ERR(ISMRMRD_FILEERROR, "Failed to close datatype.");
+    if (h5status >= 0) {
+        h5status = H5Sselect_hyperslab(handle->filespace, op, &run_start, NULL, &run_length, NULL);
     }
-    h5status = H5Sclose(dataspace);
     if (h5status < 0) {
         H5Ewalk2(H5E_DEFAULT, H5E_WALK_UPWARD, walk_hdf5_errors, NULL);
-        return ISMRMRD_PUSH_ERR(ISMRMRD_FILEERROR, "Failed to close dataspace.");
+        return ISMRMRD_PUSH_ERR(ISMRMRD_HDF5ERROR, "Failed to select hyperslab");
     }
-    h5status = H5Dclose(dataset);
+
+    /* the samples of a single acquisition go straight into its buffer */
+    if (filled > 1) {
+        block = (char *) malloc((size_t) total * element_size);
+        if (block == NULL) {
+            return ISMRMRD_PUSH_ERR(ISMRMRD_MEMORYERROR, "Failed to malloc sample block.");
+        }
+        dest = block;
+    }
+    memspace = H5Screate_simple(1, &total, NULL);
+    h5status = H5Dread(handle->dataset, datatype, memspace, handle->filespace, get_transfer_properties(dset, false), dest);
+    H5Sclose(memspace);
     if (h5status < 0) {
+        free(block);
         H5Ewalk2(H5E_DEFAULT, H5E_WALK_UPWARD, walk_hdf5_errors, NULL);
-        return ISMRMRD_PUSH_ERR(ISMRMRD_FILEERROR, "Failed to close dataset.");
+        return ISMRMRD_PUSH_ERR(ISMRMRD_HDF5ERROR, "Failed to read from dataset.");
     }
 
+    for (n = 0; block != NULL && n < count; n++) {
+        length = data ? ismrmrd_size_of_acquisition_data(&acqs[n]) : ismrmrd_size_of_acquisition_traj(&acqs[n]);
+        if (length > 0) {
+            memcpy(data ? (void *) acqs[n].data : (void *) acqs[n].traj, dest, length);
+            dest += length;
+        }
+    }
+    free(block);
     return ISMRMRD_NOERROR;
 }
 
-char * ismrmrd_read_header(const ISMRMRD_Dataset *dset) {
-    hid_t dataset, datatype;
-    herr_t h5status;
-    char* xmlstring = NULL;
-    char* path = NULL;
+/* Reads the trajectories and data of acquisitions whose samples are kept apart */
+static int read_separate_payloads(const ISMRMRD_Dataset *dset, const uint32_t first,
+        const uint32_t count, const uint32_t *records, ISMRMRD_Acquisition *acqs)
+{
+    HDF5_SampleOffsets *offsets;
+    int status;
 
-    if (dset==NULL) {
-        ISMRMRD_PUSH_ERR(ISMRMRD_RUNTIMEERROR, "Pointer should not be NULL.");
-        return NULL;
+    offsets = (HDF5_SampleOffsets *) malloc(count * sizeof(HDF5_SampleOffsets));
+    if (offsets == NULL) {
+        return ISMRMRD_PUSH_ERR(ISMRMRD_MEMORYERROR, "Failed to malloc sample offsets.");
     }
+    status = read_elements(dset, dset->cache->offsetpath, offsets, get_hdf5type_sample_offsets(),
+            first, count, records, get_transfer_properties(dset, false));
+    if (status == ISMRMRD_NOERROR) {
+        status = read_sample_runs(dset, dset->cache->trajpath, get_hdf5type_float(), offsets, acqs, count, false);
+    }
+    if (status == ISMRMRD_NOERROR) {
+        status = read_sample_runs(dset, dset->cache->samplepath, get_hdf5type_complexfloat(), offsets, acqs, count, true);
+    }
+    free(offsets);
+    return status;
+}
 
-    /* The path to the xml header */
-    path = make_path(dset, "xml");
+/* Sizes acqs from the headers already in place and reads their trajectories and data */
+static int read_acquisition_payloads(const ISMRMRD_Dataset *dset, const uint32_t first,
+        const uint32_t count, const uint32_t *records, ISMRMRD_Acquisition *acqs)
+{
+    hvl_t *payload;
+    int status = ISMRMRD_NOERROR;
+    uint32_t n;
 
-    if (!link_exists(dset, path)) {
-        /* No XML String found */
-        ISMRMRD_PUSH_ERR(ISMRMRD_RUNTIMEERROR, "No XML Header found.");
-        goto cleanup_path;
+    for (n = 0; n < count && status == ISMRMRD_NOERROR; n++) {
+        /* reuses the existing buffers when the shape hasn't changed */
+        status = ismrmrd_make_consistent_acquisition(&acqs[n]);
     }
-
-    dataset = H5Dopen2(dset->fileid, path, H5P_DEFAULT);
-    datatype = get_hdf5type_xmlheader();
-    /* Read it into a 1D buffer*/
-    h5status = H5Dread(dataset, datatype, H5S_ALL, H5S_ALL, H5P_DEFAULT, &xmlstring);
-    if (h5status < 0 || xmlstring == NULL) {
-        H5Ewalk2(H5E_DEFAULT, H5E_WALK_UPWARD, walk_hdf5_errors, NULL);
-        ISMRMRD_PUSH_ERR(ISMRMRD_FILEERROR, "Failed to read header.");
-        goto cleanup_path;
+    if (status != ISMRMRD_NOERROR) {
+        return status;
+    }
+    if (samples_apart(dset, find_handle(dset, dset->cache->datapath))) {
+        return read_separate_payloads(dset, first, count, records, acqs);
     }
 
-    /* Clean up */
-    h5status = H5Tclose(datatype);
-    if (h5status < 0) {
-        H5Ewalk2(H5E_DEFAULT, H5E_WALK_UPWARD, walk_hdf5_errors, NULL);
-        ISMRMRD_PUSH_ERR(ISMRMRD_FILEERROR, "Failed to close XML header HDF5 datatype.");
-        goto cleanup_xmlstring;
+    payload = (hvl_t *) malloc(count * sizeof(hvl_t));
+    if (payload == NULL) {
+        return ISMRMRD_PUSH_ERR(ISMRMRD_MEMORYERROR, "Failed to malloc acquisition block.");
     }
-    h5status = H5Dclose(dataset);
-    if (h5status < 0) {
-        H5Ewalk2(H5E_DEFAULT, H5E_WALK_UPWARD, walk_hdf5_errors, NULL);
-        ISMRMRD_PUSH_ERR(ISMRMRD_FILEERROR, "Failed to close XML header HDF5 dataset.");
-        goto cleanup_xmlstring;
+    status = read_acquisition_payload(dset, acqs, first, count, records, payload, false);
+    if (status == ISMRMRD_NOERROR) {
+        status = read_acquisition_payload(dset, acqs, first, count, records, payload, true);
     }
 
-    goto cleanup_path;
-
-cleanup_xmlstring:
-    free(xmlstring);
-    xmlstring = NULL;
-cleanup_path:
-    free(path);
-    return xmlstring;
+    free(payload);
+    return status;
 }
 
-uint32_t ismrmrd_get_number_of_acquisitions(const ISMRMRD_Dataset *dset) {
-    char *path;
-    uint32_t numacq;
+/* Whether the acquisitions are repacked to fixed size records of the native type,
+ * which can be read without conversion */
+static bool use_fixed_records(ISMRMRD_DatasetHandle *handle)
+{
+    hsize_t traj_length, data_length;
+    hid_t datatype;
 
-    if (dset==NULL) {
-        ISMRMRD_PUSH_ERR(ISMRMRD_RUNTIMEERROR, "Pointer should not be NULL.");
-        return 0;
+    if (handle->fixed_records == 0) {
+        handle->fixed_records = -1;
+        traj_length = get_fixed_field_length(handle->filetype, "traj");
+        data_length = get_fixed_field_length(handle->filetype, "data");
+        datatype = data_length > 0 ? build_hdf5type_repacked_acquisition(traj_length, data_length) : -1;
+        if (datatype >= 0 && H5Tequal(datatype, handle->filetype) > 0) {
+            handle->fixed_records = 1;
+            handle->fixed_type = datatype;
+        }
+        else if (datatype >= 0) {
+            H5Tclose(datatype);
+        }
     }
-    /* The path to the acqusition data */    
-    path = make_path(dset, "data");
-    numacq = get_number_of_elements(dset, path);
-    free(path);
-    return numacq;
+    return handle->fixed_records > 0;
 }
 
-int ismrmrd_append_acquisition(const ISMRMRD_Dataset *dset, const ISMRMRD_Acquisition *acq) {
+/* Reads whole repacked records in one go and splits them into the acquisitions */
+static int read_fixed_acquisition_block(const ISMRMRD_Dataset *dset, ISMRMRD_DatasetHandle *handle,
+        const uint32_t first, const uint32_t count, const uint32_t *records, ISMRMRD_Acquisition *acqs)
+{
+    size_t record_size, traj_offset, data_offset, traj_room, data_room, size;
+    char *block, *record;
     int status;
-    char *path;
-    hid_t datatype;
-    HDF5_Acquisition hdf5acq[1];
+    uint32_t n;
+
+    record_size = H5Tget_size(handle->fixed_type);
+    traj_offset = H5Tget_member_offset(handle->fixed_type, 1);
+    data_offset = H5Tget_member_offset(handle->fixed_type, H5Tget_nmembers(handle->fixed_type) - 1);
+    traj_room = (data_offset > traj_offset) ? data_offset - traj_offset : 0;
+    data_room = record_size - data_offset;
+
+    block = (char *) malloc(count * record_size);
+    if (block == NULL) {
+        return ISMRMRD_PUSH_ERR(ISMRMRD_MEMORYERROR, "Failed to malloc acquisition block.");
+    }
+    status = read_elements(dset, dset->cache->datapath, block, handle->fixed_type, first, count, records,
+            get_transfer_properties(dset, false));
+    for (n = 0; n < count && status == ISMRMRD_NOERROR; n++) {
+        record = block + n * record_size;
+        memcpy(&acqs[n].head, record, sizeof(ISMRMRD_AcquisitionHeader));
+        /* reuses the existing buffers when the shape hasn't changed */
+        status = ismrmrd_make_consistent_acquisition(&acqs[n]);
+        if (status != ISMRMRD_NOERROR) {
+            break;
+        }
+        size = ismrmrd_size_of_acquisition_traj(&acqs[n]);
+        if (size > 0) {
+            memcpy(acqs[n].traj, record + traj_offset, size < traj_room ? size : traj_room);
+        }
+        size = ismrmrd_size_of_acquisition_data(&acqs[n]);
+        memcpy(acqs[n].data, record + data_offset, size < data_room ? size : data_room);
+    }
+    free(block);
+    return status;
+}
 
-    if (dset==NULL) {
-        return ISMRMRD_PUSH_ERR(ISMRMRD_RUNTIMEERROR, "Dataset pointer should not be NULL.");
+/* Reads a block of acquisitions, or the listed records: the headers first, so the
+ * acquisitions can be sized, then the trajectories and data straight into their buffers */
+static int read_acquisition_block(const ISMRMRD_Dataset *dset, const uint32_t first,
+        const uint32_t count, const uint32_t *records, ISMRMRD_Acquisition *acqs)
+{
+    ISMRMRD_DatasetHandle *handle;
+    ISMRMRD_AcquisitionHeader *heads;
+    int status;
+    uint32_t n;
+
+    handle = find_handle(dset, dset->cache->datapath);
+    if (handle != NULL && use_fixed_records(handle)) {
+        return read_fixed_acquisition_block(dset, handle, first, count, records, acqs);
     }
-    if (acq==NULL) {
-        return ISMRMRD_PUSH_ERR(ISMRMRD_RUNTIMEERROR, "Acquisition pointer should not be NULL.");
+
+    heads = (ISMRMRD_AcquisitionHeader *) malloc(count * sizeof(ISMRMRD_AcquisitionHeader));
+    if (heads == NULL) {
+        return ISMRMRD_PUSH_ERR(ISMRMRD_MEMORYERROR, "Failed to malloc acquisition block.");
     }
 
-    /* The path to the acqusition data */    
-    path = make_path(dset, "data");
+    status = read_elements(dset, dset->cache->datapath, heads, get_hdf5type_acquisition_head(),
+            first, count, records, get_transfer_properties(dset, false));
+    if (status == ISMRMRD_NOERROR) {
+        for (n = 0; n < count; n++) {
+            memcpy(&acqs[n].head, &heads[n], sizeof(ISMRMRD_AcquisitionHeader));
+        }
+        status = read_acquisition_payloads(dset, first, count, records, acqs);
+    }
 
-    /* The acquisition datatype */
-    datatype = get_hdf5type_acquisition();
+    free(heads);
+    return status;
+}
 
-    /* Create the HDF5 version of the acquisition */
-    hdf5acq[0].head = acq->head;
-    hdf5acq[0].traj.len = acq->head.number_of_samples * acq->head.trajectory_dimensions;
-    hdf5acq[0].traj.p = acq->traj;
-    hdf5acq[0].data.len = 2 * acq->head.number_of_samples * acq->head.active_channels;
-    hdf5acq[0].data.p = acq->data;
+/* Acquisitions are indexed and scanned in blocks of this many headers */
+#define ISMRMRD_INDEX_BLOCK 4096
 
-    /* Write it */
-    status = append_element(dset, path, hdf5acq, datatype, 0, NULL);
-    if (status != ISMRMRD_NOERROR) {
-        return ISMRMRD_PUSH_ERR(ISMRMRD_FILEERROR, "Failed to append acquisition.");
+static void make_index_entry(HDF5_IndexEntry *entry, const ISMRMRD_AcquisitionHeader *head) {
+    entry->flags = head->flags;
+    entry->idx = head->idx;
+}
+
+/* Fills entries with the index of count acquisitions from first, read from their headers */
+static int read_index_from_headers(const ISMRMRD_Dataset *dset, HDF5_IndexEntry *entries,
+        const uint32_t first, const uint32_t count)
+{
+    ISMRMRD_AcquisitionHeader *heads;
+    uint32_t n, done, block;
+    int status = ISMRMRD_NOERROR;
+
+    heads = (ISMRMRD_AcquisitionHeader *) malloc(ISMRMRD_INDEX_BLOCK * sizeof(ISMRMRD_AcquisitionHeader));
+    if (heads == NULL) {
+        return ISMRMRD_PUSH_ERR(ISMRMRD_MEMORYERROR, "Failed to malloc header block.");
     }
+    for (done = 0; done < count && status == ISMRMRD_NOERROR; done += block) {
+        block = (count - done < ISMRMRD_INDEX_BLOCK) ? count - done : ISMRMRD_INDEX_BLOCK;
+        status = read_elements(dset, dset->cache->datapath, heads, get_hdf5type_acquisition_head(),
+                first + done, block, NULL, get_transfer_properties(dset, false));
+        for (n = 0; n < block && status == ISMRMRD_NOERROR; n++) {
+            make_index_entry(&entries[done + n], &heads[n]);
+        }
+    }
+    free(heads);
+    return status;
+}
 
-    free(path);
+/* Keeps the stored index in step with the acquisitions just appended */
+static int update_acquisition_index(const ISMRMRD_Dataset *dset, const ISMRMRD_Acquisition *acqs,
+        const uint32_t nacqs)
+{
+    HDF5_IndexEntry *entries;
+    uint32_t n;
+    int status;
 
-    /* Clean up */
-    status = H5Tclose(datatype);
-    if (status < 0) {
-        H5Ewalk2(H5E_DEFAULT, H5E_WALK_UPWARD, walk_hdf5_errors, NULL);
-        return ISMRMRD_PUSH_ERR(ISMRMRD_HDF5ERROR, "Failed to close datatype.");
+    /* an index that is missing or was left behind by another writer is rebuilt */
+    if (get_number_of_elements(dset, dset->cache->indexpath) + nacqs !=
+            get_number_of_elements(dset, dset->cache->datapath)) {
+        return ismrmrd_build_acquisition_index(dset);
     }
 
-    return ISMRMRD_NOERROR;
+    entries = (HDF5_IndexEntry *) malloc(nacqs * sizeof(HDF5_IndexEntry));
+    if (entries == NULL) {
+        return ISMRMRD_PUSH_ERR(ISMRMRD_MEMORYERROR, "Failed to malloc index entries.");
+    }
+    for (n = 0; n < nacqs; n++) {
+        make_index_entry(&entries[n], &acqs[n].head);
+    }
+    status = append_elements(dset, dset->cache->indexpath, entries, nacqs, get_hdf5type_index_entry(), 0, NULL);
+    free(entries);
+    return status;
 }
 
-int ismrmrd_read_acquisition(const ISMRMRD_Dataset *dset, uint32_t index, ISMRMRD_Acquisition *acq)
+/* Brings the in-memory index up to the current number of acquisitions. Whatever the
+ * stored index doesn't cover is read from the headers, so read-only files without
+ * an index can still be queried. */
+static int load_acquisition_index(const ISMRMRD_Dataset *dset, const uint32_t nacqs)
 {
-    hid_t datatype;
-    herr_t status;
-    HDF5_Acquisition hdf5acq;
-    char *path;
+    struct ISMRMRD_DatasetCache *cache = dset->cache;
+    HDF5_IndexEntry *index;
+    uint32_t nindexed, first = cache->index_count;
+    int status = ISMRMRD_NOERROR;
 
-    if (dset==NULL) {
-        return ISMRMRD_PUSH_ERR(ISMRMRD_RUNTIMEERROR, "Dataset pointer should not be NULL.");
+    if (nacqs == cache->index_count) {
+        return ISMRMRD_NOERROR;
     }
-    if (acq==NULL) {
-        return ISMRMRD_PUSH_ERR(ISMRMRD_RUNTIMEERROR, "Acquisition pointer should not be NULL.");
+    if (nacqs < cache->index_count) {
+        first = 0;
     }
 
-    /* The path to the acquisition data */
-    path = make_path(dset, "data");
+    index = (HDF5_IndexEntry *) realloc(cache->index, nacqs * sizeof(HDF5_IndexEntry));
+    if (index == NULL) {
+        return ISMRMRD_PUSH_ERR(ISMRMRD_MEMORYERROR, "Failed to malloc acquisition index.");
+    }
+    cache->index = index;
+    cache->index_count = 0;
 
-    /* The acquisition datatype */
-    datatype = get_hdf5type_acquisition();
+    nindexed = get_number_of_elements(dset, cache->indexpath);
+    if (nindexed > nacqs) {
+        nindexed = nacqs;
+    }
+    if (first < nindexed) {
+        status = read_elements(dset, cache->indexpath, &index[first], get_hdf5type_index_entry(),
+                first, nindexed - first, NULL, get_transfer_properties(dset, false));
+        first = nindexed;
+    }
+    if (status == ISMRMRD_NOERROR && first < nacqs) {
+        status = read_index_from_headers(dset, &index[first], first, nacqs - first);
+    }
+    if (status == ISMRMRD_NOERROR) {
+        cache->index_count = nacqs;
+    }
+    return status;
+}
 
-    status = read_element(dset, path, &hdf5acq, datatype, index);
-    memcpy(&acq->head, &hdf5acq.head, sizeof(ISMRMRD_AcquisitionHeader));
-    ismrmrd_make_consistent_acquisition(acq);
-    memcpy(acq->traj, hdf5acq.traj.p, ismrmrd_size_of_acquisition_traj(acq));
-    memcpy(acq->data, hdf5acq.data.p, ismrmrd_size_of_acquisition_data(acq));
+static bool index_entry_matches(const HDF5_IndexEntry *entry, const ISMRMRD_AcquisitionQuery *query) {
+    const ISMRMRD_EncodingCounters *a = &entry->idx, *b = &query->idx;
 
-    /* clean up */
-    free(path);
-    free(hdf5acq.traj.p);
-    free(hdf5acq.data.p);
+    if ((entry->flags & query->flags_set) != query->flags_set || (entry->flags & query->flags_clear) != 0) {
+        return false;
+    }
+    return !(((query->fields & ISMRMRD_QUERY_KSPACE_ENCODE_STEP_1) && a->kspace_encode_step_1 != b->kspace_encode_step_1) ||
+             ((query->fields & ISMRMRD_QUERY_KSPACE_ENCODE_STEP_2) && a->kspace_encode_step_2 != b->kspace_encode_step_2) ||
+             ((query->fields & ISMRMRD_QUERY_AVERAGE) && a->average != b->average) ||
+             ((query->fields & ISMRMRD_QUERY_SLICE) && a->slice != b->slice) ||
+             ((query->fields & ISMRMRD_QUERY_CONTRAST) && a->contrast != b->contrast) ||
+             ((query->fields & ISMRMRD_QUERY_PHASE) && a->phase != b->phase) ||
+             ((query->fields & ISMRMRD_QUERY_REPETITION) && a->repetition != b->repetition) ||
+             ((query->fields & ISMRMRD_QUERY_SET) && a->set != b->set) ||
+             ((query->fields & ISMRMRD_QUERY_SEGMENT) && a->segment != b->segment));
+}
 
-    status = H5Tclose(datatype);
-    if (status < 0) {
-        H5Ewalk2(H5E_DEFAULT, H5E_WALK_UPWARD, walk_hdf5_errors, NULL);
-        return ISMRMRD_PUSH_ERR(ISMRMRD_HDF5ERROR, "Failed to close datatype.");
+static bool header_passes_filter(const ISMRMRD_AcquisitionHeader *head, const ISMRMRD_AcquisitionFilter *filter) {
+    if (filter->flags_include != 0 && (head->flags & filter->flags_include) == 0) {
+        return false;
+    }
+    if ((head->flags & filter->flags_exclude) != 0) {
+        return false;
     }
+    return filter->predicate == NULL || filter->predicate(head, filter->predicate_data);
+}
 
-    return ISMRMRD_NOERROR;
+static bool uses_cache_options(const ISMRMRD_Dataset *dset) {
+    return dset->options.chunk_cache_slots > 0 || dset->options.chunk_cache_bytes > 0 ||
+           dset->options.chunk_cache_w0 >= 0 || dset->options.metadata_cache_bytes > 0;
 }
 
-int ismrmrd_append_image(const ISMRMRD_Dataset *dset, const char *varname, const ISMRMRD_Image *im) {
+/* Sets the cache options on file access properties, options left at their defaults keep
+ * the values of HDF5 */
+static int set_cache_properties(const ISMRMRD_Dataset *dset, const hid_t fapl) {
+    int mdc_elements;
+    size_t slots, bytes;
+    double w0;
+    H5AC_cache_config_t config;
+
+    if (H5Pget_cache(fapl, &mdc_elements, &slots, &bytes, &w0) < 0) {
+        H5Ewalk2(H5E_DEFAULT, H5E_WALK_UPWARD, walk_hdf5_errors, NULL);
+        return ISMRMRD_PUSH_ERR(ISMRMRD_HDF5ERROR, "Failed to get the cache properties.");
+    }
+    if (dset->options.chunk_cache_slots > 0) {
+        slots = dset->options.chunk_cache_slots;
+    }
+    if (dset->options.chunk_cache_bytes > 0) {
+        bytes = dset->options.chunk_cache_bytes;
+    }
+    if (dset->options.chunk_cache_w0 >= 0) {
+        if (dset->options.chunk_cache_w0 > 1) {
+            return ISMRMRD_PUSH_ERR(ISMRMRD_RUNTIMEERROR, "The chunk cache w0 must be between 0 and 1.");
+        }
+        w0 = dset->options.chunk_cache_w0;
+    }
+    if (H5Pset_cache(fapl, mdc_elements, slots, bytes, w0) < 0) {
+        H5Ewalk2(H5E_DEFAULT, H5E_WALK_UPWARD, walk_hdf5_errors, NULL);
+        return ISMRMRD_PUSH_ERR(ISMRMRD_HDF5ERROR, "Failed to set the chunk cache.");
+    }
+
+    if (dset->options.metadata_cache_bytes > 0) {
+        config.version = H5AC__CURR_CACHE_CONFIG_VERSION;
+        if (H5Pget_mdc_config(fapl, &config) < 0) {
+            H5Ewalk2(H5E_DEFAULT, H5E_WALK_UPWARD, walk_hdf5_errors, NULL);
+            return ISMRMRD_PUSH_ERR(ISMRMRD_HDF5ERROR, "Failed to get the metadata cache configuration.");
+        }
+        /* a fixed size, HDF5 wants the bounds to hold the initial size */
+        config.set_initial_size = true;
+        config.initial_size = dset->options.metadata_cache_bytes;
+        config.max_size = dset->options.metadata_cache_bytes;
+        config.min_size = dset->options.metadata_cache_bytes;
+        config.incr_mode = H5C_incr__off;
+        config.flash_incr_mode = H5C_flash_incr__off;
+        config.decr_mode = H5C_decr__off;
+        if (H5Pset_mdc_config(fapl, &config) < 0) {
+            H5Ewalk2(H5E_DEFAULT, H5E_WALK_UPWARD, walk_hdf5_errors, NULL);
+            return ISMRMRD_PUSH_ERR(ISMRMRD_HDF5ERROR, "Failed to set the metadata cache size.");
+        }
+    }
+    return ISMRMRD_NOERROR;
+}
+
+/* Opens or creates the file of a dataset with one of the SWMR modes. Both use the latest
+ * file format, SWMR needs its chunk indexes. */
+static int open_swmr_file(ISMRMRD_Dataset *dset, const bool create_if_needed) {
+#if H5_VERSION_GE(1, 10, 0)
+    hid_t fapl, fileid = -1;
+
+    fapl = H5Pcreate(H5P_FILE_ACCESS);
+    if (fapl < 0 || H5Pset_libver_bounds(fapl, H5F_LIBVER_LATEST, H5F_LIBVER_LATEST) < 0 ||
+            set_cache_properties(dset, fapl) != ISMRMRD_NOERROR) {
+        H5Ewalk2(H5E_DEFAULT, H5E_WALK_UPWARD, walk_hdf5_errors, NULL);
+        if (fapl >= 0) {
+            H5Pclose(fapl);
+        }
+        return ISMRMRD_PUSH_ERR(ISMRMRD_HDF5ERROR, "Failed to set up SWMR file access.");
+    }
+
+    if (dset->options.swmr == ISMRMRD_SWMR_READ) {
+        fileid = H5Fopen(dset->filename, H5F_ACC_RDONLY | H5F_ACC_SWMR_READ, fapl);
+    }
+    else {
+        H5E_BEGIN_TRY {
+            fileid = H5Fopen(dset->filename, H5F_ACC_RDWR, fapl);
+        } H5E_END_TRY;
+        if (fileid < 0 && create_if_needed) {
+            fileid = H5Fcreate(dset->filename, H5F_ACC_TRUNC, H5P_DEFAULT, fapl);
+        }
+    }
+    H5Pclose(fapl);
+    if (fileid < 0) {
+        H5Ewalk2(H5E_DEFAULT, H5E_WALK_UPWARD, walk_hdf5_errors, NULL);
+        return ISMRMRD_PUSH_ERR(ISMRMRD_FILEERROR, "Failed to open file.");
+    }
+    dset->fileid = fileid;
+
+    if (dset->options.swmr == ISMRMRD_SWMR_WRITE) {
+        create_link(dset, dset->groupname);
+    }
+    return ISMRMRD_NOERROR;
+#else
+    (void)dset;
+    (void)create_if_needed;
+    return ISMRMRD_PUSH_ERR(ISMRMRD_FILEERROR, "SWMR access needs HDF5 1.10 or later.");
+#endif
+}
+
+/* The file access properties for the core driver of the in_memory option and the cache
+ * options, or H5P_DEFAULT when neither is used */
+static hid_t make_file_access(const ISMRMRD_Dataset *dset) {
+    hid_t fapl;
+    size_t increment = dset->options.memory_increment > 0 ? dset->options.memory_increment : 64 * 1024;
+
+    if (!dset->options.in_memory && !uses_cache_options(dset)) {
+        return H5P_DEFAULT;
+    }
+    fapl = H5Pcreate(H5P_FILE_ACCESS);
+    if (fapl < 0 || (dset->options.in_memory && H5Pset_fapl_core(fapl, increment, dset->options.backing_store) < 0)) {
+        H5Ewalk2(H5E_DEFAULT, H5E_WALK_UPWARD, walk_hdf5_errors, NULL);
+        if (fapl >= 0) {
+            H5Pclose(fapl);
+        }
+        ISMRMRD_PUSH_ERR(ISMRMRD_HDF5ERROR, "Failed to set up file access.");
+        return -1;
+    }
+    if (set_cache_properties(dset, fapl) != ISMRMRD_NOERROR) {
+        H5Pclose(fapl);
+        return -1;
+    }
+    return fapl;
+}
+
+/********************/
+/* Public functions */
+/********************/
+int ismrmrd_init_dataset_options(ISMRMRD_DatasetOptions *options)
+{
+    if (NULL == options) {
+        return ISMRMRD_PUSH_ERR(ISMRMRD_RUNTIMEERROR, "NULL options parameter");
+    }
+    options->chunk_length = 0;
+    options->growth_policy = ISMRMRD_GROWTH_EXACT;
+    options->capacity_hint = 0;
+    options->index_acquisitions = false;
+    options->compression = ISMRMRD_COMPRESSION_NONE;
+    options->mantissa_bits = 0;
+    options->swmr = ISMRMRD_SWMR_NONE;
+    options->in_memory = false;
+    options->backing_store = false;
+    options->memory_increment = 0;
+    options->chunk_cache_slots = 0;
+    options->chunk_cache_bytes = 0;
+    options->chunk_cache_w0 = -1.0;
+    options->metadata_cache_bytes = 0;
+    return ISMRMRD_NOERROR;
+}
+
+int ismrmrd_init_acquisition_query(ISMRMRD_AcquisitionQuery *query)
+{
+    if (NULL == query) {
+        return ISMRMRD_PUSH_ERR(ISMRMRD_RUNTIMEERROR, "NULL query parameter");
+    }
+    memset(query, 0, sizeof(ISMRMRD_AcquisitionQuery));
+    return ISMRMRD_NOERROR;
+}
+
+int ismrmrd_set_compression(const ISMRMRD_Dataset *dset, const char *varname, uint16_t profile)
+{
+    ISMRMRD_CompressionSetting *setting;
+    char *path;
+
+    if (dset==NULL || dset->cache==NULL) {
+        return ISMRMRD_PUSH_ERR(ISMRMRD_RUNTIMEERROR, "Dataset pointer should not be NULL.");
+    }
+    if (varname==NULL) {
+        return ISMRMRD_PUSH_ERR(ISMRMRD_RUNTIMEERROR, "Varname should not be NULL.");
+    }
+    if (profile > ISMRMRD_COMPRESSION_CXFLOAT) {
+        return ISMRMRD_PUSH_ERR(ISMRMRD_TYPEERROR, "Unknown compression profile.");
+    }
+
+    path = make_path(dset, varname);
+    if (path == NULL) {
+        return ISMRMRD_PUSH_ERR(ISMRMRD_MEMORYERROR, "Failed to malloc path.");
+    }
+    /* their headers would be the only thing filtered */
+    if (strcmp(path, dset->cache->waveformpath) == 0 && profile != ISMRMRD_COMPRESSION_NONE) {
+        free(path);
+        return ISMRMRD_PUSH_ERR(ISMRMRD_TYPEERROR, "Waveforms can't be compressed.");
+    }
+    for (setting = dset->cache->compression; setting != NULL; setting = setting->next) {
+        if (strcmp(setting->path, path) == 0) {
+            setting->profile = profile;
+            free(path);
+            return ISMRMRD_NOERROR;
+        }
+    }
+    setting = (ISMRMRD_CompressionSetting *) malloc(sizeof(ISMRMRD_CompressionSetting));
+    if (setting == NULL) {
+        free(path);
+        return ISMRMRD_PUSH_ERR(ISMRMRD_MEMORYERROR, "Failed to malloc compression setting.");
+    }
+    setting->path = path;
+    setting->profile = profile;
+    setting->next = dset->cache->compression;
+    dset->cache->compression = setting;
+    return ISMRMRD_NOERROR;
+}
+
+int ismrmrd_init_acquisition_filter(ISMRMRD_AcquisitionFilter *filter)
+{
+    if (NULL == filter) {
+        return ISMRMRD_PUSH_ERR(ISMRMRD_RUNTIMEERROR, "NULL filter parameter");
+    }
+    memset(filter, 0, sizeof(ISMRMRD_AcquisitionFilter));
+    return ISMRMRD_NOERROR;
+}
+
+int ismrmrd_init_dataset(ISMRMRD_Dataset *dset, const char *filename,
+        const char *groupname)
+{
+    if (NULL == dset) {
+        return ISMRMRD_PUSH_ERR(ISMRMRD_RUNTIMEERROR, "NULL Dataset parameter");
+    }
+
+    /* Disable HDF5 automatic error prenting */
+    H5Eset_auto2(H5E_DEFAULT, NULL, NULL);
+
+    /* So that a failed initialization can be released by ismrmrd_close_dataset */
+    dset->filename = NULL;
+    dset->groupname = NULL;
+    dset->fileid = 0;
+    dset->cache = NULL;
+    ismrmrd_init_dataset_options(&dset->options);
+
+    dset->filename = (char *) malloc(strlen(filename) + 1);
+    if (dset->filename == NULL) {
+        return ISMRMRD_PUSH_ERR(ISMRMRD_MEMORYERROR, "Failed to malloc dataset filename");
+    }
+    strcpy(dset->filename, filename);
+
+    dset->groupname = (char *) malloc(strlen(groupname) + 1);
+    if (dset->groupname == NULL) {
+        ismrmrd_close_dataset(dset);
+        return ISMRMRD_PUSH_ERR(ISMRMRD_MEMORYERROR, "Failed to malloc dataset groupname");
+    }
+    strcpy(dset->groupname, groupname);
+
+    /* The open dataset handles and the paths used on every append and read */
+    dset->cache = (struct ISMRMRD_DatasetCache *) calloc(1, sizeof(*dset->cache));
+    if (dset->cache == NULL) {
+        ismrmrd_close_dataset(dset);
+        return ISMRMRD_PUSH_ERR(ISMRMRD_MEMORYERROR, "Failed to malloc dataset cache");
+    }
+    dset->cache->xfer = -1;
+    dset->cache->vlen_xfer = -1;
+    if (acquire_shared_hdf5types() != ISMRMRD_NOERROR) {
+        ismrmrd_close_dataset(dset);
+        return ISMRMRD_PUSH_ERR(ISMRMRD_HDF5ERROR, "Failed to build the HDF5 datatypes");
+    }
+    dset->cache->shares_hdf5types = true;
+    dset->cache->datapath = make_path(dset, "data");
+    dset->cache->waveformpath = make_path(dset, "waveforms");
+    dset->cache->indexpath = make_path(dset, "acquisition_index");
+    dset->cache->samplepath = make_path(dset, "acquisition_samples");
+    dset->cache->trajpath = make_path(dset, "acquisition_trajectories");
+    dset->cache->offsetpath = make_path(dset, "acquisition_offsets");
+    if (dset->cache->datapath == NULL || dset->cache->waveformpath == NULL || dset->cache->indexpath == NULL ||
+            dset->cache->samplepath == NULL || dset->cache->trajpath == NULL || dset->cache->offsetpath == NULL) {
+        ismrmrd_close_dataset(dset);
+        return ISMRMRD_PUSH_ERR(ISMRMRD_MEMORYERROR, "Failed to malloc dataset paths");
+    }
+    return ISMRMRD_NOERROR;
+}
+
+int ismrmrd_open_dataset(ISMRMRD_Dataset *dset, const bool create_if_needed) {
+    /* TODO add a mode for clobbering the dataset if it exists. */
+    hid_t fileid, fapl;
+
+    if (NULL == dset) {
+        ISMRMRD_PUSH_ERR(ISMRMRD_RUNTIMEERROR, "NULL Dataset parameter");
+        return false;
+    }
+
+    /* So that variables written with the complex float codec can be read back */
+    if (ismrmrd_register_cxfloat_filter() != ISMRMRD_NOERROR) {
+        return ISMRMRD_PUSH_ERR(ISMRMRD_HDF5ERROR, "Failed to register filters.");
+    }
+
+    if (dset->options.swmr != ISMRMRD_SWMR_NONE) {
+        if (dset->options.in_memory) {
+            return ISMRMRD_PUSH_ERR(ISMRMRD_FILEERROR, "In-memory datasets can't be used with SWMR.");
+        }
+        return open_swmr_file(dset, create_if_needed);
+    }
+
+    fapl = make_file_access(dset);
+    if (fapl < 0) {
+        return ISMRMRD_HDF5ERROR;
+    }
+
+    /* Try opening the file */
+    /* Note the is_hdf5 function doesn't work well when trying to open multiple files */
+    fileid = H5Fopen(dset->filename, H5F_ACC_RDWR, fapl);
+
+    if (fileid > 0) {
+        dset->fileid = fileid;
+    }
+    else if (create_if_needed == false) {
+        /*Try opening the file as read-only*/
+        fileid = H5Fopen(dset->filename, H5F_ACC_RDONLY, fapl);
+        if (fileid > 0) {
+            dset->fileid = fileid;
+        }
+        else{
+            H5Ewalk2(H5E_DEFAULT, H5E_WALK_UPWARD, walk_hdf5_errors, NULL);
+            if (fapl != H5P_DEFAULT) {
+                H5Pclose(fapl);
+            }
+            /* Some sort of error opening the file - Maybe it doesn't exist? */
+            return ISMRMRD_PUSH_ERR(ISMRMRD_FILEERROR, "Failed to open file.");
+        }
+    }
+    else {
+        /* Try creating a new file using the default properties. */
+        /* this will be readwrite */
+        fileid = H5Fcreate(dset->filename, H5F_ACC_TRUNC, H5P_DEFAULT, fapl);
+        if (fileid > 0) {
+            dset->fileid = fileid;
+        }
+        else {
+            /* Error opening the file */
+            H5Ewalk2(H5E_DEFAULT, H5E_WALK_UPWARD, walk_hdf5_errors, NULL);
+            if (fapl != H5P_DEFAULT) {
+                H5Pclose(fapl);
+            }
+            return ISMRMRD_PUSH_ERR(ISMRMRD_FILEERROR, "Failed to open file.");
+        }
+    }
+    if (fapl != H5P_DEFAULT) {
+        H5Pclose(fapl);
+    }
+    /* Open the existing dataset */
+    /* ensure that /groupname exists */
+    create_link(dset, dset->groupname);
+
+    return ISMRMRD_NOERROR;
+}
+
+int ismrmrd_open_dataset_image(ISMRMRD_Dataset *dset, const void *image, size_t size) {
+    hid_t fileid, fapl;
+
+    if (NULL == dset) {
+        return ISMRMRD_PUSH_ERR(ISMRMRD_RUNTIMEERROR, "NULL Dataset parameter");
+    }
+    if (NULL == image || size == 0) {
+        return ISMRMRD_PUSH_ERR(ISMRMRD_RUNTIMEERROR, "The file image should not be empty.");
+    }
+    if (ismrmrd_register_cxfloat_filter() != ISMRMRD_NOERROR) {
+        return ISMRMRD_PUSH_ERR(ISMRMRD_HDF5ERROR, "Failed to register filters.");
+    }
+
+    /* only the memory copy of the image changes */
+    dset->options.in_memory = true;
+    dset->options.backing_store = false;
+    dset->options.swmr = ISMRMRD_SWMR_NONE;
+    fapl = make_file_access(dset);
+    if (fapl < 0) {
+        return ISMRMRD_HDF5ERROR;
+    }
+    if (H5Pset_file_image(fapl, (void *) image, size) < 0) {
+        H5Ewalk2(H5E_DEFAULT, H5E_WALK_UPWARD, walk_hdf5_errors, NULL);
+        H5Pclose(fapl);
+        return ISMRMRD_PUSH_ERR(ISMRMRD_HDF5ERROR, "Failed to set the file image.");
+    }
+    fileid = H5Fopen(dset->filename, H5F_ACC_RDWR, fapl);
+    H5Pclose(fapl);
+    if (fileid < 0) {
+        H5Ewalk2(H5E_DEFAULT, H5E_WALK_UPWARD, walk_hdf5_errors, NULL);
+        return ISMRMRD_PUSH_ERR(ISMRMRD_FILEERROR, "Failed to open the file image.");
+    }
+    dset->fileid = fileid;
+    create_link(dset, dset->groupname);
+    return ISMRMRD_NOERROR;
+}
+
+int ismrmrd_get_dataset_image(const ISMRMRD_Dataset *dset, void *buffer, size_t *size) {
+    ssize_t image_size;
+
+    if (NULL == dset) {
+        return ISMRMRD_PUSH_ERR(ISMRMRD_RUNTIMEERROR, "NULL Dataset parameter");
+    }
+    if (NULL == size) {
+        return ISMRMRD_PUSH_ERR(ISMRMRD_RUNTIMEERROR, "NULL size parameter");
+    }
+    if (H5Fflush(dset->fileid, H5F_SCOPE_LOCAL) < 0) {
+        H5Ewalk2(H5E_DEFAULT, H5E_WALK_UPWARD, walk_hdf5_errors, NULL);
+        return ISMRMRD_PUSH_ERR(ISMRMRD_HDF5ERROR, "Failed to flush the file.");
+    }
+    image_size = H5Fget_file_image(dset->fileid, NULL, 0);
+    if (image_size < 0) {
+        H5Ewalk2(H5E_DEFAULT, H5E_WALK_UPWARD, walk_hdf5_errors, NULL);
+        return ISMRMRD_PUSH_ERR(ISMRMRD_HDF5ERROR, "Failed to get the size of the file image.");
+    }
+    if (buffer != NULL) {
+        if (*size < (size_t) image_size) {
+            return ISMRMRD_PUSH_ERR(ISMRMRD_MEMORYERROR, "The buffer is too small for the file image.");
+        }
+        if (H5Fget_file_image(dset->fileid, buffer, (size_t) image_size) < 0) {
+            H5Ewalk2(H5E_DEFAULT, H5E_WALK_UPWARD, walk_hdf5_errors, NULL);
+            return ISMRMRD_PUSH_ERR(ISMRMRD_HDF5ERROR, "Failed to get the file image.");
+        }
+    }
+    *size = (size_t) image_size;
+    return ISMRMRD_NOERROR;
+}
+
+int ismrmrd_get_cache_stats(const ISMRMRD_Dataset *dset, ISMRMRD_CacheStats *stats) {
+    hid_t fapl;
+    herr_t h5status;
+    int mdc_elements, entries;
+    size_t max_size, min_clean_size, cur_size;
+
+    if (NULL == dset) {
+        return ISMRMRD_PUSH_ERR(ISMRMRD_RUNTIMEERROR, "NULL Dataset parameter");
+    }
+    if (NULL == stats) {
+        return ISMRMRD_PUSH_ERR(ISMRMRD_RUNTIMEERROR, "NULL stats parameter");
+    }
+    if (dset->fileid <= 0) {
+        return ISMRMRD_PUSH_ERR(ISMRMRD_FILEERROR, "The dataset is not open.");
+    }
+
+    fapl = H5Fget_access_plist(dset->fileid);
+    if (fapl < 0) {
+        H5Ewalk2(H5E_DEFAULT, H5E_WALK_UPWARD, walk_hdf5_errors, NULL);
+        return ISMRMRD_PUSH_ERR(ISMRMRD_HDF5ERROR, "Failed to get the file access properties.");
+    }
+    h5status = H5Pget_cache(fapl, &mdc_elements, &stats->chunk_cache_slots, &stats->chunk_cache_bytes,
+            &stats->chunk_cache_w0);
+    H5Pclose(fapl);
+    if (h5status < 0 || H5Fget_mdc_hit_rate(dset->fileid, &stats->metadata_hit_rate) < 0 ||
+            H5Fget_mdc_size(dset->fileid, &max_size, &min_clean_size, &cur_size, &entries) < 0) {
+        H5Ewalk2(H5E_DEFAULT, H5E_WALK_UPWARD, walk_hdf5_errors, NULL);
+        return ISMRMRD_PUSH_ERR(ISMRMRD_HDF5ERROR, "Failed to get the cache statistics.");
+    }
+    stats->metadata_cache_bytes = cur_size;
+    stats->metadata_cache_max_bytes = max_size;
+    stats->metadata_cache_entries = (uint32_t) entries;
+    return ISMRMRD_NOERROR;
+}
+
+int ismrmrd_reset_cache_stats(const ISMRMRD_Dataset *dset) {
+    if (NULL == dset) {
+        return ISMRMRD_PUSH_ERR(ISMRMRD_RUNTIMEERROR, "NULL Dataset parameter");
+    }
+    if (dset->fileid <= 0) {
+        return ISMRMRD_PUSH_ERR(ISMRMRD_FILEERROR, "The dataset is not open.");
+    }
+    if (H5Freset_mdc_hit_rate_stats(dset->fileid) < 0) {
+        H5Ewalk2(H5E_DEFAULT, H5E_WALK_UPWARD, walk_hdf5_errors, NULL);
+        return ISMRMRD_PUSH_ERR(ISMRMRD_HDF5ERROR, "Failed to reset the cache statistics.");
+    }
+    return ISMRMRD_NOERROR;
+}
+
+int ismrmrd_close_dataset(ISMRMRD_Dataset *dset) {
+    herr_t h5status;
+
+    if (NULL == dset) {
+        ISMRMRD_PUSH_ERR(ISMRMRD_RUNTIMEERROR, "NULL Dataset parameter");
+        return false;
+    }
+
+    if (dset->filename != NULL) {
+        free(dset->filename);
+        dset->filename = NULL;
+    }
+
+    if (dset->groupname != NULL) {
+        free(dset->groupname);
+        dset->groupname = NULL;
+    }
+
+    /* Close the dataset handles before the file that holds them */
+    if (dset->cache != NULL) {
+        close_handles(dset);
+        close_transfer_properties(dset);
+        free_compression_settings(dset);
+        free(dset->cache->datapath);
+        free(dset->cache->waveformpath);
+        free(dset->cache->indexpath);
+        free(dset->cache->samplepath);
+        free(dset->cache->trajpath);
+        free(dset->cache->offsetpath);
+        free(dset->cache->index);
+        if (dset->cache->shares_hdf5types) {
+            release_shared_hdf5types();
+        }
+        free(dset->cache);
+        dset->cache = NULL;
+    }
+
+    /* Check for a valid fileid before trying to close the file */
+    if (dset->fileid > 0) {
+        h5status = H5Fclose (dset->fileid);
+        dset->fileid = 0;
+        if (h5status < 0) {
+            H5Ewalk2(H5E_DEFAULT, H5E_WALK_UPWARD, walk_hdf5_errors, NULL);
+            return ISMRMRD_PUSH_ERR(ISMRMRD_FILEERROR, "Failed to close dataset.");
+        }
+    }
+
+    return ISMRMRD_NOERROR;
+}
+
+int ismrmrd_reopen_dataset(ISMRMRD_Dataset *dset) {
+    herr_t h5status = 0;
+
+    if (NULL == dset) {
+        return ISMRMRD_PUSH_ERR(ISMRMRD_RUNTIMEERROR, "NULL Dataset parameter");
+    }
+    if (dset->fileid <= 0 || dset->cache == NULL) {
+        return ISMRMRD_PUSH_ERR(ISMRMRD_FILEERROR, "The dataset is not open.");
+    }
+    /* anything else may be in memory only, or open for writing, and would be lost */
+    if (dset->options.swmr != ISMRMRD_SWMR_READ) {
+        return ISMRMRD_PUSH_ERR(ISMRMRD_FILEERROR, "Only SWMR readers can be reopened.");
+    }
+
+    close_handles(dset);
+    /* the next query reads the index again */
+    free(dset->cache->index);
+    dset->cache->index = NULL;
+    dset->cache->index_count = 0;
+    if (dset->fileid > 0) {
+        h5status = H5Fclose(dset->fileid);
+        dset->fileid = 0;
+    }
+    if (h5status < 0) {
+        H5Ewalk2(H5E_DEFAULT, H5E_WALK_UPWARD, walk_hdf5_errors, NULL);
+        return ISMRMRD_PUSH_ERR(ISMRMRD_FILEERROR, "Failed to close dataset.");
+    }
+    return ismrmrd_open_dataset(dset, false);
+}
+
+int ismrmrd_begin_swmr_write(ISMRMRD_Dataset *dset) {
+    ISMRMRD_DatasetHandle *handle;
+
+    if (NULL == dset) {
+        return ISMRMRD_PUSH_ERR(ISMRMRD_RUNTIMEERROR, "NULL Dataset parameter");
+    }
+    if (dset->options.swmr != ISMRMRD_SWMR_WRITE) {
+        return ISMRMRD_PUSH_ERR(ISMRMRD_FILEERROR, "The dataset was not opened for SWMR writing.");
+    }
+
+#if H5_VERSION_GE(1, 10, 0)
+    /* readers take the extent as the number of records, so it can't run ahead any more */
+    if (dset->cache->data != NULL) {
+        trim_handle(dset->cache->data);
+    }
+    if (dset->cache->waveforms != NULL) {
+        trim_handle(dset->cache->waveforms);
+    }
+    for (handle = dset->cache->vars; handle != NULL; handle = handle->next) {
+        trim_handle(handle);
+    }
+    dset->options.growth_policy = ISMRMRD_GROWTH_EXACT;
+
+    if (H5Fstart_swmr_write(dset->fileid) < 0) {
+        H5Ewalk2(H5E_DEFAULT, H5E_WALK_UPWARD, walk_hdf5_errors, NULL);
+        return ISMRMRD_PUSH_ERR(ISMRMRD_HDF5ERROR, "Failed to start SWMR writing.");
+    }
+    return ISMRMRD_NOERROR;
+#else
+    (void)handle;
+    return ISMRMRD_PUSH_ERR(ISMRMRD_FILEERROR, "SWMR access needs HDF5 1.10 or later.");
+#endif
+}
+
+int ismrmrd_flush_dataset(const ISMRMRD_Dataset *dset) {
+    if (NULL == dset) {
+        return ISMRMRD_PUSH_ERR(ISMRMRD_RUNTIMEERROR, "NULL Dataset parameter");
+    }
+    /* the whole file rather than each dataset, variable length data live in the global heap */
+    if (H5Fflush(dset->fileid, H5F_SCOPE_LOCAL) < 0) {
+        H5Ewalk2(H5E_DEFAULT, H5E_WALK_UPWARD, walk_hdf5_errors, NULL);
+        return ISMRMRD_PUSH_ERR(ISMRMRD_HDF5ERROR, "Failed to flush the file.");
+    }
+    return ISMRMRD_NOERROR;
+}
+
+int ismrmrd_write_header(const ISMRMRD_Dataset *dset, const char *xmlstring) {
+    hid_t dataset, dataspace, datatype, props;
+    hsize_t dims[] = {1};
+    herr_t h5status;
+    void *buff[1];
+    char * path;
+
+    if (dset==NULL) {
+        return ISMRMRD_PUSH_ERR(ISMRMRD_RUNTIMEERROR, "Dataset pointer should not be NULL.");
+    }
+
+    if (xmlstring==NULL) {
+        return ISMRMRD_PUSH_ERR(ISMRMRD_RUNTIMEERROR, "xmlstring should not be NULL.");
+    }
+
+    /* The path to the xml header */
+    path = make_path(dset, "xml");
+
+    /* Delete the old header if it exists */
+    h5status = delete_var(dset, "xml");
+
+    /* Create a new dataset for the xmlstring */
+    /* i.e. create the memory type, data space, and data set */
+    dataspace = H5Screate_simple(1, dims, NULL);
+    datatype = get_hdf5type_xmlheader();
+    props = H5Pcreate (H5P_DATASET_CREATE);
+    dataset = H5Dcreate2(dset->fileid, path, datatype, dataspace, H5P_DEFAULT, props,  H5P_DEFAULT);
+    free(path);
+
+    /* Write it out */
+    /* We have to wrap the xmlstring in an array */
+    buff[0] = (void *) xmlstring;  /* safe to get rid of const the type */
+    h5status = H5Dwrite(dataset, datatype, H5S_ALL, H5S_ALL, H5P_DEFAULT, buff);
+    if (h5status < 0) {
+        H5Ewalk2(H5E_DEFAULT, H5E_WALK_UPWARD, walk_hdf5_errors, NULL);
+        return ISMRMRD_PUSH_ERR(ISMRMRD_HDF5ERROR, "Failed to write xml string to dataset");
+    }
+
+    /* Clean up */
+    h5status = H5Pclose(props);
+    if (h5status < 0) {
+        H5Ewalk2(H5E_DEFAULT, H5E_WALK_UPWARD, walk_hdf5_errors, NULL);
+        return ISMRMRD_PUSH_ERR(ISMRMRD_FILEERROR, "Failed to close property list.");
+    }
+    h5status = H5Sclose(dataspace);
+    if (h5status < 0) {
+        H5Ewalk2(H5E_DEFAULT, H5E_WALK_UPWARD, walk_hdf5_errors, NULL);
+        return ISMRMRD_PUSH_ERR(ISMRMRD_FILEERROR, "Failed to close dataspace.");
+    }
+    h5status = H5Dclose(dataset);
+    if (h5status < 0) {
+        H5Ewalk2(H5E_DEFAULT, H5E_WALK_UPWARD, walk_hdf5_errors, NULL);
+        return ISMRMRD_PUSH_ERR(ISMRMRD_FILEERROR, "Failed to close dataset.");
+    }
+
+    return ISMRMRD_NOERROR;
+}
+
+char * ismrmrd_read_header(const ISMRMRD_Dataset *dset) {
+    hid_t dataset, datatype;
+    herr_t h5status;
+    char* xmlstring = NULL;
+    char* path = NULL;
+
+    if (dset==NULL) {
+        ISMRMRD_PUSH_ERR(ISMRMRD_RUNTIMEERROR, "Pointer should not be NULL.");
+        return NULL;
+    }
+
+    /* The path to the xml header */
+    path = make_path(dset, "xml");
+
+    if (!link_exists(dset, path)) {
+        /* No XML String found */
+        ISMRMRD_PUSH_ERR(ISMRMRD_RUNTIMEERROR, "No XML Header found.");
+        goto cleanup_path;
+    }
+
+    dataset = H5Dopen2(dset->fileid, path, H5P_DEFAULT);
+    datatype = get_hdf5type_xmlheader();
+    /* Read it into a 1D buffer*/
+    h5status = H5Dread(dataset, datatype, H5S_ALL, H5S_ALL, H5P_DEFAULT, &xmlstring);
+    if (h5status < 0 || xmlstring == NULL) {
+        H5Ewalk2(H5E_DEFAULT, H5E_WALK_UPWARD, walk_hdf5_errors, NULL);
+        ISMRMRD_PUSH_ERR(ISMRMRD_FILEERROR, "Failed to read header.");
+        goto cleanup_path;
+    }
+
+    /* Clean up */
+    h5status = H5Dclose(dataset);
+    if (h5status < 0) {
+        H5Ewalk2(H5E_DEFAULT, H5E_WALK_UPWARD, walk_hdf5_errors, NULL);
+        ISMRMRD_PUSH_ERR(ISMRMRD_FILEERROR, "Failed to close XML header HDF5 dataset.");
+        goto cleanup_xmlstring;
+    }
+
+    goto cleanup_path;
+
+cleanup_xmlstring:
+    free(xmlstring);
+    xmlstring = NULL;
+cleanup_path:
+    free(path);
+    return xmlstring;
+}
+
+uint32_t ismrmrd_get_number_of_acquisitions(const ISMRMRD_Dataset *dset) {
+    const char *path;
+    uint32_t numacq;
+
+    if (dset==NULL) {
+        ISMRMRD_PUSH_ERR(ISMRMRD_RUNTIMEERROR, "Pointer should not be NULL.");
+        return 0;
+    }
+    /* The path to the acqusition data */    
+    path = dset->cache->datapath;
+    numacq = get_number_of_elements(dset, path);
+    return numacq;
+}
+
+/* Rounds count floats to the nearest value with bits mantissa bits, ties away from zero.
+ * NaNs and infinities are kept, as are values that would round up to infinity. */
+static void round_mantissas(float *values, size_t count, const uint16_t bits)
+{
+    const uint32_t exponent = 0x7f800000u;
+    const uint32_t drop = 23 - bits;
+    const uint32_t half = 1u << (drop - 1);
+    const uint32_t mask = ~((1u << drop) - 1);
+    uint32_t v, r;
+    size_t n;
+
+    for (n = 0; n < count; n++) {
+        memcpy(&v, &values[n], sizeof(v));
+        r = (v + half) & mask;
+        if ((v & exponent) == exponent || (r & exponent) == exponent) {
+            r = v;
+        }
+        memcpy(&values[n], &r, sizeof(r));
+    }
+}
+
+/* Keeps the smallest precision ever written to path in its mantissa_bits attribute */
+static int record_mantissa_bits(const ISMRMRD_Dataset *dset, const char *path, uint16_t bits)
+{
+    ISMRMRD_DatasetHandle *handle;
+    hid_t attr, space;
+    uint16_t stored;
+    htri_t exists;
+    herr_t h5status;
+
+    handle = find_handle(dset, path);
+    if (handle == NULL) {
+        return ISMRMRD_PUSH_ERR(ISMRMRD_FILEERROR, "Failed to open dataset");
+    }
+    if (handle->mantissa_bits != 0 && handle->mantissa_bits <= bits) {
+        return ISMRMRD_NOERROR;
+    }
+
+    exists = H5Aexists(handle->dataset, ISMRMRD_MANTISSA_BITS_ATTRIBUTE);
+    if (exists > 0) {
+        attr = H5Aopen(handle->dataset, ISMRMRD_MANTISSA_BITS_ATTRIBUTE, H5P_DEFAULT);
+        if (attr >= 0 && H5Aread(attr, H5T_NATIVE_UINT16, &stored) >= 0 && stored != 0 && stored < bits) {
+            bits = stored;
+        }
+    } else if (exists == 0) {
+        space = H5Screate(H5S_SCALAR);
+        attr = H5Acreate2(handle->dataset, ISMRMRD_MANTISSA_BITS_ATTRIBUTE, H5T_STD_U16LE, space,
+                H5P_DEFAULT, H5P_DEFAULT);
+        H5Sclose(space);
+    } else {
+        attr = -1;
+    }
+    if (attr < 0) {
+        H5Ewalk2(H5E_DEFAULT, H5E_WALK_UPWARD, walk_hdf5_errors, NULL);
+        return ISMRMRD_PUSH_ERR(ISMRMRD_HDF5ERROR, "Failed to open the mantissa bits attribute");
+    }
+    h5status = H5Awrite(attr, H5T_NATIVE_UINT16, &bits);
+    H5Aclose(attr);
+    if (h5status < 0) {
+        H5Ewalk2(H5E_DEFAULT, H5E_WALK_UPWARD, walk_hdf5_errors, NULL);
+        return ISMRMRD_PUSH_ERR(ISMRMRD_HDF5ERROR, "Failed to write the mantissa bits attribute");
+    }
+    handle->mantissa_bits = bits;
+    return ISMRMRD_NOERROR;
+}
+
+/* Appends the samples of a block of acquisitions to the datasets that keep them apart,
+ * followed by where each acquisition's samples start. The records of the acquisitions are
+ * appended afterwards, so a SWMR reader that sees a record also finds its samples. The
+ * data are rounded to the mantissa_bits option, the trajectories are kept as they are. */
+static int append_acquisition_samples(const ISMRMRD_Dataset *dset, const ISMRMRD_Acquisition *acqs,
+        const uint32_t nacqs)
+{
+    ISMRMRD_DatasetHandle *handle;
+    HDF5_SampleOffsets *offsets;
+    uint64_t data_end = 0, traj_end = 0, records = 0;
+    uint16_t bits = dset->options.mantissa_bits;
+    bool rounded = bits > 0 && bits < 23;
+    float *trajs = NULL;
+    complex_float_t *samples = NULL;
+    size_t size;
+    int status = ISMRMRD_NOERROR;
+    uint32_t n;
+
+    /* the samples of a record that failed to be appended are left behind, unused */
+    handle = find_handle(dset, dset->cache->samplepath);
+    data_end = (handle != NULL) ? handle->count : 0;
+    handle = find_handle(dset, dset->cache->trajpath);
+    traj_end = (handle != NULL) ? handle->count : 0;
+    handle = find_handle(dset, dset->cache->offsetpath);
+    records = (handle != NULL) ? handle->count : 0;
+    handle = find_handle(dset, dset->cache->datapath);
+    if (records != ((handle != NULL) ? handle->count : 0)) {
+        return ISMRMRD_PUSH_ERR(ISMRMRD_FILEERROR, "The sample offsets don't match the acquisitions.");
+    }
+
+    offsets = (HDF5_SampleOffsets *) malloc(nacqs * sizeof(HDF5_SampleOffsets));
+    if (offsets == NULL) {
+        return ISMRMRD_PUSH_ERR(ISMRMRD_MEMORYERROR, "Failed to malloc sample offsets.");
+    }
+    for (n = 0; n < nacqs; n++) {
+        offsets[n].data = data_end;
+        offsets[n].traj = traj_end;
+        data_end += (uint64_t) acqs[n].head.number_of_samples * acqs[n].head.active_channels;
+        traj_end += (uint64_t) acqs[n].head.number_of_samples * acqs[n].head.trajectory_dimensions;
+    }
+    data_end -= offsets[0].data;
+    traj_end -= offsets[0].traj;
+    if (data_end > UINT32_MAX || traj_end > UINT32_MAX) {
+        free(offsets);
+        return ISMRMRD_PUSH_ERR(ISMRMRD_RUNTIMEERROR, "Too many samples in one append.");
+    }
+
+    /* a single acquisition's samples are already contiguous, the caller's are left untouched */
+    samples = acqs[0].data;
+    trajs = acqs[0].traj;
+    if (nacqs > 1 || rounded) {
+        samples = (complex_float_t *) malloc((size_t) data_end * sizeof(complex_float_t) + 1);
+        if (samples == NULL) {
+            status = ISMRMRD_PUSH_ERR(ISMRMRD_MEMORYERROR, "Failed to malloc sample block.");
+        }
+        for (n = 0; n < nacqs && status == ISMRMRD_NOERROR; n++) {
+            size = ismrmrd_size_of_acquisition_data(&acqs[n]);
+            if (size > 0) {
+                memcpy(samples + (offsets[n].data - offsets[0].data), acqs[n].data, size);
+            }
+        }
+        if (status == ISMRMRD_NOERROR && rounded) {
+            round_mantissas((float *) samples, 2 * (size_t) data_end, bits);
+        }
+    }
+    if (nacqs > 1) {
+        trajs = (float *) malloc((size_t) traj_end * sizeof(float) + 1);
+        if (trajs == NULL && status == ISMRMRD_NOERROR) {
+            status = ISMRMRD_PUSH_ERR(ISMRMRD_MEMORYERROR, "Failed to malloc sample block.");
+        }
+        for (n = 0; n < nacqs && status == ISMRMRD_NOERROR; n++) {
+            size = ismrmrd_size_of_acquisition_traj(&acqs[n]);
+            if (size > 0) {
+                memcpy(trajs + (offsets[n].traj - offsets[0].traj), acqs[n].traj, size);
+            }
+        }
+    }
+
+    if (status == ISMRMRD_NOERROR) {
+        status = append_elements(dset, dset->cache->samplepath, samples, (uint32_t) data_end,
+                get_hdf5type_complexfloat(), 0, NULL);
+    }
+    if (status == ISMRMRD_NOERROR && rounded && data_end > 0) {
+        status = record_mantissa_bits(dset, dset->cache->samplepath, bits);
+    }
+    if (status == ISMRMRD_NOERROR) {
+        status = append_elements(dset, dset->cache->trajpath, trajs, (uint32_t) traj_end,
+                get_hdf5type_float(), 0, NULL);
+    }
+    if (status == ISMRMRD_NOERROR) {
+        status = append_elements(dset, dset->cache->offsetpath, offsets, nacqs,
+                get_hdf5type_sample_offsets(), 0, NULL);
+    }
+    if (samples != acqs[0].data) {
+        free(samples);
+    }
+    if (trajs != acqs[0].traj) {
+        free(trajs);
+    }
+    free(offsets);
+    return status;
+}
+
+/* Appends a block of acquisitions with a single extent change and a single write per dataset */
+static int append_acquisition_block(const ISMRMRD_Dataset *dset, const ISMRMRD_Acquisition *acqs,
+        const uint32_t nacqs)
+{
+    HDF5_Acquisition one, *hdf5acqs = &one;
+    bool apart;
+    int status = ISMRMRD_NOERROR;
+    uint32_t n;
+
+    apart = samples_apart(dset, find_handle(dset, dset->cache->datapath));
+    if (apart) {
+        status = append_acquisition_samples(dset, acqs, nacqs);
+        if (status != ISMRMRD_NOERROR) {
+            return status;
+        }
+    }
+
+    /* Create the HDF5 version of the acquisitions */
+    /* only the headers are copied, the vlen entries point at the caller's buffers */
+    if (nacqs > 1) {
+        hdf5acqs = (HDF5_Acquisition *) malloc(nacqs * sizeof(HDF5_Acquisition));
+        if (hdf5acqs == NULL) {
+            return ISMRMRD_PUSH_ERR(ISMRMRD_MEMORYERROR, "Failed to malloc acquisition block.");
+        }
+    }
+    for (n = 0; n < nacqs; n++) {
+        hdf5acqs[n].head = acqs[n].head;
+        hdf5acqs[n].traj.len = apart ? 0 : acqs[n].head.number_of_samples * acqs[n].head.trajectory_dimensions;
+        hdf5acqs[n].traj.p = apart ? NULL : acqs[n].traj;
+        hdf5acqs[n].data.len = apart ? 0 : 2 * acqs[n].head.number_of_samples * acqs[n].head.active_channels;
+        hdf5acqs[n].data.p = apart ? NULL : acqs[n].data;
+    }
+
+    status = append_elements(dset, dset->cache->datapath, hdf5acqs, nacqs, get_hdf5type_acquisition(), 0, NULL);
+    if (hdf5acqs != &one) {
+        free(hdf5acqs);
+    }
+    return status;
+}
+
+int ismrmrd_append_acquisition(const ISMRMRD_Dataset *dset, const ISMRMRD_Acquisition *acq) {
+    int status;
+
+    if (dset==NULL) {
+        return ISMRMRD_PUSH_ERR(ISMRMRD_RUNTIMEERROR, "Dataset pointer should not be NULL.");
+    }
+    if (acq==NULL) {
+        return ISMRMRD_PUSH_ERR(ISMRMRD_RUNTIMEERROR, "Acquisition pointer should not be NULL.");
+    }
+
+    /* Write it */
+    status = append_acquisition_block(dset, acq, 1);
+    if (status != ISMRMRD_NOERROR) {
+        return ISMRMRD_PUSH_ERR(ISMRMRD_FILEERROR, "Failed to append acquisition.");
+    }
+
+    if (dset->options.index_acquisitions && update_acquisition_index(dset, acq, 1) != ISMRMRD_NOERROR) {
+        return ISMRMRD_PUSH_ERR(ISMRMRD_FILEERROR, "Failed to update acquisition index.");
+    }
+
+    return ISMRMRD_NOERROR;
+}
+
+int ismrmrd_append_acquisitions(const ISMRMRD_Dataset *dset, const ISMRMRD_Acquisition *acqs, uint32_t nacqs) {
+    int status;
+
+    if (dset==NULL) {
+        return ISMRMRD_PUSH_ERR(ISMRMRD_RUNTIMEERROR, "Dataset pointer should not be NULL.");
+    }
+    if (acqs==NULL && nacqs > 0) {
+        return ISMRMRD_PUSH_ERR(ISMRMRD_RUNTIMEERROR, "Acquisition pointer should not be NULL.");
+    }
+    if (nacqs == 0) {
+        return ISMRMRD_NOERROR;
+    }
+
+    /* Write them all with a single extent change and a single write */
+    status = append_acquisition_block(dset, acqs, nacqs);
+    if (status != ISMRMRD_NOERROR) {
+        return ISMRMRD_PUSH_ERR(ISMRMRD_FILEERROR, "Failed to append acquisitions.");
+    }
+
+    if (dset->options.index_acquisitions && update_acquisition_index(dset, acqs, nacqs) != ISMRMRD_NOERROR) {
+        return ISMRMRD_PUSH_ERR(ISMRMRD_FILEERROR, "Failed to update acquisition index.");
+    }
+
+    return ISMRMRD_NOERROR;
+}
+
+int ismrmrd_read_acquisition(const ISMRMRD_Dataset *dset, uint32_t index, ISMRMRD_Acquisition *acq)
+{
+    int status;
+
+    if (dset==NULL) {
+        return ISMRMRD_PUSH_ERR(ISMRMRD_RUNTIMEERROR, "Dataset pointer should not be NULL.");
+    }
+    if (acq==NULL) {
+        return ISMRMRD_PUSH_ERR(ISMRMRD_RUNTIMEERROR, "Acquisition pointer should not be NULL.");
+    }
+
+    status = read_acquisition_block(dset, index, 1, NULL, acq);
+    if (status != ISMRMRD_NOERROR) {
+        return ISMRMRD_PUSH_ERR(ISMRMRD_FILEERROR, "Failed to read acquisition.");
+    }
+
+    return ISMRMRD_NOERROR;
+}
+
+int ismrmrd_read_acquisitions(const ISMRMRD_Dataset *dset, uint32_t first, uint32_t count, ISMRMRD_Acquisition *acqs)
+{
+    int status;
+
+    if (dset==NULL) {
+        return ISMRMRD_PUSH_ERR(ISMRMRD_RUNTIMEERROR, "Dataset pointer should not be NULL.");
+    }
+    if (acqs==NULL && count > 0) {
+        return ISMRMRD_PUSH_ERR(ISMRMRD_RUNTIMEERROR, "Acquisition pointer should not be NULL.");
+    }
+    if (count == 0) {
+        return ISMRMRD_NOERROR;
+    }
+
+    /* Read the whole block with one hyperslab selection per field */
+    status = read_acquisition_block(dset, first, count, NULL, acqs);
+    if (status != ISMRMRD_NOERROR) {
+        return ISMRMRD_PUSH_ERR(ISMRMRD_FILEERROR, "Failed to read acquisitions.");
+    }
+
+    return ISMRMRD_NOERROR;
+}
+
+int ismrmrd_read_acquisition_headers(const ISMRMRD_Dataset *dset, uint32_t first, uint32_t count, ISMRMRD_AcquisitionHeader *heads)
+{
+    int status;
+
+    if (dset==NULL) {
+        return ISMRMRD_PUSH_ERR(ISMRMRD_RUNTIMEERROR, "Dataset pointer should not be NULL.");
+    }
+    if (heads==NULL && count > 0) {
+        return ISMRMRD_PUSH_ERR(ISMRMRD_RUNTIMEERROR, "Header pointer should not be NULL.");
+    }
+    if (count == 0) {
+        return ISMRMRD_NOERROR;
+    }
+
+    /* The head only subset lays the headers out as a plain array */
+    status = read_elements(dset, dset->cache->datapath, heads, get_hdf5type_acquisition_head(),
+            first, count, NULL, get_transfer_properties(dset, false));
+    if (status != ISMRMRD_NOERROR) {
+        return ISMRMRD_PUSH_ERR(ISMRMRD_FILEERROR, "Failed to read acquisition headers.");
+    }
+
+    return ISMRMRD_NOERROR;
+}
+
+int ismrmrd_read_acquisition_list(const ISMRMRD_Dataset *dset, const uint32_t *records, uint32_t count, ISMRMRD_Acquisition *acqs)
+{
+    int status;
+
+    if (dset==NULL) {
+        return ISMRMRD_PUSH_ERR(ISMRMRD_RUNTIMEERROR, "Dataset pointer should not be NULL.");
+    }
+    if ((records==NULL || acqs==NULL) && count > 0) {
+        return ISMRMRD_PUSH_ERR(ISMRMRD_RUNTIMEERROR, "Record and acquisition pointers should not be NULL.");
+    }
+    if (count == 0) {
+        return ISMRMRD_NOERROR;
+    }
+
+    /* One selection made of a hyperslab per run of consecutive records */
+    status = read_acquisition_block(dset, 0, count, records, acqs);
+    if (status != ISMRMRD_NOERROR) {
+        return ISMRMRD_PUSH_ERR(ISMRMRD_FILEERROR, "Failed to read acquisitions.");
+    }
+
+    return ISMRMRD_NOERROR;
+}
+
+int ismrmrd_read_acquisitions_filtered(const ISMRMRD_Dataset *dset, uint32_t first, uint32_t count,
+        const ISMRMRD_AcquisitionFilter *filter, ISMRMRD_Acquisition *acqs, uint32_t *records, uint32_t *nmatched)
+{
+    ISMRMRD_AcquisitionHeader *heads;
+    uint32_t *matches;
+    uint32_t done, block, n, nmatches = 0;
+    int status = ISMRMRD_NOERROR;
+
+    if (dset==NULL || filter==NULL || nmatched==NULL) {
+        return ISMRMRD_PUSH_ERR(ISMRMRD_RUNTIMEERROR, "Pointers should not be NULL.");
+    }
+    if (acqs==NULL && count > 0) {
+        return ISMRMRD_PUSH_ERR(ISMRMRD_RUNTIMEERROR, "Acquisition pointer should not be NULL.");
+    }
+    *nmatched = 0;
+    if (count == 0) {
+        return ISMRMRD_NOERROR;
+    }
+
+    block = count < ISMRMRD_INDEX_BLOCK ? count : ISMRMRD_INDEX_BLOCK;
+    heads = (ISMRMRD_AcquisitionHeader *) malloc(block * sizeof(ISMRMRD_AcquisitionHeader));
+    matches = records ? records : (uint32_t *) malloc(count * sizeof(uint32_t));
+    if (heads == NULL || matches == NULL) {
+        free(heads);
+        if (matches != records) {
+            free(matches);
+        }
+        return ISMRMRD_PUSH_ERR(ISMRMRD_MEMORYERROR, "Failed to malloc filter buffers.");
+    }
+
+    /* Only the headers are read while filtering, the matching headers go straight into acqs */
+    for (done = 0; done < count && status == ISMRMRD_NOERROR; done += block) {
+        if (count - done < block) {
+            block = count - done;
+        }
+        status = read_elements(dset, dset->cache->datapath, heads, get_hdf5type_acquisition_head(),
+                first + done, block, NULL, get_transfer_properties(dset, false));
+        for (n = 0; n < block && status == ISMRMRD_NOERROR; n++) {
+            if (header_passes_filter(&heads[n], filter)) {
+                memcpy(&acqs[nmatches].head, &heads[n], sizeof(ISMRMRD_AcquisitionHeader));
+                matches[nmatches++] = first + done + n;
+            }
+        }
+    }
+
+    /* The matches are read as one selection made of a hyperslab per run of consecutive records */
+    if (status == ISMRMRD_NOERROR && nmatches > 0) {
+        status = read_acquisition_payloads(dset, 0, nmatches, matches, acqs);
+    }
+
+    free(heads);
+    if (matches != records) {
+        free(matches);
+    }
+    if (status != ISMRMRD_NOERROR) {
+        return ISMRMRD_PUSH_ERR(ISMRMRD_FILEERROR, "Failed to read filtered acquisitions.");
+    }
+    *nmatched = nmatches;
+    return ISMRMRD_NOERROR;
+}
+
+int ismrmrd_build_acquisition_index(const ISMRMRD_Dataset *dset)
+{
+    HDF5_IndexEntry *entries;
+    uint32_t nacqs, done, block;
+    int status = ISMRMRD_NOERROR;
+
+    if (dset==NULL) {
+        return ISMRMRD_PUSH_ERR(ISMRMRD_RUNTIMEERROR, "Dataset pointer should not be NULL.");
+    }
+
+    /* start over, the in-memory copy is reloaded by the next query */
+    delete_var(dset, "acquisition_index");
+    dset->cache->index_count = 0;
+
+    nacqs = ismrmrd_get_number_of_acquisitions(dset);
+    entries = (HDF5_IndexEntry *) malloc(ISMRMRD_INDEX_BLOCK * sizeof(HDF5_IndexEntry));
+    if (entries == NULL) {
+        return ISMRMRD_PUSH_ERR(ISMRMRD_MEMORYERROR, "Failed to malloc index entries.");
+    }
+    for (done = 0; done < nacqs && status == ISMRMRD_NOERROR; done += block) {
+        block = (nacqs - done < ISMRMRD_INDEX_BLOCK) ? nacqs - done : ISMRMRD_INDEX_BLOCK;
+        status = read_index_from_headers(dset, entries, done, block);
+        if (status == ISMRMRD_NOERROR) {
+            status = append_elements(dset, dset->cache->indexpath, entries, block,
+                    get_hdf5type_index_entry(), 0, NULL);
+        }
+    }
+    free(entries);
+    if (status != ISMRMRD_NOERROR) {
+        return ISMRMRD_PUSH_ERR(ISMRMRD_FILEERROR, "Failed to build acquisition index.");
+    }
+
+    return ISMRMRD_NOERROR;
+}
+
+int ismrmrd_find_acquisitions(const ISMRMRD_Dataset *dset, const ISMRMRD_AcquisitionQuery *query,
+        uint32_t **records, uint32_t *count)
+{
+    uint32_t nacqs, n, nmatches = 0;
+    uint32_t *matches;
+    int status;
+
+    if (dset==NULL || query==NULL || records==NULL || count==NULL) {
+        return ISMRMRD_PUSH_ERR(ISMRMRD_RUNTIMEERROR, "Pointers should not be NULL.");
+    }
+    *records = NULL;
+    *count = 0;
+
+    nacqs = ismrmrd_get_number_of_acquisitions(dset);
+    if (nacqs == 0) {
+        return ISMRMRD_NOERROR;
+    }
+    status = load_acquisition_index(dset, nacqs);
+    if (status != ISMRMRD_NOERROR) {
+        return ISMRMRD_PUSH_ERR(ISMRMRD_FILEERROR, "Failed to load acquisition index.");
+    }
+
+    matches = (uint32_t *) malloc(nacqs * sizeof(uint32_t));
+    if (matches == NULL) {
+        return ISMRMRD_PUSH_ERR(ISMRMRD_MEMORYERROR, "Failed to malloc record list.");
+    }
+    for (n = 0; n < nacqs; n++) {
+        if (index_entry_matches(&dset->cache->index[n], query)) {
+            matches[nmatches++] = n;
+        }
+    }
+
+    if (nmatches == 0) {
+        free(matches);
+        matches = NULL;
+    }
+    *records = matches;
+    *count = nmatches;
+    return ISMRMRD_NOERROR;
+}
+
+/* Appends the samples of one image or array, rounded to the mantissa_bits option when
+ * they are floats or complex floats */
+static int append_samples(const ISMRMRD_Dataset *dset, const char *path, void *data,
+        const uint16_t data_type, const uint16_t ndim, const size_t *dims)
+{
+    uint16_t bits = dset->options.mantissa_bits;
+    size_t count;
+    float *rounded;
+    int status;
+    int n;
+
+    if (bits == 0 || bits >= 23 || (data_type != ISMRMRD_FLOAT && data_type != ISMRMRD_CXFLOAT)) {
+        return append_element(dset, path, data, get_hdf5type_ndarray(data_type), ndim, dims);
+    }
+
+    /* the caller's samples are left untouched */
+    count = data_type == ISMRMRD_CXFLOAT ? 2 : 1;
+    for (n = 0; n < ndim; n++) {
+        count *= dims[n];
+    }
+    rounded = (float *) malloc(count * sizeof(float));
+    if (rounded == NULL) {
+        return ISMRMRD_PUSH_ERR(ISMRMRD_MEMORYERROR, "Failed to malloc rounded samples.");
+    }
+    memcpy(rounded, data, count * sizeof(float));
+    round_mantissas(rounded, count, bits);
+
+    status = append_element(dset, path, rounded, get_hdf5type_ndarray(data_type), ndim, dims);
+    free(rounded);
+    if (status == ISMRMRD_NOERROR) {
+        status = record_mantissa_bits(dset, path, bits);
+    }
+    return status;
+}
+
+int ismrmrd_append_image(const ISMRMRD_Dataset *dset, const char *varname, const ISMRMRD_Image *im) {
+    int status;
+    hid_t datatype;
+    char *path, *headerpath, *attrpath, *datapath;
+    size_t dims[4];
+
+    if (dset==NULL) {
+        return ISMRMRD_PUSH_ERR(ISMRMRD_RUNTIMEERROR, "Dataset pointer should not be NULL.");
+    }
+    if (varname==NULL) {
+        return ISMRMRD_PUSH_ERR(ISMRMRD_RUNTIMEERROR, "Varname should not be NULL.");
+    }
+    if (im==NULL) {
+        return ISMRMRD_PUSH_ERR(ISMRMRD_RUNTIMEERROR, "Image pointer should not be NULL.");
+    }
+
+    /* The group for this set of images */
+    /* /groupname/varname */
+    path = make_path(dset, varname);
+    /* Make sure the path exists */
+    create_link(dset, path);        
+
+    /* Handle the header */
+    headerpath = append_to_path(dset, path, "header");
+    datatype = get_hdf5type_imageheader();
+    status = append_element(dset, headerpath, (void *) &im->head, datatype, 0, NULL);
+    if (status != ISMRMRD_NOERROR) {
+        return ISMRMRD_PUSH_ERR(ISMRMRD_FILEERROR, "Failed to append image header.");
+    }
+    free(headerpath);
+
+    /* Handle the attribute string */
+    attrpath = append_to_path(dset, path, "attributes");
+    datatype = get_hdf5type_image_attribute_string();
+    status = append_element(dset, attrpath, (void *) &im->attribute_string, datatype, 0, NULL);
+    if (status != ISMRMRD_NOERROR) {
+        return ISMRMRD_PUSH_ERR(ISMRMRD_FILEERROR, "Failed to append image attribute string.");
+    }
+    free(attrpath);
+
+    /* Handle the data */
+    datapath = append_to_path(dset, path, "data");
+    /* permute the dimensions in the hdf5 file */
+    dims[3] = im->head.matrix_size[0];
+    dims[2] = im->head.matrix_size[1];
+    dims[1] = im->head.matrix_size[2];
+    dims[0] = im->head.channels;
+    status = append_samples(dset, datapath, im->data, im->head.data_type, 4, dims);
+    if (status != ISMRMRD_NOERROR) {
+        return ISMRMRD_PUSH_ERR(ISMRMRD_FILEERROR, "Failed to append image data.");
+    }
+    free(datapath);
+
+    /* Final cleanup */
+    free(path);
+
+    return ISMRMRD_NOERROR;
+}
+
+uint32_t ismrmrd_get_number_of_images(const ISMRMRD_Dataset *dset, const char *varname)
+{
+    char *path, *headerpath;
+    uint32_t numimages;
+
+    if (dset==NULL) {
+        ISMRMRD_PUSH_ERR(ISMRMRD_RUNTIMEERROR, "Dataset pointer should not be NULL.");
+        return 0;
+    }
+    if (varname==NULL) {
+        ISMRMRD_PUSH_ERR(ISMRMRD_RUNTIMEERROR, "Varname should not be NULL.");
+        return 0;
+    }
+    /* The group for this set of images */
+    /* /groupname/varname */
+    path = make_path(dset, varname);
+    /* The path to the acqusition image headers */
+    headerpath = append_to_path(dset, path, "header");
+    numimages = get_number_of_elements(dset, headerpath);
+    free(headerpath);
+    free(path);
+    return numimages;
+}
+
+
+int ismrmrd_read_image(const ISMRMRD_Dataset *dset, const char *varname,
+        const uint32_t index, ISMRMRD_Image *im) {
+
+    int status;
+    hid_t datatype;
+    char *path, *headerpath, *attrpath, *datapath, *attr_string;
+    uint32_t numims;
+
+    if (dset==NULL) {
+        return ISMRMRD_PUSH_ERR(ISMRMRD_RUNTIMEERROR, "Dataset pointer should not be NULL.");
+    }
+    if (varname==NULL) {
+        return ISMRMRD_PUSH_ERR(ISMRMRD_RUNTIMEERROR, "Varname should not be NULL.");
+    }
+    if (im==NULL) {
+        return ISMRMRD_PUSH_ERR(ISMRMRD_RUNTIMEERROR, "Image pointer should not be NULL.");
+    }
+
+    numims = ismrmrd_get_number_of_images(dset, varname);
+
+    if (index > numims) {
+        return ISMRMRD_PUSH_ERR(ISMRMRD_RUNTIMEERROR, "Index requested exceeds number of images in the dataset.");
+    }
+
+    /* The group for this set of images */
+    /* /groupname/varname */
+    path = make_path(dset, varname);
+
+    /* Handle the header */
+    headerpath = append_to_path(dset, path, "header");
+    datatype = get_hdf5type_imageheader();
+    status = read_element(dset, headerpath, (void *) &im->head, datatype, index);
+    if (status != ISMRMRD_NOERROR) {
+        return ISMRMRD_PUSH_ERR(ISMRMRD_FILEERROR, "Failed to read image header.");
+    }
+    free(headerpath);
+
+    /* Allocate the memory for the attribute string and the data */
+    ismrmrd_make_consistent_image(im);
+
+    /* Handle the attribute string */
+    attrpath = append_to_path(dset, path, "attributes");
+    datatype = get_hdf5type_image_attribute_string();
+    status = read_element(dset, attrpath, (void *) &attr_string, datatype, index);
+    if (status != ISMRMRD_NOERROR) {
+        return ISMRMRD_PUSH_ERR(ISMRMRD_FILEERROR, "Failed to read image attribute string.");
+    }
+    free(attrpath);
+
+    /* copy the attribute string read from the file into the Image */
+    memcpy(im->attribute_string, attr_string, ismrmrd_size_of_image_attribute_string(im));
+    free(attr_string);
+
+    /* Handle the data */
+    datapath = append_to_path(dset, path, "data");
+    datatype = get_hdf5type_ndarray(im->head.data_type);
+    status = read_element(dset, datapath, im->data, datatype, index);
+    if (status != ISMRMRD_NOERROR) {
+        return ISMRMRD_PUSH_ERR(ISMRMRD_FILEERROR, "Failed to read image data.");
+    }
+    free(datapath);
+
+    /* Final cleanup */
+    free(path);
+
+    return ISMRMRD_NOERROR;
+}
+
+
+int ismrmrd_init_image_region(ISMRMRD_ImageRegion *region)
+{
+    if (NULL == region) {
+        return ISMRMRD_PUSH_ERR(ISMRMRD_RUNTIMEERROR, "NULL region parameter");
+    }
+    memset(region, 0, sizeof(ISMRMRD_ImageRegion));
+    return ISMRMRD_NOERROR;
+}
+
+/* Selects the samples of a region of the image at index, with dims [channels][z][y][x] after
+ * the record axis. Each run of consecutive channels is OR'd into the selection as one block. */
+static int select_image_region(ISMRMRD_DatasetHandle *handle, const uint32_t index,
+        const uint16_t *first, const uint16_t *count, const ISMRMRD_ImageRegion *region)
+{
+    hsize_t offset[5], block[5];
+    H5S_seloper_t op = H5S_SELECT_SET;
+    herr_t h5status = 0;
+    uint16_t n, run;
+    int d;
+
+    offset[0] = index;
+    block[0] = 1;
+    for (d = 0; d < 3; d++) {
+        offset[4 - d] = first[d];
+        block[4 - d] = count[d];
+    }
+    if (region->channels == NULL) {
+        offset[1] = 0;
+        block[1] = handle->dims[1];
+        h5status = H5Sselect_hyperslab(handle->filespace, H5S_SELECT_SET, offset, NULL, block, NULL);
+    }
+    for (n = 0; region->channels != NULL && n < region->nchannels && h5status >= 0; n += run) {
+        for (run = 1; n + run < region->nchannels && region->channels[n + run] == region->channels[n] + run; run++);
+        if (n + run < region->nchannels && region->channels[n + run] < region->channels[n] + run) {
+            return ISMRMRD_PUSH_ERR(ISMRMRD_RUNTIMEERROR, "Channels must be listed in increasing order.");
+        }
+        offset[1] = region->channels[n];
+        block[1] = run;
+        h5status = H5Sselect_hyperslab(handle->filespace, op, offset, NULL, block, NULL);
+        op = H5S_SELECT_OR;
+    }
+    if (h5status < 0) {
+        H5Ewalk2(H5E_DEFAULT, H5E_WALK_UPWARD, walk_hdf5_errors, NULL);
+        return ISMRMRD_PUSH_ERR(ISMRMRD_HDF5ERROR, "Failed to select hyperslab");
+    }
+    return ISMRMRD_NOERROR;
+}
+
+int ismrmrd_read_image_region(const ISMRMRD_Dataset *dset, const char *varname,
+        const uint32_t index, const ISMRMRD_ImageRegion *region, ISMRMRD_Image *im) {
+
+    int status;
+    char *path, *headerpath, *attrpath, *datapath, *attr_string;
+    ISMRMRD_ImageHeader head;
+    ISMRMRD_DatasetHandle *handle;
+    uint16_t first[3], count[3], n;
+    hsize_t memdims[5];
+    hid_t memspace;
+    herr_t h5status;
+    float shift[3];
+    int d;
+
+    if (dset==NULL) {
+        return ISMRMRD_PUSH_ERR(ISMRMRD_RUNTIMEERROR, "Dataset pointer should not be NULL.");
+    }
+    if (varname==NULL) {
+        return ISMRMRD_PUSH_ERR(ISMRMRD_RUNTIMEERROR, "Varname should not be NULL.");
+    }
+    if (region==NULL || im==NULL) {
+        return ISMRMRD_PUSH_ERR(ISMRMRD_RUNTIMEERROR, "Region and image pointers should not be NULL.");
+    }
+
+    /* The group for this set of images */
+    /* /groupname/varname */
+    path = make_path(dset, varname);
+    headerpath = append_to_path(dset, path, "header");
+    attrpath = append_to_path(dset, path, "attributes");
+    datapath = append_to_path(dset, path, "data");
+    free(path);
+
+    status = read_element(dset, headerpath, (void *) &head, get_hdf5type_imageheader(), index);
+    free(headerpath);
+    if (status != ISMRMRD_NOERROR) {
+        free(attrpath);
+        free(datapath);
+        return ISMRMRD_PUSH_ERR(ISMRMRD_FILEERROR, "Failed to read image header.");
+    }
+
+    /* resolve and check the region against the image */
+    for (d = 0; d < 3; d++) {
+        first[d] = region->first[d];
+        count[d] = region->count[d] > 0 ? region->count[d] : (uint16_t) (head.matrix_size[d] - first[d]);
+        if (first[d] >= head.matrix_size[d] || count[d] > head.matrix_size[d] - first[d]) {
+            free(attrpath);
+            free(datapath);
+            return ISMRMRD_PUSH_ERR(ISMRMRD_RUNTIMEERROR, "Region out of range.");
+        }
+    }
+    for (n = 0; region->channels != NULL && n < region->nchannels; n++) {
+        if (region->channels[n] >= head.channels) {
+            free(attrpath);
+            free(datapath);
+            return ISMRMRD_PUSH_ERR(ISMRMRD_RUNTIMEERROR, "Channel out of range.");
+        }
+    }
+    if (region->channels != NULL && region->nchannels == 0) {
+        free(attrpath);
+        free(datapath);
+        return ISMRMRD_PUSH_ERR(ISMRMRD_RUNTIMEERROR, "The channel list should not be empty.");
+    }
+
+    /* the block keeps its place in space: its center moves by whole pixels from the image's */
+    for (d = 0; d < 3; d++) {
+        shift[d] = (first[d] + count[d] / 2.0f - head.matrix_size[d] / 2.0f) *
+                head.field_of_view[d] / head.matrix_size[d];
+    }
+    for (d = 0; d < 3; d++) {
+        head.position[d] += shift[0] * head.read_dir[d] + shift[1] * head.phase_dir[d] + shift[2] * head.slice_dir[d];
+    }
+    for (d = 0; d < 3; d++) {
+        head.field_of_view[d] = head.field_of_view[d] * count[d] / head.matrix_size[d];
+        head.matrix_size[d] = count[d];
+    }
+    if (region->channels != NULL) {
+        head.channels = region->nchannels;
+    }
+
+    /* Allocate the memory for the attribute string and the data */
+    im->head = head;
+    ismrmrd_make_consistent_image(im);
+
+    /* Handle the attribute string */
+    status = read_element(dset, attrpath, (void *) &attr_string, get_hdf5type_image_attribute_string(), index);
+    free(attrpath);
+    if (status != ISMRMRD_NOERROR) {
+        free(datapath);
+        return ISMRMRD_PUSH_ERR(ISMRMRD_FILEERROR, "Failed to read image attribute string.");
+    }
+    memcpy(im->attribute_string, attr_string, ismrmrd_size_of_image_attribute_string(im));
+    free(attr_string);
+
+    /* Handle the data */
+    handle = find_handle(dset, datapath);
+    free(datapath);
+    if (handle == NULL) {
+        return ISMRMRD_PUSH_ERR(ISMRMRD_FILEERROR, "Path to element not found.");
+    }
+    if (index >= handle->count) {
+        if (handle->writer || refresh_handle(handle) != ISMRMRD_NOERROR || index >= handle->count) {
+            return ISMRMRD_PUSH_ERR(ISMRMRD_FILEERROR, "Index out of range.");
+        }
+    }
+    if (handle->rank != 5) {
+        return ISMRMRD_PUSH_ERR(ISMRMRD_FILEERROR, "Dimensions are incorrect.");
+    }
+    if (select_image_region(handle, index, first, count, region) != ISMRMRD_NOERROR) {
+        return ISMRMRD_PUSH_ERR(ISMRMRD_FILEERROR, "Failed to select the image region.");
+    }
+
+    memdims[0] = 1;
+    memdims[1] = im->head.channels;
+    memdims[2] = count[2];
+    memdims[3] = count[1];
+    memdims[4] = count[0];
+    memspace = H5Screate_simple(5, memdims, NULL);
+    h5status = H5Dread(handle->dataset, get_hdf5type_ndarray(im->head.data_type), memspace, handle->filespace,
+            get_transfer_properties(dset, false), im->data);
+    H5Sclose(memspace);
+    if (h5status < 0) {
+        H5Ewalk2(H5E_DEFAULT, H5E_WALK_UPWARD, walk_hdf5_errors, NULL);
+        return ISMRMRD_PUSH_ERR(ISMRMRD_HDF5ERROR, "Failed to read image data.");
+    }
+
+    return ISMRMRD_NOERROR;
+}
+
+int ismrmrd_append_waveform(const ISMRMRD_Dataset *dset, const ISMRMRD_Waveform *wav) {
     int status;
+    const char *path;
+    hid_t datatype;
+    HDF5_Waveform hdf5wav[1];
+
+    if (dset==NULL) {
+        return ISMRMRD_PUSH_ERR(ISMRMRD_RUNTIMEERROR, "Dataset pointer should not be NULL.");
+    }
+    if (wav==NULL) {
+        return ISMRMRD_PUSH_ERR(ISMRMRD_RUNTIMEERROR, "Acquisition pointer should not be NULL.");
+    }
+
+    /* The path to the acqusition data */
+    path = dset->cache->waveformpath;
+
+    /* The acquisition datatype */
+    datatype = get_hdf5type_waveform();
+
+    /* Create the HDF5 version of the acquisition */
+    hdf5wav[0].head = wav->head;
+    hdf5wav[0].data.len = wav->head.number_of_samples * wav->head.channels;
+    hdf5wav[0].data.p = wav->data;
+
+    /* Write it */
+    status = append_element(dset, path, hdf5wav, datatype, 0, NULL);
+    if (status != ISMRMRD_NOERROR) {
+        return ISMRMRD_PUSH_ERR(ISMRMRD_FILEERROR, "Failed to append acquisition.");
+    }
+
+    return ISMRMRD_NOERROR;
+}
+
+int ismrmrd_read_waveform(const ISMRMRD_Dataset *dset, uint32_t index, ISMRMRD_Waveform *wav)
+{
     hid_t datatype;
-    char *path, *headerpath, *attrpath, *datapath;
-    size_t dims[4];
+    herr_t status;
+    HDF5_Waveform hdf5wav;
+    const char *path;
 
     if (dset==NULL) {
         return ISMRMRD_PUSH_ERR(ISMRMRD_RUNTIMEERROR, "Dataset pointer should not be NULL.");
     }
-    if (varname==NULL) {
-        return ISMRMRD_PUSH_ERR(ISMRMRD_RUNTIMEERROR, "Varname should not be NULL.");
-    }
-    if (im==NULL) {
-        return ISMRMRD_PUSH_ERR(ISMRMRD_RUNTIMEERROR, "Image pointer should not be NULL.");
+    if (wav==NULL) {
+        return ISMRMRD_PUSH_ERR(ISMRMRD_RUNTIMEERROR, "Waveform pointer should not be NULL.");
     }
 
-    /* The group for this set of images */
-    /* /groupname/varname */
-    path = make_path(dset, varname);
-    /* Make sure the path exists */
-    create_link(dset, path);        
+    /* The path to the acquisition data */
+    path = dset->cache->waveformpath;
 
-    /* Handle the header */
-    headerpath = append_to_path(dset, path, "header");
-    datatype = get_hdf5type_imageheader();
-    status = append_element(dset, headerpath, (void *) &im->head, datatype, 0, NULL);
+    /* The acquisition datatype */
+    datatype = get_hdf5type_waveform();
+
+    status = read_element(dset, path, &hdf5wav, datatype, index);
     if (status != ISMRMRD_NOERROR) {
-        return ISMRMRD_PUSH_ERR(ISMRMRD_FILEERROR, "Failed to append image header.");
+        return ISMRMRD_PUSH_ERR(ISMRMRD_FILEERROR, "Failed to read waveform.");
     }
-    status = H5Tclose(datatype);
-    free(headerpath);
+    memcpy(&wav->head, &hdf5wav.head, sizeof(ISMRMRD_WaveformHeader));
+    ismrmrd_make_consistent_waveform(wav);
+    memcpy(wav->data, hdf5wav.data.p, ismrmrd_size_of_waveform_data(wav));
 
-    /* Handle the attribute string */
-    attrpath = append_to_path(dset, path, "attributes");
-    datatype = get_hdf5type_image_attribute_string();
-    status = append_element(dset, attrpath, (void *) &im->attribute_string, datatype, 0, NULL);
-    if (status != ISMRMRD_NOERROR) {
-        return ISMRMRD_PUSH_ERR(ISMRMRD_FILEERROR, "Failed to append image attribute string.");
+    /* clean up */
+    free(hdf5wav.data.p);
+
+    return ISMRMRD_NOERROR;
+}
+
+uint32_t ismrmrd_get_number_of_waveforms(const ISMRMRD_Dataset *dset) {
+    const char *path;
+    uint32_t numacq;
+
+    if (dset==NULL) {
+        ISMRMRD_PUSH_ERR(ISMRMRD_RUNTIMEERROR, "Pointer should not be NULL.");
+        return 0;
     }
-    status = H5Tclose(datatype);
-    free(attrpath);
+    /* The path to the acqusition data */
+    path = dset->cache->waveformpath;
+    numacq = get_number_of_elements(dset, path);
+    return numacq;
+}
+
+int ismrmrd_append_array(const ISMRMRD_Dataset *dset, const char *varname, const ISMRMRD_NDArray *arr) {
+    int status;
+    uint16_t ndim;
+    size_t *dims;
+    int n;
+    char *path;
+
+    if (dset==NULL) {
+        return ISMRMRD_PUSH_ERR(ISMRMRD_RUNTIMEERROR, "Dataset pointer should not be NULL.");
+    }
+    if (varname==NULL) {
+        return ISMRMRD_PUSH_ERR(ISMRMRD_RUNTIMEERROR, "Varname should not be NULL.");
+    }
+    if (arr==NULL) {
+        return ISMRMRD_PUSH_ERR(ISMRMRD_RUNTIMEERROR, "Array pointer should not be NULL.");
+    }
+
+    /* The group for this set */
+    /* /groupname/varname */
+    path = make_path(dset, varname);
 
     /* Handle the data */
-    datapath = append_to_path(dset, path, "data");
-    datatype = get_hdf5type_ndarray(im->head.data_type);
+    ndim = arr->ndim;
+    dims = (size_t *) malloc(ndim*sizeof(size_t));
     /* permute the dimensions in the hdf5 file */
-    dims[3] = im->head.matrix_size[0];
-    dims[2] = im->head.matrix_size[1];
-    dims[1] = im->head.matrix_size[2];
-    dims[0] = im->head.channels;
-    status = append_element(dset, datapath, im->data, datatype, 4, dims);
+    for (n=0; n<ndim; n++) {
+        dims[ndim-n-1] = arr->dims[n];
+    }
+    status = append_samples(dset, path, arr->data, arr->data_type, ndim, dims);
     if (status != ISMRMRD_NOERROR) {
-        return ISMRMRD_PUSH_ERR(ISMRMRD_FILEERROR, "Failed to append image data.");
+        free(dims);
+        return ISMRMRD_PUSH_ERR(ISMRMRD_FILEERROR, "Failed to append array.");
     }
-    status = H5Tclose(datatype);
-    free(datapath);
 
     /* Final cleanup */
-    if (status < 0) {
-        H5Ewalk2(H5E_DEFAULT, H5E_WALK_UPWARD, walk_hdf5_errors, NULL);
-        return ISMRMRD_PUSH_ERR(ISMRMRD_HDF5ERROR, "Failed to close datatype.");
-    }
+    free(dims);
     free(path);
 
     return ISMRMRD_NOERROR;
 }
 
-uint32_t ismrmrd_get_number_of_images(const ISMRMRD_Dataset *dset, const char *varname)
-{
-    char *path, *headerpath;
-    uint32_t numimages;
+uint32_t ismrmrd_get_number_of_arrays(const ISMRMRD_Dataset *dset, const char *varname) {
+    char *path;
+    uint32_t numarrays;
 
     if (dset==NULL) {
         ISMRMRD_PUSH_ERR(ISMRMRD_RUNTIMEERROR, "Dataset pointer should not be NULL.");
@@ -1316,25 +3984,20 @@ uint32_t ismrmrd_get_number_of_images(const ISMRMRD_Dataset *dset, const char *v
         ISMRMRD_PUSH_ERR(ISMRMRD_RUNTIMEERROR, "Varname should not be NULL.");
         return 0;
     }
-    /* The group for this set of images */
+
+    /* The group for this set */
     /* /groupname/varname */
     path = make_path(dset, varname);
-    /* The path to the acqusition image headers */
-    headerpath = append_to_path(dset, path, "header");
-    numimages = get_number_of_elements(dset, headerpath);
-    free(headerpath);
+    numarrays = get_number_of_elements(dset, path);
     free(path);
-    return numimages;
+    return numarrays;
 }
 
-
-int ismrmrd_read_image(const ISMRMRD_Dataset *dset, const char *varname,
-        const uint32_t index, ISMRMRD_Image *im) {
-
+int ismrmrd_read_array(const ISMRMRD_Dataset *dset, const char *varname,
+        const uint32_t index, ISMRMRD_NDArray *arr) {    
     int status;
     hid_t datatype;
-    char *path, *headerpath, *attrpath, *datapath, *attr_string;
-    uint32_t numims;
+    char *path;
 
     if (dset==NULL) {
         return ISMRMRD_PUSH_ERR(ISMRMRD_RUNTIMEERROR, "Dataset pointer should not be NULL.");
@@ -1342,276 +4005,790 @@ int ismrmrd_read_image(const ISMRMRD_Dataset *dset, const char *varname,
     if (varname==NULL) {
         return ISMRMRD_PUSH_ERR(ISMRMRD_RUNTIMEERROR, "Varname should not be NULL.");
     }
-    if (im==NULL) {
-        return ISMRMRD_PUSH_ERR(ISMRMRD_RUNTIMEERROR, "Image pointer should not be NULL.");
-    }
-
-    numims = ismrmrd_get_number_of_images(dset, varname);
-
-    if (index > numims) {
-        return ISMRMRD_PUSH_ERR(ISMRMRD_RUNTIMEERROR, "Index requested exceeds number of images in the dataset.");
+    if (arr==NULL) {
+        return ISMRMRD_PUSH_ERR(ISMRMRD_RUNTIMEERROR, "Array pointer should not be NULL.");
     }
 
-    /* The group for this set of images */
+    /* The group for this set */
     /* /groupname/varname */
     path = make_path(dset, varname);
 
-    /* Handle the header */
-    headerpath = append_to_path(dset, path, "header");
-    datatype = get_hdf5type_imageheader();
-    status = read_element(dset, headerpath, (void *) &im->head, datatype, index);
+    /* get the array properties */
+    status = get_array_properties(dset, path, &arr->ndim, arr->dims, &arr->data_type);
     if (status != ISMRMRD_NOERROR) {
-        return ISMRMRD_PUSH_ERR(ISMRMRD_FILEERROR, "Failed to read image header.");
+        free(path);
+        return ISMRMRD_PUSH_ERR(ISMRMRD_FILEERROR, "Failed to read array properties.");
     }
-    free(headerpath);
-    H5Tclose(datatype);
+    datatype = get_hdf5type_ndarray(arr->data_type);
 
-    /* Allocate the memory for the attribute string and the data */
-    ismrmrd_make_consistent_image(im);
+    /* allocate the memory */
+    ismrmrd_make_consistent_ndarray(arr);
 
-    /* Handle the attribute string */
-    attrpath = append_to_path(dset, path, "attributes");
-    datatype = get_hdf5type_image_attribute_string();
-    status = read_element(dset, attrpath, (void *) &attr_string, datatype, index);
+    /* read the data */
+    status = read_element(dset, path, arr->data, datatype, index);
     if (status != ISMRMRD_NOERROR) {
-        return ISMRMRD_PUSH_ERR(ISMRMRD_FILEERROR, "Failed to read image attribute string.");
+        return ISMRMRD_PUSH_ERR(ISMRMRD_FILEERROR, "Failed to append array.");
     }
-    free(attrpath);
-    H5Tclose(datatype);
 
-    /* copy the attribute string read from the file into the Image */
-    memcpy(im->attribute_string, attr_string, ismrmrd_size_of_image_attribute_string(im));
-    free(attr_string);
+    /* Final cleanup */
+    free(path);
 
-    /* Handle the data */
-    datapath = append_to_path(dset, path, "data");
-    datatype = get_hdf5type_ndarray(im->head.data_type);
-    status = read_element(dset, datapath, im->data, datatype, index);
+    return ISMRMRD_NOERROR;
+}
+
+int ismrmrd_read_array_properties(const ISMRMRD_Dataset *dset, const char *varname,
+        uint16_t *ndim, size_t dims[ISMRMRD_NDARRAY_MAXDIM], uint16_t *data_type) {
+    int status;
+    char *path;
+
+    if (dset==NULL) {
+        return ISMRMRD_PUSH_ERR(ISMRMRD_RUNTIMEERROR, "Dataset pointer should not be NULL.");
+    }
+    if (varname==NULL || ndim==NULL || dims==NULL || data_type==NULL) {
+        return ISMRMRD_PUSH_ERR(ISMRMRD_RUNTIMEERROR, "Varname and properties should not be NULL.");
+    }
+
+    path = make_path(dset, varname);
+    status = get_array_properties(dset, path, ndim, dims, data_type);
+    free(path);
     if (status != ISMRMRD_NOERROR) {
-        return ISMRMRD_PUSH_ERR(ISMRMRD_FILEERROR, "Failed to read image data.");
+        return ISMRMRD_PUSH_ERR(ISMRMRD_FILEERROR, "Failed to read array properties.");
     }
-    free(datapath);
+    return ISMRMRD_NOERROR;
+}
 
-    /* Final cleanup */
-    status = H5Tclose(datatype);
-    if (status < 0) {
-        H5Ewalk2(H5E_DEFAULT, H5E_WALK_UPWARD, walk_hdf5_errors, NULL);
-        return ISMRMRD_PUSH_ERR(ISMRMRD_HDF5ERROR, "Failed to close datatype.");
+int ismrmrd_init_array_region(ISMRMRD_ArrayRegion *region)
+{
+    int d;
+
+    if (NULL == region) {
+        return ISMRMRD_PUSH_ERR(ISMRMRD_RUNTIMEERROR, "NULL region parameter");
+    }
+    memset(region, 0, sizeof(ISMRMRD_ArrayRegion));
+    for (d = 0; d < ISMRMRD_NDARRAY_MAXDIM; d++) {
+        region->stride[d] = 1;
+    }
+    return ISMRMRD_NOERROR;
+}
+
+int ismrmrd_read_array_region(const ISMRMRD_Dataset *dset, const char *varname,
+        const uint32_t index, const ISMRMRD_ArrayRegion *region, ISMRMRD_NDArray *arr) {
+    int status;
+    char *path;
+    ISMRMRD_DatasetHandle *handle;
+    uint16_t ndim, data_type;
+    size_t dims[ISMRMRD_NDARRAY_MAXDIM], stride, available;
+    hsize_t start[ISMRMRD_NDARRAY_MAXDIM + 1], step[ISMRMRD_NDARRAY_MAXDIM + 1];
+    hsize_t count[ISMRMRD_NDARRAY_MAXDIM + 1];
+    hid_t memspace;
+    herr_t h5status;
+    int d;
+
+    if (dset==NULL) {
+        return ISMRMRD_PUSH_ERR(ISMRMRD_RUNTIMEERROR, "Dataset pointer should not be NULL.");
+    }
+    if (varname==NULL) {
+        return ISMRMRD_PUSH_ERR(ISMRMRD_RUNTIMEERROR, "Varname should not be NULL.");
+    }
+    if (region==NULL || arr==NULL) {
+        return ISMRMRD_PUSH_ERR(ISMRMRD_RUNTIMEERROR, "Region and array pointers should not be NULL.");
     }
+
+    path = make_path(dset, varname);
+    status = get_array_properties(dset, path, &ndim, dims, &data_type);
+    handle = find_handle(dset, path);
     free(path);
+    if (status != ISMRMRD_NOERROR || handle == NULL) {
+        return ISMRMRD_PUSH_ERR(ISMRMRD_FILEERROR, "Failed to read array properties.");
+    }
+    if (index >= handle->count) {
+        return ISMRMRD_PUSH_ERR(ISMRMRD_FILEERROR, "Index out of range.");
+    }
+
+    /* resolve and check the region, the file holds the dimensions in reverse after the record axis */
+    start[0] = index;
+    step[0] = 1;
+    count[0] = 1;
+    for (d = 0; d < ndim; d++) {
+        stride = region->stride[d] > 0 ? region->stride[d] : 1;
+        if (region->offset[d] >= dims[d]) {
+            return ISMRMRD_PUSH_ERR(ISMRMRD_RUNTIMEERROR, "Region out of range.");
+        }
+        available = (dims[d] - region->offset[d] + stride - 1) / stride;
+        if (region->count[d] > available) {
+            return ISMRMRD_PUSH_ERR(ISMRMRD_RUNTIMEERROR, "Region out of range.");
+        }
+        arr->dims[d] = region->count[d] > 0 ? region->count[d] : available;
+        start[ndim - d] = region->offset[d];
+        step[ndim - d] = stride;
+        count[ndim - d] = arr->dims[d];
+    }
+    arr->ndim = ndim;
+    arr->data_type = data_type;
+    if (ismrmrd_make_consistent_ndarray(arr) != ISMRMRD_NOERROR) {
+        return ISMRMRD_PUSH_ERR(ISMRMRD_MEMORYERROR, "Failed to allocate the array.");
+    }
+
+    h5status = H5Sselect_hyperslab(handle->filespace, H5S_SELECT_SET, start, step, count, NULL);
+    if (h5status < 0) {
+        H5Ewalk2(H5E_DEFAULT, H5E_WALK_UPWARD, walk_hdf5_errors, NULL);
+        return ISMRMRD_PUSH_ERR(ISMRMRD_HDF5ERROR, "Failed to select hyperslab");
+    }
+    memspace = H5Screate_simple(ndim + 1, count, NULL);
+    h5status = H5Dread(handle->dataset, get_hdf5type_ndarray(data_type), memspace, handle->filespace,
+            get_transfer_properties(dset, false), arr->data);
+    H5Sclose(memspace);
+    if (h5status < 0) {
+        H5Ewalk2(H5E_DEFAULT, H5E_WALK_UPWARD, walk_hdf5_errors, NULL);
+        return ISMRMRD_PUSH_ERR(ISMRMRD_HDF5ERROR, "Failed to read array.");
+    }
+    return ISMRMRD_NOERROR;
+}
+
+int ismrmrd_read_mantissa_bits(const ISMRMRD_Dataset *dset, const char *varname, uint16_t *bits) {
+    char *path, *datapath;
+    hid_t dataset, attr;
+    htri_t exists;
+    herr_t h5status = 0;
+
+    if (dset==NULL) {
+        return ISMRMRD_PUSH_ERR(ISMRMRD_RUNTIMEERROR, "Dataset pointer should not be NULL.");
+    }
+    if (varname==NULL || bits==NULL) {
+        return ISMRMRD_PUSH_ERR(ISMRMRD_RUNTIMEERROR, "Varname and bits should not be NULL.");
+    }
+    *bits = 0;
+
+    /* the samples of an image are in its data dataset, those of an array in the variable,
+     * and those of the acquisitions in the samples dataset, if they are kept apart */
+    path = make_path(dset, varname);
+    if (path != NULL && strcmp(path, dset->cache->datapath) == 0) {
+        free(path);
+        if (!link_exists(dset, dset->cache->datapath)) {
+            return ISMRMRD_PUSH_ERR(ISMRMRD_FILEERROR, "Variable does not exist.");
+        }
+        if (!link_exists(dset, dset->cache->samplepath)) {
+            return ISMRMRD_NOERROR;
+        }
+        datapath = make_path(dset, "acquisition_samples");
+    }
+    else {
+        datapath = append_to_path(dset, path, "data");
+        if (!link_exists(dset, datapath)) {
+            free(datapath);
+            datapath = path;
+            path = NULL;
+        }
+        free(path);
+    }
+    if (!link_exists(dset, datapath)) {
+        free(datapath);
+        return ISMRMRD_PUSH_ERR(ISMRMRD_FILEERROR, "Variable does not exist.");
+    }
+
+    dataset = H5Dopen2(dset->fileid, datapath, H5P_DEFAULT);
+    free(datapath);
+    if (dataset < 0) {
+        H5Ewalk2(H5E_DEFAULT, H5E_WALK_UPWARD, walk_hdf5_errors, NULL);
+        return ISMRMRD_PUSH_ERR(ISMRMRD_FILEERROR, "Failed to open dataset.");
+    }
+    exists = H5Aexists(dataset, ISMRMRD_MANTISSA_BITS_ATTRIBUTE);
+    if (exists > 0) {
+        attr = H5Aopen(dataset, ISMRMRD_MANTISSA_BITS_ATTRIBUTE, H5P_DEFAULT);
+        h5status = attr < 0 ? -1 : H5Aread(attr, H5T_NATIVE_UINT16, bits);
+        if (attr >= 0) {
+            H5Aclose(attr);
+        }
+    }
+    H5Dclose(dataset);
+    if (exists < 0 || h5status < 0) {
+        H5Ewalk2(H5E_DEFAULT, H5E_WALK_UPWARD, walk_hdf5_errors, NULL);
+        return ISMRMRD_PUSH_ERR(ISMRMRD_HDF5ERROR, "Failed to read the mantissa bits attribute.");
+    }
+    return ISMRMRD_NOERROR;
+}
+
+
+/*************************************/
+/* Repacking and mapped file layouts */
+/*************************************/
 
-    return ISMRMRD_NOERROR;
-}
+/* Records are copied in blocks of about this size */
+#define ISMRMRD_REPACK_BLOCK_BYTES (4 * 1024 * 1024)
 
+/* Acquisitions are only padded to fixed size records when that takes up to this
+ * factor more room than their samples do */
+#define ISMRMRD_REPACK_MAX_PADDING 2
 
-int ismrmrd_append_waveform(const ISMRMRD_Dataset *dset, const ISMRMRD_Waveform *wav) {
+typedef struct ISMRMRD_Repack {
+    const ISMRMRD_Dataset *dset;
+    hid_t src;   /* the group being repacked */
+    hid_t dst;   /* the same group in the new file */
     int status;
-    char *path;
-    hid_t datatype;
-    HDF5_Waveform hdf5wav[1];
+} ISMRMRD_Repack;
 
-    if (dset==NULL) {
-        return ISMRMRD_PUSH_ERR(ISMRMRD_RUNTIMEERROR, "Dataset pointer should not be NULL.");
+static void trim_handles(const ISMRMRD_Dataset *dset) {
+    ISMRMRD_DatasetHandle *handle;
+
+    if (dset->cache->data != NULL) {
+        trim_handle(dset->cache->data);
     }
-    if (wav==NULL) {
-        return ISMRMRD_PUSH_ERR(ISMRMRD_RUNTIMEERROR, "Acquisition pointer should not be NULL.");
+    if (dset->cache->waveforms != NULL) {
+        trim_handle(dset->cache->waveforms);
+    }
+    for (handle = dset->cache->vars; handle != NULL; handle = handle->next) {
+        trim_handle(handle);
     }
+}
 
-    /* The path to the acqusition data */
-    path = make_path(dset, "waveforms");
+static herr_t copy_attribute(hid_t location, const char *name, const H5A_info_t *info, void *op_data) {
+    hid_t dst = *(hid_t *) op_data;
+    hid_t attr, copy = -1, filetype, memtype, space;
+    herr_t h5status = -1;
+    size_t size;
+    void *buffer;
+
+    (void)info;
+    attr = H5Aopen(location, name, H5P_DEFAULT);
+    filetype = H5Aget_type(attr);
+    memtype = H5Tget_native_type(filetype, H5T_DIR_DEFAULT);
+    space = H5Aget_space(attr);
+    size = (size_t) H5Sget_simple_extent_npoints(space) * H5Tget_size(memtype);
+    buffer = malloc(size > 0 ? size : 1);
+    if (attr >= 0 && filetype >= 0 && memtype >= 0 && space >= 0 && buffer != NULL &&
+            H5Aread(attr, memtype, buffer) >= 0) {
+        copy = H5Acreate2(dst, name, filetype, space, H5P_DEFAULT, H5P_DEFAULT);
+        h5status = copy < 0 ? -1 : H5Awrite(copy, memtype, buffer);
+        if (H5Tdetect_class(memtype, H5T_VLEN) > 0 || H5Tis_variable_str(memtype) > 0) {
+            H5Dvlen_reclaim(memtype, space, H5P_DEFAULT, buffer);
+        }
+    }
+    free(buffer);
+    if (copy >= 0) {
+        H5Aclose(copy);
+    }
+    if (space >= 0) {
+        H5Sclose(space);
+    }
+    if (memtype >= 0) {
+        H5Tclose(memtype);
+    }
+    if (filetype >= 0) {
+        H5Tclose(filetype);
+    }
+    if (attr >= 0) {
+        H5Aclose(attr);
+    }
+    return h5status;
+}
 
-    /* The acquisition datatype */
-    datatype = get_hdf5type_waveform();
+static int copy_attributes(hid_t src, hid_t dst) {
+    if (H5Aiterate2(src, H5_INDEX_NAME, H5_ITER_NATIVE, NULL, copy_attribute, &dst) < 0) {
+        H5Ewalk2(H5E_DEFAULT, H5E_WALK_UPWARD, walk_hdf5_errors, NULL);
+        return ISMRMRD_PUSH_ERR(ISMRMRD_HDF5ERROR, "Failed to copy attributes");
+    }
+    return ISMRMRD_NOERROR;
+}
 
-    /* Create the HDF5 version of the acquisition */
-    hdf5wav[0].head = wav->head;
-    hdf5wav[0].data.len = wav->head.number_of_samples * wav->head.channels;
-    hdf5wav[0].data.p = wav->data;
+/* Creates a dataset whose records lie one after the other at a fixed place in the file */
+static hid_t create_contiguous(hid_t location, const char *name, const hid_t datatype,
+        const int rank, const hsize_t *dims)
+{
+    hid_t props, space, dataset;
 
-    /* Write it */
-    status = append_element(dset, path, hdf5wav, datatype, 0, NULL);
-    if (status != ISMRMRD_NOERROR) {
-        return ISMRMRD_PUSH_ERR(ISMRMRD_FILEERROR, "Failed to append acquisition.");
+    props = H5Pcreate(H5P_DATASET_CREATE);
+    space = H5Screate_simple(rank, dims, NULL);
+    dataset = -1;
+    if (props >= 0 && space >= 0 && H5Pset_layout(props, H5D_CONTIGUOUS) >= 0 &&
+            H5Pset_alloc_time(props, H5D_ALLOC_TIME_EARLY) >= 0) {
+        dataset = H5Dcreate2(location, name, datatype, space, H5P_DEFAULT, props, H5P_DEFAULT);
+    }
+    if (space >= 0) {
+        H5Sclose(space);
+    }
+    if (props >= 0) {
+        H5Pclose(props);
+    }
+    if (dataset < 0) {
+        H5Ewalk2(H5E_DEFAULT, H5E_WALK_UPWARD, walk_hdf5_errors, NULL);
+        ISMRMRD_PUSH_ERR(ISMRMRD_HDF5ERROR, "Failed to create dataset");
     }
+    return dataset;
+}
 
-    free(path);
+/* Copies the records of src to dst in blocks, converting them to datatype */
+static int copy_records(hid_t src, hid_t dst, const hid_t datatype, const int rank, const hsize_t *dims)
+{
+    hsize_t offset[ISMRMRD_NDARRAY_MAXDIM + 1], count[ISMRMRD_NDARRAY_MAXDIM + 1];
+    hsize_t record_size, block;
+    hid_t srcspace, dstspace, memspace;
+    herr_t h5status = 0;
+    void *buffer;
+    int d;
 
-    /* Clean up */
-    status = H5Tclose(datatype);
-    if (status < 0) {
-        H5Ewalk2(H5E_DEFAULT, H5E_WALK_UPWARD, walk_hdf5_errors, NULL);
-        return ISMRMRD_PUSH_ERR(ISMRMRD_HDF5ERROR, "Failed to close datatype.");
+    record_size = H5Tget_size(datatype);
+    for (d = 1; d < rank; d++) {
+        offset[d] = 0;
+        count[d] = dims[d];
+        record_size *= dims[d];
+    }
+    block = record_size > 0 ? ISMRMRD_REPACK_BLOCK_BYTES / record_size : 1;
+    if (block == 0) {
+        block = 1;
+    }
+    if (block > dims[0]) {
+        block = dims[0];
+    }
+    if (block == 0) {
+        return ISMRMRD_NOERROR;
     }
 
+    buffer = malloc((size_t) (block * record_size));
+    if (buffer == NULL) {
+        return ISMRMRD_PUSH_ERR(ISMRMRD_MEMORYERROR, "Failed to malloc copy buffer.");
+    }
+    srcspace = H5Dget_space(src);
+    dstspace = H5Dget_space(dst);
+    for (offset[0] = 0; offset[0] < dims[0] && h5status >= 0; offset[0] += count[0]) {
+        count[0] = (dims[0] - offset[0] < block) ? dims[0] - offset[0] : block;
+        memspace = H5Screate_simple(rank, count, NULL);
+        h5status = H5Sselect_hyperslab(srcspace, H5S_SELECT_SET, offset, NULL, count, NULL);
+        if (h5status >= 0) {
+            h5status = H5Sselect_hyperslab(dstspace, H5S_SELECT_SET, offset, NULL, count, NULL);
+        }
+        if (h5status >= 0) {
+            h5status = H5Dread(src, datatype, memspace, srcspace, H5P_DEFAULT, buffer);
+        }
+        if (h5status >= 0) {
+            h5status = H5Dwrite(dst, datatype, memspace, dstspace, H5P_DEFAULT, buffer);
+        }
+        H5Sclose(memspace);
+    }
+    H5Sclose(dstspace);
+    H5Sclose(srcspace);
+    free(buffer);
+    if (h5status < 0) {
+        H5Ewalk2(H5E_DEFAULT, H5E_WALK_UPWARD, walk_hdf5_errors, NULL);
+        return ISMRMRD_PUSH_ERR(ISMRMRD_HDF5ERROR, "Failed to copy records");
+    }
     return ISMRMRD_NOERROR;
 }
 
-int ismrmrd_read_waveform(const ISMRMRD_Dataset *dset, uint32_t index, ISMRMRD_Waveform *wav)
+/* Rewrites a dataset of fixed size records contiguously, with the native type readers ask for */
+static int repack_fixed(ISMRMRD_Repack *repack, const char *name, hid_t src)
 {
-    hid_t datatype;
-    herr_t status;
-    HDF5_Waveform hdf5wav;
-    char *path;
+    hsize_t dims[ISMRMRD_NDARRAY_MAXDIM + 1];
+    hid_t filetype, space, datatype, dst;
+    const char *base;
+    uint16_t data_type;
+    int rank, status;
+
+    filetype = H5Dget_type(src);
+    space = H5Dget_space(src);
+    rank = H5Sget_simple_extent_ndims(space);
+    if (rank < 1 || rank > ISMRMRD_NDARRAY_MAXDIM + 1) {
+        H5Sclose(space);
+        H5Tclose(filetype);
+        return ISMRMRD_PUSH_ERR(ISMRMRD_FILEERROR, "Dimensions are incorrect.");
+    }
+    H5Sget_simple_extent_dims(space, dims, NULL);
+    H5Sclose(space);
+
+    /* image headers and samples are stored as their structs, anything else as HDF5's native type */
+    base = strrchr(name, '/');
+    data_type = get_ndarray_data_type(filetype);
+    if (base != NULL && strcmp(base + 1, "header") == 0 && H5Tget_class(filetype) == H5T_COMPOUND) {
+        datatype = H5Tcopy(get_hdf5type_imageheader());
+    }
+    else if (data_type != 0) {
+        datatype = H5Tcopy(get_hdf5type_ndarray(data_type));
+    }
+    else {
+        datatype = H5Tget_native_type(filetype, H5T_DIR_DEFAULT);
+    }
+    H5Tclose(filetype);
 
-    if (dset==NULL) {
-        return ISMRMRD_PUSH_ERR(ISMRMRD_RUNTIMEERROR, "Dataset pointer should not be NULL.");
+    dst = create_contiguous(repack->dst, name, datatype, rank, dims);
+    status = dst < 0 ? ISMRMRD_HDF5ERROR : copy_records(src, dst, datatype, rank, dims);
+    if (status == ISMRMRD_NOERROR) {
+        status = copy_attributes(src, dst);
     }
-    if (wav==NULL) {
-        return ISMRMRD_PUSH_ERR(ISMRMRD_RUNTIMEERROR, "Waveform pointer should not be NULL.");
+    if (dst >= 0) {
+        H5Dclose(dst);
     }
+    H5Tclose(datatype);
+    return status;
+}
 
-    /* The path to the acquisition data */
-    path = make_path(dset, "waveforms");
+/* Rewrites the acquisitions as fixed size records, when padding them doesn't waste too much
+ * room. Otherwise acquisitions whose samples are kept apart are rewritten as variable
+ * length records, the others are left for the caller to copy. */
+static int repack_acquisitions(ISMRMRD_Repack *repack, const char *name, bool *repacked)
+{
+    const ISMRMRD_Dataset *dset = repack->dset;
+    ISMRMRD_AcquisitionHeader *heads = NULL;
+    ISMRMRD_Acquisition *acqs = NULL;
+    hsize_t traj_length = 0, data_length = 0, samples = 0, traj_size, data_size;
+    hsize_t record_size, block, offset, count;
+    size_t traj_offset, data_offset;
+    hid_t datatype = -1, dst = -1, dstspace = -1, memspace;
+    herr_t h5status = 0;
+    int status = ISMRMRD_NOERROR;
+    uint32_t nacqs, first, n;
+    char *buffer = NULL, *record;
+    HDF5_Acquisition *vlen_record;
+    bool padded;
+
+    *repacked = false;
+    nacqs = ismrmrd_get_number_of_acquisitions(dset);
+    if (nacqs == 0) {
+        return ISMRMRD_NOERROR;
+    }
 
-    /* The acquisition datatype */
-    datatype = get_hdf5type_waveform();
+    /* the longest trajectory and data */
+    heads = (ISMRMRD_AcquisitionHeader *) malloc(ISMRMRD_INDEX_BLOCK * sizeof(ISMRMRD_AcquisitionHeader));
+    if (heads == NULL) {
+        return ISMRMRD_PUSH_ERR(ISMRMRD_MEMORYERROR, "Failed to malloc acquisition headers.");
+    }
+    for (first = 0; first < nacqs && status == ISMRMRD_NOERROR; first += count) {
+        count = (nacqs - first < ISMRMRD_INDEX_BLOCK) ? nacqs - first : ISMRMRD_INDEX_BLOCK;
+        status = ismrmrd_read_acquisition_headers(dset, first, (uint32_t) count, heads);
+        for (n = 0; n < count && status == ISMRMRD_NOERROR; n++) {
+            traj_size = (hsize_t) heads[n].trajectory_dimensions * heads[n].number_of_samples;
+            data_size = 2 * (hsize_t) heads[n].active_channels * heads[n].number_of_samples;
+            traj_length = traj_size > traj_length ? traj_size : traj_length;
+            data_length = data_size > data_length ? data_size : data_length;
+            samples += traj_size + data_size;
+        }
+    }
+    free(heads);
+    if (status != ISMRMRD_NOERROR) {
+        return status;
+    }
+    padded = data_length > 0 && (traj_length + data_length) * nacqs <= ISMRMRD_REPACK_MAX_PADDING * samples;
+    if (!padded && !samples_apart(dset, find_handle(dset, dset->cache->datapath))) {
+        return ISMRMRD_NOERROR;
+    }
 
-    status = read_element(dset, path, &hdf5wav, datatype, index);
-    memcpy(&wav->head, &hdf5wav.head, sizeof(ISMRMRD_WaveformHeader));
-    ismrmrd_make_consistent_waveform(wav);
-    memcpy(wav->data, hdf5wav.data.p, ismrmrd_size_of_waveform_data(wav));
+    datatype = padded ? build_hdf5type_repacked_acquisition(traj_length, data_length) : H5Tcopy(get_hdf5type_acquisition());
+    if (datatype < 0) {
+        return ISMRMRD_PUSH_ERR(ISMRMRD_HDF5ERROR, "Failed to repack acquisitions");
+    }
+    record_size = H5Tget_size(datatype);
+    traj_offset = (padded && traj_length > 0) ? H5Tget_member_offset(datatype, 1) : 0;
+    data_offset = padded ? H5Tget_member_offset(datatype, traj_length > 0 ? 2 : 1) : 0;
+    count = nacqs;
+    dst = create_contiguous(repack->dst, name, datatype, 1, &count);
 
-    /* clean up */
-    free(path);
-    free(hdf5wav.data.p);
+    block = ISMRMRD_REPACK_BLOCK_BYTES / record_size;
+    block = block == 0 ? 1 : (block > nacqs ? nacqs : block);
+    buffer = (char *) malloc((size_t) (block * record_size));
+    acqs = (ISMRMRD_Acquisition *) malloc((size_t) block * sizeof(ISMRMRD_Acquisition));
+    if (buffer == NULL || acqs == NULL) {
+        status = ISMRMRD_PUSH_ERR(ISMRMRD_MEMORYERROR, "Failed to malloc acquisition block.");
+        block = 0;
+    }
+    for (n = 0; n < block; n++) {
+        ismrmrd_init_acquisition(&acqs[n]);
+    }
+    dstspace = dst >= 0 ? H5Dget_space(dst) : -1;
+    if (dst < 0) {
+        status = ISMRMRD_HDF5ERROR;
+    }
 
-    status = H5Tclose(datatype);
-    if (status < 0) {
+    for (offset = 0; offset < nacqs && status == ISMRMRD_NOERROR && h5status >= 0; offset += count) {
+        count = (nacqs - offset < block) ? nacqs - offset : block;
+        status = ismrmrd_read_acquisitions(dset, (uint32_t) offset, (uint32_t) count, acqs);
+        if (status != ISMRMRD_NOERROR) {
+            break;
+        }
+        memset(buffer, 0, (size_t) (count * record_size));
+        for (n = 0; n < count; n++) {
+            record = buffer + n * record_size;
+            if (!padded) {
+                /* the variable length fields point at the samples just read */
+                vlen_record = (HDF5_Acquisition *) record;
+                vlen_record->head = acqs[n].head;
+                vlen_record->traj.len = ismrmrd_size_of_acquisition_traj(&acqs[n]) / sizeof(float);
+                vlen_record->traj.p = acqs[n].traj;
+                vlen_record->data.len = ismrmrd_size_of_acquisition_data(&acqs[n]) / sizeof(float);
+                vlen_record->data.p = acqs[n].data;
+                continue;
+            }
+            memcpy(record, &acqs[n].head, sizeof(ISMRMRD_AcquisitionHeader));
+            memcpy(record + traj_offset, acqs[n].traj, ismrmrd_size_of_acquisition_traj(&acqs[n]));
+            memcpy(record + data_offset, acqs[n].data, ismrmrd_size_of_acquisition_data(&acqs[n]));
+        }
+        memspace = H5Screate_simple(1, &count, NULL);
+        h5status = H5Sselect_hyperslab(dstspace, H5S_SELECT_SET, &offset, NULL, &count, NULL);
+        if (h5status >= 0) {
+            h5status = H5Dwrite(dst, datatype, memspace, dstspace, H5P_DEFAULT, buffer);
+        }
+        H5Sclose(memspace);
+    }
+    if (h5status < 0) {
         H5Ewalk2(H5E_DEFAULT, H5E_WALK_UPWARD, walk_hdf5_errors, NULL);
-        return ISMRMRD_PUSH_ERR(ISMRMRD_HDF5ERROR, "Failed to close datatype.");
+        status = ISMRMRD_PUSH_ERR(ISMRMRD_HDF5ERROR, "Failed to write repacked acquisitions");
     }
 
-    return ISMRMRD_NOERROR;
+    for (n = 0; acqs != NULL && n < block; n++) {
+        ismrmrd_cleanup_acquisition(&acqs[n]);
+    }
+    free(acqs);
+    free(buffer);
+    if (dstspace >= 0) {
+        H5Sclose(dstspace);
+    }
+    if (dst >= 0) {
+        H5Dclose(dst);
+    }
+    H5Tclose(datatype);
+    *repacked = (status == ISMRMRD_NOERROR);
+    return status;
 }
 
-uint32_t ismrmrd_get_number_of_waveforms(const ISMRMRD_Dataset *dset) {
-    char *path;
-    uint32_t numacq;
-
-    if (dset==NULL) {
-        ISMRMRD_PUSH_ERR(ISMRMRD_RUNTIMEERROR, "Pointer should not be NULL.");
-        return 0;
+/* Whether name, relative to the dataset group, is one of the datasets that keep the
+ * samples of the acquisitions apart */
+static bool is_sample_dataset(const ISMRMRD_Dataset *dset, const char *name) {
+    if (strcmp(name, "acquisition_samples") != 0 && strcmp(name, "acquisition_trajectories") != 0 &&
+            strcmp(name, "acquisition_offsets") != 0) {
+        return false;
     }
-    /* The path to the acqusition data */
-    path = make_path(dset, "waveforms");
-    numacq = get_number_of_elements(dset, path);
-    free(path);
-    return numacq;
+    return samples_apart(dset, find_handle(dset, dset->cache->datapath));
 }
 
-int ismrmrd_append_array(const ISMRMRD_Dataset *dset, const char *varname, const ISMRMRD_NDArray *arr) {
-    int status;
-    hid_t datatype;
-    uint16_t ndim;
-    size_t *dims;
-    int n;
-    char *path;
+static herr_t repack_link(hid_t group, const char *name, const H5L_info_t *info, void *op_data) {
+    ISMRMRD_Repack *repack = (ISMRMRD_Repack *) op_data;
+    hid_t object, copy, filetype;
+    bool repacked = false;
+    int status = ISMRMRD_NOERROR;
 
-    if (dset==NULL) {
-        return ISMRMRD_PUSH_ERR(ISMRMRD_RUNTIMEERROR, "Dataset pointer should not be NULL.");
+    (void)group;
+    if (info->type != H5L_TYPE_HARD) {
+        return 0;
     }
-    if (varname==NULL) {
-        return ISMRMRD_PUSH_ERR(ISMRMRD_RUNTIMEERROR, "Varname should not be NULL.");
+    object = H5Oopen(repack->src, name, H5P_DEFAULT);
+    if (object < 0) {
+        H5Ewalk2(H5E_DEFAULT, H5E_WALK_UPWARD, walk_hdf5_errors, NULL);
+        repack->status = ISMRMRD_PUSH_ERR(ISMRMRD_HDF5ERROR, "Failed to open object");
+        return -1;
     }
-    if (arr==NULL) {
-        return ISMRMRD_PUSH_ERR(ISMRMRD_RUNTIMEERROR, "Array pointer should not be NULL.");
+
+    if (H5Iget_type(object) == H5I_GROUP) {
+        copy = H5Gcreate2(repack->dst, name, H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT);
+        status = copy < 0 ? ISMRMRD_HDF5ERROR : copy_attributes(object, copy);
+        if (copy >= 0) {
+            H5Gclose(copy);
+        }
+    }
+    else if (H5Iget_type(object) == H5I_DATASET) {
+        filetype = H5Dget_type(object);
+        if (is_sample_dataset(repack->dset, name)) {
+            /* the samples go into the acquisition records */
+            repacked = true;
+        }
+        else if (strcmp(name, "data") == 0) {
+            status = repack_acquisitions(repack, name, &repacked);
+        }
+        else if (H5Tdetect_class(filetype, H5T_VLEN) == 0 && H5Tis_variable_str(filetype) == 0) {
+            status = repack_fixed(repack, name, object);
+            repacked = true;
+        }
+        H5Tclose(filetype);
+        /* variable length records, e.g. waveforms and image attributes, are copied as they are */
+        if (status == ISMRMRD_NOERROR && !repacked &&
+                H5Ocopy(repack->src, name, repack->dst, name, H5P_DEFAULT, H5P_DEFAULT) < 0) {
+            H5Ewalk2(H5E_DEFAULT, H5E_WALK_UPWARD, walk_hdf5_errors, NULL);
+            status = ISMRMRD_PUSH_ERR(ISMRMRD_HDF5ERROR, "Failed to copy dataset");
+        }
     }
+    H5Oclose(object);
 
-    /* The group for this set */
-    /* /groupname/varname */
-    path = make_path(dset, varname);
+    if (status != ISMRMRD_NOERROR) {
+        repack->status = status;
+        return -1;
+    }
+    return 0;
+}
 
-    /* Handle the data */
-    datatype = get_hdf5type_ndarray(arr->data_type);
-    ndim = arr->ndim;
-    dims = (size_t *) malloc(ndim*sizeof(size_t));
-    /* permute the dimensions in the hdf5 file */
-    for (n=0; n<ndim; n++) {
-        dims[ndim-n-1] = arr->dims[n];
+int ismrmrd_repack_dataset(const ISMRMRD_Dataset *dset, const char *filename) {
+    ISMRMRD_Repack repack;
+    hid_t access, file;
+    herr_t h5status;
+
+    if (dset == NULL || filename == NULL) {
+        return ISMRMRD_PUSH_ERR(ISMRMRD_RUNTIMEERROR, "Dataset and filename should not be NULL.");
     }
-    status = append_element(dset, path, arr->data, datatype, ndim, dims);
-    if (status != ISMRMRD_NOERROR) {
-        free(dims);
-        return ISMRMRD_PUSH_ERR(ISMRMRD_FILEERROR, "Failed to append array.");
+    if (dset->fileid <= 0 || dset->cache == NULL) {
+        return ISMRMRD_PUSH_ERR(ISMRMRD_FILEERROR, "The dataset is not open.");
     }
 
-    /* Final cleanup */
-    free(dims);
-    status = H5Tclose(datatype);
-    if (status < 0) {
+    /* records reserved by the growth policy are not copied */
+    trim_handles(dset);
+
+    access = H5Pcreate(H5P_FILE_ACCESS);
+    H5Pset_alignment(access, 0, ISMRMRD_REPACK_ALIGNMENT);
+    file = H5Fcreate(filename, H5F_ACC_TRUNC, H5P_DEFAULT, access);
+    H5Pclose(access);
+    if (file < 0) {
         H5Ewalk2(H5E_DEFAULT, H5E_WALK_UPWARD, walk_hdf5_errors, NULL);
-        return ISMRMRD_PUSH_ERR(ISMRMRD_HDF5ERROR, "Failed to close datatype.");
+        return ISMRMRD_PUSH_ERR(ISMRMRD_FILEERROR, "Failed to create the repacked file.");
     }
-    free(path);
 
-    return ISMRMRD_NOERROR;
-}
+    repack.dset = dset;
+    repack.status = ISMRMRD_NOERROR;
+    repack.src = H5Gopen2(dset->fileid, dset->groupname, H5P_DEFAULT);
+    repack.dst = -1;
+    if (repack.src >= 0) {
+        access = H5Pcreate(H5P_LINK_CREATE);
+        H5Pset_create_intermediate_group(access, 1);
+        repack.dst = H5Gcreate2(file, dset->groupname, access, H5P_DEFAULT, H5P_DEFAULT);
+        H5Pclose(access);
+    }
+    if (repack.src < 0 || repack.dst < 0) {
+        H5Ewalk2(H5E_DEFAULT, H5E_WALK_UPWARD, walk_hdf5_errors, NULL);
+        repack.status = ISMRMRD_PUSH_ERR(ISMRMRD_FILEERROR, "Failed to open the dataset group.");
+    }
+    else {
+        h5status = H5Lvisit(repack.src, H5_INDEX_NAME, H5_ITER_INC, repack_link, &repack);
+        if (h5status < 0 && repack.status == ISMRMRD_NOERROR) {
+            H5Ewalk2(H5E_DEFAULT, H5E_WALK_UPWARD, walk_hdf5_errors, NULL);
+            repack.status = ISMRMRD_PUSH_ERR(ISMRMRD_HDF5ERROR, "Failed to repack the dataset group.");
+        }
+    }
 
-uint32_t ismrmrd_get_number_of_arrays(const ISMRMRD_Dataset *dset, const char *varname) {
-    char *path;
-    uint32_t numarrays;
+    if (repack.dst >= 0) {
+        H5Gclose(repack.dst);
+    }
+    if (repack.src >= 0) {
+        H5Gclose(repack.src);
+    }
+    if (H5Fclose(file) < 0 && repack.status == ISMRMRD_NOERROR) {
+        H5Ewalk2(H5E_DEFAULT, H5E_WALK_UPWARD, walk_hdf5_errors, NULL);
+        repack.status = ISMRMRD_PUSH_ERR(ISMRMRD_FILEERROR, "Failed to close the repacked file.");
+    }
+    return repack.status;
+}
 
-    if (dset==NULL) {
-        ISMRMRD_PUSH_ERR(ISMRMRD_RUNTIMEERROR, "Dataset pointer should not be NULL.");
-        return 0;
+/* Finds where the records of a repacked dataset lie in the file. The file type must be
+ * datatype, or any of the ndarray types when datatype is negative. */
+static int locate_records(const ISMRMRD_Dataset *dset, const char *path, const hid_t datatype,
+        ISMRMRD_StorageExtent *extent)
+{
+    ISMRMRD_DatasetHandle *handle;
+    H5D_layout_t layout = H5D_LAYOUT_ERROR;
+    haddr_t offset;
+    hid_t props;
+    uint16_t data_type;
+    int d;
+
+    handle = find_handle(dset, path);
+    if (handle == NULL) {
+        return ISMRMRD_PUSH_ERR(ISMRMRD_FILEERROR, "Path to element not found.");
     }
-    if (varname==NULL) {
-        ISMRMRD_PUSH_ERR(ISMRMRD_RUNTIMEERROR, "Varname should not be NULL.");
-        return 0;
+    props = H5Dget_create_plist(handle->dataset);
+    if (props >= 0) {
+        layout = H5Pget_layout(props);
+        H5Pclose(props);
+    }
+    if (layout != H5D_CONTIGUOUS) {
+        return ISMRMRD_PUSH_ERR(ISMRMRD_FILEERROR, "The dataset has not been repacked.");
+    }
+    data_type = datatype < 0 ? get_ndarray_data_type(handle->filetype) : 0;
+    if (datatype >= 0 ? H5Tequal(handle->filetype, datatype) <= 0 : data_type == 0) {
+        return ISMRMRD_PUSH_ERR(ISMRMRD_TYPEERROR, "The dataset is not stored with native types.");
     }
 
-    /* The group for this set */
-    /* /groupname/varname */
-    path = make_path(dset, varname);
-    numarrays = get_number_of_elements(dset, path);
-    free(path);
-    return numarrays;
+    extent->count = (uint32_t) handle->count;
+    extent->record_size = H5Tget_size(handle->filetype);
+    for (d = 1; d < handle->rank; d++) {
+        extent->record_size *= handle->dims[d];
+    }
+    offset = H5Dget_offset(handle->dataset);
+    extent->offset = (offset == HADDR_UNDEF) ? 0 : offset;
+    if (offset == HADDR_UNDEF && extent->count > 0) {
+        return ISMRMRD_PUSH_ERR(ISMRMRD_FILEERROR, "The dataset has no storage.");
+    }
+    return ISMRMRD_NOERROR;
 }
 
-int ismrmrd_read_array(const ISMRMRD_Dataset *dset, const char *varname,
-        const uint32_t index, ISMRMRD_NDArray *arr) {    
-    int status;
-    hid_t datatype;
-    char *path;
+int ismrmrd_locate_acquisitions(const ISMRMRD_Dataset *dset, ISMRMRD_StorageExtent *records,
+        uint64_t *traj_offset, uint64_t *data_offset) {
+    ISMRMRD_DatasetHandle *handle;
+    hid_t head;
+    int index;
 
-    if (dset==NULL) {
-        return ISMRMRD_PUSH_ERR(ISMRMRD_RUNTIMEERROR, "Dataset pointer should not be NULL.");
+    if (dset == NULL || records == NULL || traj_offset == NULL || data_offset == NULL) {
+        return ISMRMRD_PUSH_ERR(ISMRMRD_RUNTIMEERROR, "Dataset and layout pointers should not be NULL.");
     }
-    if (varname==NULL) {
-        return ISMRMRD_PUSH_ERR(ISMRMRD_RUNTIMEERROR, "Varname should not be NULL.");
+    memset(records, 0, sizeof(ISMRMRD_StorageExtent));
+    *traj_offset = *data_offset = 0;
+    if (!link_exists(dset, dset->cache->datapath)) {
+        return ISMRMRD_NOERROR;
     }
-    if (arr==NULL) {
-        return ISMRMRD_PUSH_ERR(ISMRMRD_RUNTIMEERROR, "Array pointer should not be NULL.");
+    handle = find_handle(dset, dset->cache->datapath);
+    if (handle == NULL) {
+        return ISMRMRD_PUSH_ERR(ISMRMRD_FILEERROR, "Failed to open the acquisitions.");
+    }
+    if (handle->count == 0) {
+        return ISMRMRD_NOERROR;
     }
 
-    /* The group for this set */
-    /* /groupname/varname */
-    path = make_path(dset, varname);
-
-    /* get the array properties */
-    get_array_properties(dset, path, &arr->ndim, arr->dims, &arr->data_type);
-    datatype = get_hdf5type_ndarray(arr->data_type);
+    /* the header as its struct at the start of each record, see build_hdf5type_repacked_acquisition */
+    index = H5Tget_member_index(handle->filetype, "head");
+    head = index == 0 ? H5Tget_member_type(handle->filetype, 0) : -1;
+    if (head < 0 || H5Tget_member_offset(handle->filetype, 0) != 0 ||
+            H5Tequal(head, get_hdf5type_acquisitionheader()) <= 0 ||
+            get_fixed_field_length(handle->filetype, "data") == 0) {
+        if (head >= 0) {
+            H5Tclose(head);
+        }
+        return ISMRMRD_PUSH_ERR(ISMRMRD_FILEERROR, "The acquisitions have not been repacked.");
+    }
+    H5Tclose(head);
+    index = H5Tget_member_index(handle->filetype, "traj");
+    *traj_offset = index < 0 ? 0 : H5Tget_member_offset(handle->filetype, (unsigned) index);
+    index = H5Tget_member_index(handle->filetype, "data");
+    *data_offset = H5Tget_member_offset(handle->filetype, (unsigned) index);
+    return locate_records(dset, dset->cache->datapath, handle->filetype, records);
+}
 
-    /* allocate the memory */
-    ismrmrd_make_consistent_ndarray(arr);
+int ismrmrd_locate_images(const ISMRMRD_Dataset *dset, const char *varname,
+        ISMRMRD_StorageExtent *headers, ISMRMRD_StorageExtent *data) {
+    char *path, *headerpath, *datapath;
+    int status = ISMRMRD_NOERROR;
 
-    /* read the data */
-    status = read_element(dset, path, arr->data, datatype, index);
-    if (status != ISMRMRD_NOERROR) {
-        return ISMRMRD_PUSH_ERR(ISMRMRD_FILEERROR, "Failed to append array.");
+    if (dset == NULL || varname == NULL || headers == NULL || data == NULL) {
+        return ISMRMRD_PUSH_ERR(ISMRMRD_RUNTIMEERROR, "Dataset, varname and layout pointers should not be NULL.");
     }
-
-    /* Final cleanup */
-    status = H5Tclose(datatype);
-    if (status < 0) {
-        H5Ewalk2(H5E_DEFAULT, H5E_WALK_UPWARD, walk_hdf5_errors, NULL);
-        return ISMRMRD_PUSH_ERR(ISMRMRD_HDF5ERROR, "Failed to close datatype.");
+    path = make_path(dset, varname);
+    headerpath = append_to_path(dset, path, "header");
+    datapath = append_to_path(dset, path, "data");
+    status = locate_records(dset, headerpath, get_hdf5type_imageheader(), headers);
+    if (status == ISMRMRD_NOERROR) {
+        status = locate_records(dset, datapath, -1, data);
     }
+    free(datapath);
+    free(headerpath);
     free(path);
-
-    return ISMRMRD_NOERROR;
+    if (status == ISMRMRD_NOERROR && headers->count != data->count) {
+        status = ISMRMRD_PUSH_ERR(ISMRMRD_FILEERROR, "The image headers and data differ in length.");
+    }
+    return status;
 }
 
+int ismrmrd_locate_arrays(const ISMRMRD_Dataset *dset, const char *varname, ISMRMRD_StorageExtent *arrays) {
+    char *path;
+    int status;
+
+    if (dset == NULL || varname == NULL || arrays == NULL) {
+        return ISMRMRD_PUSH_ERR(ISMRMRD_RUNTIMEERROR, "Dataset, varname and layout pointers should not be NULL.");
+    }
+    path = make_path(dset, varname);
+    status = locate_records(dset, path, -1, arrays);
+    free(path);
+    return status;
+}
 
 #ifdef __cplusplus
 } /* extern "C" */
@@ -1,17 +1,87 @@
 #include "ismrmrd/dataset.h"
+#include "ismrmrd/xml.h"
 
 // for memcpy and free in older compilers
 #include <string.h>
 #include <stdlib.h>
+#include <algorithm>
+#include <chrono>
+#include <mutex>
 #include <stdexcept>
+#include <thread>
+#include <utility>
 
 namespace ISMRMRD {
+//
+// DatasetLock class implementation
+//
+// Recursive, as Dataset calls can be made while the caller holds a DatasetLock
+static std::recursive_mutex &dataset_mutex()
+{
+    static std::recursive_mutex mutex;
+    return mutex;
+}
+
+void ismrmrd_lock_datasets(void)
+{
+    dataset_mutex().lock();
+}
+
+void ismrmrd_unlock_datasets(void)
+{
+    dataset_mutex().unlock();
+}
+
+DatasetLock::DatasetLock()
+{
+    ismrmrd_lock_datasets();
+}
+
+DatasetLock::~DatasetLock()
+{
+    ismrmrd_unlock_datasets();
+}
+
 //
 // Dataset class implementation
 //
+// Runs read under the lock, end is one past the last record it reads. With ISMRMRD_SWMR_READ
+// a record past the refreshed count fails at once, and failures that HDF5 reports are tried
+// again after a growing pause of up to 128 ms, with the file reopened. The lock is released
+// while pausing, unless the caller holds a DatasetLock of its own.
+template <typename Count, typename Read>
+static void read_with_retry(ISMRMRD_Dataset &dset, uint64_t end, Count count, Read read)
+{
+    for (int attempt = 0;; attempt++) {
+        {
+            DatasetLock lock;
+            bool swmr = dset.options.swmr == ISMRMRD_SWMR_READ;
+            if (swmr && attempt > 0 && ismrmrd_reopen_dataset(&dset) != ISMRMRD_NOERROR) {
+                throw std::runtime_error(build_exception_string());
+            }
+            // counting refreshes the extent, waiting won't bring records past it
+            if (swmr && end > count()) {
+                std::string errors = build_exception_string();
+                throw std::runtime_error(errors.empty() ? "Index out of range." : errors);
+            }
+            if (read() == ISMRMRD_NOERROR) {
+                return;
+            }
+            // HDF5 reports the failures a SWMR reader sees while the writer is flushing
+            bool hdf5;
+            std::string message = build_exception_string(&hdf5);
+            if (!hdf5 || !swmr || attempt >= 7) {
+                throw std::runtime_error(message);
+            }
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(1 << attempt));
+    }
+}
+
 // Constructor
 Dataset::Dataset(const char* filename, const char* groupname, bool create_file_if_needed)
 {
+    DatasetLock lock;
     // TODO error checking and exception throwing
     // Initialize the dataset
     int status;
@@ -21,27 +91,102 @@ Dataset::Dataset(const char* filename, const char* groupname, bool create_file_i
     }
     // Open the file
     status = ismrmrd_open_dataset(&dset_, create_file_if_needed);
+    if (status != ISMRMRD_NOERROR) {
+        // HDF5 frees the messages of its errors on the next call, so take them before closing
+        std::string error = build_exception_string();
+        ismrmrd_close_dataset(&dset_);
+        throw std::runtime_error(error);
+    }
+}
+
+Dataset::Dataset(const char* filename, const char* groupname, const ISMRMRD_DatasetOptions &options,
+        bool create_file_if_needed)
+{
+    DatasetLock lock;
+    int status;
+    status = ismrmrd_init_dataset(&dset_, filename, groupname);
     if (status != ISMRMRD_NOERROR) {
         throw std::runtime_error(build_exception_string());
     }
+    dset_.options = options;
+    // Open the file
+    status = ismrmrd_open_dataset(&dset_, create_file_if_needed);
+    if (status != ISMRMRD_NOERROR) {
+        std::string error = build_exception_string();
+        ismrmrd_close_dataset(&dset_);
+        throw std::runtime_error(error);
+    }
+}
+
+Dataset::Dataset(const char* filename, const char* groupname, const void *image, size_t size)
+{
+    DatasetLock lock;
+    int status;
+    status = ismrmrd_init_dataset(&dset_, filename, groupname);
+    if (status != ISMRMRD_NOERROR) {
+        throw std::runtime_error(build_exception_string());
+    }
+    status = ismrmrd_open_dataset_image(&dset_, image, size);
+    if (status != ISMRMRD_NOERROR) {
+        std::string error = build_exception_string();
+        ismrmrd_close_dataset(&dset_);
+        throw std::runtime_error(error);
+    }
 }
 
 // Destructor
 Dataset::~Dataset()
 {
+    DatasetLock lock;
     ismrmrd_close_dataset(&dset_);
 }
 
+// The number of readouts implied by the encoding limits, summed over all encodings.
+// Segments subdivide the phase encoding steps, so they don't multiply the count.
+static uint32_t expected_acquisitions(const IsmrmrdHeader &header)
+{
+    uint64_t total = 0;
+    for (size_t e = 0; e < header.encoding.size(); e++) {
+        const EncodingLimits &limits = header.encoding[e].encodingLimits;
+        const Optional<Limit> *counters[] = {
+            &limits.kspace_encoding_step_1, &limits.kspace_encoding_step_2,
+            &limits.average, &limits.slice, &limits.contrast,
+            &limits.phase, &limits.repetition, &limits.set
+        };
+        uint64_t count = 1;
+        for (size_t n = 0; n < sizeof(counters) / sizeof(counters[0]); n++) {
+            if (*counters[n]) {
+                count *= (*counters[n])->maximum + 1;
+            }
+        }
+        total += count;
+    }
+    return total > UINT32_MAX ? UINT32_MAX : static_cast<uint32_t>(total);
+}
+
 // XML Header
 void Dataset::writeHeader(const std::string &xmlstring)
 {
+    DatasetLock lock;
     int status = ismrmrd_write_header(&dset_, xmlstring.c_str());
     if (status != ISMRMRD_NOERROR) {
         throw std::runtime_error(build_exception_string());
     }
+
+    if (dset_.options.growth_policy == ISMRMRD_GROWTH_HINT && dset_.options.capacity_hint == 0) {
+        IsmrmrdHeader header;
+        try {
+            deserialize(xmlstring.c_str(), header);
+        } catch (const std::exception &) {
+            // the header isn't validated on write, without limits there is no hint
+            return;
+        }
+        dset_.options.capacity_hint = expected_acquisitions(header);
+    }
 }
 
 void Dataset::readHeader(std::string& xmlstring){
+    DatasetLock lock;
     char * temp = ismrmrd_read_header(&dset_);
     if (NULL == temp) {
         throw std::runtime_error(build_exception_string());
@@ -51,32 +196,249 @@ void Dataset::readHeader(std::string& xmlstring){
     }
 }
 
+void Dataset::setCompression(const std::string &var, uint16_t profile)
+{
+    DatasetLock lock;
+    int status = ismrmrd_set_compression(&dset_, var.c_str(), profile);
+    if (status != ISMRMRD_NOERROR) {
+        throw std::runtime_error(build_exception_string());
+    }
+}
+
 // Acquisitions
 void Dataset::appendAcquisition(const Acquisition &acq)
 {
+    DatasetLock lock;
     int status = ismrmrd_append_acquisition(&dset_, &acq.acq);
     if (status != ISMRMRD_NOERROR) {
         throw std::runtime_error(build_exception_string());
     }
 }
 
+void Dataset::appendAcquisitions(const std::vector<Acquisition> &acqs)
+{
+    DatasetLock lock;
+    std::vector<ISMRMRD_Acquisition> block(acqs.size());
+    for (size_t n = 0; n < acqs.size(); n++) {
+        block[n] = acqs[n].acq;
+    }
+    int status = ismrmrd_append_acquisitions(&dset_, block.data(), static_cast<uint32_t>(block.size()));
+    if (status != ISMRMRD_NOERROR) {
+        throw std::runtime_error(build_exception_string());
+    }
+}
+
 void Dataset::readAcquisition(uint32_t index, Acquisition & acq) {
-    int status = ismrmrd_read_acquisition(&dset_, index, &acq.acq);
+    read_with_retry(dset_, uint64_t(index) + 1,
+                    [&] { return ismrmrd_get_number_of_acquisitions(&dset_); },
+                    [&] { return ismrmrd_read_acquisition(&dset_, index, &acq.acq); });
+}
+
+void Dataset::readAcquisitions(uint32_t first, uint32_t count, std::vector<Acquisition> &acqs)
+{
+    // The buffers are the caller's, only read_with_retry needs the lock, so that it is
+    // released while pausing
+    acqs.resize(count);
+    // Hand the existing buffers to the C library so their capacity is reused
+    std::vector<ISMRMRD_Acquisition> block(count);
+    for (uint32_t n = 0; n < count; n++) {
+        block[n] = acqs[n].acq;
+    }
+    try {
+        read_with_retry(dset_, count ? uint64_t(first) + count : 0,
+                        [&] { return ismrmrd_get_number_of_acquisitions(&dset_); },
+                        [&] { return ismrmrd_read_acquisitions(&dset_, first, count, block.data()); });
+    } catch (...) {
+        // The buffers may have been reallocated, so always take them back
+        for (uint32_t n = 0; n < count; n++) {
+            acqs[n].acq = block[n];
+        }
+        throw;
+    }
+    for (uint32_t n = 0; n < count; n++) {
+        acqs[n].acq = block[n];
+    }
+}
+
+void Dataset::readAcquisitionHeaders(uint32_t first, uint32_t count, std::vector<AcquisitionHeader> &heads)
+{
+    DatasetLock lock;
+    heads.resize(count);
+    // AcquisitionHeader adds no data members, so the vector is an array of C headers
+    int status = ismrmrd_read_acquisition_headers(&dset_, first, count, count ? &heads[0] : NULL);
     if (status != ISMRMRD_NOERROR) {
         throw std::runtime_error(build_exception_string());
     }
 }
 
+void Dataset::readAcquisitions(const std::vector<uint32_t> &records, std::vector<Acquisition> &acqs)
+{
+    uint32_t count = static_cast<uint32_t>(records.size());
+    acqs.resize(count);
+    std::vector<ISMRMRD_Acquisition> block(count);
+    for (uint32_t n = 0; n < count; n++) {
+        block[n] = acqs[n].acq;
+    }
+    uint64_t end = records.empty() ? 0 : uint64_t(*std::max_element(records.begin(), records.end())) + 1;
+    try {
+        read_with_retry(dset_, end, [&] { return ismrmrd_get_number_of_acquisitions(&dset_); },
+                        [&] { return ismrmrd_read_acquisition_list(&dset_, records.data(), count, block.data()); });
+    } catch (...) {
+        for (uint32_t n = 0; n < count; n++) {
+            acqs[n].acq = block[n];
+        }
+        throw;
+    }
+    for (uint32_t n = 0; n < count; n++) {
+        acqs[n].acq = block[n];
+    }
+}
+
+void Dataset::readAcquisitions(uint32_t first, uint32_t count, const ISMRMRD_AcquisitionFilter &filter,
+                               std::vector<Acquisition> &acqs, std::vector<uint32_t> *records)
+{
+    // Room for every record in the range, trimmed to the matches afterwards
+    acqs.resize(count);
+    std::vector<ISMRMRD_Acquisition> block(count);
+    for (uint32_t n = 0; n < count; n++) {
+        block[n] = acqs[n].acq;
+    }
+    std::vector<uint32_t> matches(count);
+    uint32_t nmatched = 0;
+    try {
+        read_with_retry(dset_, count ? uint64_t(first) + count : 0,
+                        [&] { return ismrmrd_get_number_of_acquisitions(&dset_); },
+                        [&] {
+                            return ismrmrd_read_acquisitions_filtered(&dset_, first, count, &filter, block.data(),
+                                                                      matches.data(), &nmatched);
+                        });
+    } catch (...) {
+        for (uint32_t n = 0; n < count; n++) {
+            acqs[n].acq = block[n];
+        }
+        throw;
+    }
+    for (uint32_t n = 0; n < count; n++) {
+        acqs[n].acq = block[n];
+    }
+    acqs.resize(nmatched);
+    if (records) {
+        matches.resize(nmatched);
+        records->swap(matches);
+    }
+}
+
+void Dataset::buildAcquisitionIndex()
+{
+    DatasetLock lock;
+    int status = ismrmrd_build_acquisition_index(&dset_);
+    if (status != ISMRMRD_NOERROR) {
+        throw std::runtime_error(build_exception_string());
+    }
+}
+
+std::vector<uint32_t> Dataset::findAcquisitions(const ISMRMRD_AcquisitionQuery &query)
+{
+    DatasetLock lock;
+    uint32_t *records = NULL;
+    uint32_t count = 0;
+    int status = ismrmrd_find_acquisitions(&dset_, &query, &records, &count);
+    if (status != ISMRMRD_NOERROR) {
+        throw std::runtime_error(build_exception_string());
+    }
+    std::vector<uint32_t> matches(records, records + count);
+    free(records);
+    return matches;
+}
 
 uint32_t Dataset::getNumberOfAcquisitions()
 {
+    DatasetLock lock;
     uint32_t num = ismrmrd_get_number_of_acquisitions(&dset_);
     return num;
 }
 
+uint32_t Dataset::waitForAcquisitions(uint32_t count, uint32_t timeout_ms)
+{
+    // Polls at a growing interval, up to 50 ms, and only holds the lock while counting
+    std::chrono::steady_clock::time_point deadline =
+        std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms);
+    std::chrono::steady_clock::duration interval = std::chrono::milliseconds(1);
+    for (;;) {
+        uint32_t available = getNumberOfAcquisitions();
+        std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+        if (available >= count || now >= deadline) {
+            return available;
+        }
+        std::this_thread::sleep_for(std::min(interval, deadline - now));
+        interval = std::min<std::chrono::steady_clock::duration>(2 * interval, std::chrono::milliseconds(50));
+    }
+}
+
+// SWMR
+void Dataset::beginSWMRWrite()
+{
+    DatasetLock lock;
+    int status = ismrmrd_begin_swmr_write(&dset_);
+    if (status != ISMRMRD_NOERROR) {
+        throw std::runtime_error(build_exception_string());
+    }
+}
+
+void Dataset::flush()
+{
+    DatasetLock lock;
+    int status = ismrmrd_flush_dataset(&dset_);
+    if (status != ISMRMRD_NOERROR) {
+        throw std::runtime_error(build_exception_string());
+    }
+}
+
+ISMRMRD_CacheStats Dataset::getCacheStats()
+{
+    DatasetLock lock;
+    ISMRMRD_CacheStats stats;
+    if (ismrmrd_get_cache_stats(&dset_, &stats) != ISMRMRD_NOERROR) {
+        throw std::runtime_error(build_exception_string());
+    }
+    return stats;
+}
+
+void Dataset::resetCacheStats()
+{
+    DatasetLock lock;
+    if (ismrmrd_reset_cache_stats(&dset_) != ISMRMRD_NOERROR) {
+        throw std::runtime_error(build_exception_string());
+    }
+}
+
+void Dataset::getFileImage(std::vector<char> &image)
+{
+    DatasetLock lock;
+    size_t size = 0;
+    int status = ismrmrd_get_dataset_image(&dset_, NULL, &size);
+    if (status == ISMRMRD_NOERROR) {
+        image.resize(size);
+        status = ismrmrd_get_dataset_image(&dset_, image.data(), &size);
+    }
+    if (status != ISMRMRD_NOERROR) {
+        throw std::runtime_error(build_exception_string());
+    }
+}
+
+void Dataset::repack(const char *filename)
+{
+    DatasetLock lock;
+    int status = ismrmrd_repack_dataset(&dset_, filename);
+    if (status != ISMRMRD_NOERROR) {
+        throw std::runtime_error(build_exception_string());
+    }
+}
+
 // Images
 template <typename T>void Dataset::appendImage(const std::string &var, const Image<T> &im)
 {
+    DatasetLock lock;
     int status = ismrmrd_append_image(&dset_, var.c_str(), &im.im);
     if (status != ISMRMRD_NOERROR) {
         throw std::runtime_error(build_exception_string());
@@ -85,6 +447,7 @@ template <typename T>void Dataset::appendImage(const std::string &var, const Ima
 
 void Dataset::appendImage(const std::string &var, const ISMRMRD_Image *im)
 {
+    DatasetLock lock;
     int status = ismrmrd_append_image(&dset_, var.c_str(), im);
     if (status != ISMRMRD_NOERROR) {
         throw std::runtime_error(build_exception_string());
@@ -93,6 +456,7 @@ void Dataset::appendImage(const std::string &var, const ISMRMRD_Image *im)
 
 
 void Dataset::appendWaveform(const Waveform &wav) {
+    DatasetLock lock;
     int status = ismrmrd_append_waveform(&dset_,&wav);
     if (status != ISMRMRD_NOERROR){
         throw std::runtime_error(build_exception_string());
@@ -100,13 +464,13 @@ void Dataset::appendWaveform(const Waveform &wav) {
 }
 
 void Dataset::readWaveform(uint32_t index, Waveform &wav) {
-    int status = ismrmrd_read_waveform(&dset_,index,&wav);
-    if (status != ISMRMRD_NOERROR){
-        throw std::runtime_error(build_exception_string());
-    }
+    read_with_retry(dset_, uint64_t(index) + 1,
+                    [&] { return ismrmrd_get_number_of_waveforms(&dset_); },
+                    [&] { return ismrmrd_read_waveform(&dset_, index, &wav); });
 }
 
 uint32_t Dataset::getNumberOfWaveforms() {
+    DatasetLock lock;
     return ismrmrd_get_number_of_waveforms(&dset_);
 }
 // Specific instantiations
@@ -121,10 +485,14 @@ template EXPORTISMRMRD void Dataset::appendImage(const std::string &var, const I
 
 
 template <typename T> void Dataset::readImage(const std::string &var, uint32_t index, Image<T> &im) {
-    int status = ismrmrd_read_image(&dset_, var.c_str(), index, &im.im);
-    if (status != ISMRMRD_NOERROR) {
-        throw std::runtime_error(build_exception_string());
-    }
+    readImage(var, index, &im.im);
+}
+
+void Dataset::readImage(const std::string &var, uint32_t index, ISMRMRD_Image *im)
+{
+    read_with_retry(dset_, uint64_t(index) + 1,
+                    [&] { return ismrmrd_get_number_of_images(&dset_, var.c_str()); },
+                    [&] { return ismrmrd_read_image(&dset_, var.c_str(), index, im); });
 }
 
 // Specific instantiations
@@ -137,8 +505,60 @@ template EXPORTISMRMRD void Dataset::readImage(const std::string &var, uint32_t
 template EXPORTISMRMRD void Dataset::readImage(const std::string &var, uint32_t index, Image<complex_float_t> &im);
 template EXPORTISMRMRD void Dataset::readImage(const std::string &var, uint32_t index, Image<complex_double_t> &im);
 
+template <typename T> void Dataset::readImageRegion(const std::string &var, uint32_t index,
+        uint16_t x0, uint16_t x1, uint16_t y0, uint16_t y1, uint16_t z0, uint16_t z1,
+        const std::vector<uint16_t> &channels, Image<T> &im)
+{
+    if (x1 <= x0 || y1 <= y0 || z1 <= z0) {
+        throw std::runtime_error("The image region is empty");
+    }
+    ISMRMRD_ImageRegion region;
+    ismrmrd_init_image_region(&region);
+    region.first[0] = x0;
+    region.first[1] = y0;
+    region.first[2] = z0;
+    region.count[0] = x1 - x0;
+    region.count[1] = y1 - y0;
+    region.count[2] = z1 - z0;
+    if (!channels.empty()) {
+        region.channels = &channels[0];
+        region.nchannels = static_cast<uint16_t>(channels.size());
+    }
+
+    read_with_retry(dset_, uint64_t(index) + 1,
+                    [&] { return ismrmrd_get_number_of_images(&dset_, var.c_str()); },
+                    [&] { return ismrmrd_read_image_region(&dset_, var.c_str(), index, &region, &im.im); });
+}
+
+// Specific instantiations
+template EXPORTISMRMRD void Dataset::readImageRegion(const std::string &var, uint32_t index,
+        uint16_t x0, uint16_t x1, uint16_t y0, uint16_t y1, uint16_t z0, uint16_t z1,
+        const std::vector<uint16_t> &channels, Image<uint16_t> &im);
+template EXPORTISMRMRD void Dataset::readImageRegion(const std::string &var, uint32_t index,
+        uint16_t x0, uint16_t x1, uint16_t y0, uint16_t y1, uint16_t z0, uint16_t z1,
+        const std::vector<uint16_t> &channels, Image<int16_t> &im);
+template EXPORTISMRMRD void Dataset::readImageRegion(const std::string &var, uint32_t index,
+        uint16_t x0, uint16_t x1, uint16_t y0, uint16_t y1, uint16_t z0, uint16_t z1,
+        const std::vector<uint16_t> &channels, Image<uint32_t> &im);
+template EXPORTISMRMRD void Dataset::readImageRegion(const std::string &var, uint32_t index,
+        uint16_t x0, uint16_t x1, uint16_t y0, uint16_t y1, uint16_t z0, uint16_t z1,
+        const std::vector<uint16_t> &channels, Image<int32_t> &im);
+template EXPORTISMRMRD void Dataset::readImageRegion(const std::string &var, uint32_t index,
+        uint16_t x0, uint16_t x1, uint16_t y0, uint16_t y1, uint16_t z0, uint16_t z1,
+        const std::vector<uint16_t> &channels, Image<float> &im);
+template EXPORTISMRMRD void Dataset::readImageRegion(const std::string &var, uint32_t index,
+        uint16_t x0, uint16_t x1, uint16_t y0, uint16_t y1, uint16_t z0, uint16_t z1,
+        const std::vector<uint16_t> &channels, Image<double> &im);
+template EXPORTISMRMRD void Dataset::readImageRegion(const std::string &var, uint32_t index,
+        uint16_t x0, uint16_t x1, uint16_t y0, uint16_t y1, uint16_t z0, uint16_t z1,
+        const std::vector<uint16_t> &channels, Image<complex_float_t> &im);
+template EXPORTISMRMRD void Dataset::readImageRegion(const std::string &var, uint32_t index,
+        uint16_t x0, uint16_t x1, uint16_t y0, uint16_t y1, uint16_t z0, uint16_t z1,
+        const std::vector<uint16_t> &channels, Image<complex_double_t> &im);
+
 uint32_t Dataset::getNumberOfImages(const std::string &var)
 {
+    DatasetLock lock;
     uint32_t num =  ismrmrd_get_number_of_images(&dset_, var.c_str());
     return num;
 }
@@ -147,6 +567,7 @@ uint32_t Dataset::getNumberOfImages(const std::string &var)
 // NDArrays
 template <typename T> void Dataset::appendNDArray(const std::string &var, const NDArray<T> &arr)
 {
+    DatasetLock lock;
     int status = ismrmrd_append_array(&dset_, var.c_str(), &arr.arr);
     if (status != ISMRMRD_NOERROR) {
         throw std::runtime_error(build_exception_string());
@@ -165,6 +586,7 @@ template EXPORTISMRMRD void Dataset::appendNDArray(const std::string &var, const
 
 void Dataset::appendNDArray(const std::string &var, const ISMRMRD_NDArray *arr)
 {
+    DatasetLock lock;
     int status = ismrmrd_append_array(&dset_, var.c_str(), arr);
     if (status != ISMRMRD_NOERROR) {
         throw std::runtime_error(build_exception_string());
@@ -172,6 +594,7 @@ void Dataset::appendNDArray(const std::string &var, const ISMRMRD_NDArray *arr)
 }
 
 template <typename T> void Dataset::readNDArray(const std::string &var, uint32_t index, NDArray<T> &arr) {
+    DatasetLock lock;
     int status = ismrmrd_read_array(&dset_, var.c_str(), index, &arr.arr);
     if (status != ISMRMRD_NOERROR) {
         throw std::runtime_error(build_exception_string());
@@ -188,10 +611,120 @@ template EXPORTISMRMRD void Dataset::readNDArray(const std::string &var, uint32_
 template EXPORTISMRMRD void Dataset::readNDArray(const std::string &var, uint32_t index, NDArray<complex_float_t> &arr);
 template EXPORTISMRMRD void Dataset::readNDArray(const std::string &var, uint32_t index, NDArray<complex_double_t> &arr);
 
+void Dataset::readNDArrayProperties(const std::string &var, std::vector<size_t> &dims, uint16_t &data_type)
+{
+    DatasetLock lock;
+    uint16_t ndim = 0;
+    size_t d[ISMRMRD_NDARRAY_MAXDIM];
+    int status = ismrmrd_read_array_properties(&dset_, var.c_str(), &ndim, d, &data_type);
+    if (status != ISMRMRD_NOERROR) {
+        throw std::runtime_error(build_exception_string());
+    }
+    dims.assign(d, d + ndim);
+}
+
+template <typename T> void Dataset::readNDArrayRegion(const std::string &var, uint32_t index,
+        const std::vector<size_t> &offset, const std::vector<size_t> &count, const std::vector<size_t> &stride,
+        NDArray<T> &arr)
+{
+    if (offset.size() > ISMRMRD_NDARRAY_MAXDIM || count.size() > ISMRMRD_NDARRAY_MAXDIM ||
+            stride.size() > ISMRMRD_NDARRAY_MAXDIM) {
+        throw std::runtime_error("The array region has too many dimensions");
+    }
+    ISMRMRD_ArrayRegion region;
+    ismrmrd_init_array_region(&region);
+    std::copy(offset.begin(), offset.end(), region.offset);
+    std::copy(count.begin(), count.end(), region.count);
+    std::copy(stride.begin(), stride.end(), region.stride);
+
+    DatasetLock lock;
+    int status = ismrmrd_read_array_region(&dset_, var.c_str(), index, &region, &arr.arr);
+    if (status != ISMRMRD_NOERROR) {
+        throw std::runtime_error(build_exception_string());
+    }
+}
+
+// Specific instantiations
+template EXPORTISMRMRD void Dataset::readNDArrayRegion(const std::string &var, uint32_t index,
+        const std::vector<size_t> &offset, const std::vector<size_t> &count, const std::vector<size_t> &stride,
+        NDArray<uint16_t> &arr);
+template EXPORTISMRMRD void Dataset::readNDArrayRegion(const std::string &var, uint32_t index,
+        const std::vector<size_t> &offset, const std::vector<size_t> &count, const std::vector<size_t> &stride,
+        NDArray<int16_t> &arr);
+template EXPORTISMRMRD void Dataset::readNDArrayRegion(const std::string &var, uint32_t index,
+        const std::vector<size_t> &offset, const std::vector<size_t> &count, const std::vector<size_t> &stride,
+        NDArray<uint32_t> &arr);
+template EXPORTISMRMRD void Dataset::readNDArrayRegion(const std::string &var, uint32_t index,
+        const std::vector<size_t> &offset, const std::vector<size_t> &count, const std::vector<size_t> &stride,
+        NDArray<int32_t> &arr);
+template EXPORTISMRMRD void Dataset::readNDArrayRegion(const std::string &var, uint32_t index,
+        const std::vector<size_t> &offset, const std::vector<size_t> &count, const std::vector<size_t> &stride,
+        NDArray<float> &arr);
+template EXPORTISMRMRD void Dataset::readNDArrayRegion(const std::string &var, uint32_t index,
+        const std::vector<size_t> &offset, const std::vector<size_t> &count, const std::vector<size_t> &stride,
+        NDArray<double> &arr);
+template EXPORTISMRMRD void Dataset::readNDArrayRegion(const std::string &var, uint32_t index,
+        const std::vector<size_t> &offset, const std::vector<size_t> &count, const std::vector<size_t> &stride,
+        NDArray<complex_float_t> &arr);
+template EXPORTISMRMRD void Dataset::readNDArrayRegion(const std::string &var, uint32_t index,
+        const std::vector<size_t> &offset, const std::vector<size_t> &count, const std::vector<size_t> &stride,
+        NDArray<complex_double_t> &arr);
+
 uint32_t Dataset::getNumberOfNDArrays(const std::string &var)
 {
+    DatasetLock lock;
     uint32_t num = ismrmrd_get_number_of_arrays(&dset_, var.c_str());
     return num;
 }
 
+uint16_t Dataset::readMantissaBits(const std::string &var)
+{
+    DatasetLock lock;
+    uint16_t bits = 0;
+    int status = ismrmrd_read_mantissa_bits(&dset_, var.c_str(), &bits);
+    if (status != ISMRMRD_NOERROR) {
+        throw std::runtime_error(build_exception_string());
+    }
+    return bits;
+}
+
+//
+// AcquisitionCursor class implementation
+//
+AcquisitionCursor::AcquisitionCursor(Dataset &dataset, uint32_t first, uint32_t count, uint32_t block_size)
+    : dataset_(dataset)
+    , position_(first)
+    , block_size_(block_size > 0 ? block_size : 1)
+    , block_position_(0)
+{
+    uint32_t number_of_acquisitions = dataset_.getNumberOfAcquisitions();
+    end_ = (count < number_of_acquisitions - std::min(first, number_of_acquisitions)) ? first + count : number_of_acquisitions;
+}
+
+bool AcquisitionCursor::next(Acquisition &acq)
+{
+    if (position_ >= end_) {
+        return false;
+    }
+    if (block_position_ >= block_.size()) {
+        // the buffers of the previous block are reused
+        dataset_.readAcquisitions(position_, std::min(block_size_, end_ - position_), block_);
+        block_position_ = 0;
+    }
+    std::swap(acq, block_[block_position_++]);
+    position_++;
+    return true;
+}
+
+uint32_t AcquisitionCursor::position() const
+{
+    return position_;
+}
+
+void AcquisitionCursor::seek(uint32_t index)
+{
+    position_ = index;
+    block_position_ = block_.size();
+}
+
 } // namespace ISMRMRD
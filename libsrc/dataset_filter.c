@@ -0,0 +1,325 @@
+/* Language and Cross platform section for defining types */
+#ifdef __cplusplus
+#include <cstring>
+#include <cstdlib>
+#else
+/* C99 compiler */
+#include <string.h>
+#include <stdlib.h>
+#endif /* __cplusplus */
+
+#include <hdf5.h>
+#include <zlib.h>
+#include "ismrmrd/dataset.h"
+
+#ifdef __cplusplus
+namespace ISMRMRD {
+extern "C" {
+#endif
+
+/*
+ * The complex float codec
+ *
+ * Each chunk is split into byte planes, one for every byte of the 8 byte complex
+ * element, so that the sign and exponent bytes of the real and imaginary parts each
+ * get a plane of their own. In noisy k-space only those planes compress, the
+ * mantissa planes are close to random. Every plane is Huffman coded, or deflated
+ * when that does better, and kept as is when neither saves enough to be worth
+ * decoding. Decoding the raw planes is a plain interleave, so most of a k-space
+ * chunk is never run through inflate.
+ *
+ * The client data of the filter are ISMRMRD_FILTER_CXFLOAT_CODEC and the version,
+ * which tell the codec apart from other filters given the same unregistered id.
+ *
+ * Encoded chunk, all integers little endian:
+ *   uint8  version
+ *   uint8  number of planes
+ *   uint16 reserved
+ *   uint64 size of the decoded chunk
+ *   per plane: uint8 method, uint32 encoded length
+ *   the planes, then the bytes past the last whole element
+ */
+
+#define CXFLOAT_VERSION 1
+#define CXFLOAT_PLANES 8
+#define CXFLOAT_HEADER_BYTES 12
+#define CXFLOAT_PLANE_HEADER_BYTES 5
+
+enum CXFloatPlaneMethods {
+    CXFLOAT_PLANE_RAW = 0,
+    CXFLOAT_PLANE_ZLIB
+};
+
+static void put_uint32(unsigned char *p, uint32_t v) {
+    p[0] = (unsigned char) v;
+    p[1] = (unsigned char) (v >> 8);
+    p[2] = (unsigned char) (v >> 16);
+    p[3] = (unsigned char) (v >> 24);
+}
+
+static uint32_t get_uint32(const unsigned char *p) {
+    return (uint32_t) p[0] | ((uint32_t) p[1] << 8) | ((uint32_t) p[2] << 16) | ((uint32_t) p[3] << 24);
+}
+
+static void put_uint64(unsigned char *p, uint64_t v) {
+    put_uint32(p, (uint32_t) v);
+    put_uint32(p + 4, (uint32_t) (v >> 32));
+}
+
+static uint64_t get_uint64(const unsigned char *p) {
+    return (uint64_t) get_uint32(p) | ((uint64_t) get_uint32(p + 4) << 32);
+}
+
+/* Both loops touch every plane once per element with no branches, so compilers turn
+ * them into vector shuffles */
+static void split_planes(const unsigned char *in, size_t nelems, unsigned char *planes) {
+    unsigned char *p0 = planes, *p1 = p0 + nelems, *p2 = p1 + nelems, *p3 = p2 + nelems;
+    unsigned char *p4 = p3 + nelems, *p5 = p4 + nelems, *p6 = p5 + nelems, *p7 = p6 + nelems;
+    size_t i;
+
+    for (i = 0; i < nelems; i++) {
+        p0[i] = in[8 * i];
+        p1[i] = in[8 * i + 1];
+        p2[i] = in[8 * i + 2];
+        p3[i] = in[8 * i + 3];
+        p4[i] = in[8 * i + 4];
+        p5[i] = in[8 * i + 5];
+        p6[i] = in[8 * i + 6];
+        p7[i] = in[8 * i + 7];
+    }
+}
+
+static void merge_planes(const unsigned char *const *planes, size_t nelems, unsigned char *out) {
+    const unsigned char *p0 = planes[0], *p1 = planes[1], *p2 = planes[2], *p3 = planes[3];
+    const unsigned char *p4 = planes[4], *p5 = planes[5], *p6 = planes[6], *p7 = planes[7];
+    size_t i;
+
+    for (i = 0; i < nelems; i++) {
+        out[8 * i] = p0[i];
+        out[8 * i + 1] = p1[i];
+        out[8 * i + 2] = p2[i];
+        out[8 * i + 3] = p3[i];
+        out[8 * i + 4] = p4[i];
+        out[8 * i + 5] = p5[i];
+        out[8 * i + 6] = p6[i];
+        out[8 * i + 7] = p7[i];
+    }
+}
+
+/* Deflates a plane into at most limit bytes, returns 0 when it doesn't fit */
+static size_t deflate_plane(const unsigned char *plane, size_t nbytes, unsigned char *out,
+        size_t limit, int strategy) {
+    z_stream stream;
+    size_t length = 0;
+
+    memset(&stream, 0, sizeof(stream));
+    if (deflateInit2(&stream, 1, Z_DEFLATED, 15, 8, strategy) != Z_OK) {
+        return 0;
+    }
+    stream.next_in = (Bytef *) plane;
+    stream.avail_in = (uInt) nbytes;
+    stream.next_out = out;
+    stream.avail_out = (uInt) limit;
+    if (deflate(&stream, Z_FINISH) == Z_STREAM_END) {
+        length = stream.total_out;
+    }
+    deflateEnd(&stream);
+    return length;
+}
+
+static int inflate_plane(const unsigned char *in, size_t length, unsigned char *plane, size_t nbytes) {
+    z_stream stream;
+    int status;
+
+    memset(&stream, 0, sizeof(stream));
+    if (inflateInit(&stream) != Z_OK) {
+        return -1;
+    }
+    stream.next_in = (Bytef *) in;
+    stream.avail_in = (uInt) length;
+    stream.next_out = plane;
+    stream.avail_out = (uInt) nbytes;
+    status = inflate(&stream, Z_FINISH);
+    inflateEnd(&stream);
+    return (status == Z_STREAM_END && stream.total_out == nbytes) ? 0 : -1;
+}
+
+static size_t encode_chunk(size_t nbytes, size_t *buf_size, void **buf) {
+    const unsigned char *in = (const unsigned char *) *buf;
+    unsigned char *out, *planes, *header, *dst, *scratch;
+    size_t nelems = nbytes / CXFLOAT_PLANES, tail = nbytes % CXFLOAT_PLANES;
+    size_t capacity, length, alternative;
+    int k;
+
+    capacity = CXFLOAT_HEADER_BYTES + CXFLOAT_PLANES * CXFLOAT_PLANE_HEADER_BYTES + nbytes;
+    out = (unsigned char *) H5allocate_memory(capacity, false);
+    planes = (unsigned char *) malloc(nbytes + nelems);
+    if (out == NULL || planes == NULL) {
+        H5free_memory(out);
+        free(planes);
+        return 0;
+    }
+    scratch = planes + nbytes;
+    split_planes(in, nelems, planes);
+
+    out[0] = CXFLOAT_VERSION;
+    out[1] = CXFLOAT_PLANES;
+    out[2] = 0;
+    out[3] = 0;
+    put_uint64(out + 4, nbytes);
+    header = out + CXFLOAT_HEADER_BYTES;
+    dst = header + CXFLOAT_PLANES * CXFLOAT_PLANE_HEADER_BYTES;
+
+    for (k = 0; k < CXFLOAT_PLANES; k++) {
+        const unsigned char *plane = planes + k * nelems;
+        /* a plane has to shrink by an eighth before decoding it beats copying it */
+        size_t limit = nelems - nelems / 8;
+
+        length = deflate_plane(plane, nelems, dst, limit, Z_HUFFMAN_ONLY);
+        if (length > 0) {
+            /* runs of equal bytes, as in the exponents of smooth images, deflate further */
+            alternative = deflate_plane(plane, nelems, scratch, length, Z_DEFAULT_STRATEGY);
+            if (alternative > 0 && alternative < length) {
+                memcpy(dst, scratch, alternative);
+                length = alternative;
+            }
+            header[0] = CXFLOAT_PLANE_ZLIB;
+        } else {
+            memcpy(dst, plane, nelems);
+            length = nelems;
+            header[0] = CXFLOAT_PLANE_RAW;
+        }
+        put_uint32(header + 1, (uint32_t) length);
+        header += CXFLOAT_PLANE_HEADER_BYTES;
+        dst += length;
+    }
+    memcpy(dst, in + nelems * CXFLOAT_PLANES, tail);
+    dst += tail;
+    free(planes);
+
+    H5free_memory(*buf);
+    *buf = out;
+    *buf_size = capacity;
+    return (size_t) (dst - out);
+}
+
+static size_t decode_chunk(size_t nbytes, size_t *buf_size, void **buf) {
+    const unsigned char *in = (const unsigned char *) *buf, *header, *src;
+    const unsigned char *plane_ptrs[CXFLOAT_PLANES];
+    unsigned char *out, *planes;
+    size_t size, nelems, tail, length, used;
+    int k;
+
+    if (nbytes < CXFLOAT_HEADER_BYTES + CXFLOAT_PLANES * CXFLOAT_PLANE_HEADER_BYTES ||
+            in[0] != CXFLOAT_VERSION || in[1] != CXFLOAT_PLANES) {
+        return 0;
+    }
+    size = (size_t) get_uint64(in + 4);
+    nelems = size / CXFLOAT_PLANES;
+    tail = size % CXFLOAT_PLANES;
+
+    out = (unsigned char *) H5allocate_memory(size > 0 ? size : 1, false);
+    planes = (unsigned char *) malloc(size > 0 ? size : 1);
+    if (out == NULL || planes == NULL) {
+        H5free_memory(out);
+        free(planes);
+        return 0;
+    }
+
+    /* raw planes are merged straight from the input, the others are inflated first */
+    header = in + CXFLOAT_HEADER_BYTES;
+    src = header + CXFLOAT_PLANES * CXFLOAT_PLANE_HEADER_BYTES;
+    used = (size_t) (src - in);
+    for (k = 0; k < CXFLOAT_PLANES; k++) {
+        length = get_uint32(header + 1);
+        if (used + length > nbytes) {
+            break;
+        }
+        if (header[0] == CXFLOAT_PLANE_RAW && length == nelems) {
+            plane_ptrs[k] = src;
+        } else if (header[0] == CXFLOAT_PLANE_ZLIB &&
+                inflate_plane(src, length, planes + k * nelems, nelems) == 0) {
+            plane_ptrs[k] = planes + k * nelems;
+        } else {
+            break;
+        }
+        header += CXFLOAT_PLANE_HEADER_BYTES;
+        src += length;
+        used += length;
+    }
+    if (k < CXFLOAT_PLANES || used + tail > nbytes) {
+        H5free_memory(out);
+        free(planes);
+        return 0;
+    }
+    merge_planes(plane_ptrs, nelems, out);
+    memcpy(out + nelems * CXFLOAT_PLANES, src, tail);
+    free(planes);
+
+    H5free_memory(*buf);
+    *buf = out;
+    *buf_size = size > 0 ? size : 1;
+    return size;
+}
+
+static size_t cxfloat_filter(unsigned int flags, size_t cd_nelmts, const unsigned int cd_values[],
+        size_t nbytes, size_t *buf_size, void **buf) {
+    /* the dataset was set up for another filter with the same id */
+    if (cd_nelmts < 2 || cd_values[0] != ISMRMRD_FILTER_CXFLOAT_CODEC || cd_values[1] > CXFLOAT_VERSION) {
+        return 0;
+    }
+    if (flags & H5Z_FLAG_REVERSE) {
+        return decode_chunk(nbytes, buf_size, buf);
+    }
+    return encode_chunk(nbytes, buf_size, buf);
+}
+
+/* The planes assume 8 byte elements, i.e. pairs of 32 bit floats */
+static htri_t cxfloat_can_apply(hid_t dcpl_id, hid_t type_id, hid_t space_id) {
+    (void)dcpl_id;
+    (void)space_id;
+    return H5Tget_size(type_id) == 2 * sizeof(float) ? 1 : 0;
+}
+
+/* Stores the codec identifier with a new dataset, client data given by the caller are kept */
+static herr_t cxfloat_set_local(hid_t dcpl_id, hid_t type_id, hid_t space_id) {
+    unsigned int values[2] = { ISMRMRD_FILTER_CXFLOAT_CODEC, CXFLOAT_VERSION };
+    unsigned int flags;
+    size_t nelmts = 0;
+    (void)type_id;
+    (void)space_id;
+
+    if (H5Pget_filter_by_id2(dcpl_id, ISMRMRD_FILTER_CXFLOAT, &flags, &nelmts, NULL, 0, NULL, NULL) < 0) {
+        return -1;
+    }
+    if (nelmts > 0) {
+        return 0;
+    }
+    return H5Pmodify_filter(dcpl_id, ISMRMRD_FILTER_CXFLOAT, flags, 2, values);
+}
+
+int ismrmrd_register_cxfloat_filter(void) {
+    H5Z_class2_t filter_class;
+
+    if (H5Zfilter_avail(ISMRMRD_FILTER_CXFLOAT) > 0) {
+        return ISMRMRD_NOERROR;
+    }
+
+    filter_class.version = H5Z_CLASS_T_VERS;
+    filter_class.id = ISMRMRD_FILTER_CXFLOAT;
+    filter_class.encoder_present = 1;
+    filter_class.decoder_present = 1;
+    filter_class.name = "ismrmrd complex float";
+    filter_class.can_apply = cxfloat_can_apply;
+    filter_class.set_local = cxfloat_set_local;
+    filter_class.filter = cxfloat_filter;
+    if (H5Zregister(&filter_class) < 0) {
+        return ISMRMRD_PUSH_ERR(ISMRMRD_HDF5ERROR, "Failed to register the complex float filter.");
+    }
+    return ISMRMRD_NOERROR;
+}
+
+#ifdef __cplusplus
+} /* extern "C" */
+} /* ISMRMRD namespace */
+#endif
@@ -31,9 +31,21 @@ typedef struct ISMRMRD_error_node {
     int code;
 } ISMRMRD_error_node_t;
 
+/* Each thread has an error stack of its own, so that the errors popped after a failed
+ * call are the ones that call pushed */
+#if defined(__cplusplus) && __cplusplus >= 201103L
+#define ISMRMRD_THREAD_LOCAL thread_local
+#elif defined(_MSC_VER)
+#define ISMRMRD_THREAD_LOCAL __declspec(thread)
+#elif defined(__GNUC__)
+#define ISMRMRD_THREAD_LOCAL __thread
+#else
+#define ISMRMRD_THREAD_LOCAL _Thread_local
+#endif
+
 static void ismrmrd_error_default(const char *file, int line,
         const char *func, int code, const char *msg);
-static ISMRMRD_error_node_t *error_stack_head = NULL;
+static ISMRMRD_THREAD_LOCAL ISMRMRD_error_node_t *error_stack_head = NULL;
 static ismrmrd_error_handler_t ismrmrd_error_handler = ismrmrd_error_default;
 
 
@@ -141,6 +141,20 @@ Acquisition & Acquisition::operator= (const Acquisition &other) {
     return *this;
 }
 
+Acquisition::Acquisition(Acquisition &&other) {
+    acq = other.acq;
+    ismrmrd_init_acquisition(&other.acq);
+}
+
+Acquisition & Acquisition::operator= (Acquisition &&other) {
+    if (this != &other) {
+        ismrmrd_cleanup_acquisition(&acq);
+        acq = other.acq;
+        ismrmrd_init_acquisition(&other.acq);
+    }
+    return *this;
+}
+
 Acquisition::~Acquisition() {
     ismrmrd_cleanup_acquisition(&acq);
 }
@@ -441,6 +455,24 @@ template <typename T> Image<T> & Image<T>::operator= (const Image<T> &other)
     return *this;
 }
 
+template <typename T> Image<T>::Image(Image<T> &&other) {
+    im = other.im;
+    ismrmrd_init_image(&other.im);
+    // the emptied image keeps its type so that it can be resized and reused
+    other.im.head.data_type = im.head.data_type;
+}
+
+template <typename T> Image<T> & Image<T>::operator= (Image<T> &&other)
+{
+    if (this != &other) {
+        ismrmrd_cleanup_image(&im);
+        im = other.im;
+        ismrmrd_init_image(&other.im);
+        other.im.head.data_type = im.head.data_type;
+    }
+    return *this;
+}
+
 template <typename T> Image<T>::~Image() {
     ismrmrd_cleanup_image(&im);
 }
@@ -1238,16 +1270,27 @@ template EXPORTISMRMRD class NDArray<complex_double_t>;
 
 // Helper function for generating exception message from ISMRMRD error stack
 std::string build_exception_string(void)
+{
+    return build_exception_string(NULL);
+}
+
+std::string build_exception_string(bool *hdf5)
 {
     char *file = NULL, *func = NULL, *msg = NULL;
     int line = 0, code = 0;
     std::stringstream stream;
+    if (hdf5 != NULL) {
+        *hdf5 = false;
+    }
     for (int i = 0; ismrmrd_pop_error(&file, &line, &func, &code, &msg); ++i) {
         if (i > 0) {
             stream << std::endl;
         }
         stream << "ISMRMRD " << ismrmrd_strerror(code) << " in " << func <<
-                " (" << file << ":" << line << ": " << msg;
+                " (" << file << ":" << line << "): " << msg;
+        if (hdf5 != NULL && code == ISMRMRD_HDF5ERROR) {
+            *hdf5 = true;
+        }
     }
     return stream.str();
 }
@@ -0,0 +1,304 @@
+#include "ismrmrd/mapped_dataset.h"
+
+#include <stdexcept>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace ISMRMRD {
+
+// Maps the whole file read-only, returns NULL on failure
+static const char *map_file(const char *filename, size_t &size)
+{
+#ifdef _WIN32
+    HANDLE file = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE) {
+        return NULL;
+    }
+    LARGE_INTEGER length;
+    HANDLE mapping = NULL;
+    const char *base = NULL;
+    if (GetFileSizeEx(file, &length) && length.QuadPart > 0) {
+        mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+    }
+    if (mapping != NULL) {
+        base = static_cast<const char *>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+        // the view keeps the mapping open
+        CloseHandle(mapping);
+    }
+    CloseHandle(file);
+    size = base != NULL ? static_cast<size_t>(length.QuadPart) : 0;
+    return base;
+#else
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0) {
+        return NULL;
+    }
+    struct stat info;
+    void *base = MAP_FAILED;
+    if (fstat(fd, &info) == 0 && info.st_size > 0) {
+        base = mmap(NULL, static_cast<size_t>(info.st_size), PROT_READ, MAP_SHARED, fd, 0);
+    }
+    // the mapping keeps the file open
+    close(fd);
+    if (base == MAP_FAILED) {
+        return NULL;
+    }
+    size = static_cast<size_t>(info.st_size);
+    return static_cast<const char *>(base);
+#endif
+}
+
+static void unmap_file(const char *base, size_t size)
+{
+#ifdef _WIN32
+    (void) size;
+    UnmapViewOfFile(base);
+#else
+    munmap(const_cast<char *>(base), size);
+#endif
+}
+
+// Whether the records of an extent lie within the file and are aligned for their samples
+static bool extent_fits(const ISMRMRD_StorageExtent &extent, size_t size, size_t alignment)
+{
+    if (extent.count == 0) {
+        return true;
+    }
+    return extent.offset % alignment == 0 && extent.record_size % alignment == 0 &&
+           extent.offset <= size && extent.record_size <= (size - extent.offset) / extent.count;
+}
+
+// The alignment the samples of data_type need, complex samples are pairs of their parts
+static size_t sample_alignment(uint16_t data_type)
+{
+    size_t size = ismrmrd_sizeof_data_type(data_type);
+    if (size == 0) {
+        return 1;
+    }
+    return (data_type == ISMRMRD_CXFLOAT || data_type == ISMRMRD_CXDOUBLE) ? size / 2 : size;
+}
+
+// The data type of samples of type T, get_data_type<T> is only available inside ismrmrd.cpp
+static uint16_t sample_type(const uint16_t *) { return ISMRMRD_USHORT; }
+static uint16_t sample_type(const int16_t *) { return ISMRMRD_SHORT; }
+static uint16_t sample_type(const uint32_t *) { return ISMRMRD_UINT; }
+static uint16_t sample_type(const int32_t *) { return ISMRMRD_INT; }
+static uint16_t sample_type(const float *) { return ISMRMRD_FLOAT; }
+static uint16_t sample_type(const double *) { return ISMRMRD_DOUBLE; }
+static uint16_t sample_type(const complex_float_t *) { return ISMRMRD_CXFLOAT; }
+static uint16_t sample_type(const complex_double_t *) { return ISMRMRD_CXDOUBLE; }
+
+// Constructor
+MappedDataset::MappedDataset(const char* filename, const char* groupname)
+    : base_(NULL)
+    , size_(0)
+    , traj_offset_(0)
+    , data_offset_(0)
+{
+    DatasetLock lock;
+    int status = ismrmrd_init_dataset(&dset_, filename, groupname);
+    if (status != ISMRMRD_NOERROR) {
+        throw std::runtime_error(build_exception_string());
+    }
+    status = ismrmrd_open_dataset(&dset_, false);
+    if (status == ISMRMRD_NOERROR) {
+        status = ismrmrd_locate_acquisitions(&dset_, &acquisitions_, &traj_offset_, &data_offset_);
+    }
+    if (status != ISMRMRD_NOERROR) {
+        // HDF5 frees the messages of its errors on the next call, so take them before closing
+        std::string error = build_exception_string();
+        ismrmrd_close_dataset(&dset_);
+        throw std::runtime_error(error);
+    }
+
+    base_ = map_file(filename, size_);
+    if (base_ == NULL) {
+        ismrmrd_close_dataset(&dset_);
+        throw std::runtime_error("Failed to map the file into memory");
+    }
+    // repacked acquisitions are padded to 8 bytes, which also aligns their samples
+    if (!extent_fits(acquisitions_, size_, sizeof(uint64_t))) {
+        close();
+        throw std::runtime_error("The acquisitions don't fit in the file");
+    }
+}
+
+// Destructor
+MappedDataset::~MappedDataset()
+{
+    close();
+}
+
+void MappedDataset::close()
+{
+    if (base_ != NULL) {
+        unmap_file(base_, size_);
+        base_ = NULL;
+    }
+    DatasetLock lock;
+    ismrmrd_close_dataset(&dset_);
+}
+
+uint32_t MappedDataset::getNumberOfAcquisitions() const
+{
+    return acquisitions_.count;
+}
+
+MappedAcquisition MappedDataset::acquisition(uint32_t index) const
+{
+    const char *start = record(acquisitions_, index);
+    MappedAcquisition acq;
+    acq.head = reinterpret_cast<const AcquisitionHeader *>(start);
+    acq.traj = (traj_offset_ > 0 && acq.head->trajectory_dimensions > 0) ?
+               reinterpret_cast<const float *>(start + traj_offset_) : NULL;
+    acq.data = reinterpret_cast<const complex_float_t *>(start + data_offset_);
+    return acq;
+}
+
+uint32_t MappedDataset::getNumberOfImages(const std::string &var)
+{
+    return images(var).data.count;
+}
+
+uint32_t MappedDataset::getNumberOfNDArrays(const std::string &var)
+{
+    return arrays(var).data.count;
+}
+
+std::vector<size_t> MappedDataset::getNDArrayDims(const std::string &var)
+{
+    return arrays(var).dims;
+}
+
+const char *MappedDataset::record(const ISMRMRD_StorageExtent &extent, uint32_t index) const
+{
+    if (index >= extent.count) {
+        throw std::out_of_range("Index out of range");
+    }
+    return base_ + extent.offset + index * extent.record_size;
+}
+
+// Locates the images of var on first use
+const MappedDataset::Variable &MappedDataset::images(const std::string &var)
+{
+    std::lock_guard<std::mutex> guard(mutex_);
+    std::map<std::string, Variable>::iterator it = images_.find(var);
+    if (it != images_.end()) {
+        return it->second;
+    }
+
+    Variable v;
+    {
+        DatasetLock lock;
+        if (ismrmrd_locate_images(&dset_, var.c_str(), &v.headers, &v.data) != ISMRMRD_NOERROR) {
+            throw std::runtime_error(build_exception_string());
+        }
+    }
+    // the header struct is packed to 2 bytes
+    if (!extent_fits(v.headers, size_, 2)) {
+        throw std::runtime_error("The image headers don't fit in the file");
+    }
+    v.data_type = 0;
+    if (v.data.count > 0) {
+        // the images of a variable share their size and type
+        const ISMRMRD_ImageHeader *head = reinterpret_cast<const ISMRMRD_ImageHeader *>(record(v.headers, 0));
+        v.data_type = head->data_type;
+        uint64_t size = uint64_t(head->matrix_size[0]) * head->matrix_size[1] * head->matrix_size[2] *
+                        head->channels * ismrmrd_sizeof_data_type(head->data_type);
+        if (size == 0 || size != v.data.record_size) {
+            throw std::runtime_error("The image headers don't match the image data");
+        }
+        if (!extent_fits(v.data, size_, sample_alignment(v.data_type))) {
+            throw std::runtime_error("The images don't fit in the file");
+        }
+    }
+    return images_[var] = v;
+}
+
+// Locates the arrays of var on first use
+const MappedDataset::Variable &MappedDataset::arrays(const std::string &var)
+{
+    std::lock_guard<std::mutex> guard(mutex_);
+    std::map<std::string, Variable>::iterator it = arrays_.find(var);
+    if (it != arrays_.end()) {
+        return it->second;
+    }
+
+    Variable v;
+    uint16_t ndim = 0;
+    size_t dims[ISMRMRD_NDARRAY_MAXDIM];
+    {
+        DatasetLock lock;
+        if (ismrmrd_locate_arrays(&dset_, var.c_str(), &v.data) != ISMRMRD_NOERROR ||
+                ismrmrd_read_array_properties(&dset_, var.c_str(), &ndim, dims, &v.data_type) != ISMRMRD_NOERROR) {
+            throw std::runtime_error(build_exception_string());
+        }
+    }
+    if (!extent_fits(v.data, size_, sample_alignment(v.data_type))) {
+        throw std::runtime_error("The arrays don't fit in the file");
+    }
+    v.headers = ISMRMRD_StorageExtent();
+    v.dims.assign(dims, dims + ndim);
+    return arrays_[var] = v;
+}
+
+template <typename T> MappedImage<T> MappedDataset::image(const std::string &var, uint32_t index)
+{
+    MappedImage<T> im;
+    im.data = static_cast<const T *>(image_data(var, index, sample_type(static_cast<const T *>(NULL)), &im.head));
+    return im;
+}
+
+// Specific instantiations
+template EXPORTISMRMRD MappedImage<uint16_t> MappedDataset::image(const std::string &var, uint32_t index);
+template EXPORTISMRMRD MappedImage<int16_t> MappedDataset::image(const std::string &var, uint32_t index);
+template EXPORTISMRMRD MappedImage<uint32_t> MappedDataset::image(const std::string &var, uint32_t index);
+template EXPORTISMRMRD MappedImage<int32_t> MappedDataset::image(const std::string &var, uint32_t index);
+template EXPORTISMRMRD MappedImage<float> MappedDataset::image(const std::string &var, uint32_t index);
+template EXPORTISMRMRD MappedImage<double> MappedDataset::image(const std::string &var, uint32_t index);
+template EXPORTISMRMRD MappedImage<complex_float_t> MappedDataset::image(const std::string &var, uint32_t index);
+template EXPORTISMRMRD MappedImage<complex_double_t> MappedDataset::image(const std::string &var, uint32_t index);
+
+template <typename T> const T *MappedDataset::ndarray(const std::string &var, uint32_t index)
+{
+    return static_cast<const T *>(ndarray_data(var, index, sample_type(static_cast<const T *>(NULL))));
+}
+
+// Specific instantiations
+template EXPORTISMRMRD const uint16_t *MappedDataset::ndarray(const std::string &var, uint32_t index);
+template EXPORTISMRMRD const int16_t *MappedDataset::ndarray(const std::string &var, uint32_t index);
+template EXPORTISMRMRD const uint32_t *MappedDataset::ndarray(const std::string &var, uint32_t index);
+template EXPORTISMRMRD const int32_t *MappedDataset::ndarray(const std::string &var, uint32_t index);
+template EXPORTISMRMRD const float *MappedDataset::ndarray(const std::string &var, uint32_t index);
+template EXPORTISMRMRD const double *MappedDataset::ndarray(const std::string &var, uint32_t index);
+template EXPORTISMRMRD const complex_float_t *MappedDataset::ndarray(const std::string &var, uint32_t index);
+template EXPORTISMRMRD const complex_double_t *MappedDataset::ndarray(const std::string &var, uint32_t index);
+
+const void *MappedDataset::image_data(const std::string &var, uint32_t index, uint16_t data_type,
+                                      const ImageHeader **head)
+{
+    const Variable &v = images(var);
+    if (v.data_type != data_type && index < v.data.count) {
+        throw std::runtime_error("The images are of a different type");
+    }
+    *head = reinterpret_cast<const ImageHeader *>(record(v.headers, index));
+    return record(v.data, index);
+}
+
+const void *MappedDataset::ndarray_data(const std::string &var, uint32_t index, uint16_t data_type)
+{
+    const Variable &v = arrays(var);
+    if (v.data_type != data_type) {
+        throw std::runtime_error("The arrays are of a different type");
+    }
+    return record(v.data, index);
+}
+
+} // namespace ISMRMRD
@@ -0,0 +1,390 @@
+#include "ismrmrd/serialization.h"
+
+#include <stdexcept>
+#include <vector>
+
+namespace ISMRMRD {
+
+static void write_bytes(std::ostream &os, const void *data, size_t size)
+{
+    if (size > 0) {
+        os.write(static_cast<const char *>(data), static_cast<std::streamsize>(size));
+    }
+    if (!os) {
+        throw std::runtime_error("Failed to write to the stream");
+    }
+}
+
+static void read_bytes(std::istream &is, void *data, size_t size)
+{
+    if (size > 0) {
+        is.read(static_cast<char *>(data), static_cast<std::streamsize>(size));
+    }
+    if (!is) {
+        throw std::runtime_error("Failed to read from the stream, it ended inside a message");
+    }
+}
+
+// The size of count elements of element_size bytes, which must be within MAX_MESSAGE_PAYLOAD
+static uint64_t checked_payload_size(uint64_t count, size_t element_size)
+{
+    if (element_size == 0) {
+        throw std::runtime_error("Corrupt message in the stream, unknown data type");
+    }
+    if (count > MAX_MESSAGE_PAYLOAD / element_size) {
+        throw std::runtime_error("Message in the stream is larger than MAX_MESSAGE_PAYLOAD");
+    }
+    return count * element_size;
+}
+
+static void write_id(std::ostream &os, MessageId id)
+{
+    uint16_t value = static_cast<uint16_t>(id);
+    write_bytes(os, &value, sizeof(value));
+}
+
+static void expect_id(std::istream &is, MessageId expected)
+{
+    MessageId id;
+    if (!readMessageId(is, id)) {
+        throw std::runtime_error("Failed to read from the stream, it has ended");
+    }
+    if (id != expected) {
+        throw std::runtime_error("Unexpected message id in the stream");
+    }
+}
+
+static void write_image(std::ostream &os, const ISMRMRD_ImageHeader &head, const char *attributes,
+                        const void *data, size_t size)
+{
+    uint64_t attribute_length = (attributes != NULL) ? head.attribute_string_len : 0;
+    write_id(os, MessageId::IMAGE);
+    write_bytes(os, &head, sizeof(head));
+    write_bytes(os, &attribute_length, sizeof(attribute_length));
+    write_bytes(os, attributes, attribute_length);
+    write_bytes(os, data, size);
+}
+
+// Reads the image header and the length of the attribute string that follows it
+static void read_image_header(std::istream &is, ISMRMRD_ImageHeader &head)
+{
+    uint64_t attribute_length;
+    read_bytes(is, &head, sizeof(head));
+    read_bytes(is, &attribute_length, sizeof(attribute_length));
+    if (attribute_length != head.attribute_string_len) {
+        throw std::runtime_error("Corrupt image message, the attribute length doesn't match the header");
+    }
+    // at most 65535^4 elements, which fits in 64 bits
+    uint64_t elements = uint64_t(head.matrix_size[0]) * head.matrix_size[1] * head.matrix_size[2] * head.channels;
+    checked_payload_size(elements, ismrmrd_sizeof_data_type(head.data_type));
+    checked_payload_size(attribute_length, 1);
+}
+
+static void write_ndarray(std::ostream &os, uint16_t data_type, uint16_t ndim, const size_t *dims,
+                          const void *data, size_t size)
+{
+    write_id(os, MessageId::NDARRAY);
+    write_bytes(os, &data_type, sizeof(data_type));
+    write_bytes(os, &ndim, sizeof(ndim));
+    for (uint16_t n = 0; n < ndim; n++) {
+        uint64_t dim = dims[n];
+        write_bytes(os, &dim, sizeof(dim));
+    }
+    write_bytes(os, data, size);
+}
+
+static void read_ndarray_shape(std::istream &is, uint16_t &data_type, std::vector<size_t> &dims)
+{
+    uint16_t ndim;
+    read_bytes(is, &data_type, sizeof(data_type));
+    read_bytes(is, &ndim, sizeof(ndim));
+    if (ndim > ISMRMRD_NDARRAY_MAXDIM) {
+        throw std::runtime_error("Corrupt array message, too many dimensions");
+    }
+    dims.resize(ndim);
+    uint64_t elements = 1;
+    for (uint16_t n = 0; n < ndim; n++) {
+        uint64_t dim;
+        read_bytes(is, &dim, sizeof(dim));
+        if (dim > 0 && elements > MAX_MESSAGE_PAYLOAD / dim) {
+            throw std::runtime_error("Message in the stream is larger than MAX_MESSAGE_PAYLOAD");
+        }
+        elements *= dim;
+        dims[n] = static_cast<size_t>(dim);
+    }
+    checked_payload_size(elements, ismrmrd_sizeof_data_type(data_type));
+}
+
+//
+// Writing
+//
+void serialize(const std::string &xmlstring, std::ostream &os)
+{
+    uint32_t length = static_cast<uint32_t>(xmlstring.size());
+    write_id(os, MessageId::HEADER);
+    write_bytes(os, &length, sizeof(length));
+    write_bytes(os, xmlstring.data(), xmlstring.size());
+}
+
+void serialize(const Acquisition &acq, std::ostream &os)
+{
+    write_id(os, MessageId::ACQUISITION);
+    write_bytes(os, &acq.getHead(), sizeof(ISMRMRD_AcquisitionHeader));
+    write_bytes(os, acq.getTrajPtr(), acq.getTrajSize());
+    write_bytes(os, acq.getDataPtr(), acq.getDataSize());
+}
+
+void serialize(const Waveform &wav, std::ostream &os)
+{
+    write_id(os, MessageId::WAVEFORM);
+    write_bytes(os, &wav.head, sizeof(ISMRMRD_WaveformHeader));
+    write_bytes(os, wav.data, ismrmrd_size_of_waveform_data(&wav));
+}
+
+template <typename T> void serialize(const Image<T> &im, std::ostream &os)
+{
+    write_image(os, im.getHead(), im.getAttributeString(), im.getDataPtr(), im.getDataSize());
+}
+
+void serialize(const ISMRMRD_Image *im, std::ostream &os)
+{
+    if (im == NULL) {
+        throw std::runtime_error("Image pointer should not be NULL");
+    }
+    write_image(os, im->head, im->attribute_string, im->data, ismrmrd_size_of_image_data(im));
+}
+
+template <typename T> void serialize(const NDArray<T> &arr, std::ostream &os)
+{
+    write_ndarray(os, arr.getDataType(), arr.getNDim(), const_cast<NDArray<T> &>(arr).getDims(),
+                  arr.getDataPtr(), arr.getDataSize());
+}
+
+void serialize(const ISMRMRD_NDArray *arr, std::ostream &os)
+{
+    if (arr == NULL) {
+        throw std::runtime_error("Array pointer should not be NULL");
+    }
+    write_ndarray(os, arr->data_type, arr->ndim, arr->dims, arr->data, ismrmrd_size_of_ndarray_data(arr));
+}
+
+void serializeClose(std::ostream &os)
+{
+    write_id(os, MessageId::CLOSE);
+}
+
+//
+// Reading
+//
+bool readMessageId(std::istream &is, MessageId &id)
+{
+    uint16_t value;
+    is.read(reinterpret_cast<char *>(&value), sizeof(value));
+    if (is.gcount() == 0 && is.eof()) {
+        return false;
+    }
+    if (!is) {
+        throw std::runtime_error("Failed to read from the stream, it ended inside a message id");
+    }
+    id = static_cast<MessageId>(value);
+    switch (id) {
+    case MessageId::HEADER:
+    case MessageId::CLOSE:
+    case MessageId::ACQUISITION:
+    case MessageId::IMAGE:
+    case MessageId::WAVEFORM:
+    case MessageId::NDARRAY:
+        return true;
+    }
+    throw std::runtime_error("Unknown message id in the stream");
+}
+
+void deserialize(std::istream &is, std::string &xmlstring)
+{
+    expect_id(is, MessageId::HEADER);
+    deserializePayload(is, xmlstring);
+}
+
+void deserialize(std::istream &is, Acquisition &acq)
+{
+    expect_id(is, MessageId::ACQUISITION);
+    deserializePayload(is, acq);
+}
+
+void deserialize(std::istream &is, Waveform &wav)
+{
+    expect_id(is, MessageId::WAVEFORM);
+    deserializePayload(is, wav);
+}
+
+template <typename T> void deserialize(std::istream &is, Image<T> &im)
+{
+    expect_id(is, MessageId::IMAGE);
+    deserializePayload(is, im);
+}
+
+void deserialize(std::istream &is, ISMRMRD_Image *im)
+{
+    expect_id(is, MessageId::IMAGE);
+    deserializePayload(is, im);
+}
+
+template <typename T> void deserialize(std::istream &is, NDArray<T> &arr)
+{
+    expect_id(is, MessageId::NDARRAY);
+    deserializePayload(is, arr);
+}
+
+void deserialize(std::istream &is, ISMRMRD_NDArray *arr)
+{
+    expect_id(is, MessageId::NDARRAY);
+    deserializePayload(is, arr);
+}
+
+void deserializePayload(std::istream &is, std::string &xmlstring)
+{
+    uint32_t length;
+    read_bytes(is, &length, sizeof(length));
+    checked_payload_size(length, 1);
+    xmlstring.resize(length);
+    if (length > 0) {
+        read_bytes(is, &xmlstring[0], length);
+    }
+}
+
+void deserializePayload(std::istream &is, Acquisition &acq)
+{
+    AcquisitionHeader head;
+    read_bytes(is, &head, sizeof(ISMRMRD_AcquisitionHeader));
+    checked_payload_size(uint64_t(head.number_of_samples) *
+                         (head.trajectory_dimensions * sizeof(float) + head.active_channels * sizeof(complex_float_t)), 1);
+    acq.setHead(head);
+    read_bytes(is, acq.getTrajPtr(), acq.getTrajSize());
+    read_bytes(is, acq.getDataPtr(), acq.getDataSize());
+}
+
+void deserializePayload(std::istream &is, Waveform &wav)
+{
+    ISMRMRD_WaveformHeader head;
+    read_bytes(is, &head, sizeof(ISMRMRD_WaveformHeader));
+    checked_payload_size(uint64_t(head.number_of_samples) * head.channels, sizeof(uint32_t));
+    wav.head = head;
+    if (ismrmrd_make_consistent_waveform(&wav) != ISMRMRD_NOERROR) {
+        throw std::runtime_error(build_exception_string());
+    }
+    read_bytes(is, wav.data, ismrmrd_size_of_waveform_data(&wav));
+}
+
+template <typename T> void deserializePayload(std::istream &is, Image<T> &im)
+{
+    ImageHeader head;
+    read_image_header(is, head);
+    if (head.data_type != im.getDataType()) {
+        throw std::runtime_error("The image in the stream is of a different type");
+    }
+    std::string attributes(head.attribute_string_len, '\0');
+    if (!attributes.empty()) {
+        read_bytes(is, &attributes[0], attributes.size());
+    }
+    im.setHead(head);
+    im.setAttributeString(attributes);
+    read_bytes(is, im.getDataPtr(), im.getDataSize());
+}
+
+void deserializePayload(std::istream &is, ISMRMRD_Image *im)
+{
+    if (im == NULL) {
+        throw std::runtime_error("Image pointer should not be NULL");
+    }
+    ISMRMRD_ImageHeader head;
+    read_image_header(is, head);
+    im->head = head;
+    if (ismrmrd_make_consistent_image(im) != ISMRMRD_NOERROR) {
+        throw std::runtime_error(build_exception_string());
+    }
+    read_bytes(is, im->attribute_string, im->head.attribute_string_len);
+    read_bytes(is, im->data, ismrmrd_size_of_image_data(im));
+}
+
+template <typename T> void deserializePayload(std::istream &is, NDArray<T> &arr)
+{
+    uint16_t data_type;
+    std::vector<size_t> dims;
+    read_ndarray_shape(is, data_type, dims);
+    if (data_type != arr.getDataType()) {
+        throw std::runtime_error("The array in the stream is of a different type");
+    }
+    arr.resize(dims);
+    read_bytes(is, arr.getDataPtr(), arr.getDataSize());
+}
+
+void deserializePayload(std::istream &is, ISMRMRD_NDArray *arr)
+{
+    if (arr == NULL) {
+        throw std::runtime_error("Array pointer should not be NULL");
+    }
+    uint16_t data_type;
+    std::vector<size_t> dims;
+    read_ndarray_shape(is, data_type, dims);
+    arr->data_type = data_type;
+    arr->ndim = static_cast<uint16_t>(dims.size());
+    for (size_t n = 0; n < dims.size(); n++) {
+        arr->dims[n] = dims[n];
+    }
+    if (ismrmrd_make_consistent_ndarray(arr) != ISMRMRD_NOERROR) {
+        throw std::runtime_error(build_exception_string());
+    }
+    read_bytes(is, arr->data, ismrmrd_size_of_ndarray_data(arr));
+}
+
+// Specific instantiations
+template EXPORTISMRMRD void serialize(const Image<uint16_t> &im, std::ostream &os);
+template EXPORTISMRMRD void serialize(const Image<int16_t> &im, std::ostream &os);
+template EXPORTISMRMRD void serialize(const Image<uint32_t> &im, std::ostream &os);
+template EXPORTISMRMRD void serialize(const Image<int32_t> &im, std::ostream &os);
+template EXPORTISMRMRD void serialize(const Image<float> &im, std::ostream &os);
+template EXPORTISMRMRD void serialize(const Image<double> &im, std::ostream &os);
+template EXPORTISMRMRD void serialize(const Image<complex_float_t> &im, std::ostream &os);
+template EXPORTISMRMRD void serialize(const Image<complex_double_t> &im, std::ostream &os);
+template EXPORTISMRMRD void serialize(const NDArray<uint16_t> &arr, std::ostream &os);
+template EXPORTISMRMRD void serialize(const NDArray<int16_t> &arr, std::ostream &os);
+template EXPORTISMRMRD void serialize(const NDArray<uint32_t> &arr, std::ostream &os);
+template EXPORTISMRMRD void serialize(const NDArray<int32_t> &arr, std::ostream &os);
+template EXPORTISMRMRD void serialize(const NDArray<float> &arr, std::ostream &os);
+template EXPORTISMRMRD void serialize(const NDArray<double> &arr, std::ostream &os);
+template EXPORTISMRMRD void serialize(const NDArray<complex_float_t> &arr, std::ostream &os);
+template EXPORTISMRMRD void serialize(const NDArray<complex_double_t> &arr, std::ostream &os);
+template EXPORTISMRMRD void deserialize(std::istream &is, Image<uint16_t> &im);
+template EXPORTISMRMRD void deserialize(std::istream &is, Image<int16_t> &im);
+template EXPORTISMRMRD void deserialize(std::istream &is, Image<uint32_t> &im);
+template EXPORTISMRMRD void deserialize(std::istream &is, Image<int32_t> &im);
+template EXPORTISMRMRD void deserialize(std::istream &is, Image<float> &im);
+template EXPORTISMRMRD void deserialize(std::istream &is, Image<double> &im);
+template EXPORTISMRMRD void deserialize(std::istream &is, Image<complex_float_t> &im);
+template EXPORTISMRMRD void deserialize(std::istream &is, Image<complex_double_t> &im);
+template EXPORTISMRMRD void deserialize(std::istream &is, NDArray<uint16_t> &arr);
+template EXPORTISMRMRD void deserialize(std::istream &is, NDArray<int16_t> &arr);
+template EXPORTISMRMRD void deserialize(std::istream &is, NDArray<uint32_t> &arr);
+template EXPORTISMRMRD void deserialize(std::istream &is, NDArray<int32_t> &arr);
+template EXPORTISMRMRD void deserialize(std::istream &is, NDArray<float> &arr);
+template EXPORTISMRMRD void deserialize(std::istream &is, NDArray<double> &arr);
+template EXPORTISMRMRD void deserialize(std::istream &is, NDArray<complex_float_t> &arr);
+template EXPORTISMRMRD void deserialize(std::istream &is, NDArray<complex_double_t> &arr);
+template EXPORTISMRMRD void deserializePayload(std::istream &is, Image<uint16_t> &im);
+template EXPORTISMRMRD void deserializePayload(std::istream &is, Image<int16_t> &im);
+template EXPORTISMRMRD void deserializePayload(std::istream &is, Image<uint32_t> &im);
+template EXPORTISMRMRD void deserializePayload(std::istream &is, Image<int32_t> &im);
+template EXPORTISMRMRD void deserializePayload(std::istream &is, Image<float> &im);
+template EXPORTISMRMRD void deserializePayload(std::istream &is, Image<double> &im);
+template EXPORTISMRMRD void deserializePayload(std::istream &is, Image<complex_float_t> &im);
+template EXPORTISMRMRD void deserializePayload(std::istream &is, Image<complex_double_t> &im);
+template EXPORTISMRMRD void deserializePayload(std::istream &is, NDArray<uint16_t> &arr);
+template EXPORTISMRMRD void deserializePayload(std::istream &is, NDArray<int16_t> &arr);
+template EXPORTISMRMRD void deserializePayload(std::istream &is, NDArray<uint32_t> &arr);
+template EXPORTISMRMRD void deserializePayload(std::istream &is, NDArray<int32_t> &arr);
+template EXPORTISMRMRD void deserializePayload(std::istream &is, NDArray<float> &arr);
+template EXPORTISMRMRD void deserializePayload(std::istream &is, NDArray<double> &arr);
+template EXPORTISMRMRD void deserializePayload(std::istream &is, NDArray<complex_float_t> &arr);
+template EXPORTISMRMRD void deserializePayload(std::istream &is, NDArray<complex_double_t> &arr);
+
+} // namespace ISMRMRD
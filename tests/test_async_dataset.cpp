@@ -0,0 +1,287 @@
+#include "ismrmrd/ismrmrd.h"
+#include "ismrmrd/async_dataset.h"
+#include "test_ismrmrd.h"
+#include <boost/test/unit_test.hpp>
+#include <chrono>
+#include <cstdio>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace ISMRMRD;
+
+BOOST_AUTO_TEST_SUITE(AsyncDatasetTest)
+
+static const char *test_file = "test_async_dataset.h5";
+static const char *test_group = "dataset";
+
+BOOST_AUTO_TEST_CASE(test_async_append_order)
+{
+    std::remove(test_file);
+    {
+        AsyncDataset d(test_file, test_group, true, 16);
+        d.writeHeader("<ismrmrdHeader/>");
+        for (uint32_t n = 0; n < 500; n++) {
+            Acquisition acq = make_acquisition(n, 64, 4, 0);
+            BOOST_CHECK(d.appendAcquisition(std::move(acq)));
+            // moving leaves the source empty rather than copying it
+            BOOST_CHECK_EQUAL(acq.number_of_samples(), 0);
+            if (n % 100 == 0) {
+                Image<float> im(8, 8);
+                im.setImageSeriesIndex(n);
+                BOOST_CHECK(d.appendImage("images", std::move(im)));
+                Waveform wav(16, 1);
+                wav.head.scan_counter = n;
+                BOOST_CHECK(d.appendWaveform(std::move(wav)));
+            }
+        }
+        d.flush();
+
+        AsyncDatasetStats stats = d.getStats();
+        BOOST_CHECK_EQUAL(stats.queued, 511u);
+        BOOST_CHECK_EQUAL(stats.written, 511u);
+        BOOST_CHECK_EQUAL(stats.dropped, 0u);
+        BOOST_CHECK_EQUAL(stats.failed, 0u);
+        BOOST_CHECK(stats.batches > 0);
+        BOOST_CHECK(stats.max_depth <= 16);
+        d.close();
+    }
+
+    Dataset d(test_file, test_group, false);
+    std::string xml;
+    d.readHeader(xml);
+    BOOST_CHECK_EQUAL(xml, "<ismrmrdHeader/>");
+    BOOST_REQUIRE_EQUAL(d.getNumberOfAcquisitions(), 500u);
+    for (uint32_t n = 0; n < 500; n++) {
+        Acquisition acq;
+        d.readAcquisition(n, acq);
+        BOOST_CHECK_EQUAL(acq.scan_counter(), n);
+        BOOST_REQUIRE_EQUAL(acq.getNumberOfDataElements(), 256u);
+        BOOST_CHECK(acq.data(63, 3) == complex_float_t(float(n), float(255)));
+    }
+    BOOST_REQUIRE_EQUAL(d.getNumberOfImages("images"), 5u);
+    for (uint32_t n = 0; n < 5; n++) {
+        Image<float> im;
+        d.readImage("images", n, im);
+        BOOST_CHECK_EQUAL(im.getImageSeriesIndex(), n * 100);
+    }
+    BOOST_REQUIRE_EQUAL(d.getNumberOfWaveforms(), 5u);
+    std::remove(test_file);
+}
+
+BOOST_AUTO_TEST_CASE(test_async_drop_policy)
+{
+    std::remove(test_file);
+    uint32_t accepted = 0;
+    {
+        AsyncDataset d(test_file, test_group, true, 1, AsyncQueuePolicy::DROP);
+        for (uint32_t n = 0; n < 2000; n++) {
+            if (d.appendAcquisition(make_acquisition(n, 64, 4, 0))) {
+                accepted++;
+            }
+        }
+        d.flush();
+
+        AsyncDatasetStats stats = d.getStats();
+        BOOST_CHECK_EQUAL(stats.queued, accepted);
+        BOOST_CHECK_EQUAL(stats.queued + stats.dropped, 2000u);
+        BOOST_CHECK_EQUAL(stats.written, accepted);
+        BOOST_CHECK(stats.max_depth <= 1);
+        d.close();
+    }
+
+    // the accepted acquisitions keep their order around the gaps
+    Dataset d(test_file, test_group, false);
+    BOOST_REQUIRE_EQUAL(d.getNumberOfAcquisitions(), accepted);
+    uint32_t last = 0;
+    for (uint32_t n = 0; n < accepted; n++) {
+        Acquisition acq;
+        d.readAcquisition(n, acq);
+        BOOST_CHECK(n == 0 || acq.scan_counter() > last);
+        last = acq.scan_counter();
+    }
+    std::remove(test_file);
+}
+
+BOOST_AUTO_TEST_CASE(test_async_grow_policy)
+{
+    std::remove(test_file);
+    {
+        AsyncDataset d(test_file, test_group, true, 4, AsyncQueuePolicy::GROW);
+        for (uint32_t n = 0; n < 1000; n++) {
+            BOOST_CHECK(d.appendAcquisition(make_acquisition(n, 64, 4, 0)));
+        }
+        d.close();
+
+        AsyncDatasetStats stats = d.getStats();
+        BOOST_CHECK_EQUAL(stats.written, 1000u);
+        BOOST_CHECK_EQUAL(stats.dropped, 0u);
+        // the writer takes at most the capacity in one go however deep the queue gets
+        BOOST_CHECK(stats.batches >= 250);
+        BOOST_CHECK_THROW(d.appendAcquisition(make_acquisition(0, 64, 4, 0)), std::runtime_error);
+    }
+
+    Dataset d(test_file, test_group, false);
+    BOOST_CHECK_EQUAL(d.getNumberOfAcquisitions(), 1000u);
+    std::remove(test_file);
+}
+
+BOOST_AUTO_TEST_CASE(test_async_close_wakes_blocked_producer)
+{
+    std::remove(test_file);
+    uint32_t accepted = 0;
+    {
+        AsyncDataset d(test_file, test_group, true, 1, AsyncQueuePolicy::BLOCK);
+        std::thread producer([&d, &accepted] {
+            try {
+                for (uint32_t n = 0; n < 100000; n++) {
+                    d.appendAcquisition(make_acquisition(n, 64, 4, 0));
+                    accepted++;
+                }
+            } catch (std::runtime_error &) {
+                // closed while the producer waited for room
+            }
+        });
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        d.close();
+        producer.join();
+
+        // nothing is queued once the writer has stopped
+        AsyncDatasetStats stats = d.getStats();
+        BOOST_CHECK_EQUAL(stats.queued, accepted);
+        BOOST_CHECK_EQUAL(stats.written, accepted);
+        BOOST_CHECK_EQUAL(stats.depth, 0u);
+        BOOST_CHECK(accepted < 100000u);
+    }
+
+    Dataset d(test_file, test_group, false);
+    BOOST_CHECK_EQUAL(d.getNumberOfAcquisitions(), accepted);
+    std::remove(test_file);
+}
+
+BOOST_AUTO_TEST_CASE(test_async_error_propagation)
+{
+    std::remove(test_file);
+    {
+        AsyncDataset d(test_file, test_group);
+        d.appendImage("images", Image<float>(8, 8));
+        // the variable already holds 8x8 images, so this write fails on the writer thread
+        d.appendImage("images", Image<float>(16, 16));
+        d.appendAcquisition(make_acquisition(0, 64, 4, 0));
+        BOOST_CHECK_THROW(d.flush(), std::runtime_error);
+
+        // the error is reported once and the writer carries on
+        d.flush();
+        AsyncDatasetStats stats = d.getStats();
+        BOOST_CHECK_EQUAL(stats.written, 2u);
+        BOOST_CHECK_EQUAL(stats.failed, 1u);
+
+        d.appendImage("images", Image<float>(16, 16));
+        BOOST_CHECK_THROW(d.close(), std::runtime_error);
+    }
+
+    Dataset d(test_file, test_group, false);
+    BOOST_CHECK_EQUAL(d.getNumberOfAcquisitions(), 1u);
+    std::remove(test_file);
+}
+
+BOOST_AUTO_TEST_CASE(test_async_untyped_append)
+{
+    std::remove(test_file);
+    {
+        AsyncDataset d(test_file, test_group);
+        ISMRMRD_Image im;
+        ismrmrd_init_image(&im);
+        im.head.data_type = ISMRMRD_DOUBLE;
+        im.head.matrix_size[0] = 4;
+        im.head.matrix_size[1] = 3;
+        ismrmrd_make_consistent_image(&im);
+        static_cast<double *>(im.data)[11] = 5.0;
+        BOOST_CHECK(d.appendImage("images", &im));
+        // the buffers went with the image
+        BOOST_CHECK(im.data == NULL);
+
+        ISMRMRD_NDArray arr;
+        ismrmrd_init_ndarray(&arr);
+        arr.data_type = ISMRMRD_SHORT;
+        arr.ndim = 2;
+        arr.dims[0] = 5;
+        arr.dims[1] = 2;
+        ismrmrd_make_consistent_ndarray(&arr);
+        static_cast<int16_t *>(arr.data)[9] = -7;
+        BOOST_CHECK(d.appendNDArray("arrays", &arr));
+        BOOST_CHECK(arr.data == NULL);
+
+        d.flush();
+        AsyncDatasetStats stats = d.getStats();
+        BOOST_CHECK_EQUAL(stats.written, 2u);
+        BOOST_CHECK_EQUAL(stats.depth, 0u);
+        d.close();
+    }
+
+    Dataset d(test_file, test_group, false);
+    Image<double> im;
+    d.readImage("images", 0, im);
+    BOOST_CHECK_EQUAL(im(3, 2), 5.0);
+    NDArray<int16_t> arr;
+    d.readNDArray("arrays", 0, arr);
+    BOOST_CHECK_EQUAL(arr(4, 1), -7);
+    std::remove(test_file);
+}
+
+BOOST_AUTO_TEST_CASE(test_prefetching_reader)
+{
+    std::remove(test_file);
+    {
+        Dataset d(test_file, test_group);
+        for (uint32_t n = 0; n < 1000; n++) {
+            d.appendAcquisition(make_acquisition(n, 64, 4, 0));
+        }
+    }
+
+    {
+        PrefetchingAcquisitionReader reader(test_file, test_group, 64, 3);
+        BOOST_REQUIRE_EQUAL(reader.getNumberOfAcquisitions(), 1000u);
+
+        // single acquisitions and blocks can be mixed, a block takes the rest of the current one
+        Acquisition acq;
+        std::vector<Acquisition> block;
+        uint32_t scan = 0;
+        while (scan < 1000) {
+            if (scan % 100 == 10) {
+                BOOST_REQUIRE(reader.nextBlock(block));
+                BOOST_REQUIRE(!block.empty());
+                for (size_t n = 0; n < block.size(); n++, scan++) {
+                    BOOST_CHECK_EQUAL(block[n].scan_counter(), scan);
+                    BOOST_REQUIRE_EQUAL(block[n].getNumberOfDataElements(), 256u);
+                    BOOST_CHECK(block[n].data(63, 3) == complex_float_t(float(scan), float(255)));
+                }
+            } else {
+                BOOST_REQUIRE(reader.next(acq));
+                BOOST_CHECK_EQUAL(acq.scan_counter(), scan);
+                BOOST_REQUIRE_EQUAL(acq.getNumberOfDataElements(), 256u);
+                BOOST_CHECK(acq.data(63, 3) == complex_float_t(float(scan), float(255)));
+                scan++;
+            }
+        }
+        BOOST_CHECK(!reader.next(acq));
+        BOOST_CHECK(!reader.nextBlock(block));
+
+        PrefetchStats stats = reader.getStats();
+        BOOST_CHECK_EQUAL(stats.acquisitions, 1000u);
+        BOOST_CHECK_EQUAL(stats.blocks, 16u);
+        BOOST_CHECK(stats.stall_seconds >= 0);
+    }
+
+    // stopping early leaves the reader to clean up its ring
+    {
+        PrefetchingAcquisitionReader reader(test_file, test_group, 16, 2);
+        Acquisition acq;
+        BOOST_CHECK(reader.next(acq));
+        BOOST_CHECK_EQUAL(acq.scan_counter(), 0u);
+    }
+    std::remove(test_file);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
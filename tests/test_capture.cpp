@@ -0,0 +1,202 @@
+#include "ismrmrd/ismrmrd.h"
+#include "ismrmrd/capture.h"
+#include "test_ismrmrd.h"
+#include <boost/test/unit_test.hpp>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+using namespace ISMRMRD;
+
+BOOST_AUTO_TEST_SUITE(CaptureTest)
+
+static const char *capture_file = "test_capture.bin";
+static const char *truncated_file = "test_capture_truncated.bin";
+static const char *dataset_file = "test_capture.h5";
+
+// Noise scans are shorter than the readouts, and every other record has no trajectory
+static Acquisition capture_acquisition(uint32_t scan)
+{
+    return make_acquisition(scan, (scan % 10 == 0) ? 32 : 64, 4, (scan % 2 == 0) ? 2 : 0);
+}
+
+// A small buffer makes the writer both batch records and write large ones directly
+static void write_capture(bool close)
+{
+    CaptureWriter w(capture_file, 4096);
+    w.writeHeader("<ismrmrdHeader/>");
+    for (uint32_t n = 0; n < 200; n++) {
+        w.appendAcquisition(capture_acquisition(n));
+        if (n % 50 == 0) {
+            Waveform wav(16, 2);
+            wav.head.waveform_id = n;
+            for (size_t i = 0; i < wav.size(); i++) {
+                wav.data[i] = n + i;
+            }
+            w.appendWaveform(wav);
+        }
+    }
+    Image<float> im(16, 8, 1, 2);
+    im.setAttributeString("<ismrmrdMeta/>");
+    for (uint16_t n = 0; n < 3; n++) {
+        im.setImageIndex(n);
+        im(3, 2, 0, 1) = float(n);
+        w.appendImage("images", im);
+    }
+    Image<complex_float_t> cx(4, 4);
+    cx(1, 1) = complex_float_t(1.0f, 2.0f);
+    w.appendImage("complex", cx);
+    if (close) {
+        w.close();
+    } else {
+        w.flush();
+        // the writer is abandoned without its footer, as when the process is killed
+        std::remove(truncated_file);
+        std::ifstream in(capture_file, std::ios::binary);
+        std::ofstream out(truncated_file, std::ios::binary);
+        out << in.rdbuf();
+    }
+}
+
+BOOST_AUTO_TEST_CASE(test_capture_reads_back)
+{
+    write_capture(true);
+    CaptureReader r(capture_file);
+    BOOST_CHECK(!r.isRecovered());
+    std::string xml;
+    BOOST_REQUIRE(r.readHeader(xml));
+    BOOST_CHECK_EQUAL(xml, "<ismrmrdHeader/>");
+    BOOST_CHECK_EQUAL(r.getIndex().size(), 1u + 200u + 4u + 4u);
+
+    // random access, reusing one acquisition
+    BOOST_REQUIRE_EQUAL(r.getNumberOfAcquisitions(), 200u);
+    Acquisition acq;
+    for (uint32_t n = 0; n < 200; n++) {
+        uint32_t index = (n * 37) % 200;
+        r.readAcquisition(index, acq);
+        BOOST_CHECK(same_acquisition(acq, capture_acquisition(index)));
+    }
+    BOOST_CHECK_THROW(r.readAcquisition(200, acq), std::out_of_range);
+
+    BOOST_REQUIRE_EQUAL(r.getNumberOfWaveforms(), 4u);
+    Waveform wav;
+    r.readWaveform(2, wav);
+    BOOST_CHECK_EQUAL(wav.head.waveform_id, 100u);
+    BOOST_CHECK_EQUAL(wav.data[5], 105u);
+
+    BOOST_REQUIRE_EQUAL(r.getNumberOfImages(), 4u);
+    std::string var;
+    Image<float> im;
+    r.readImage(2, var, im);
+    BOOST_CHECK_EQUAL(var, "images");
+    BOOST_CHECK_EQUAL(im.getImageIndex(), 2u);
+    BOOST_CHECK_EQUAL(im(3, 2, 0, 1), 2.0f);
+    BOOST_CHECK_EQUAL(std::string(im.getAttributeString()), "<ismrmrdMeta/>");
+    Image<complex_float_t> cx;
+    r.readImage(3, var, cx);
+    BOOST_CHECK_EQUAL(var, "complex");
+    BOOST_CHECK(cx(1, 1) == complex_float_t(1.0f, 2.0f));
+    BOOST_CHECK_THROW(r.readImage(3, var, im), std::runtime_error);
+    std::remove(capture_file);
+}
+
+BOOST_AUTO_TEST_CASE(test_capture_recovers_truncation)
+{
+    write_capture(false);
+    std::remove(capture_file);
+
+    // cut the last image in half
+    std::ifstream in(truncated_file, std::ios::binary | std::ios::ate);
+    size_t size = static_cast<size_t>(in.tellg());
+    std::vector<char> bytes(size);
+    in.seekg(0);
+    in.read(&bytes[0], size);
+    in.close();
+    std::ofstream out(truncated_file, std::ios::binary | std::ios::trunc);
+    out.write(&bytes[0], size - 40);
+    out.close();
+
+    CaptureReader r(truncated_file);
+    BOOST_CHECK(r.isRecovered());
+    BOOST_CHECK_EQUAL(r.getNumberOfAcquisitions(), 200u);
+    BOOST_CHECK_EQUAL(r.getNumberOfWaveforms(), 4u);
+    BOOST_CHECK_EQUAL(r.getNumberOfImages(), 3u);
+    Acquisition acq;
+    r.readAcquisition(199, acq);
+    BOOST_CHECK(same_acquisition(acq, capture_acquisition(199)));
+    std::remove(truncated_file);
+}
+
+BOOST_AUTO_TEST_CASE(test_capture_rejects_corrupt_header)
+{
+    {
+        CaptureWriter w(capture_file);
+        w.appendAcquisition(capture_acquisition(1));
+        w.appendAcquisition(capture_acquisition(2));
+    }
+    // the first acquisition claims far more samples and channels than its record holds
+    std::fstream f(capture_file, std::ios::binary | std::ios::in | std::ios::out);
+    uint16_t huge = 65535;
+    f.seekp(32 + offsetof(ISMRMRD_AcquisitionHeader, number_of_samples));
+    f.write(reinterpret_cast<const char *>(&huge), sizeof(huge));
+    f.seekp(32 + offsetof(ISMRMRD_AcquisitionHeader, active_channels));
+    f.write(reinterpret_cast<const char *>(&huge), sizeof(huge));
+    f.close();
+
+    CaptureReader r(capture_file);
+    Acquisition acq;
+    BOOST_CHECK_THROW(r.readAcquisition(0, acq), std::runtime_error);
+    BOOST_CHECK_EQUAL(acq.number_of_samples(), 0u);
+    r.readAcquisition(1, acq);
+    BOOST_CHECK(same_acquisition(acq, capture_acquisition(2)));
+    std::remove(capture_file);
+}
+
+BOOST_AUTO_TEST_CASE(test_capture_converts)
+{
+    write_capture(true);
+    std::remove(dataset_file);
+    {
+        CaptureReader r(capture_file);
+        Dataset d(dataset_file, "dataset");
+        convertCaptureToDataset(r, d);
+    }
+    {
+        Dataset d(dataset_file, "dataset", false);
+        BOOST_REQUIRE_EQUAL(d.getNumberOfAcquisitions(), 200u);
+        Acquisition acq;
+        d.readAcquisition(150, acq);
+        BOOST_CHECK(same_acquisition(acq, capture_acquisition(150)));
+        BOOST_CHECK_EQUAL(d.getNumberOfWaveforms(), 4u);
+        BOOST_CHECK_EQUAL(d.getNumberOfImages("images"), 3u);
+        BOOST_CHECK_EQUAL(d.getNumberOfImages("complex"), 1u);
+
+        // and back
+        CaptureWriter w(capture_file);
+        std::vector<std::string> vars(1, "images");
+        convertDatasetToCapture(d, vars, w);
+    }
+    CaptureReader r(capture_file);
+    std::string xml;
+    BOOST_REQUIRE(r.readHeader(xml));
+    BOOST_CHECK_EQUAL(xml, "<ismrmrdHeader/>");
+    BOOST_REQUIRE_EQUAL(r.getNumberOfAcquisitions(), 200u);
+    Acquisition acq;
+    r.readAcquisition(33, acq);
+    BOOST_CHECK(same_acquisition(acq, capture_acquisition(33)));
+    BOOST_CHECK_EQUAL(r.getNumberOfWaveforms(), 4u);
+    BOOST_REQUIRE_EQUAL(r.getNumberOfImages(), 3u);
+    std::string var;
+    Image<float> im;
+    r.readImage(1, var, im);
+    BOOST_CHECK_EQUAL(var, "images");
+    BOOST_CHECK_EQUAL(im(3, 2, 0, 1), 1.0f);
+    std::remove(capture_file);
+    std::remove(dataset_file);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
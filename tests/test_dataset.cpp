@@ -0,0 +1,1510 @@
+#include "ismrmrd/ismrmrd.h"
+#include "ismrmrd/dataset.h"
+#include "ismrmrd/version.h"
+#include "ismrmrd/xml.h"
+#include "test_ismrmrd.h"
+#include <boost/test/unit_test.hpp>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <limits>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace ISMRMRD;
+
+BOOST_AUTO_TEST_SUITE(DatasetTest)
+
+static const char *test_file = "test_dataset.h5";
+static const char *test_group = "dataset";
+
+BOOST_AUTO_TEST_CASE(test_append_acquisitions)
+{
+    std::remove(test_file);
+    {
+        Dataset d(test_file, test_group, true);
+        d.appendAcquisition(make_acquisition(0, 32, 4, 2));
+
+        std::vector<Acquisition> block;
+        for (uint32_t n = 1; n < 11; n++) {
+            block.push_back(make_acquisition(n, 32, 4, 2));
+        }
+        d.appendAcquisitions(block);
+
+        // An empty block is a no-op
+        d.appendAcquisitions(std::vector<Acquisition>());
+        d.appendAcquisition(make_acquisition(11, 32, 4, 2));
+        BOOST_CHECK_EQUAL(d.getNumberOfAcquisitions(), 12);
+    }
+    {
+        Dataset d(test_file, test_group, false);
+        BOOST_REQUIRE_EQUAL(d.getNumberOfAcquisitions(), 12);
+        Acquisition acq;
+        for (uint32_t n = 0; n < 12; n++) {
+            d.readAcquisition(n, acq);
+            check_acquisition(acq, n, 32, 4, 2);
+        }
+    }
+    std::remove(test_file);
+}
+
+BOOST_AUTO_TEST_CASE(test_read_acquisitions)
+{
+    std::remove(test_file);
+    {
+        Dataset d(test_file, test_group, true);
+        std::vector<Acquisition> block;
+        for (uint32_t n = 0; n < 20; n++) {
+            // vary the shapes to exercise buffer reuse
+            block.push_back(make_acquisition(n, 16 + n % 3, 2 + n % 2, n % 2));
+        }
+        d.appendAcquisitions(block);
+    }
+    {
+        Dataset d(test_file, test_group, false);
+        std::vector<Acquisition> acqs;
+        d.readAcquisitions(5, 10, acqs);
+        BOOST_REQUIRE_EQUAL(acqs.size(), 10);
+        for (uint32_t n = 0; n < 10; n++) {
+            uint32_t scan = n + 5;
+            check_acquisition(acqs[n], scan, 16 + scan % 3, 2 + scan % 2, scan % 2);
+        }
+
+        // Reading again into the same vector reuses its acquisitions
+        d.readAcquisitions(0, 20, acqs);
+        BOOST_REQUIRE_EQUAL(acqs.size(), 20);
+        for (uint32_t n = 0; n < 20; n++) {
+            check_acquisition(acqs[n], n, 16 + n % 3, 2 + n % 2, n % 2);
+        }
+
+        BOOST_CHECK_THROW(d.readAcquisitions(15, 10, acqs), std::runtime_error);
+        BOOST_CHECK_THROW(d.readAcquisitions(20, 1, acqs), std::runtime_error);
+    }
+    std::remove(test_file);
+}
+
+BOOST_AUTO_TEST_CASE(test_open_handles)
+{
+    std::remove(test_file);
+    {
+        Dataset writer(test_file, test_group, true);
+        std::vector<Acquisition> block;
+        for (uint32_t n = 0; n < 5; n++) {
+            block.push_back(make_acquisition(n, 8, 1, 0));
+        }
+        writer.appendAcquisitions(block);
+
+        // A second dataset on the same file sees appends made through the first one
+        Dataset reader(test_file, test_group, false);
+        BOOST_CHECK_EQUAL(reader.getNumberOfAcquisitions(), 5);
+        writer.appendAcquisition(make_acquisition(5, 8, 1, 0));
+        BOOST_CHECK_EQUAL(reader.getNumberOfAcquisitions(), 6);
+        Acquisition acq;
+        reader.readAcquisition(5, acq);
+        check_acquisition(acq, 5, 8, 1, 0);
+
+        // Interleave appends to several image variables
+        for (uint16_t n = 0; n < 4; n++) {
+            for (int var = 0; var < 3; var++) {
+                Image<float> im(4, 4, 1, 1);
+                im.setImageIndex(n);
+                im.setSlice(var);
+                std::fill(im.begin(), im.end(), float(n + var));
+                writer.appendImage("image_" + std::to_string(var), im);
+            }
+        }
+    }
+    {
+        Dataset d(test_file, test_group, false);
+        for (int var = 0; var < 3; var++) {
+            std::string name = "image_" + std::to_string(var);
+            BOOST_REQUIRE_EQUAL(d.getNumberOfImages(name), 4);
+            for (uint16_t n = 0; n < 4; n++) {
+                Image<float> im;
+                d.readImage(name, n, im);
+                BOOST_CHECK_EQUAL(im.getImageIndex(), n);
+                BOOST_CHECK_EQUAL(im.getSlice(), var);
+                BOOST_CHECK_EQUAL(im(3, 3), float(n + var));
+            }
+        }
+        BOOST_CHECK_EQUAL(d.getNumberOfImages("missing"), 0);
+    }
+    std::remove(test_file);
+}
+
+BOOST_AUTO_TEST_CASE(test_read_acquisition_headers)
+{
+    std::remove(test_file);
+    {
+        Dataset d(test_file, test_group, true);
+        std::vector<Acquisition> block;
+        for (uint32_t n = 0; n < 20; n++) {
+            block.push_back(make_acquisition(n, 16, 2, n % 2));
+            block.back().setFlag(ISMRMRD_ACQ_LAST_IN_SLICE);
+        }
+        d.appendAcquisitions(block);
+    }
+    {
+        Dataset d(test_file, test_group, false);
+        std::vector<AcquisitionHeader> heads;
+        d.readAcquisitionHeaders(4, 12, heads);
+        BOOST_REQUIRE_EQUAL(heads.size(), 12);
+        for (uint32_t n = 0; n < 12; n++) {
+            BOOST_CHECK_EQUAL(heads[n].scan_counter, n + 4);
+            BOOST_CHECK_EQUAL(heads[n].idx.kspace_encode_step_1, (n + 4) % 64);
+            BOOST_CHECK_EQUAL(heads[n].number_of_samples, 16);
+            BOOST_CHECK_EQUAL(heads[n].trajectory_dimensions, (n + 4) % 2);
+            BOOST_CHECK(heads[n].isFlagSet(ISMRMRD_ACQ_LAST_IN_SLICE));
+        }
+        BOOST_CHECK_THROW(d.readAcquisitionHeaders(10, 11, heads), std::runtime_error);
+    }
+    std::remove(test_file);
+}
+
+BOOST_AUTO_TEST_CASE(test_read_acquisitions_in_place)
+{
+    std::remove(test_file);
+    {
+        Dataset d(test_file, test_group, true);
+        std::vector<Acquisition> block;
+        for (uint32_t n = 0; n < 30; n++) {
+            // empty records and records without trajectories in between
+            block.push_back(make_acquisition(n, (n % 5 == 0) ? 0 : 8 + n % 4, 1 + n % 3, (n % 4 == 1) ? 2 : 0));
+        }
+        d.appendAcquisitions(block);
+    }
+    {
+        Dataset d(test_file, test_group, false);
+        std::vector<Acquisition> acqs;
+        for (int pass = 0; pass < 2; pass++) {
+            // the second pass reads into buffers that already have the right shape
+            d.readAcquisitions(0, 30, acqs);
+            for (uint32_t n = 0; n < 30; n++) {
+                check_acquisition(acqs[n], n, (n % 5 == 0) ? 0 : 8 + n % 4, 1 + n % 3, (n % 4 == 1) ? 2 : 0);
+            }
+        }
+        Acquisition acq;
+        for (uint32_t n = 30; n-- > 0;) {
+            d.readAcquisition(n, acq);
+            check_acquisition(acq, n, (n % 5 == 0) ? 0 : 8 + n % 4, 1 + n % 3, (n % 4 == 1) ? 2 : 0);
+        }
+    }
+    std::remove(test_file);
+}
+
+// Rewrites the number of samples in the header of one acquisition, leaving its samples as they are
+static void set_number_of_samples(hsize_t index, uint16_t samples)
+{
+    hid_t file = H5Fopen(test_file, H5F_ACC_RDWR, H5P_DEFAULT);
+    hid_t dataset = H5Dopen2(file, "/dataset/data", H5P_DEFAULT);
+    hid_t headtype = H5Tcreate(H5T_COMPOUND, sizeof(uint16_t));
+    H5Tinsert(headtype, "number_of_samples", 0, H5T_NATIVE_UINT16);
+    hid_t datatype = H5Tcreate(H5T_COMPOUND, sizeof(uint16_t));
+    H5Tinsert(datatype, "head", 0, headtype);
+    hid_t space = H5Dget_space(dataset);
+    hsize_t count = 1;
+    H5Sselect_hyperslab(space, H5S_SELECT_SET, &index, NULL, &count, NULL);
+    hid_t memspace = H5Screate_simple(1, &count, NULL);
+    H5Dwrite(dataset, datatype, memspace, space, H5P_DEFAULT, &samples);
+    H5Sclose(memspace);
+    H5Sclose(space);
+    H5Tclose(datatype);
+    H5Tclose(headtype);
+    H5Dclose(dataset);
+    H5Fclose(file);
+}
+
+BOOST_AUTO_TEST_CASE(test_read_mismatched_acquisitions)
+{
+    std::remove(test_file);
+    {
+        Dataset d(test_file, test_group, true);
+        std::vector<Acquisition> block;
+        for (uint32_t n = 0; n < 4; n++) {
+            block.push_back(make_acquisition(n, 8, 2, 2));
+        }
+        d.appendAcquisitions(block);
+    }
+    // headers claiming fewer or more samples than the file holds
+    set_number_of_samples(1, 6);
+    set_number_of_samples(2, 12);
+    {
+        Dataset d(test_file, test_group, false);
+        Acquisition acq;
+        std::vector<Acquisition> acqs;
+        for (int pass = 0; pass < 2; pass++) {
+            BOOST_CHECK_THROW(d.readAcquisition(1, acq), std::runtime_error);
+            BOOST_CHECK_THROW(d.readAcquisition(2, acq), std::runtime_error);
+            BOOST_CHECK_THROW(d.readAcquisitions(0, 4, acqs), std::runtime_error);
+        }
+        d.readAcquisition(3, acq);
+        check_acquisition(acq, 3, 8, 2, 2);
+    }
+    std::remove(test_file);
+}
+
+// The chunk length and extent of a variable, read straight from the file
+static void get_layout(const char *path, hsize_t &chunk, hsize_t &extent)
+{
+    hid_t file = H5Fopen(test_file, H5F_ACC_RDONLY, H5P_DEFAULT);
+    hid_t dataset = H5Dopen2(file, path, H5P_DEFAULT);
+    hid_t props = H5Dget_create_plist(dataset);
+    hid_t space = H5Dget_space(dataset);
+    hsize_t dims[ISMRMRD_NDARRAY_MAXDIM + 1];
+    H5Pget_chunk(props, ISMRMRD_NDARRAY_MAXDIM + 1, dims);
+    chunk = dims[0];
+    H5Sget_simple_extent_dims(space, dims, NULL);
+    extent = dims[0];
+    H5Sclose(space);
+    H5Pclose(props);
+    H5Dclose(dataset);
+    H5Fclose(file);
+}
+
+BOOST_AUTO_TEST_CASE(test_dataset_options)
+{
+    hsize_t chunk, extent;
+
+    std::remove(test_file);
+    {
+        ISMRMRD_DatasetOptions options;
+        ismrmrd_init_dataset_options(&options);
+        options.chunk_length = 16;
+        options.growth_policy = ISMRMRD_GROWTH_GEOMETRIC;
+        Dataset d(test_file, test_group, options);
+        for (uint32_t n = 0; n < 100; n++) {
+            d.appendAcquisition(make_acquisition(n, 8, 2, 0));
+            BOOST_CHECK_EQUAL(d.getNumberOfAcquisitions(), n + 1);
+        }
+        std::vector<Acquisition> acqs;
+        d.readAcquisitions(0, 100, acqs);
+        check_acquisition(acqs[99], 99, 8, 2, 0);
+        BOOST_CHECK_THROW(d.readAcquisitions(100, 1, acqs), std::runtime_error);
+    }
+    // the spare capacity is trimmed on close
+    get_layout("/dataset/data", chunk, extent);
+    BOOST_CHECK_EQUAL(chunk, 16);
+    BOOST_CHECK_EQUAL(extent, 100);
+
+    // the default chunk length doesn't allocate more than the first records
+    std::remove(test_file);
+    {
+        Dataset d(test_file, test_group, true);
+        d.appendAcquisition(make_acquisition(0, 8, 2, 0));
+    }
+    get_layout("/dataset/data", chunk, extent);
+    BOOST_CHECK_EQUAL(chunk, 1);
+    BOOST_CHECK_EQUAL(extent, 1);
+
+    // and packs the small records of a batched append into one chunk
+    std::remove(test_file);
+    {
+        Dataset d(test_file, test_group, true);
+        std::vector<Acquisition> block;
+        for (uint32_t n = 0; n < 200; n++) {
+            block.push_back(make_acquisition(n, 8, 2, 0));
+        }
+        d.appendAcquisitions(block);
+    }
+    get_layout("/dataset/data", chunk, extent);
+    BOOST_CHECK_EQUAL(chunk, 200);
+    BOOST_CHECK_EQUAL(extent, 200);
+    std::remove(test_file);
+}
+
+BOOST_AUTO_TEST_CASE(test_capacity_hint)
+{
+    IsmrmrdHeader h;
+    h.experimentalConditions.H1resonanceFrequency_Hz = 63500000;
+    Encoding e;
+    e.encodedSpace.matrixSize.x = 8;
+    e.encodedSpace.matrixSize.y = 64;
+    e.encodedSpace.matrixSize.z = 1;
+    e.encodedSpace.fieldOfView_mm.x = 300;
+    e.encodedSpace.fieldOfView_mm.y = 300;
+    e.encodedSpace.fieldOfView_mm.z = 6;
+    e.reconSpace = e.encodedSpace;
+    e.trajectory = TrajectoryType::CARTESIAN;
+    e.encodingLimits.kspace_encoding_step_1 = Limit(0, 63, 32);
+    e.encodingLimits.repetition = Limit(0, 1, 0);
+    h.encoding.push_back(e);
+    std::stringstream xml;
+    serialize(h, xml);
+
+    std::remove(test_file);
+    {
+        ISMRMRD_DatasetOptions options;
+        ismrmrd_init_dataset_options(&options);
+        options.growth_policy = ISMRMRD_GROWTH_HINT;
+        Dataset d(test_file, test_group, options);
+        d.writeHeader(xml.str());
+        for (uint32_t n = 0; n < 10; n++) {
+            d.appendAcquisition(make_acquisition(n, 8, 1, 0));
+        }
+        BOOST_CHECK_EQUAL(d.getNumberOfAcquisitions(), 10);
+
+        // other readers see the whole allocation until the writer closes
+        Dataset reader(test_file, test_group, false);
+        BOOST_CHECK_EQUAL(reader.getNumberOfAcquisitions(), 128);
+    }
+    {
+        Dataset d(test_file, test_group, false);
+        BOOST_CHECK_EQUAL(d.getNumberOfAcquisitions(), 10);
+    }
+    // the hinted allocation sets the chunk length
+    hsize_t chunk, extent;
+    get_layout("/dataset/data", chunk, extent);
+    BOOST_CHECK_EQUAL(chunk, 128);
+    BOOST_CHECK_EQUAL(extent, 10);
+    std::remove(test_file);
+}
+
+// The deflate level of a dataset, 0 when it isn't compressed
+static unsigned get_deflate_level(const char *path)
+{
+    hid_t file = H5Fopen(test_file, H5F_ACC_RDONLY, H5P_DEFAULT);
+    hid_t dataset = H5Dopen2(file, path, H5P_DEFAULT);
+    hid_t props = H5Dget_create_plist(dataset);
+    unsigned flags, level = 0;
+    size_t nvalues = 1;
+    if (H5Pget_filter_by_id2(props, H5Z_FILTER_DEFLATE, &flags, &nvalues, &level, 0, NULL, NULL) < 0) {
+        level = 0;
+    }
+    H5Pclose(props);
+    H5Dclose(dataset);
+    H5Fclose(file);
+    return level;
+}
+
+BOOST_AUTO_TEST_CASE(test_compression)
+{
+    std::vector<size_t> dims(2);
+    dims[0] = 64;
+    dims[1] = 32;
+    NDArray<float> arr(dims);
+    for (size_t n = 0; n < arr.getNumberOfElements(); n++) {
+        arr.getDataPtr()[n] = float(n % 64);
+    }
+    Image<complex_float_t> im(32, 32, 1, 2);
+    for (size_t n = 0; n < im.getNumberOfDataElements(); n++) {
+        im.getDataPtr()[n] = complex_float_t(float(n % 32), 0.0f);
+    }
+
+    std::remove(test_file);
+    {
+        ISMRMRD_DatasetOptions options;
+        ismrmrd_init_dataset_options(&options);
+        options.compression = ISMRMRD_COMPRESSION_FAST;
+        Dataset d(test_file, test_group, options);
+        d.setCompression("images", ISMRMRD_COMPRESSION_MAX);
+        d.setCompression("plain", ISMRMRD_COMPRESSION_NONE);
+        BOOST_CHECK_THROW(d.setCompression("other", 7), std::runtime_error);
+        for (uint32_t n = 0; n < 10; n++) {
+            d.appendAcquisition(make_acquisition(n, 8, 2, 1));
+            d.appendNDArray("arrays", arr);
+            d.appendNDArray("plain", arr);
+            d.appendImage("images", im);
+        }
+    }
+    if (H5Zfilter_avail(H5Z_FILTER_DEFLATE) > 0) {
+        BOOST_CHECK_EQUAL(get_deflate_level("/dataset/data"), 1);
+        BOOST_CHECK_EQUAL(get_deflate_level("/dataset/arrays"), 1);
+        BOOST_CHECK_EQUAL(get_deflate_level("/dataset/plain"), 0);
+        BOOST_CHECK_EQUAL(get_deflate_level("/dataset/images/data"), 9);
+        BOOST_CHECK_EQUAL(get_deflate_level("/dataset/images/header"), 9);
+    }
+    {
+        Dataset d(test_file, test_group, false);
+        std::vector<Acquisition> acqs;
+        d.readAcquisitions(0, 10, acqs);
+        for (uint32_t n = 0; n < 10; n++) {
+            check_acquisition(acqs[n], n, 8, 2, 1);
+        }
+        Image<complex_float_t> im_in;
+        d.readImage("images", 9, im_in);
+        BOOST_REQUIRE_EQUAL(im_in.getNumberOfDataElements(), im.getNumberOfDataElements());
+        BOOST_CHECK(std::equal(im.begin(), im.end(), im_in.begin()));
+    }
+    std::remove(test_file);
+}
+
+// The size of a file, to compare layouts
+static long file_size(const char *filename)
+{
+    FILE *f = std::fopen(filename, "rb");
+    if (f == NULL) {
+        return -1;
+    }
+    std::fseek(f, 0, SEEK_END);
+    long size = std::ftell(f);
+    std::fclose(f);
+    return size;
+}
+
+// Readouts of 4 to 35 samples, without a trajectory every third one
+static Acquisition make_uneven_acquisition(uint32_t n)
+{
+    return make_acquisition(n, 4 + n % 32, 2, n % 3 == 0 ? 0 : 2);
+}
+
+BOOST_AUTO_TEST_CASE(test_compressed_acquisitions)
+{
+    std::vector<uint32_t> records;
+    records.push_back(3);
+    records.push_back(4);
+    records.push_back(5);
+    records.push_back(40);
+    records.push_back(199);
+    long uncompressed = 0;
+
+    for (uint16_t profile = ISMRMRD_COMPRESSION_NONE; profile <= ISMRMRD_COMPRESSION_MAX; profile++) {
+        std::remove(test_file);
+        {
+            ISMRMRD_DatasetOptions options;
+            ismrmrd_init_dataset_options(&options);
+            options.compression = profile;
+            Dataset d(test_file, test_group, options);
+            d.appendAcquisition(make_uneven_acquisition(0));
+            std::vector<Acquisition> block;
+            for (uint32_t n = 1; n < 200; n++) {
+                block.push_back(make_uneven_acquisition(n));
+                if (block.size() == 33) {
+                    d.appendAcquisitions(block);
+                    block.clear();
+                }
+            }
+            d.appendAcquisitions(block);
+            // waveforms would only have their headers filtered
+            BOOST_CHECK_THROW(d.setCompression("waveforms", ISMRMRD_COMPRESSION_FAST), std::runtime_error);
+            d.appendWaveform(Waveform(16, 1));
+        }
+        BOOST_CHECK_EQUAL(get_deflate_level("/dataset/waveforms"), 0);
+        // only compressed acquisitions keep their samples in a dataset of their own
+        hid_t file = H5Fopen(test_file, H5F_ACC_RDONLY, H5P_DEFAULT);
+        BOOST_CHECK_EQUAL(H5Lexists(file, "/dataset/acquisition_samples", H5P_DEFAULT) > 0,
+                          profile != ISMRMRD_COMPRESSION_NONE);
+        H5Fclose(file);
+        if (profile == ISMRMRD_COMPRESSION_NONE) {
+            uncompressed = file_size(test_file);
+        } else if (H5Zfilter_avail(H5Z_FILTER_DEFLATE) > 0) {
+            BOOST_CHECK_EQUAL(get_deflate_level("/dataset/acquisition_samples"), profile == ISMRMRD_COMPRESSION_MAX ? 9 : 1);
+            BOOST_CHECK_LT(file_size(test_file), uncompressed / 2);
+        }
+        {
+            Dataset d(test_file, test_group, false);
+            BOOST_REQUIRE_EQUAL(d.getNumberOfAcquisitions(), 200);
+            std::vector<Acquisition> acqs;
+            d.readAcquisitions(0, 200, acqs);
+            for (uint32_t n = 0; n < 200; n++) {
+                check_acquisition(acqs[n], n, 4 + n % 32, 2, n % 3 == 0 ? 0 : 2);
+            }
+            Acquisition acq;
+            d.readAcquisition(131, acq);
+            check_acquisition(acq, 131, 4 + 131 % 32, 2, 2);
+            d.readAcquisitions(records, acqs);
+            for (size_t n = 0; n < records.size(); n++) {
+                check_acquisition(acqs[n], records[n], 4 + records[n] % 32, 2, records[n] % 3 == 0 ? 0 : 2);
+            }
+        }
+    }
+    std::remove(test_file);
+}
+
+static bool has_filter(const char *path, H5Z_filter_t filter)
+{
+    hid_t file = H5Fopen(test_file, H5F_ACC_RDONLY, H5P_DEFAULT);
+    hid_t dataset = H5Dopen2(file, path, H5P_DEFAULT);
+    hid_t props = H5Dget_create_plist(dataset);
+    unsigned flags;
+    size_t nvalues = 0;
+    bool found = H5Pget_filter_by_id2(props, filter, &flags, &nvalues, NULL, 0, NULL, NULL) >= 0;
+    H5Pclose(props);
+    H5Dclose(dataset);
+    H5Fclose(file);
+    return found;
+}
+
+BOOST_AUTO_TEST_CASE(test_cxfloat_filter)
+{
+    // noisy samples with every bit pattern in the mantissas, plus runs of zeros
+    Image<complex_float_t> im(64, 32, 1, 4);
+    uint32_t state = 12345;
+    for (size_t n = 0; n < im.getNumberOfDataElements(); n++) {
+        state = state * 1664525u + 1013904223u;
+        float re = float(int32_t(state >> 8) - (1 << 23)) * 1.0e-6f;
+        state = state * 1664525u + 1013904223u;
+        float im_part = float(int32_t(state >> 8) - (1 << 23)) * 1.0e-6f;
+        im.getDataPtr()[n] = (n % 256 < 32) ? complex_float_t(0.0f, 0.0f) : complex_float_t(re, im_part);
+    }
+    std::vector<size_t> dims(1, 100);
+    NDArray<float> arr(dims);
+    for (size_t n = 0; n < arr.getNumberOfElements(); n++) {
+        arr.getDataPtr()[n] = float(n);
+    }
+    Acquisition acq(64, 4, 2);
+    std::copy(im.getDataPtr(), im.getDataPtr() + 64 * 4, acq.getDataPtr());
+    for (uint16_t s = 0; s < 64; s++) {
+        acq.traj(0, s) = float(s);
+        acq.traj(1, s) = -float(s);
+    }
+
+    std::remove(test_file);
+    {
+        ISMRMRD_DatasetOptions options;
+        ismrmrd_init_dataset_options(&options);
+        options.compression = ISMRMRD_COMPRESSION_CXFLOAT;
+        Dataset d(test_file, test_group, options);
+        for (uint32_t n = 0; n < 20; n++) {
+            d.appendImage("images", im);
+            d.appendNDArray("arrays", arr);
+            d.appendAcquisition(acq);
+        }
+    }
+    BOOST_CHECK(has_filter("/dataset/images/data", ISMRMRD_FILTER_CXFLOAT));
+    // the samples of the acquisitions are kept apart from their records, so the codec takes them
+    BOOST_CHECK(has_filter("/dataset/acquisition_samples", ISMRMRD_FILTER_CXFLOAT));
+    BOOST_CHECK(!has_filter("/dataset/acquisition_trajectories", ISMRMRD_FILTER_CXFLOAT));
+    // the codec only takes complex floats, anything else gets the fast profile
+    BOOST_CHECK(!has_filter("/dataset/images/header", ISMRMRD_FILTER_CXFLOAT));
+    BOOST_CHECK(!has_filter("/dataset/arrays", ISMRMRD_FILTER_CXFLOAT));
+    {
+        // the id is unregistered, so the codec identifies itself in the client data
+        hid_t file = H5Fopen(test_file, H5F_ACC_RDONLY, H5P_DEFAULT);
+        hid_t dataset = H5Dopen2(file, "/dataset/images/data", H5P_DEFAULT);
+        hid_t props = H5Dget_create_plist(dataset);
+        unsigned int flags, values[4];
+        size_t nelmts = 4;
+        BOOST_CHECK(H5Pget_filter_by_id2(props, ISMRMRD_FILTER_CXFLOAT, &flags, &nelmts, values, 0, NULL, NULL) >= 0);
+        BOOST_REQUIRE_EQUAL(nelmts, 2u);
+        BOOST_CHECK_EQUAL(values[0], ISMRMRD_FILTER_CXFLOAT_CODEC);
+        BOOST_CHECK_EQUAL(values[1], 1u);
+        H5Pclose(props);
+        H5Dclose(dataset);
+        H5Fclose(file);
+    }
+    {
+        Dataset d(test_file, test_group, false);
+        Image<complex_float_t> im_in;
+        for (uint32_t n = 0; n < 20; n += 7) {
+            d.readImage("images", n, im_in);
+            BOOST_REQUIRE_EQUAL(im_in.getDataSize(), im.getDataSize());
+            BOOST_CHECK(memcmp(im_in.getDataPtr(), im.getDataPtr(), im.getDataSize()) == 0);
+        }
+        std::vector<Acquisition> acqs;
+        d.readAcquisitions(0, 20, acqs);
+        for (uint32_t n = 0; n < 20; n++) {
+            BOOST_CHECK(same_acquisition(acqs[n], acq));
+        }
+    }
+    // and it is bit exact through the plain HDF5 API once registered
+    BOOST_CHECK_EQUAL(ismrmrd_register_cxfloat_filter(), ISMRMRD_NOERROR);
+    hid_t file = H5Fopen(test_file, H5F_ACC_RDONLY, H5P_DEFAULT);
+    hid_t dataset = H5Dopen2(file, "/dataset/images/data", H5P_DEFAULT);
+    hid_t datatype = H5Dget_type(dataset);
+    std::vector<complex_float_t> all(20 * im.getNumberOfDataElements());
+    BOOST_CHECK(H5Dread(dataset, datatype, H5S_ALL, H5S_ALL, H5P_DEFAULT, &all[0]) >= 0);
+    BOOST_CHECK(memcmp(&all[19 * im.getNumberOfDataElements()], im.getDataPtr(), im.getDataSize()) == 0);
+    H5Tclose(datatype);
+    H5Dclose(dataset);
+    H5Fclose(file);
+
+    // a dataset set up for another filter with the same id is neither written nor read
+    file = H5Fcreate(test_file, H5F_ACC_TRUNC, H5P_DEFAULT, H5P_DEFAULT);
+    hsize_t length = 64;
+    hid_t space = H5Screate_simple(1, &length, NULL);
+    hid_t props = H5Pcreate(H5P_DATASET_CREATE);
+    unsigned int other[2] = { 7, 1 };
+    H5Pset_chunk(props, 1, &length);
+    H5Pset_filter(props, ISMRMRD_FILTER_CXFLOAT, H5Z_FLAG_MANDATORY, 2, other);
+    datatype = H5Tcopy(H5T_NATIVE_DOUBLE);
+    // without a chunk cache the chunk goes through the filter on the write itself
+    hid_t access = H5Pcreate(H5P_DATASET_ACCESS);
+    H5Pset_chunk_cache(access, 0, 0, 1.0);
+    dataset = H5Dcreate2(file, "other", datatype, space, H5P_DEFAULT, props, access);
+    H5Pclose(access);
+    BOOST_REQUIRE(dataset >= 0);
+    H5E_BEGIN_TRY {
+        BOOST_CHECK(H5Dwrite(dataset, datatype, H5S_ALL, H5S_ALL, H5P_DEFAULT, &all[0]) < 0);
+    } H5E_END_TRY;
+    H5Tclose(datatype);
+    H5Pclose(props);
+    H5Sclose(space);
+    H5Dclose(dataset);
+    H5Fclose(file);
+    std::remove(test_file);
+}
+
+BOOST_AUTO_TEST_CASE(test_direct_chunks)
+{
+    // one record per chunk and no filters, so the samples are written and read as raw chunks
+    std::vector<Image<complex_float_t> > ims;
+    for (uint32_t n = 0; n < 6; n++) {
+        Image<complex_float_t> im(64, 32, 4, 2);
+        for (size_t s = 0; s < im.getNumberOfDataElements(); s++) {
+            im.getDataPtr()[s] = complex_float_t(float(n), float(s));
+        }
+        ims.push_back(im);
+    }
+
+    std::remove(test_file);
+    {
+        ISMRMRD_DatasetOptions options;
+        ismrmrd_init_dataset_options(&options);
+        options.chunk_length = 1;
+        Dataset d(test_file, test_group, options);
+        d.setCompression("filtered", ISMRMRD_COMPRESSION_FAST);
+        for (uint32_t n = 0; n < ims.size(); n++) {
+            d.appendImage("images", ims[n]);
+            d.appendImage("filtered", ims[n]);
+        }
+        // the writer reads its own records back the same way
+        Image<complex_float_t> im_in;
+        d.readImage("images", 3, im_in);
+        BOOST_CHECK(memcmp(im_in.getDataPtr(), ims[3].getDataPtr(), ims[3].getDataSize()) == 0);
+    }
+    {
+        Dataset d(test_file, test_group, false);
+        Image<complex_float_t> im_in;
+        for (uint32_t n = 0; n < ims.size(); n++) {
+            d.readImage("images", n, im_in);
+            BOOST_REQUIRE_EQUAL(im_in.getDataSize(), ims[n].getDataSize());
+            BOOST_CHECK(memcmp(im_in.getDataPtr(), ims[n].getDataPtr(), ims[n].getDataSize()) == 0);
+            d.readImage("filtered", n, im_in);
+            BOOST_REQUIRE_EQUAL(im_in.getDataSize(), ims[n].getDataSize());
+            BOOST_CHECK(memcmp(im_in.getDataPtr(), ims[n].getDataPtr(), ims[n].getDataSize()) == 0);
+        }
+    }
+
+    // the chunks hold the records as HDF5 itself would have written them
+    hid_t file = H5Fopen(test_file, H5F_ACC_RDONLY, H5P_DEFAULT);
+    hid_t dataset = H5Dopen2(file, "/dataset/images/data", H5P_DEFAULT);
+    hid_t datatype = H5Dget_type(dataset);
+    hsize_t offset[5] = {5, 0, 0, 0, 0};
+    hsize_t chunk_size = 0;
+    BOOST_CHECK(H5Dget_chunk_storage_size(dataset, offset, &chunk_size) >= 0);
+    BOOST_CHECK_EQUAL(chunk_size, ims[5].getDataSize());
+    std::vector<complex_float_t> all(ims.size() * ims[0].getNumberOfDataElements());
+    BOOST_CHECK(H5Dread(dataset, datatype, H5S_ALL, H5S_ALL, H5P_DEFAULT, &all[0]) >= 0);
+    for (uint32_t n = 0; n < ims.size(); n++) {
+        BOOST_CHECK(memcmp(&all[n * ims[n].getNumberOfDataElements()], ims[n].getDataPtr(), ims[n].getDataSize()) == 0);
+    }
+    H5Tclose(datatype);
+    H5Dclose(dataset);
+    H5Fclose(file);
+    std::remove(test_file);
+}
+
+static float region_sample(uint16_t x, uint16_t y, uint16_t z, uint16_t c)
+{
+    return float(x + 100 * y + 10000 * z + 1000000 * c);
+}
+
+BOOST_AUTO_TEST_CASE(test_image_region)
+{
+    Image<float> im(20, 12, 6, 5);
+    for (uint16_t c = 0; c < 5; c++) {
+        for (uint16_t z = 0; z < 6; z++) {
+            for (uint16_t y = 0; y < 12; y++) {
+                for (uint16_t x = 0; x < 20; x++) {
+                    im(x, y, z, c) = region_sample(x, y, z, c);
+                }
+            }
+        }
+    }
+    // 2 mm pixels along each axis
+    im.setFieldOfView(40.0f, 24.0f, 12.0f);
+    im.setPosition(1.0f, 2.0f, 3.0f);
+    im.setReadDirection(1.0f, 0.0f, 0.0f);
+    im.setPhaseDirection(0.0f, 1.0f, 0.0f);
+    im.setSliceDirection(0.0f, 0.0f, 1.0f);
+    im.setAttributeString("<ismrmrdMeta/>");
+
+    std::remove(test_file);
+    Dataset d(test_file, test_group);
+    for (uint32_t n = 0; n < 3; n++) {
+        im.setImageIndex(n);
+        d.appendImage("images", im);
+    }
+
+    std::vector<uint16_t> channels;
+    channels.push_back(0);
+    channels.push_back(2);
+    channels.push_back(3);
+    Image<float> region;
+    d.readImageRegion("images", 1, 4, 10, 2, 5, 3, 4, channels, region);
+    BOOST_CHECK_EQUAL(region.getImageIndex(), 1u);
+    BOOST_REQUIRE_EQUAL(region.getMatrixSizeX(), 6u);
+    BOOST_REQUIRE_EQUAL(region.getMatrixSizeY(), 3u);
+    BOOST_REQUIRE_EQUAL(region.getMatrixSizeZ(), 1u);
+    BOOST_REQUIRE_EQUAL(region.getNumberOfChannels(), 3u);
+    for (uint16_t c = 0; c < 3; c++) {
+        for (uint16_t y = 0; y < 3; y++) {
+            for (uint16_t x = 0; x < 6; x++) {
+                BOOST_CHECK_EQUAL(region(x, y, 0, c), region_sample(x + 4, y + 2, 3, channels[c]));
+            }
+        }
+    }
+    BOOST_CHECK_CLOSE(region.getFieldOfViewX(), 12.0f, 1e-4);
+    BOOST_CHECK_CLOSE(region.getFieldOfViewY(), 6.0f, 1e-4);
+    BOOST_CHECK_CLOSE(region.getFieldOfViewZ(), 2.0f, 1e-4);
+    BOOST_CHECK_CLOSE(region.getPositionX(), -5.0f, 1e-4);
+    BOOST_CHECK_CLOSE(region.getPositionY(), -3.0f, 1e-4);
+    BOOST_CHECK_CLOSE(region.getPositionZ(), 4.0f, 1e-4);
+    BOOST_CHECK_EQUAL(std::string(region.getAttributeString()), "<ismrmrdMeta/>");
+
+    // the whole extent and no channel list is the whole image
+    Image<float> whole;
+    d.readImageRegion("images", 2, 0, 20, 0, 12, 0, 6, std::vector<uint16_t>(), whole);
+    BOOST_REQUIRE_EQUAL(whole.getDataSize(), im.getDataSize());
+    BOOST_CHECK(memcmp(whole.getDataPtr(), im.getDataPtr(), im.getDataSize()) == 0);
+    BOOST_CHECK_CLOSE(whole.getPositionX(), 1.0f, 1e-4);
+
+    BOOST_CHECK_THROW(d.readImageRegion("images", 0, 4, 21, 0, 1, 0, 1, channels, region), std::runtime_error);
+    BOOST_CHECK_THROW(d.readImageRegion("images", 0, 4, 4, 0, 1, 0, 1, channels, region), std::runtime_error);
+    BOOST_CHECK_THROW(d.readImageRegion("images", 3, 0, 1, 0, 1, 0, 1, channels, region), std::runtime_error);
+    std::vector<uint16_t> unordered(2, 3);
+    unordered[1] = 1;
+    BOOST_CHECK_THROW(d.readImageRegion("images", 0, 0, 1, 0, 1, 0, 1, unordered, region), std::runtime_error);
+    BOOST_CHECK_THROW(d.readImageRegion("images", 0, 0, 1, 0, 1, 0, 1, std::vector<uint16_t>(1, 5), region),
+                      std::runtime_error);
+    std::remove(test_file);
+}
+
+BOOST_AUTO_TEST_CASE(test_array_region)
+{
+    std::vector<size_t> dims(3);
+    dims[0] = 10;
+    dims[1] = 7;
+    dims[2] = 4;
+    NDArray<complex_float_t> arr(dims);
+    std::remove(test_file);
+    Dataset d(test_file, test_group);
+    for (uint32_t n = 0; n < 3; n++) {
+        for (size_t k = 0; k < 4; k++) {
+            for (size_t j = 0; j < 7; j++) {
+                for (size_t i = 0; i < 10; i++) {
+                    arr(i, j, k) = complex_float_t(float(i + 10 * j + 100 * k), float(n));
+                }
+            }
+        }
+        d.appendNDArray("arrays", arr);
+    }
+
+    std::vector<size_t> props;
+    uint16_t data_type = 0;
+    d.readNDArrayProperties("arrays", props, data_type);
+    BOOST_CHECK(props == dims);
+    BOOST_CHECK_EQUAL(data_type, ISMRMRD_CXFLOAT);
+    BOOST_CHECK_THROW(d.readNDArrayProperties("missing", props, data_type), std::runtime_error);
+
+    // a whole array keeps its own dimensions
+    NDArray<complex_float_t> whole;
+    d.readNDArray("arrays", 2, whole);
+    BOOST_REQUIRE_EQUAL(whole.getNDim(), 3u);
+    BOOST_CHECK(std::equal(dims.begin(), dims.end(), whole.getDims()));
+    BOOST_CHECK(std::equal(arr.begin(), arr.end(), whole.begin()));
+
+    std::vector<size_t> offset(3), count(3), stride(3, 1);
+    offset[0] = 1;
+    offset[1] = 2;
+    offset[2] = 3;
+    count[0] = 4;
+    count[1] = 0;
+    count[2] = 1;
+    stride[0] = 2;
+    stride[1] = 3;
+    NDArray<complex_float_t> region;
+    d.readNDArrayRegion("arrays", 1, offset, count, stride, region);
+    BOOST_REQUIRE_EQUAL(region.getNDim(), 3u);
+    BOOST_REQUIRE_EQUAL(region.getDims()[0], 4u);
+    BOOST_REQUIRE_EQUAL(region.getDims()[1], 2u);
+    BOOST_REQUIRE_EQUAL(region.getDims()[2], 1u);
+    for (size_t j = 0; j < 2; j++) {
+        for (size_t i = 0; i < 4; i++) {
+            BOOST_CHECK(region(i, j, 0) == complex_float_t(float(1 + 2 * i + 10 * (2 + 3 * j) + 300), 1.0f));
+        }
+    }
+
+    // missing entries read the whole dimension
+    d.readNDArrayRegion("arrays", 0, std::vector<size_t>(1, 9), std::vector<size_t>(),
+                        std::vector<size_t>(), region);
+    BOOST_REQUIRE_EQUAL(region.getNumberOfElements(), 28u);
+    BOOST_CHECK(region(0, 6, 3) == complex_float_t(369.0f, 0.0f));
+
+    count[0] = 6;
+    BOOST_CHECK_THROW(d.readNDArrayRegion("arrays", 1, offset, count, stride, region), std::runtime_error);
+    BOOST_CHECK_THROW(d.readNDArrayRegion("arrays", 0, std::vector<size_t>(1, 10), std::vector<size_t>(),
+                                          std::vector<size_t>(), region), std::runtime_error);
+    BOOST_CHECK_THROW(d.readNDArrayRegion("arrays", 3, std::vector<size_t>(), std::vector<size_t>(),
+                                          std::vector<size_t>(), region), std::runtime_error);
+    std::remove(test_file);
+}
+
+BOOST_AUTO_TEST_CASE(test_mantissa_bits)
+{
+    Image<float> im(16, 16);
+    for (size_t n = 0; n < im.getNumberOfDataElements(); n++) {
+        im.getDataPtr()[n] = (float(n) - 100.0f) * 0.3183099f;
+    }
+    im.getDataPtr()[1] = std::numeric_limits<float>::infinity();
+    im.getDataPtr()[2] = std::numeric_limits<float>::max();
+    Image<complex_float_t> cx(8, 8);
+    for (size_t n = 0; n < cx.getNumberOfDataElements(); n++) {
+        cx.getDataPtr()[n] = complex_float_t(1.0f / float(n + 1), -float(n) * 1.4142135f);
+    }
+    Image<int16_t> ints(8, 8);
+    std::fill(ints.begin(), ints.end(), int16_t(12345));
+    Image<float> original = im;
+
+    std::remove(test_file);
+    {
+        ISMRMRD_DatasetOptions options;
+        ismrmrd_init_dataset_options(&options);
+        options.mantissa_bits = 10;
+        Dataset d(test_file, test_group, options);
+        d.appendImage("float", im);
+        d.appendImage("complex", cx);
+        d.appendImage("ints", ints);
+    }
+    // the caller's samples are not rounded
+    BOOST_CHECK(memcmp(im.getDataPtr(), original.getDataPtr(), im.getDataSize()) == 0);
+    {
+        Dataset d(test_file, test_group, false);
+        BOOST_CHECK_EQUAL(d.readMantissaBits("float"), 10);
+        BOOST_CHECK_EQUAL(d.readMantissaBits("complex"), 10);
+        BOOST_CHECK_EQUAL(d.readMantissaBits("ints"), 0);
+        BOOST_CHECK_THROW(d.readMantissaBits("missing"), std::runtime_error);
+
+        const float bound = std::ldexp(1.0f, -11);
+        Image<float> im_in;
+        d.readImage("float", 0, im_in);
+        for (size_t n = 0; n < im.getNumberOfDataElements(); n++) {
+            float in = im_in.getDataPtr()[n], out = im.getDataPtr()[n];
+            uint32_t bits;
+            memcpy(&bits, &in, sizeof(bits));
+            if (n == 1 || n == 2) {
+                // infinities and values that would round up to one are kept
+                BOOST_CHECK_EQUAL(in, out);
+                continue;
+            }
+            BOOST_CHECK_EQUAL(bits & 0x1fffu, 0u);
+            BOOST_CHECK(std::fabs(in - out) <= bound * std::fabs(out));
+        }
+        Image<complex_float_t> cx_in;
+        d.readImage("complex", 0, cx_in);
+        for (size_t n = 0; n < cx.getNumberOfDataElements(); n++) {
+            complex_float_t in = cx_in.getDataPtr()[n], out = cx.getDataPtr()[n];
+            BOOST_CHECK(std::fabs(in.real() - out.real()) <= bound * std::fabs(out.real()));
+            BOOST_CHECK(std::fabs(in.imag() - out.imag()) <= bound * std::fabs(out.imag()));
+        }
+        Image<int16_t> ints_in;
+        d.readImage("ints", 0, ints_in);
+        BOOST_CHECK(std::equal(ints.begin(), ints.end(), ints_in.begin()));
+    }
+
+    // acquisitions are only rounded when their samples are kept apart for compression
+    for (uint16_t profile = ISMRMRD_COMPRESSION_NONE; profile <= ISMRMRD_COMPRESSION_FAST; profile++) {
+        Acquisition acq = make_acquisition(1, 64, 2, 2);
+        for (size_t n = 0; n < acq.getNumberOfDataElements(); n++) {
+            acq.getDataPtr()[n] *= 0.3183099f;
+        }
+        Acquisition acq_original = acq;
+        std::remove(test_file);
+        {
+            ISMRMRD_DatasetOptions options;
+            ismrmrd_init_dataset_options(&options);
+            options.mantissa_bits = 10;
+            options.compression = profile;
+            Dataset d(test_file, test_group, options);
+            d.appendAcquisition(acq);
+            d.appendAcquisitions(std::vector<Acquisition>(3, acq));
+        }
+        BOOST_CHECK(same_acquisition(acq, acq_original));
+        Dataset d(test_file, test_group, false);
+        const bool rounded = profile != ISMRMRD_COMPRESSION_NONE;
+        BOOST_CHECK_EQUAL(d.readMantissaBits("data"), rounded ? 10 : 0);
+        const float bound = std::ldexp(1.0f, -11);
+        for (uint32_t n = 0; n < d.getNumberOfAcquisitions(); n++) {
+            Acquisition acq_in;
+            d.readAcquisition(n, acq_in);
+            BOOST_CHECK(std::equal(acq.traj_begin(), acq.traj_end(), acq_in.traj_begin()));
+            const float *in = reinterpret_cast<const float *>(acq_in.getDataPtr());
+            const float *out = reinterpret_cast<const float *>(acq.getDataPtr());
+            for (size_t k = 0; k < 2 * acq.getNumberOfDataElements(); k++) {
+                uint32_t bits;
+                memcpy(&bits, &in[k], sizeof(bits));
+                BOOST_CHECK(!rounded || (bits & 0x1fffu) == 0);
+                BOOST_CHECK(std::fabs(in[k] - out[k]) <= (rounded ? bound : 0.0f) * std::fabs(out[k]));
+            }
+        }
+    }
+    std::remove(test_file);
+}
+
+static Acquisition make_indexed_acquisition(uint32_t scan)
+{
+    Acquisition acq = make_acquisition(scan, 4, 1, 0);
+    acq.idx().kspace_encode_step_1 = scan % 16;
+    acq.idx().repetition = (scan / 16) % 3;
+    acq.idx().slice = scan / 48;
+    if (scan % 16 == 15) {
+        acq.setFlag(ISMRMRD_ACQ_LAST_IN_REPETITION);
+    }
+    return acq;
+}
+
+static void check_slice_query(Dataset &d, uint32_t total)
+{
+    ISMRMRD_AcquisitionQuery query;
+    ismrmrd_init_acquisition_query(&query);
+    query.fields = ISMRMRD_QUERY_SLICE | ISMRMRD_QUERY_REPETITION;
+    query.idx.slice = 2;
+    query.idx.repetition = 1;
+    std::vector<uint32_t> records = d.findAcquisitions(query);
+    BOOST_REQUIRE_EQUAL(records.size(), 16);
+    for (uint32_t n = 0; n < 16; n++) {
+        BOOST_CHECK_EQUAL(records[n], 2 * 48 + 16 + n);
+    }
+
+    std::vector<Acquisition> acqs;
+    d.readAcquisitions(records, acqs);
+    BOOST_REQUIRE_EQUAL(acqs.size(), 16);
+    for (uint32_t n = 0; n < 16; n++) {
+        BOOST_CHECK_EQUAL(acqs[n].scan_counter(), records[n]);
+        BOOST_CHECK_EQUAL(acqs[n].idx().slice, 2);
+        BOOST_CHECK_EQUAL(acqs[n].idx().repetition, 1);
+    }
+
+    ismrmrd_init_acquisition_query(&query);
+    ismrmrd_set_flag(&query.flags_set, ISMRMRD_ACQ_LAST_IN_REPETITION);
+    records = d.findAcquisitions(query);
+    BOOST_REQUIRE_EQUAL(records.size(), total / 16);
+    for (size_t n = 0; n < records.size(); n++) {
+        BOOST_CHECK_EQUAL(records[n] % 16, 15);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(test_acquisition_index)
+{
+    hsize_t chunk, extent;
+
+    std::remove(test_file);
+    {
+        ISMRMRD_DatasetOptions options;
+        ismrmrd_init_dataset_options(&options);
+        options.index_acquisitions = true;
+        Dataset d(test_file, test_group, options);
+        std::vector<Acquisition> block;
+        for (uint32_t n = 0; n < 96; n++) {
+            block.push_back(make_indexed_acquisition(n));
+        }
+        d.appendAcquisitions(block);
+        for (uint32_t n = 96; n < 192; n++) {
+            d.appendAcquisition(make_indexed_acquisition(n));
+        }
+        check_slice_query(d, 192);
+    }
+    get_layout("/dataset/acquisition_index", chunk, extent);
+    BOOST_CHECK_EQUAL(extent, 192);
+    {
+        Dataset d(test_file, test_group, false);
+        check_slice_query(d, 192);
+
+        // the records have to be in increasing order
+        std::vector<uint32_t> records(2, 5);
+        std::vector<Acquisition> acqs;
+        BOOST_CHECK_THROW(d.readAcquisitions(records, acqs), std::runtime_error);
+    }
+
+    // without an index, queries fall back to the headers until one is built
+    std::remove(test_file);
+    {
+        Dataset d(test_file, test_group, true);
+        for (uint32_t n = 0; n < 144; n++) {
+            d.appendAcquisition(make_indexed_acquisition(n));
+        }
+        check_slice_query(d, 144);
+        d.buildAcquisitionIndex();
+        for (uint32_t n = 144; n < 192; n++) {
+            d.appendAcquisition(make_indexed_acquisition(n));
+        }
+        // acquisitions appended after the index was built are still found
+        check_slice_query(d, 192);
+    }
+    get_layout("/dataset/acquisition_index", chunk, extent);
+    BOOST_CHECK_EQUAL(extent, 144);
+    std::remove(test_file);
+}
+
+static bool scan_below(const ISMRMRD_AcquisitionHeader *head, void *limit)
+{
+    return head->scan_counter < *static_cast<uint32_t *>(limit);
+}
+
+BOOST_AUTO_TEST_CASE(test_read_acquisitions_filtered)
+{
+    std::remove(test_file);
+    {
+        // noise scans first, a few dummy scans, then imaging interleaved with navigators
+        Dataset d(test_file, test_group, true);
+        for (uint32_t n = 0; n < 64; n++) {
+            Acquisition acq = make_acquisition(n, n < 4 ? 3 : 2, n % 8 == 7 ? 0 : 2, n);
+            if (n < 4) {
+                acq.setFlag(ISMRMRD_ACQ_IS_NOISE_MEASUREMENT);
+            } else if (n < 8) {
+                acq.setFlag(ISMRMRD_ACQ_IS_DUMMYSCAN_DATA);
+            } else if (n % 8 == 7) {
+                acq.setFlag(ISMRMRD_ACQ_IS_NAVIGATION_DATA);
+            }
+            d.appendAcquisition(acq);
+        }
+    }
+    {
+        Dataset d(test_file, test_group, false);
+        ISMRMRD_AcquisitionFilter filter;
+        ismrmrd_init_acquisition_filter(&filter);
+        ismrmrd_set_flag(&filter.flags_exclude, ISMRMRD_ACQ_IS_NOISE_MEASUREMENT);
+        ismrmrd_set_flag(&filter.flags_exclude, ISMRMRD_ACQ_IS_DUMMYSCAN_DATA);
+        ismrmrd_set_flag(&filter.flags_exclude, ISMRMRD_ACQ_IS_NAVIGATION_DATA);
+
+        std::vector<Acquisition> acqs;
+        std::vector<uint32_t> records;
+        d.readAcquisitions(0, 64, filter, acqs, &records);
+        BOOST_REQUIRE_EQUAL(acqs.size(), 49);
+        BOOST_REQUIRE_EQUAL(records.size(), 49);
+        for (size_t n = 0; n < acqs.size(); n++) {
+            BOOST_CHECK(records[n] >= 8 && records[n] % 8 != 7);
+            check_acquisition(acqs[n], records[n], 2, 2, records[n]);
+        }
+
+        // a range starting part way through, narrowed further by a predicate
+        uint32_t limit = 40;
+        filter.predicate = scan_below;
+        filter.predicate_data = &limit;
+        d.readAcquisitions(20, 44, filter, acqs, &records);
+        BOOST_REQUIRE_EQUAL(acqs.size(), 17);
+        BOOST_CHECK_EQUAL(records.front(), 20);
+        BOOST_CHECK_EQUAL(records.back(), 38);
+        for (size_t n = 0; n < acqs.size(); n++) {
+            check_acquisition(acqs[n], records[n], 2, 2, records[n]);
+        }
+
+        // only the noise scans
+        ismrmrd_init_acquisition_filter(&filter);
+        ismrmrd_set_flag(&filter.flags_include, ISMRMRD_ACQ_IS_NOISE_MEASUREMENT);
+        d.readAcquisitions(0, 64, filter, acqs);
+        BOOST_REQUIRE_EQUAL(acqs.size(), 4);
+        for (uint32_t n = 0; n < 4; n++) {
+            check_acquisition(acqs[n], n, 3, 2, n);
+        }
+
+        // nothing matches
+        ismrmrd_set_flag(&filter.flags_exclude, ISMRMRD_ACQ_IS_NOISE_MEASUREMENT);
+        d.readAcquisitions(0, 64, filter, acqs, &records);
+        BOOST_CHECK(acqs.empty());
+        BOOST_CHECK(records.empty());
+    }
+    std::remove(test_file);
+}
+
+BOOST_AUTO_TEST_CASE(test_swmr)
+{
+    std::remove(test_file);
+    {
+        // SWMR writing has to be asked for when the file is opened
+        Dataset d(test_file, test_group);
+        d.appendAcquisition(make_acquisition(0, 16, 2, 0));
+        BOOST_CHECK_THROW(d.beginSWMRWrite(), std::runtime_error);
+    }
+
+    std::remove(test_file);
+    {
+        ISMRMRD_DatasetOptions options;
+        ismrmrd_init_dataset_options(&options);
+        options.swmr = ISMRMRD_SWMR_WRITE;
+        options.growth_policy = ISMRMRD_GROWTH_GEOMETRIC;
+        Dataset d(test_file, test_group, options);
+        d.writeHeader("<ismrmrdHeader/>");
+        for (uint32_t n = 0; n < 5; n++) {
+            d.appendAcquisition(make_acquisition(n, 16, 2, n % 2));
+        }
+        d.beginSWMRWrite();
+        for (uint32_t n = 5; n < 40; n++) {
+            d.appendAcquisition(make_acquisition(n, 16, 2, n % 2));
+            if (n % 8 == 0) {
+                d.flush();
+            }
+        }
+        d.flush();
+    }
+
+    {
+        ISMRMRD_DatasetOptions options;
+        ismrmrd_init_dataset_options(&options);
+        options.swmr = ISMRMRD_SWMR_READ;
+        Dataset d(test_file, test_group, options, false);
+        BOOST_CHECK_EQUAL(d.getNumberOfAcquisitions(), 40u);
+        BOOST_CHECK_EQUAL(d.waitForAcquisitions(10, 1000), 40u);
+        // nothing more is coming, so this waits out the timeout
+        BOOST_CHECK_EQUAL(d.waitForAcquisitions(41, 20), 40u);
+        Acquisition acq;
+        for (uint32_t n = 0; n < 40; n++) {
+            d.readAcquisition(n, acq);
+            check_acquisition(acq, n, 16, 2, n % 2);
+        }
+        BOOST_CHECK_THROW(d.appendAcquisition(acq), std::runtime_error);
+    }
+
+    // the capacity reserved before SWMR writing started has been given back
+    Dataset d(test_file, test_group, false);
+    BOOST_CHECK_EQUAL(d.getNumberOfAcquisitions(), 40u);
+    std::remove(test_file);
+}
+
+BOOST_AUTO_TEST_CASE(test_reopen_dataset)
+{
+    std::remove(test_file);
+    {
+        ISMRMRD_DatasetOptions options;
+        ismrmrd_init_dataset_options(&options);
+        options.swmr = ISMRMRD_SWMR_WRITE;
+        Dataset d(test_file, test_group, options);
+        d.appendAcquisition(make_acquisition(0, 16, 2, 0));
+        d.beginSWMRWrite();
+    }
+
+    // only a SWMR reader can be reopened, anything else could lose what it holds in memory
+    ISMRMRD_Dataset dset;
+    BOOST_REQUIRE_EQUAL(ismrmrd_init_dataset(&dset, test_file, test_group), ISMRMRD_NOERROR);
+    BOOST_REQUIRE_EQUAL(ismrmrd_open_dataset(&dset, false), ISMRMRD_NOERROR);
+    BOOST_CHECK_EQUAL(ismrmrd_reopen_dataset(&dset), ISMRMRD_FILEERROR);
+    BOOST_CHECK_EQUAL(ismrmrd_get_number_of_acquisitions(&dset), 1u);
+    BOOST_CHECK_EQUAL(ismrmrd_close_dataset(&dset), ISMRMRD_NOERROR);
+
+    BOOST_REQUIRE_EQUAL(ismrmrd_init_dataset(&dset, test_file, test_group), ISMRMRD_NOERROR);
+    dset.options.swmr = ISMRMRD_SWMR_READ;
+    BOOST_REQUIRE_EQUAL(ismrmrd_open_dataset(&dset, false), ISMRMRD_NOERROR);
+    BOOST_CHECK_EQUAL(ismrmrd_reopen_dataset(&dset), ISMRMRD_NOERROR);
+    BOOST_CHECK_EQUAL(ismrmrd_get_number_of_acquisitions(&dset), 1u);
+    BOOST_CHECK_EQUAL(ismrmrd_close_dataset(&dset), ISMRMRD_NOERROR);
+    // a closed dataset has no cache left
+    BOOST_CHECK_EQUAL(ismrmrd_reopen_dataset(&dset), ISMRMRD_FILEERROR);
+    while (ismrmrd_pop_error(NULL, NULL, NULL, NULL, NULL)) {
+    }
+    std::remove(test_file);
+}
+
+BOOST_AUTO_TEST_CASE(test_swmr_reader_follows_writer)
+{
+    std::remove(test_file);
+    {
+        ISMRMRD_DatasetOptions options;
+        ismrmrd_init_dataset_options(&options);
+        options.swmr = ISMRMRD_SWMR_WRITE;
+        Dataset writer(test_file, test_group, options);
+        writer.writeHeader("<ismrmrdHeader/>");
+        for (uint32_t n = 0; n < 5; n++) {
+            writer.appendAcquisition(make_acquisition(n, 16, 2, 0));
+        }
+        writer.beginSWMRWrite();
+        writer.flush();
+
+        options.swmr = ISMRMRD_SWMR_READ;
+        Dataset reader(test_file, test_group, options, false);
+        BOOST_CHECK_EQUAL(reader.getNumberOfAcquisitions(), 5u);
+
+        // a record past the extent fails without waiting for the writer
+        Acquisition acq;
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        BOOST_CHECK_THROW(reader.readAcquisition(5, acq), std::runtime_error);
+        BOOST_CHECK(std::chrono::steady_clock::now() - start < std::chrono::milliseconds(50));
+
+        // the reader sees what the writer appends while both are open
+        for (uint32_t n = 5; n < 20; n++) {
+            writer.appendAcquisition(make_acquisition(n, 16, 2, 0));
+        }
+        writer.flush();
+        BOOST_CHECK_EQUAL(reader.waitForAcquisitions(20, 1000), 20u);
+        BOOST_CHECK_EQUAL(reader.getNumberOfAcquisitions(), 20u);
+        for (uint32_t n = 0; n < 20; n++) {
+            reader.readAcquisition(n, acq);
+            check_acquisition(acq, n, 16, 2, 0);
+        }
+        std::vector<Acquisition> block;
+        reader.readAcquisitions(10, 10, block);
+        check_acquisition(block[9], 19, 16, 2, 0);
+    }
+    std::remove(test_file);
+}
+
+BOOST_AUTO_TEST_CASE(test_datatypes_after_library_restart)
+{
+    std::remove(test_file);
+    {
+        Dataset d(test_file, test_group);
+        d.appendAcquisition(make_acquisition(0, 16, 2, 1));
+    }
+    // a failed open mustn't keep its reference to the shared datatypes
+    BOOST_CHECK_THROW(Dataset("test_dataset_missing.h5", test_group, false), std::runtime_error);
+    // the shared datatypes went with the last dataset, so a restart can't leave stale ids
+    H5close();
+    H5open();
+    {
+        Dataset d(test_file, test_group, false);
+        d.appendAcquisition(make_acquisition(1, 16, 2, 1));
+        Acquisition acq;
+        for (uint32_t n = 0; n < 2; n++) {
+            d.readAcquisition(n, acq);
+            check_acquisition(acq, n, 16, 2, 1);
+        }
+    }
+    std::remove(test_file);
+}
+
+static bool file_exists(const char *filename)
+{
+    FILE *f = std::fopen(filename, "rb");
+    if (f != NULL) {
+        std::fclose(f);
+    }
+    return f != NULL;
+}
+
+BOOST_AUTO_TEST_CASE(test_in_memory)
+{
+    std::remove(test_file);
+    ISMRMRD_DatasetOptions options;
+    ismrmrd_init_dataset_options(&options);
+    options.in_memory = true;
+    options.memory_increment = 64 * 1024;
+
+    std::vector<char> image;
+    {
+        Dataset d(test_file, test_group, options);
+        d.writeHeader("<ismrmrdHeader/>");
+        for (uint32_t n = 0; n < 20; n++) {
+            d.appendAcquisition(make_acquisition(n, 16, 2, n % 2));
+        }
+        Image<float> im(8, 8);
+        im.setImageSeriesIndex(7);
+        d.appendImage("images", im);
+        d.getFileImage(image);
+    }
+    // without a backing store nothing reaches the disk
+    BOOST_CHECK(!file_exists(test_file));
+    BOOST_REQUIRE(!image.empty());
+
+    {
+        // the image can be read, and changed in memory
+        Dataset d("received.h5", test_group, image.data(), image.size());
+        std::string xml;
+        d.readHeader(xml);
+        BOOST_CHECK_EQUAL(xml, "<ismrmrdHeader/>");
+        BOOST_REQUIRE_EQUAL(d.getNumberOfAcquisitions(), 20u);
+        Acquisition acq;
+        for (uint32_t n = 0; n < 20; n++) {
+            d.readAcquisition(n, acq);
+            check_acquisition(acq, n, 16, 2, n % 2);
+        }
+        Image<float> im;
+        d.readImage("images", 0, im);
+        BOOST_CHECK_EQUAL(im.getImageSeriesIndex(), 7u);
+        d.appendAcquisition(make_acquisition(20, 16, 2, 0));
+        BOOST_CHECK_EQUAL(d.getNumberOfAcquisitions(), 21u);
+    }
+    BOOST_CHECK(!file_exists("received.h5"));
+
+    const char garbage[] = "not an HDF5 file";
+    BOOST_CHECK_THROW(Dataset("garbage.h5", test_group, garbage, sizeof(garbage)), std::runtime_error);
+
+    {
+        // with a backing store the file is written when the dataset closes
+        options.backing_store = true;
+        Dataset d(test_file, test_group, options);
+        for (uint32_t n = 0; n < 10; n++) {
+            d.appendAcquisition(make_acquisition(n, 16, 2, 0));
+        }
+    }
+    {
+        // an existing file is read into memory, and without a backing store changes are discarded
+        options.backing_store = false;
+        Dataset d(test_file, test_group, options, false);
+        BOOST_CHECK_EQUAL(d.getNumberOfAcquisitions(), 10u);
+        d.appendAcquisition(make_acquisition(10, 16, 2, 0));
+        BOOST_CHECK_EQUAL(d.getNumberOfAcquisitions(), 11u);
+    }
+    {
+        Dataset d(test_file, test_group, false);
+        BOOST_CHECK_EQUAL(d.getNumberOfAcquisitions(), 10u);
+    }
+
+    options.swmr = ISMRMRD_SWMR_WRITE;
+    BOOST_CHECK_THROW(Dataset(test_file, test_group, options), std::runtime_error);
+    std::remove(test_file);
+}
+
+BOOST_AUTO_TEST_CASE(test_cache_options)
+{
+    std::remove(test_file);
+    ISMRMRD_DatasetOptions options;
+    ismrmrd_init_dataset_options(&options);
+    options.chunk_cache_slots = 10007;
+    options.chunk_cache_bytes = 16 << 20;
+    options.chunk_cache_w0 = 1.0;
+    options.metadata_cache_bytes = 4 << 20;
+    {
+        Dataset d(test_file, test_group, options);
+        for (uint32_t n = 0; n < 100; n++) {
+            d.appendAcquisition(Acquisition(64, 4));
+        }
+        ISMRMRD_CacheStats stats = d.getCacheStats();
+        BOOST_CHECK_EQUAL(stats.chunk_cache_slots, 10007u);
+        BOOST_CHECK_EQUAL(stats.chunk_cache_bytes, size_t(16 << 20));
+        BOOST_CHECK_EQUAL(stats.chunk_cache_w0, 1.0);
+        BOOST_CHECK_EQUAL(stats.metadata_cache_max_bytes, size_t(4 << 20));
+        BOOST_CHECK(stats.metadata_cache_entries > 0);
+
+        Acquisition acq;
+        d.resetCacheStats();
+        for (uint32_t n = 0; n < 100; n++) {
+            d.readAcquisition(n, acq);
+        }
+        stats = d.getCacheStats();
+        BOOST_CHECK(stats.metadata_hit_rate > 0.0 && stats.metadata_hit_rate <= 1.0);
+    }
+
+    // the defaults of HDF5 are kept without the options
+    Dataset d(test_file, test_group, false);
+    ISMRMRD_CacheStats stats = d.getCacheStats();
+    BOOST_CHECK_EQUAL(stats.chunk_cache_bytes, size_t(1 << 20));
+
+    options.chunk_cache_w0 = 2.0;
+    BOOST_CHECK_THROW(Dataset(test_file, test_group, options), std::runtime_error);
+    std::remove(test_file);
+}
+
+// Boost checks aren't thread safe, so the threads count their failures for the main thread
+struct ThreadResult {
+    ThreadResult() : read(0), failures(0) {}
+    uint32_t read;
+    uint32_t failures;
+};
+
+static void read_range(Dataset &d, uint32_t first, uint32_t count, ThreadResult &result)
+{
+    AcquisitionCursor cursor(d, first, count, 32);
+    Acquisition acq;
+    for (uint32_t pass = 0; pass < 4; pass++) {
+        cursor.seek(first);
+        while (cursor.next(acq)) {
+            uint32_t scan = cursor.position() - 1;
+            if (acq.scan_counter() != scan || acq.getNumberOfDataElements() != 32 * 4 ||
+                    acq.data(31, 3) != complex_float_t(float(scan), float(31 + 3 * 32))) {
+                result.failures++;
+            }
+            result.read++;
+        }
+
+        // errors pushed by the other threads don't end up in this thread's exception
+        try {
+            d.readAcquisition(1000000 + first, acq);
+            result.failures++;
+        } catch (std::runtime_error &e) {
+            std::string what = e.what();
+            size_t found = what.find("Index out of range");
+            if (found == std::string::npos || what.find("Index out of range", found + 1) != std::string::npos) {
+                result.failures++;
+            }
+        }
+        if (ismrmrd_pop_error(NULL, NULL, NULL, NULL, NULL)) {
+            result.failures++;
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(test_c_dataset_lock)
+{
+    std::remove(test_file);
+    ismrmrd_lock_datasets();
+    // the C lock is the one Dataset calls take, so a Dataset on another thread waits for it
+    std::atomic<bool> opened(false);
+    std::thread other([&opened] {
+        Dataset d(test_file, test_group);
+        d.appendAcquisition(make_acquisition(0, 16, 2, 0));
+        opened = true;
+    });
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    BOOST_CHECK(!opened);
+    {
+        // recursive, the owner can take it again
+        DatasetLock lock;
+    }
+    ismrmrd_unlock_datasets();
+    other.join();
+    BOOST_CHECK(opened);
+    std::remove(test_file);
+}
+
+BOOST_AUTO_TEST_CASE(test_concurrent_access)
+{
+    const char *write_file = "test_dataset_concurrent.h5";
+    const uint32_t number_of_acquisitions = 2000;
+    const uint32_t number_of_threads = 4;
+
+    std::remove(test_file);
+    std::remove(write_file);
+    {
+        Dataset d(test_file, test_group);
+        std::vector<Acquisition> acqs;
+        for (uint32_t n = 0; n < number_of_acquisitions; n++) {
+            acqs.push_back(make_acquisition(n, 32, 4, 0));
+        }
+        d.appendAcquisitions(acqs);
+    }
+
+    {
+        // readers share one Dataset with a cursor each, while another thread writes a second file
+        Dataset reader(test_file, test_group, false);
+        Dataset writer(write_file, test_group);
+        std::vector<ThreadResult> results(number_of_threads + 1);
+        std::vector<std::thread> threads;
+        uint32_t share = number_of_acquisitions / number_of_threads;
+        for (uint32_t t = 0; t < number_of_threads; t++) {
+            threads.push_back(std::thread(read_range, std::ref(reader), t * share, share, std::ref(results[t])));
+        }
+        threads.push_back(std::thread([&writer, &results, number_of_threads] {
+            ThreadResult &result = results[number_of_threads];
+            for (uint32_t n = 0; n < 500; n++) {
+                writer.appendAcquisition(make_acquisition(n, 16, 2, 2));
+                if (n % 50 == 0 && writer.getNumberOfAcquisitions() != n + 1) {
+                    result.failures++;
+                }
+            }
+        }));
+        for (size_t t = 0; t < threads.size(); t++) {
+            threads[t].join();
+        }
+
+        for (uint32_t t = 0; t < number_of_threads; t++) {
+            BOOST_CHECK_EQUAL(results[t].read, 4 * share);
+            BOOST_CHECK_EQUAL(results[t].failures, 0u);
+        }
+        BOOST_CHECK_EQUAL(results[number_of_threads].failures, 0u);
+    }
+
+    Dataset d(write_file, test_group, false);
+    BOOST_REQUIRE_EQUAL(d.getNumberOfAcquisitions(), 500u);
+    Acquisition acq;
+    d.readAcquisition(499, acq);
+    check_acquisition(acq, 499, 16, 2, 2);
+    std::remove(test_file);
+    std::remove(write_file);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
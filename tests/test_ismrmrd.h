@@ -1,4 +1,57 @@
 #pragma once
 
+#include "ismrmrd/ismrmrd.h"
+#include <boost/test/unit_test.hpp>
+#include <cstring>
+
 void silent_error_handler(const char *file, int line,
         const char *function, int code, const char *msg);
+
+// An acquisition whose samples and trajectory follow from scan and their position, so
+// that what is read back can be compared with a fresh copy or checked in place
+inline ISMRMRD::Acquisition make_acquisition(uint32_t scan, uint16_t samples, uint16_t channels,
+                                             uint16_t traj_dims)
+{
+    ISMRMRD::Acquisition acq(samples, channels, traj_dims);
+    acq.scan_counter() = scan;
+    acq.idx().kspace_encode_step_1 = scan % 64;
+    for (uint16_t c = 0; c < channels; c++) {
+        for (uint16_t s = 0; s < samples; s++) {
+            acq.data(s, c) = complex_float_t(float(scan), float(s + c * samples));
+        }
+    }
+    for (uint16_t s = 0; s < samples; s++) {
+        for (uint16_t d = 0; d < traj_dims; d++) {
+            acq.traj(d, s) = float(scan + d);
+        }
+    }
+    return acq;
+}
+
+inline void check_acquisition(ISMRMRD::Acquisition &acq, uint32_t scan, uint16_t samples, uint16_t channels,
+                              uint16_t traj_dims)
+{
+    BOOST_CHECK_EQUAL(acq.scan_counter(), scan);
+    BOOST_CHECK_EQUAL(acq.idx().kspace_encode_step_1, scan % 64);
+    BOOST_REQUIRE_EQUAL(acq.number_of_samples(), samples);
+    BOOST_REQUIRE_EQUAL(acq.active_channels(), channels);
+    BOOST_REQUIRE_EQUAL(acq.trajectory_dimensions(), traj_dims);
+    for (uint16_t c = 0; c < channels; c++) {
+        for (uint16_t s = 0; s < samples; s++) {
+            BOOST_CHECK(acq.data(s, c) == complex_float_t(float(scan), float(s + c * samples)));
+        }
+    }
+    for (uint16_t s = 0; s < samples; s++) {
+        for (uint16_t d = 0; d < traj_dims; d++) {
+            BOOST_CHECK_EQUAL(acq.traj(d, s), float(scan + d));
+        }
+    }
+}
+
+inline bool same_acquisition(const ISMRMRD::Acquisition &a, const ISMRMRD::Acquisition &b)
+{
+    return a.getHead() == b.getHead() && a.getDataSize() == b.getDataSize() &&
+           a.getTrajSize() == b.getTrajSize() &&
+           memcmp(a.getDataPtr(), b.getDataPtr(), a.getDataSize()) == 0 &&
+           memcmp(a.getTrajPtr(), b.getTrajPtr(), a.getTrajSize()) == 0;
+}
@@ -0,0 +1,198 @@
+#include "ismrmrd/ismrmrd.h"
+#include "ismrmrd/mapped_dataset.h"
+#include "test_ismrmrd.h"
+#include <boost/test/unit_test.hpp>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+using namespace ISMRMRD;
+
+BOOST_AUTO_TEST_SUITE(MappedDatasetTest)
+
+static const char *test_file = "test_mapped_dataset.h5";
+static const char *repacked_file = "test_mapped_dataset_repacked.h5";
+static const char *test_group = "dataset";
+
+static void write_test_file()
+{
+    std::remove(test_file);
+    Dataset d(test_file, test_group);
+    d.writeHeader("<ismrmrdHeader/>");
+    for (uint32_t n = 0; n < 300; n++) {
+        // noise scans are shorter than the readouts, so the repacked records are padded
+        d.appendAcquisition(make_acquisition(n, (n % 10 == 0) ? 32 : 64, 4, 2));
+    }
+    Image<float> im(16, 8, 1, 2);
+    for (uint32_t n = 0; n < 5; n++) {
+        im.setImageIndex(n);
+        for (size_t i = 0; i < im.getNumberOfDataElements(); i++) {
+            im.getDataPtr()[i] = float(n * 1000 + i);
+        }
+        im.setAttributeString("<ismrmrdMeta/>");
+        d.appendImage("images", im);
+    }
+    std::vector<size_t> dims(2);
+    dims[0] = 6;
+    dims[1] = 5;
+    NDArray<complex_float_t> arr(dims);
+    for (uint32_t n = 0; n < 3; n++) {
+        for (size_t i = 0; i < arr.getNumberOfElements(); i++) {
+            arr.getDataPtr()[i] = complex_float_t(float(i), float(n));
+        }
+        d.appendNDArray("arrays", arr);
+    }
+    Waveform wav(16, 1);
+    d.appendWaveform(wav);
+}
+
+BOOST_AUTO_TEST_CASE(test_repack_closed_dataset)
+{
+    write_test_file();
+    ISMRMRD_Dataset dset;
+    BOOST_REQUIRE_EQUAL(ismrmrd_init_dataset(&dset, test_file, test_group), ISMRMRD_NOERROR);
+    BOOST_REQUIRE_EQUAL(ismrmrd_open_dataset(&dset, false), ISMRMRD_NOERROR);
+    BOOST_REQUIRE_EQUAL(ismrmrd_close_dataset(&dset), ISMRMRD_NOERROR);
+    BOOST_CHECK_EQUAL(ismrmrd_repack_dataset(&dset, repacked_file), ISMRMRD_FILEERROR);
+    while (ismrmrd_pop_error(NULL, NULL, NULL, NULL, NULL)) {
+    }
+    std::remove(test_file);
+}
+
+BOOST_AUTO_TEST_CASE(test_repack_reads_back)
+{
+    write_test_file();
+    {
+        Dataset d(test_file, test_group, false);
+        d.repack(repacked_file);
+    }
+
+    // the repacked file reads like the original
+    Dataset original(test_file, test_group, false);
+    Dataset repacked(repacked_file, test_group, false);
+    std::string xml;
+    repacked.readHeader(xml);
+    BOOST_CHECK_EQUAL(xml, "<ismrmrdHeader/>");
+    BOOST_REQUIRE_EQUAL(repacked.getNumberOfAcquisitions(), 300u);
+    std::vector<Acquisition> a, b;
+    original.readAcquisitions(0, 300, a);
+    repacked.readAcquisitions(0, 300, b);
+    for (uint32_t n = 0; n < 300; n++) {
+        BOOST_CHECK(a[n].getHead() == b[n].getHead());
+        BOOST_REQUIRE_EQUAL(a[n].getDataSize(), b[n].getDataSize());
+        BOOST_CHECK(memcmp(a[n].getDataPtr(), b[n].getDataPtr(), a[n].getDataSize()) == 0);
+        BOOST_REQUIRE_EQUAL(a[n].getTrajSize(), b[n].getTrajSize());
+        BOOST_CHECK(memcmp(a[n].getTrajPtr(), b[n].getTrajPtr(), a[n].getTrajSize()) == 0);
+    }
+    Image<float> ia, ib;
+    original.readImage("images", 4, ia);
+    repacked.readImage("images", 4, ib);
+    BOOST_CHECK(std::equal(ia.begin(), ia.end(), ib.begin()));
+    BOOST_CHECK_EQUAL(std::string(ib.getAttributeString()), "<ismrmrdMeta/>");
+    NDArray<complex_float_t> arr;
+    repacked.readNDArray("arrays", 2, arr);
+    BOOST_CHECK(arr(5, 4) == complex_float_t(29.0f, 2.0f));
+    BOOST_CHECK_EQUAL(repacked.getNumberOfWaveforms(), 1u);
+
+    // it is only meant to be read
+    BOOST_CHECK_THROW(repacked.appendAcquisition(make_acquisition(0, 32, 4, 2)), std::runtime_error);
+    std::remove(test_file);
+    std::remove(repacked_file);
+}
+
+BOOST_AUTO_TEST_CASE(test_mapped_dataset)
+{
+    write_test_file();
+    BOOST_CHECK_THROW(MappedDataset(test_file, test_group), std::runtime_error);
+    {
+        Dataset d(test_file, test_group, false);
+        d.repack(repacked_file);
+    }
+
+    MappedDataset m(repacked_file, test_group);
+    BOOST_REQUIRE_EQUAL(m.getNumberOfAcquisitions(), 300u);
+    for (uint32_t n = 0; n < 300; n++) {
+        Acquisition acq = make_acquisition(n, (n % 10 == 0) ? 32 : 64, 4, 2);
+        MappedAcquisition view = m.acquisition(n);
+        BOOST_CHECK(memcmp(view.head, &acq.getHead(), sizeof(ISMRMRD_AcquisitionHeader)) == 0);
+        BOOST_CHECK(memcmp(view.data, acq.getDataPtr(), acq.getDataSize()) == 0);
+        BOOST_REQUIRE(view.traj != NULL);
+        BOOST_CHECK(memcmp(view.traj, acq.getTrajPtr(), acq.getTrajSize()) == 0);
+    }
+    BOOST_CHECK_THROW(m.acquisition(300), std::out_of_range);
+
+    BOOST_REQUIRE_EQUAL(m.getNumberOfImages("images"), 5u);
+    MappedImage<float> im = m.image<float>("images", 3);
+    BOOST_CHECK_EQUAL(im.head->image_index, 3u);
+    BOOST_CHECK_EQUAL(im.data[17], 3017.0f);
+    BOOST_CHECK_THROW(m.image<double>("images", 0), std::runtime_error);
+    BOOST_CHECK_THROW(m.getNumberOfImages("missing"), std::runtime_error);
+
+    BOOST_REQUIRE_EQUAL(m.getNumberOfNDArrays("arrays"), 3u);
+    std::vector<size_t> dims = m.getNDArrayDims("arrays");
+    BOOST_REQUIRE_EQUAL(dims.size(), 2u);
+    BOOST_CHECK_EQUAL(dims[0], 6u);
+    BOOST_CHECK_EQUAL(dims[1], 5u);
+    BOOST_CHECK(m.ndarray<complex_float_t>("arrays", 1)[29] == complex_float_t(29.0f, 1.0f));
+    BOOST_CHECK_THROW(m.ndarray<float>("arrays", 1), std::runtime_error);
+    std::remove(test_file);
+    std::remove(repacked_file);
+}
+
+BOOST_AUTO_TEST_CASE(test_repack_keeps_uneven_acquisitions)
+{
+    // a single long readout among short ones would mostly pad
+    std::remove(test_file);
+    {
+        Dataset d(test_file, test_group);
+        d.appendAcquisition(Acquisition(4096, 8));
+        for (uint32_t n = 0; n < 20; n++) {
+            d.appendAcquisition(Acquisition(64, 8));
+        }
+        d.repack(repacked_file);
+    }
+    Dataset repacked(repacked_file, test_group, false);
+    BOOST_CHECK_EQUAL(repacked.getNumberOfAcquisitions(), 21u);
+    Acquisition acq;
+    repacked.readAcquisition(0, acq);
+    BOOST_CHECK_EQUAL(acq.number_of_samples(), 4096u);
+    BOOST_CHECK_THROW(MappedDataset(repacked_file, test_group), std::runtime_error);
+    std::remove(test_file);
+    std::remove(repacked_file);
+}
+
+BOOST_AUTO_TEST_CASE(test_repack_compressed_acquisitions)
+{
+    // contiguous storage can't be filtered, so the samples kept apart go back into the records
+    for (int uneven = 0; uneven < 2; uneven++) {
+        std::remove(test_file);
+        {
+            ISMRMRD_DatasetOptions options;
+            ismrmrd_init_dataset_options(&options);
+            options.compression = ISMRMRD_COMPRESSION_FAST;
+            Dataset d(test_file, test_group, options);
+            d.appendAcquisition(make_acquisition(0, uneven ? 4096 : 64, 4, 2));
+            for (uint32_t n = 1; n < 20; n++) {
+                d.appendAcquisition(make_acquisition(n, 64, 4, n % 2 ? 0 : 2));
+            }
+            d.repack(repacked_file);
+        }
+        Dataset repacked(repacked_file, test_group, false);
+        BOOST_REQUIRE_EQUAL(repacked.getNumberOfAcquisitions(), 20u);
+        std::vector<Acquisition> acqs;
+        repacked.readAcquisitions(0, 20, acqs);
+        check_acquisition(acqs[0], 0, uneven ? 4096 : 64, 4, 2);
+        for (uint32_t n = 1; n < 20; n++) {
+            check_acquisition(acqs[n], n, 64, 4, n % 2 ? 0 : 2);
+        }
+        hid_t file = H5Fopen(repacked_file, H5F_ACC_RDONLY, H5P_DEFAULT);
+        BOOST_CHECK(H5Lexists(file, "/dataset/acquisition_samples", H5P_DEFAULT) <= 0);
+        H5Fclose(file);
+    }
+    std::remove(test_file);
+    std::remove(repacked_file);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
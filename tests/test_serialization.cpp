@@ -0,0 +1,137 @@
+#include "ismrmrd/ismrmrd.h"
+#include "ismrmrd/serialization.h"
+#include "test_ismrmrd.h"
+#include <boost/test/unit_test.hpp>
+#include <cstring>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+using namespace ISMRMRD;
+
+BOOST_AUTO_TEST_SUITE(SerializationTest)
+
+BOOST_AUTO_TEST_CASE(test_serialize_round_trip)
+{
+    std::stringstream stream;
+    serialize(std::string("<ismrmrdHeader/>"), stream);
+    Acquisition a1 = make_acquisition(1, 64, 4, 2);
+    Acquisition a2 = make_acquisition(2, 128, 2, 0);
+    serialize(a1, stream);
+    serialize(a2, stream);
+    Waveform wav(10, 3);
+    for (size_t i = 0; i < wav.size(); i++) {
+        wav.data[i] = uint32_t(i * 3);
+    }
+    serialize(wav, stream);
+    Image<float> im(8, 4, 1, 2);
+    im.setImageIndex(7);
+    im(5, 3, 0, 1) = 42.0f;
+    im.setAttributeString("<ismrmrdMeta/>");
+    serialize(im, stream);
+    std::vector<size_t> dims(3);
+    dims[0] = 3;
+    dims[1] = 4;
+    dims[2] = 2;
+    NDArray<complex_float_t> arr(dims);
+    arr(2, 3, 1) = complex_float_t(1.0f, 2.0f);
+    serialize(arr, stream);
+    serializeClose(stream);
+
+    std::string xml;
+    deserialize(stream, xml);
+    BOOST_CHECK_EQUAL(xml, "<ismrmrdHeader/>");
+
+    // the second acquisition is read into the buffers of the first
+    Acquisition acq;
+    deserialize(stream, acq);
+    BOOST_CHECK(same_acquisition(acq, a1));
+    deserialize(stream, acq);
+    BOOST_CHECK(same_acquisition(acq, a2));
+
+    MessageId id;
+    BOOST_REQUIRE(readMessageId(stream, id));
+    BOOST_REQUIRE(id == MessageId::WAVEFORM);
+    Waveform w;
+    deserializePayload(stream, w);
+    BOOST_CHECK_EQUAL(w.head.channels, 3u);
+    BOOST_CHECK_EQUAL(w.data[29], 87u);
+
+    Image<float> im2;
+    deserialize(stream, im2);
+    BOOST_CHECK_EQUAL(im2.getImageIndex(), 7u);
+    BOOST_CHECK_EQUAL(im2(5, 3, 0, 1), 42.0f);
+    BOOST_CHECK_EQUAL(std::string(im2.getAttributeString()), "<ismrmrdMeta/>");
+
+    // an array of any type through the C struct
+    ISMRMRD_NDArray carr;
+    ismrmrd_init_ndarray(&carr);
+    deserialize(stream, &carr);
+    BOOST_CHECK_EQUAL(carr.data_type, ISMRMRD_CXFLOAT);
+    BOOST_CHECK_EQUAL(carr.ndim, 3u);
+    BOOST_CHECK(memcmp(carr.data, arr.getDataPtr(), arr.getDataSize()) == 0);
+    ismrmrd_cleanup_ndarray(&carr);
+
+    BOOST_REQUIRE(readMessageId(stream, id));
+    BOOST_CHECK(id == MessageId::CLOSE);
+    BOOST_CHECK(!readMessageId(stream, id));
+}
+
+BOOST_AUTO_TEST_CASE(test_deserialize_errors)
+{
+    Image<float> im(4, 4);
+    std::stringstream stream;
+    serialize(im, stream);
+    Image<double> other;
+    BOOST_CHECK_THROW(deserialize(stream, other), std::runtime_error);
+
+    // a message of another kind
+    std::stringstream wrong;
+    serialize(make_acquisition(1, 16, 1, 0), wrong);
+    Waveform wav;
+    BOOST_CHECK_THROW(deserialize(wrong, wav), std::runtime_error);
+
+    // a stream cut inside a message
+    std::stringstream full;
+    serialize(make_acquisition(1, 16, 1, 0), full);
+    std::string bytes = full.str();
+    std::stringstream cut(bytes.substr(0, bytes.size() - 10));
+    Acquisition acq;
+    BOOST_CHECK_THROW(deserialize(cut, acq), std::runtime_error);
+
+    std::stringstream unknown(std::string("\x01\x00", 2));
+    MessageId id;
+    BOOST_CHECK_THROW(readMessageId(unknown, id), std::runtime_error);
+}
+
+BOOST_AUTO_TEST_CASE(test_deserialize_rejects_oversized)
+{
+    // headers claiming more than MAX_MESSAGE_PAYLOAD, with nothing behind them
+    AcquisitionHeader head;
+    head.number_of_samples = 65535;
+    head.active_channels = 65535;
+    std::stringstream acq_stream;
+    uint16_t id = static_cast<uint16_t>(MessageId::ACQUISITION);
+    acq_stream.write(reinterpret_cast<const char *>(&id), sizeof(id));
+    acq_stream.write(reinterpret_cast<const char *>(&head), sizeof(ISMRMRD_AcquisitionHeader));
+    Acquisition acq;
+    BOOST_CHECK_THROW(deserialize(acq_stream, acq), std::runtime_error);
+    BOOST_CHECK_EQUAL(acq.number_of_samples(), 0u);
+
+    std::stringstream arr_stream;
+    id = static_cast<uint16_t>(MessageId::NDARRAY);
+    uint16_t data_type = ISMRMRD_FLOAT, ndim = 2;
+    uint64_t dims[2] = {uint64_t(1) << 40, uint64_t(1) << 40};
+    arr_stream.write(reinterpret_cast<const char *>(&id), sizeof(id));
+    arr_stream.write(reinterpret_cast<const char *>(&data_type), sizeof(data_type));
+    arr_stream.write(reinterpret_cast<const char *>(&ndim), sizeof(ndim));
+    arr_stream.write(reinterpret_cast<const char *>(dims), sizeof(dims));
+    ISMRMRD_NDArray arr;
+    ismrmrd_init_ndarray(&arr);
+    BOOST_CHECK_THROW(deserialize(arr_stream, &arr), std::runtime_error);
+    BOOST_CHECK(arr.data == NULL);
+    ismrmrd_cleanup_ndarray(&arr);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,67 @@
+#include "ismrmrd/ismrmrd.h"
+#include "ismrmrd/dataset.h"
+#include "ismrmrd/serialization.h"
+#include "test_ismrmrd.h"
+#include <boost/test/unit_test.hpp>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <string>
+#include <vector>
+
+using namespace ISMRMRD;
+
+BOOST_AUTO_TEST_SUITE(StreamRecorderTest)
+
+static const char *test_file = "test_stream_recorder.h5";
+static const char *stream_file = "test_stream_recorder.bin";
+
+// Runs the recorder on the messages in stream_file, returns its exit status
+static int record_stream()
+{
+    std::string command = std::string(ISMRMRD_STREAM_RECORDER) + " " + test_file + " < " + stream_file + " > /dev/null";
+    return std::system(command.c_str());
+}
+
+BOOST_AUTO_TEST_CASE(test_record_varying_shapes)
+{
+    std::remove(test_file);
+    {
+        std::ofstream stream(stream_file, std::ios::binary);
+        serialize(std::string("<ismrmrdHeader/>"), stream);
+        serialize(make_acquisition(0, 32, 2, 0), stream);
+        // arrays and images whose shape or type changes from one message to the next
+        serialize(NDArray<float>(std::vector<size_t>(2, 4)), stream);
+        serialize(NDArray<float>(std::vector<size_t>(3, 2)), stream);
+        serialize(NDArray<complex_float_t>(std::vector<size_t>(2, 4)), stream);
+        serialize(NDArray<float>(std::vector<size_t>(2, 4)), stream);
+        Image<float> im(8, 8);
+        im.setImageSeriesIndex(1);
+        serialize(im, stream);
+        Image<float> larger(16, 8, 1, 2);
+        larger.setImageSeriesIndex(1);
+        serialize(larger, stream);
+        Image<int16_t> ints(8, 8);
+        ints.setImageSeriesIndex(1);
+        serialize(ints, stream);
+        serialize(make_acquisition(1, 32, 2, 0), stream);
+        serializeClose(stream);
+    }
+    BOOST_REQUIRE_EQUAL(record_stream(), 0);
+
+    Dataset d(test_file, "dataset", false);
+    std::string xml;
+    d.readHeader(xml);
+    BOOST_CHECK_EQUAL(xml, "<ismrmrdHeader/>");
+    BOOST_CHECK_EQUAL(d.getNumberOfAcquisitions(), 2u);
+    BOOST_CHECK_EQUAL(d.getNumberOfNDArrays("array_float_4x4"), 2u);
+    BOOST_CHECK_EQUAL(d.getNumberOfNDArrays("array_float_2x2x2"), 1u);
+    BOOST_CHECK_EQUAL(d.getNumberOfNDArrays("array_cxfloat_4x4"), 1u);
+    BOOST_CHECK_EQUAL(d.getNumberOfImages("image_1_float_8x8x1x1"), 1u);
+    BOOST_CHECK_EQUAL(d.getNumberOfImages("image_1_float_16x8x1x2"), 1u);
+    BOOST_CHECK_EQUAL(d.getNumberOfImages("image_1_short_8x8x1x1"), 1u);
+    std::remove(test_file);
+    std::remove(stream_file);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,165 @@
+#ifdef WIN32
+#include <windows.h>
+#else
+#include <sys/time.h>
+#endif
+
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "ismrmrd/ismrmrd.h"
+#include "ismrmrd/dataset.h"
+#include "ismrmrd/async_dataset.h"
+
+
+class Timer
+{
+public:
+
+  Timer(const char* name) : name_(name), bytes_(0) {
+#ifdef WIN32
+    QueryPerformanceFrequency(&frequency_);
+    QueryPerformanceCounter(&start_);
+#else
+    gettimeofday(&start_, NULL);
+#endif
+  }
+
+  void setBytes(double bytes) { bytes_ = bytes; }
+
+  ~Timer() {
+    double time_in_us = 0.0;
+#ifdef WIN32
+    QueryPerformanceCounter(&end_);
+    time_in_us = (end_.QuadPart * (1.0e6/ frequency_.QuadPart)) - start_.QuadPart * (1.0e6 / frequency_.QuadPart);
+#else
+    gettimeofday(&end_, NULL);
+    time_in_us = ((end_.tv_sec * 1e6) + end_.tv_usec) - ((start_.tv_sec * 1e6) + start_.tv_usec);
+#endif
+    std::cout << name_ << ": " << time_in_us/1000.0 << " ms";
+    if (bytes_ > 0 && time_in_us > 0) {
+      std::cout << " (" << bytes_ / time_in_us << " MB/s)";
+    }
+    std::cout << std::endl; std::cout.flush();
+  }
+
+protected:
+
+#ifdef WIN32
+  LARGE_INTEGER frequency_;
+  LARGE_INTEGER start_;
+  LARGE_INTEGER end_;
+#else
+  timeval start_;
+  timeval end_;
+#endif
+
+  std::string name_;
+  double bytes_;
+};
+
+
+int main(int argc, char** argv)
+{
+  std::cout << "File writer timing test" << std::endl;
+
+  if (argc < 2) {
+    std::cout << "Usage: " << std::endl;
+    std::cout << "  " << argv[0] << " <FILENAME> [acquisitions] [channels] [samples] [block size]" << std::endl;
+    return -1;
+  }
+
+  uint32_t number_of_acquisitions = (argc > 2) ? atoi(argv[2]) : 4096;
+  uint16_t channels = (argc > 3) ? atoi(argv[3]) : 32;
+  uint16_t samples = (argc > 4) ? atoi(argv[4]) : 256;
+  uint32_t block_size = (argc > 5) ? atoi(argv[5]) : 256;
+  if (block_size == 0) {
+    block_size = 1;
+  }
+
+  std::cout << "Writing " << number_of_acquisitions << " acquisitions with " << channels
+            << " channels and " << samples << " samples to " << argv[1] << std::endl;
+
+  std::vector<ISMRMRD::Acquisition> block(block_size);
+  for (uint32_t n = 0; n < block_size; n++) {
+    block[n].resize(samples, channels);
+    block[n].scan_counter() = n;
+  }
+  double total_bytes = double(number_of_acquisitions) * block[0].getDataSize();
+
+  {
+    std::remove(argv[1]);
+    ISMRMRD::Dataset d(argv[1], "dataset", true);
+    Timer t("ONE AT A TIME");
+    t.setBytes(total_bytes);
+    for (uint32_t i = 0; i < number_of_acquisitions; i++) {
+      d.appendAcquisition(block[i % block_size]);
+    }
+  }
+
+  {
+    std::remove(argv[1]);
+    ISMRMRD::Dataset d(argv[1], "dataset", true);
+    std::string name = "BLOCKS OF " + std::to_string(block_size);
+    Timer t(name.c_str());
+    t.setBytes(total_bytes);
+    uint32_t written = 0;
+    while (written + block_size <= number_of_acquisitions) {
+      d.appendAcquisitions(block);
+      written += block_size;
+    }
+    if (written < number_of_acquisitions) {
+      std::vector<ISMRMRD::Acquisition> tail(block.begin(), block.begin() + (number_of_acquisitions - written));
+      d.appendAcquisitions(tail);
+    }
+  }
+
+  {
+    // The same appends to a file kept in memory by the HDF5 core driver
+    ISMRMRD::ISMRMRD_DatasetOptions options;
+    ISMRMRD::ismrmrd_init_dataset_options(&options);
+    options.in_memory = true;
+    std::remove(argv[1]);
+    ISMRMRD::Dataset d(argv[1], "dataset", options, true);
+    std::string name = "IN MEMORY, BLOCKS OF " + std::to_string(block_size);
+    Timer t(name.c_str());
+    t.setBytes(total_bytes);
+    for (uint32_t written = 0; written < number_of_acquisitions; written += block_size) {
+      if (written + block_size <= number_of_acquisitions) {
+        d.appendAcquisitions(block);
+      } else {
+        std::vector<ISMRMRD::Acquisition> tail(block.begin(), block.begin() + (number_of_acquisitions - written));
+        d.appendAcquisitions(tail);
+      }
+    }
+  }
+
+  {
+    // A front end hands its buffers over, so the producer only pays for queueing them
+    // while the writer thread batches the appends. The queue is allowed to grow so that
+    // the producer never waits for the writer.
+    std::vector<ISMRMRD::Acquisition> acqs(block.begin(), block.end());
+    while (acqs.size() < number_of_acquisitions) {
+      acqs.push_back(block[acqs.size() % block_size]);
+    }
+    std::remove(argv[1]);
+    ISMRMRD::AsyncDataset d(argv[1], "dataset", true, block_size, ISMRMRD::AsyncQueuePolicy::GROW);
+    {
+      Timer t("ASYNC ONE AT A TIME, PRODUCER");
+      for (uint32_t i = 0; i < number_of_acquisitions; i++) {
+        d.appendAcquisition(std::move(acqs[i]));
+      }
+    }
+    {
+      Timer t("ASYNC DRAIN");
+      d.close();
+    }
+    ISMRMRD::AsyncDatasetStats stats = d.getStats();
+    std::cout << "Writer took " << stats.batches << " batches, queue depth reached " << stats.max_depth << std::endl;
+  }
+
+  return 0;
+}
@@ -0,0 +1,151 @@
+#ifdef WIN32
+#include <windows.h>
+#else
+#include <sys/time.h>
+#endif
+
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "ismrmrd/ismrmrd.h"
+#include "ismrmrd/dataset.h"
+
+
+class Timer
+{
+public:
+
+  Timer() {
+#ifdef WIN32
+    QueryPerformanceFrequency(&frequency_);
+    QueryPerformanceCounter(&start_);
+#else
+    gettimeofday(&start_, NULL);
+#endif
+  }
+
+  double elapsed_us() {
+#ifdef WIN32
+    QueryPerformanceCounter(&end_);
+    return (end_.QuadPart * (1.0e6/ frequency_.QuadPart)) - start_.QuadPart * (1.0e6 / frequency_.QuadPart);
+#else
+    gettimeofday(&end_, NULL);
+    return ((end_.tv_sec * 1e6) + end_.tv_usec) - ((start_.tv_sec * 1e6) + start_.tv_usec);
+#endif
+  }
+
+protected:
+
+#ifdef WIN32
+  LARGE_INTEGER frequency_;
+  LARGE_INTEGER start_;
+  LARGE_INTEGER end_;
+#else
+  timeval start_;
+  timeval end_;
+#endif
+};
+
+static double file_size(const char *filename)
+{
+  std::ifstream f(filename, std::ios::binary | std::ios::ate);
+  return double(f.tellg());
+}
+
+int main(int argc, char** argv)
+{
+  std::cout << "Compression benchmark" << std::endl;
+
+  if (argc < 3) {
+    std::cout << "Usage: " << std::endl;
+    std::cout << "  " << argv[0] << " <INPUT FILE> <SCRATCH FILE> [block size]" << std::endl;
+    std::cout << "The input is typically made by ismrmrd_generate_cartesian_shepp_logan." << std::endl;
+    return -1;
+  }
+
+  uint32_t block_size = (argc > 3) ? atoi(argv[3]) : 256;
+  if (block_size == 0) {
+    block_size = 1;
+  }
+
+  // The acquisitions are held in memory so that only the writes and reads are timed
+  std::vector<ISMRMRD::Acquisition> acqs;
+  {
+    ISMRMRD::Dataset d(argv[1], "dataset", false);
+    d.readAcquisitions(0, d.getNumberOfAcquisitions(), acqs);
+  }
+  if (acqs.empty()) {
+    std::cout << "No acquisitions in " << argv[1] << std::endl;
+    return -1;
+  }
+  double data_bytes = 0;
+  for (size_t n = 0; n < acqs.size(); n++) {
+    data_bytes += acqs[n].getDataSize();
+  }
+
+  // The same samples stored as fixed size images, which are compressed as a whole
+  std::vector<ISMRMRD::Image<complex_float_t> > images(acqs.size());
+  for (size_t n = 0; n < acqs.size(); n++) {
+    images[n].resize(acqs[n].number_of_samples(), 1, 1, acqs[n].active_channels());
+    std::copy(acqs[n].data_begin(), acqs[n].data_end(), images[n].begin());
+  }
+
+  std::cout << acqs.size() << " acquisitions, " << data_bytes / 1.0e6 << " MB of samples" << std::endl;
+  std::cout << "profile  layout        ratio  write MB/s  read MB/s" << std::endl;
+
+  const char *names[] = { "none", "fast", "max", "cxfloat" };
+  for (uint16_t profile = ISMRMRD::ISMRMRD_COMPRESSION_NONE; profile <= ISMRMRD::ISMRMRD_COMPRESSION_CXFLOAT; profile++) {
+    for (int layout = 0; layout < 2; layout++) {
+      ISMRMRD::ISMRMRD_DatasetOptions options;
+      ISMRMRD::ismrmrd_init_dataset_options(&options);
+      options.compression = profile;
+
+      std::remove(argv[2]);
+      double write_us, read_us;
+      {
+        ISMRMRD::Dataset d(argv[2], "dataset", options);
+        Timer t;
+        for (size_t first = 0; first < acqs.size(); first += block_size) {
+          size_t last = std::min(acqs.size(), first + block_size);
+          if (layout == 0) {
+            std::vector<ISMRMRD::Acquisition> block(acqs.begin() + first, acqs.begin() + last);
+            d.appendAcquisitions(block);
+          } else {
+            for (size_t n = first; n < last; n++) {
+              d.appendImage("kspace", images[n]);
+            }
+          }
+        }
+        write_us = t.elapsed_us();
+      }
+      {
+        ISMRMRD::Dataset d(argv[2], "dataset", false);
+        Timer t;
+        if (layout == 0) {
+          std::vector<ISMRMRD::Acquisition> in;
+          for (uint32_t first = 0; first < acqs.size(); first += block_size) {
+            uint32_t count = std::min<uint32_t>(block_size, acqs.size() - first);
+            d.readAcquisitions(first, count, in);
+          }
+        } else {
+          ISMRMRD::Image<complex_float_t> in;
+          for (uint32_t n = 0; n < images.size(); n++) {
+            d.readImage("kspace", n, in);
+          }
+        }
+        read_us = t.elapsed_us();
+      }
+
+      std::printf("%-8s %-12s %6.3f  %10.1f  %9.1f\n", names[profile],
+                  layout == 0 ? "acquisitions" : "images", data_bytes / file_size(argv[2]),
+                  data_bytes / write_us, data_bytes / read_us);
+    }
+  }
+  std::remove(argv[2]);
+
+  return 0;
+}
@@ -7,7 +7,9 @@
  *
  */
 
+#include <chrono>
 #include <iostream>
+#include <thread>
 #include "ismrmrd/ismrmrd.h"
 #include "ismrmrd/xml.h"
 #include "ismrmrd/dataset.h"
@@ -42,6 +44,9 @@ int main(int argc, char** argv)
 	std::string dataset;
 	bool store_coordinates = false;
 	bool noise_calibration = false;
+	bool swmr = false;
+	unsigned int flush_interval;
+	unsigned int readout_delay;
 
 	po::options_description desc("Allowed options");
 	desc.add_options()
@@ -57,6 +62,9 @@ int main(int argc, char** argv)
 	    ("dataset,d", po::value<std::string>(&dataset)->default_value("dataset"), "Output Dataset Name")
 	    ("noise-calibration,C", po::value<bool>(&noise_calibration)->zero_tokens(), "Add noise calibration")
 	    ("k-coordinates,k",  po::value<bool>(&store_coordinates)->zero_tokens(), "Store k-space coordinates")
+	    ("swmr,s", po::value<bool>(&swmr)->zero_tokens(), "Write in SWMR mode, so that the file can be read while it is written")
+	    ("flush-interval,F", po::value<unsigned int>(&flush_interval)->default_value(16), "Readouts between flushes in SWMR mode, 0 to flush only at the end")
+	    ("readout-delay,D", po::value<unsigned int>(&readout_delay)->default_value(0), "Pause between readouts in microseconds, to mimic a scan")
 	;
 
 	po::variables_map vm;
@@ -91,11 +99,75 @@ int main(int argc, char** argv)
             }
 	}
 
+        size_t readout = matrix_size*ros;
+
+	//Let's create a header, we will use the C++ classes in ismrmrd/xml.h
+	IsmrmrdHeader h;
+        h.version = ISMRMRD_XMLHDR_VERSION;
+	h.experimentalConditions.H1resonanceFrequency_Hz = 63500000; //~1.5T        
+
+	AcquisitionSystemInformation sys;
+	sys.institutionName = "ISMRM Synthetic Imaging Lab";
+	sys.receiverChannels = ncoils;
+	h.acquisitionSystemInformation = sys;
+
+	//Create an encoding section
+        Encoding e;
+        e.encodedSpace.matrixSize.x = readout;
+        e.encodedSpace.matrixSize.y = matrix_size;
+        e.encodedSpace.matrixSize.z = 1;
+        e.encodedSpace.fieldOfView_mm.x = 600;
+        e.encodedSpace.fieldOfView_mm.y = 300;
+        e.encodedSpace.fieldOfView_mm.z = 6;
+        e.reconSpace.matrixSize.x = readout/2;
+        e.reconSpace.matrixSize.y = matrix_size;
+        e.reconSpace.matrixSize.z = 1;
+        e.reconSpace.fieldOfView_mm.x = 300;
+        e.reconSpace.fieldOfView_mm.y = 300;
+        e.reconSpace.fieldOfView_mm.z = 6;
+        e.trajectory = TrajectoryType::CARTESIAN;
+        e.encodingLimits.kspace_encoding_step_1 = Limit(0, matrix_size-1,(matrix_size>>1));
+        e.encodingLimits.repetition = Limit(0, repetitions*acc_factor - 1,0);
+        
+	//e.g. parallel imaging
+	if (acc_factor > 1) {
+            ParallelImaging parallel;
+            parallel.accelerationFactor.kspace_encoding_step_1 = acc_factor;
+            parallel.accelerationFactor.kspace_encoding_step_2 = 1;
+            parallel.calibrationMode = "interleaved";
+            e.parallelImaging = parallel;
+	}
+
+	//Add the encoding section to the header
+	h.encoding.push_back(e);
+
+	//Add any additional fields that you may want would go here....
+
+	//Serialize the header
+        std::stringstream str;
+        ISMRMRD::serialize( h, str);
+        std::string xml_header = str.str();
+        //std::cout << xml_header << std::endl;
+        
         //Let's append the data to the file
         //Create if needed
-	Dataset d(outfile.c_str(),dataset.c_str(), true);
+	ISMRMRD_DatasetOptions options;
+	ismrmrd_init_dataset_options(&options);
+	if (swmr) {
+	    options.swmr = ISMRMRD_SWMR_WRITE;
+	}
+	Dataset d(outfile.c_str(),dataset.c_str(), options, true);
 	Acquisition acq;
-        size_t readout = matrix_size*ros;
+	unsigned int appended = 0;
+
+	//Write the header to the data file.
+	//With SWMR, readers only see what was there when SWMR writing started, so this goes first
+	d.writeHeader(xml_header);
+
+        //Write out some arrays for convenience
+        d.appendNDArray("phantom", *phantom);
+        d.appendNDArray("csm", *coils);
+        d.appendNDArray("coil_images", coil_images);
         
 	if (noise_calibration)
         {
@@ -105,6 +177,10 @@ int main(int argc, char** argv)
             add_noise(acq,noise_level);
             acq.sample_time_us() = 5.0;
             d.appendAcquisition(acq);
+            appended++;
+            if (swmr) {
+                d.beginSWMRWrite();
+            }
 	}
         
         if (store_coordinates) {
@@ -166,65 +242,22 @@ int main(int argc, char** argv)
                         }
                     }
                     d.appendAcquisition(acq);
+                    appended++;
+                    if (swmr && appended == 1) {
+                        d.beginSWMRWrite();
+                    }
+                    else if (swmr && flush_interval > 0 && appended % flush_interval == 0) {
+                        d.flush();
+                    }
+                    if (readout_delay > 0) {
+                        std::this_thread::sleep_for(std::chrono::microseconds(readout_delay));
+                    }
                 }
             }
 	}
 
-	//Let's create a header, we will use the C++ classes in ismrmrd/xml.h
-	IsmrmrdHeader h;
-        h.version = ISMRMRD_XMLHDR_VERSION;
-	h.experimentalConditions.H1resonanceFrequency_Hz = 63500000; //~1.5T        
-
-	AcquisitionSystemInformation sys;
-	sys.institutionName = "ISMRM Synthetic Imaging Lab";
-	sys.receiverChannels = ncoils;
-	h.acquisitionSystemInformation = sys;
-
-	//Create an encoding section
-        Encoding e;
-        e.encodedSpace.matrixSize.x = readout;
-        e.encodedSpace.matrixSize.y = matrix_size;
-        e.encodedSpace.matrixSize.z = 1;
-        e.encodedSpace.fieldOfView_mm.x = 600;
-        e.encodedSpace.fieldOfView_mm.y = 300;
-        e.encodedSpace.fieldOfView_mm.z = 6;
-        e.reconSpace.matrixSize.x = readout/2;
-        e.reconSpace.matrixSize.y = matrix_size;
-        e.reconSpace.matrixSize.z = 1;
-        e.reconSpace.fieldOfView_mm.x = 300;
-        e.reconSpace.fieldOfView_mm.y = 300;
-        e.reconSpace.fieldOfView_mm.z = 6;
-        e.trajectory = TrajectoryType::CARTESIAN;
-        e.encodingLimits.kspace_encoding_step_1 = Limit(0, matrix_size-1,(matrix_size>>1));
-        e.encodingLimits.repetition = Limit(0, repetitions*acc_factor - 1,0);
-        
-	//e.g. parallel imaging
-	if (acc_factor > 1) {
-            ParallelImaging parallel;
-            parallel.accelerationFactor.kspace_encoding_step_1 = acc_factor;
-            parallel.accelerationFactor.kspace_encoding_step_2 = 1;
-            parallel.calibrationMode = "interleaved";
-            e.parallelImaging = parallel;
+	if (swmr) {
+	    d.flush();
 	}
-
-	//Add the encoding section to the header
-	h.encoding.push_back(e);
-
-	//Add any additional fields that you may want would go here....
-
-	//Serialize the header
-        std::stringstream str;
-        ISMRMRD::serialize( h, str);
-        std::string xml_header = str.str();
-        //std::cout << xml_header << std::endl;
-        
-	//Write the header to the data file.
-	d.writeHeader(xml_header);
-
-        //Write out some arrays for convenience
-        d.appendNDArray("phantom", *phantom);
-        d.appendNDArray("csm", *coils);
-        d.appendNDArray("coil_images", coil_images);
-        
 	return 0;
 }
@@ -4,11 +4,16 @@
 #include <sys/time.h>
 #endif
 
+#include <algorithm>
+#include <cstdlib>
 #include <iostream>
 #include <string>
+#include <thread>
+#include <vector>
 
 #include "ismrmrd/ismrmrd.h"
 #include "ismrmrd/dataset.h"
+#include "ismrmrd/async_dataset.h"
 
 
 class Timer
@@ -58,14 +63,35 @@ protected:
 };
 
 
+// Stands in for reconstruction work on an acquisition
+static float compute(const ISMRMRD::Acquisition &acq, uint32_t passes)
+{
+  float sum = 0;
+  for (uint32_t p = 0; p < passes; p++) {
+    for (const complex_float_t *it = acq.data_begin(); it != acq.data_end(); ++it) {
+      sum += std::norm(*it) * (p + 1);
+    }
+  }
+  return sum;
+}
+
 int main(int argc, char** argv)
 {
   std::cout << "File reader timing test" << std::endl;
 
-  if (argc != 2) {
+  if (argc < 2) {
     std::cout << "Usage: " << std::endl;
-    std::cout << "  " << argv[0] << " <FILENAME>" << std::endl;
-  } 
+    std::cout << "  " << argv[0] << " <FILENAME> [block size] [compute passes] [prefetch depth] [max threads]" << std::endl;
+    return -1;
+  }
+
+  uint32_t block_size = (argc > 2) ? atoi(argv[2]) : 1024;
+  if (block_size == 0) {
+    block_size = 1;
+  }
+  uint32_t passes = (argc > 3) ? atoi(argv[3]) : 0;
+  uint32_t depth = (argc > 4) ? atoi(argv[4]) : 4;
+  uint32_t max_threads = (argc > 5) ? atoi(argv[5]) : 4;
 
   std::cout << "Opening file " << argv[1] << std::endl;
 
@@ -80,6 +106,89 @@ int main(int argc, char** argv)
         //We'll just throw the data away here. 
     }
   }
+
+  {
+    Timer t("BLOCK READ TIMER");
+    ISMRMRD::Dataset d(argv[1],"dataset", false);
+    uint32_t number_of_acquisitions = d.getNumberOfAcquisitions();
+    std::vector<ISMRMRD::Acquisition> acqs;
+    for (uint32_t i = 0; i < number_of_acquisitions; i += block_size) {
+        uint32_t count = std::min(block_size, number_of_acquisitions - i);
+        d.readAcquisitions(i, count, acqs);
+        //We'll just throw the data away here.
+    }
+  }
+
+  // With compute passes the reads are followed by work on every acquisition, which the
+  // prefetching reader overlaps with reading the next blocks
+  float result = 0;
+  {
+    Timer t("BLOCK READ AND COMPUTE TIMER");
+    ISMRMRD::Dataset d(argv[1],"dataset", false);
+    uint32_t number_of_acquisitions = d.getNumberOfAcquisitions();
+    std::vector<ISMRMRD::Acquisition> acqs;
+    for (uint32_t i = 0; i < number_of_acquisitions; i += block_size) {
+        uint32_t count = std::min(block_size, number_of_acquisitions - i);
+        d.readAcquisitions(i, count, acqs);
+        for (uint32_t n = 0; n < count; n++) {
+            result += compute(acqs[n], passes);
+        }
+    }
+  }
+
+  {
+    ISMRMRD::PrefetchStats stats;
+    {
+      Timer t("PREFETCH READ AND COMPUTE TIMER");
+      ISMRMRD::PrefetchingAcquisitionReader reader(argv[1], "dataset", block_size, depth);
+      ISMRMRD::Acquisition acq;
+      while (reader.next(acq)) {
+          result += compute(acq, passes);
+      }
+      stats = reader.getStats();
+    }
+    std::cout << "  read " << stats.read_seconds * 1000.0 << " ms in " << stats.blocks << " blocks, consumer stalled "
+              << stats.stall_seconds * 1000.0 << " ms in " << stats.stalls << " waits" << std::endl;
+  }
+  // Threads sharing one Dataset, each with a cursor over its share of the acquisitions.
+  // The reads are serialized, so only the compute scales with the threads.
+  for (uint32_t threads = 1; threads <= max_threads; threads *= 2) {
+    std::string name = "SHARED READ AND COMPUTE TIMER, " + std::to_string(threads) + " THREADS";
+    Timer t(name.c_str());
+    ISMRMRD::Dataset d(argv[1],"dataset", false);
+    uint32_t number_of_acquisitions = d.getNumberOfAcquisitions();
+    uint32_t share = (number_of_acquisitions + threads - 1) / threads;
+    std::vector<float> results(threads, 0);
+    std::vector<std::thread> workers;
+    for (uint32_t n = 0; n < threads; n++) {
+      workers.push_back(std::thread([&d, &results, n, share, block_size, passes] {
+        ISMRMRD::AcquisitionCursor cursor(d, n * share, share, block_size);
+        ISMRMRD::Acquisition acq;
+        while (cursor.next(acq)) {
+          results[n] += compute(acq, passes);
+        }
+      }));
+    }
+    for (uint32_t n = 0; n < threads; n++) {
+      workers[n].join();
+      result += results[n];
+    }
+  }
+
+  if (result < 0) {
+    std::cout << result << std::endl;
+  }
+
+  {
+    Timer t("HEADER SCAN TIMER");
+    ISMRMRD::Dataset d(argv[1],"dataset", false);
+    uint32_t number_of_acquisitions = d.getNumberOfAcquisitions();
+    std::vector<ISMRMRD::AcquisitionHeader> heads;
+    for (uint32_t i = 0; i < number_of_acquisitions; i += block_size) {
+        uint32_t count = std::min(block_size, number_of_acquisitions - i);
+        d.readAcquisitionHeaders(i, count, heads);
+    }
+  }
   
   return 0;
 }
@@ -0,0 +1,52 @@
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <string>
+
+#include "ismrmrd/ismrmrd.h"
+#include "ismrmrd/dataset.h"
+#include "ismrmrd/mapped_dataset.h"
+
+// Rewrites a finished dataset for read-only use, see ismrmrd_repack_dataset, and
+// reports whether its acquisitions can be read through a MappedDataset.
+
+static long long file_size(const char *filename)
+{
+  std::ifstream file(filename, std::ios::binary | std::ios::ate);
+  return file ? static_cast<long long>(file.tellg()) : -1;
+}
+
+int main(int argc, char** argv)
+{
+  if (argc < 3) {
+    std::cout << "Usage: " << std::endl;
+    std::cout << "  " << argv[0] << " <INPUT FILE> <OUTPUT FILE> [group]" << std::endl;
+    return -1;
+  }
+  std::string group = (argc > 3) ? argv[3] : "dataset";
+
+  try {
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    {
+      ISMRMRD::Dataset d(argv[1], group.c_str(), false);
+      d.repack(argv[2]);
+    }
+    double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    std::printf("input:           %.1f MB\n", file_size(argv[1]) / 1e6);
+    std::printf("output:          %.1f MB\n", file_size(argv[2]) / 1e6);
+    std::printf("elapsed:         %.3f s\n", elapsed);
+    try {
+      ISMRMRD::MappedDataset mapped(argv[2], group.c_str());
+      std::printf("acquisitions:    %u, mapped\n", mapped.getNumberOfAcquisitions());
+    } catch (std::exception &) {
+      std::printf("acquisitions:    kept variable length, their sizes vary too much to map\n");
+    }
+  } catch (std::exception &e) {
+    std::cout << e.what() << std::endl;
+    return -1;
+  }
+
+  return 0;
+}
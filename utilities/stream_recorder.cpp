@@ -0,0 +1,307 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <streambuf>
+#include <string>
+#include <vector>
+
+#include <errno.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "ismrmrd/ismrmrd.h"
+#include "ismrmrd/async_dataset.h"
+#include "ismrmrd/serialization.h"
+
+// Records a stream of serialized messages, see serialization.h, to a dataset. The stream
+// is read from a Unix domain socket, one connection, or from stdin. Decoding runs on this
+// thread while an AsyncDataset writes batches of acquisitions on its own. A variable only
+// holds records of one type and shape, so images go to the variable
+// image_<series index>_<type>_<matrix size>x<channels>, e.g. image_1_float_256x256x1x8, and
+// arrays to array_<type>_<dims>, e.g. array_cxfloat_128x64. With -d a full queue drops
+// acquisitions, waveforms, images and arrays, which the counts leave out, but never the header.
+
+// Reads a file descriptor, large reads go straight into the caller's buffer
+class DescriptorBuffer : public std::streambuf {
+public:
+  DescriptorBuffer(int fd) : fd_(fd), buffer_(1 << 20), bytes_(0)
+  {
+    setg(&buffer_[0], &buffer_[0], &buffer_[0]);
+  }
+
+  unsigned long long bytes() const { return bytes_; }
+
+protected:
+  int_type underflow()
+  {
+    ssize_t count = fill(&buffer_[0], buffer_.size());
+    if (count <= 0) {
+      return traits_type::eof();
+    }
+    setg(&buffer_[0], &buffer_[0], &buffer_[0] + count);
+    return traits_type::to_int_type(buffer_[0]);
+  }
+
+  std::streamsize xsgetn(char *data, std::streamsize size)
+  {
+    std::streamsize done = std::min<std::streamsize>(size, egptr() - gptr());
+    std::memcpy(data, gptr(), static_cast<size_t>(done));
+    gbump(static_cast<int>(done));
+    while (done < size) {
+      if (static_cast<size_t>(size - done) < buffer_.size()) {
+        if (underflow() == traits_type::eof()) {
+          break;
+        }
+        std::streamsize part = std::min<std::streamsize>(size - done, egptr() - gptr());
+        std::memcpy(data + done, gptr(), static_cast<size_t>(part));
+        gbump(static_cast<int>(part));
+        done += part;
+      } else {
+        ssize_t count = fill(data + done, static_cast<size_t>(size - done));
+        if (count <= 0) {
+          break;
+        }
+        done += count;
+      }
+    }
+    return done;
+  }
+
+private:
+  ssize_t fill(char *data, size_t size)
+  {
+    ssize_t count;
+    do {
+      count = ::read(fd_, data, size);
+    } while (count < 0 && errno == EINTR);
+    if (count > 0) {
+      bytes_ += count;
+    }
+    return count;
+  }
+
+  int fd_;
+  std::vector<char> buffer_;
+  unsigned long long bytes_;
+};
+
+// Listens on path and returns the first connection, or -1
+static int accept_connection(const char *path)
+{
+  sockaddr_un address;
+  std::memset(&address, 0, sizeof(address));
+  address.sun_family = AF_UNIX;
+  if (std::strlen(path) >= sizeof(address.sun_path)) {
+    std::cerr << "Socket path too long: " << path << std::endl;
+    return -1;
+  }
+  std::strcpy(address.sun_path, path);
+
+  int server = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (server < 0) {
+    std::perror("socket");
+    return -1;
+  }
+  unlink(path);
+  if (bind(server, reinterpret_cast<sockaddr *>(&address), sizeof(address)) != 0 || listen(server, 1) != 0) {
+    std::perror(path);
+    close(server);
+    return -1;
+  }
+  std::printf("listening on %s\n", path);
+  std::fflush(stdout);
+  int connection = accept(server, NULL, NULL);
+  if (connection < 0) {
+    std::perror("accept");
+  }
+  close(server);
+  unlink(path);
+  return connection;
+}
+
+static const char *type_name(uint16_t data_type)
+{
+  switch (data_type) {
+    case ISMRMRD::ISMRMRD_USHORT: return "ushort";
+    case ISMRMRD::ISMRMRD_SHORT: return "short";
+    case ISMRMRD::ISMRMRD_UINT: return "uint";
+    case ISMRMRD::ISMRMRD_INT: return "int";
+    case ISMRMRD::ISMRMRD_FLOAT: return "float";
+    case ISMRMRD::ISMRMRD_DOUBLE: return "double";
+    case ISMRMRD::ISMRMRD_CXFLOAT: return "cxfloat";
+    case ISMRMRD::ISMRMRD_CXDOUBLE: return "cxdouble";
+    default: return "unknown";
+  }
+}
+
+static std::string image_variable(const ISMRMRD::ISMRMRD_Image &im)
+{
+  return "image_" + std::to_string(im.head.image_series_index) + "_" + type_name(im.head.data_type) + "_" +
+         std::to_string(im.head.matrix_size[0]) + "x" + std::to_string(im.head.matrix_size[1]) + "x" +
+         std::to_string(im.head.matrix_size[2]) + "x" + std::to_string(im.head.channels);
+}
+
+static std::string array_variable(const ISMRMRD::ISMRMRD_NDArray &arr)
+{
+  std::string var = std::string("array_") + type_name(arr.data_type) + "_";
+  for (uint16_t n = 0; n < arr.ndim; n++) {
+    var += (n > 0 ? "x" : "") + std::to_string(arr.dims[n]);
+  }
+  return var;
+}
+
+static double seconds_since(const std::chrono::steady_clock::time_point &start)
+{
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+static void usage(const char *program)
+{
+  std::cout << "Usage: " << std::endl;
+  std::cout << "  " << program << " <OUTPUT FILE> [options]" << std::endl;
+  std::cout << "    -s <path>      listen on a Unix domain socket instead of reading stdin" << std::endl;
+  std::cout << "    -g <group>     the group to write, dataset by default" << std::endl;
+  std::cout << "    -q <capacity>  the capacity of the write queue, 1024 by default" << std::endl;
+  std::cout << "    -d             drop messages when the queue is full instead of waiting" << std::endl;
+}
+
+int main(int argc, char** argv)
+{
+  if (argc < 2 || argv[1][0] == '-') {
+    usage(argv[0]);
+    return -1;
+  }
+  const char *socket_path = NULL;
+  std::string group = "dataset";
+  size_t capacity = 1024;
+  ISMRMRD::AsyncQueuePolicy policy = ISMRMRD::AsyncQueuePolicy::BLOCK;
+  for (int n = 2; n < argc; n++) {
+    std::string option = argv[n];
+    if (option == "-d") {
+      policy = ISMRMRD::AsyncQueuePolicy::DROP;
+    } else if (n + 1 < argc && option == "-s") {
+      socket_path = argv[++n];
+    } else if (n + 1 < argc && option == "-g") {
+      group = argv[++n];
+    } else if (n + 1 < argc && option == "-q") {
+      capacity = static_cast<size_t>(std::atol(argv[++n]));
+    } else {
+      usage(argv[0]);
+      return -1;
+    }
+  }
+
+  int fd = 0;
+  if (socket_path != NULL && (fd = accept_connection(socket_path)) < 0) {
+    return -1;
+  }
+
+  DescriptorBuffer buffer(fd);
+  std::istream stream(&buffer);
+  unsigned long long acquisitions = 0, images = 0, arrays = 0, waveforms = 0;
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  int status = 0;
+
+  try {
+    ISMRMRD::AsyncDataset d(argv[1], group.c_str(), true, capacity, policy);
+    ISMRMRD::MessageId id;
+    std::string xml;
+    ISMRMRD::Acquisition acq;
+    ISMRMRD::Waveform wav;
+    double last_report = 0;
+    unsigned long long last_bytes = 0;
+
+    while (ISMRMRD::readMessageId(stream, id) && id != ISMRMRD::MessageId::CLOSE) {
+      switch (id) {
+      case ISMRMRD::MessageId::HEADER:
+        ISMRMRD::deserializePayload(stream, xml);
+        // the header is never dropped, a full queue is written out first to make room
+        while (!d.writeHeader(xml)) {
+          d.flush();
+        }
+        break;
+      case ISMRMRD::MessageId::ACQUISITION:
+        // moving hands the buffers to the queue, the next acquisition gets new ones
+        ISMRMRD::deserializePayload(stream, acq);
+        if (d.appendAcquisition(std::move(acq))) {
+          acquisitions++;
+        }
+        break;
+      case ISMRMRD::MessageId::WAVEFORM:
+        ISMRMRD::deserializePayload(stream, wav);
+        if (d.appendWaveform(std::move(wav))) {
+          waveforms++;
+        }
+        break;
+      case ISMRMRD::MessageId::IMAGE: {
+        ISMRMRD::ISMRMRD_Image im;
+        ISMRMRD::ismrmrd_init_image(&im);
+        try {
+          ISMRMRD::deserializePayload(stream, &im);
+        } catch (...) {
+          ISMRMRD::ismrmrd_cleanup_image(&im);
+          throw;
+        }
+        if (d.appendImage(image_variable(im), &im)) {
+          images++;
+        }
+        break;
+      }
+      case ISMRMRD::MessageId::NDARRAY: {
+        ISMRMRD::ISMRMRD_NDArray arr;
+        ISMRMRD::ismrmrd_init_ndarray(&arr);
+        try {
+          ISMRMRD::deserializePayload(stream, &arr);
+        } catch (...) {
+          ISMRMRD::ismrmrd_cleanup_ndarray(&arr);
+          throw;
+        }
+        if (d.appendNDArray(array_variable(arr), &arr)) {
+          arrays++;
+        }
+        break;
+      }
+      default:
+        break;
+      }
+
+      double elapsed = seconds_since(start);
+      if (elapsed - last_report >= 1.0) {
+        ISMRMRD::AsyncDatasetStats stats = d.getStats();
+        std::printf("%8.1f s  %8.1f MB/s  queue %5zu  written %llu  dropped %llu\n", elapsed,
+                    (buffer.bytes() - last_bytes) / (elapsed - last_report) / 1e6, stats.depth,
+                    static_cast<unsigned long long>(stats.written), static_cast<unsigned long long>(stats.dropped));
+        std::fflush(stdout);
+        last_report = elapsed;
+        last_bytes = buffer.bytes();
+      }
+    }
+
+    d.close();
+    double elapsed = seconds_since(start);
+    ISMRMRD::AsyncDatasetStats stats = d.getStats();
+    std::printf("acquisitions:    %llu\n", acquisitions);
+    std::printf("images:          %llu\n", images);
+    std::printf("arrays:          %llu\n", arrays);
+    std::printf("waveforms:       %llu\n", waveforms);
+    std::printf("received:        %.1f MB\n", buffer.bytes() / 1e6);
+    std::printf("elapsed:         %.3f s\n", elapsed);
+    std::printf("throughput:      %.1f MB/s\n", elapsed > 0 ? buffer.bytes() / elapsed / 1e6 : 0.0);
+    std::printf("max queue depth: %zu\n", stats.max_depth);
+    std::printf("batches:         %llu\n", static_cast<unsigned long long>(stats.batches));
+    std::printf("dropped:         %llu\n", static_cast<unsigned long long>(stats.dropped));
+    std::printf("failed:          %llu\n", static_cast<unsigned long long>(stats.failed));
+  } catch (std::exception &e) {
+    std::cout << e.what() << std::endl;
+    status = -1;
+  }
+
+  if (fd != 0) {
+    close(fd);
+  }
+  return status;
+}
@@ -0,0 +1,96 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "ismrmrd/ismrmrd.h"
+#include "ismrmrd/dataset.h"
+
+// Follows a dataset while it is written in SWMR mode, e.g. by
+// ismrmrd_generate_cartesian_shepp_logan --swmr, and reports each slice as soon
+// as its last readout is in the file. That is the point at which a reconstruction
+// of the slice could start, without waiting for the scan to end.
+
+// The most acquisitions read at a time
+static const uint32_t max_block = 1024;
+
+static double seconds_since(const std::chrono::steady_clock::time_point &start)
+{
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+int main(int argc, char** argv)
+{
+  if (argc < 2) {
+    std::cout << "Usage: " << std::endl;
+    std::cout << "  " << argv[0] << " <FILENAME> [group] [timeout seconds]" << std::endl;
+    return -1;
+  }
+  std::string group = (argc > 2) ? argv[2] : "dataset";
+  double timeout = (argc > 3) ? std::atof(argv[3]) : 5.0;
+
+  // reads racing the writer are retried, the errors of the failed attempts aren't of interest
+  ISMRMRD::ismrmrd_set_error_handler(NULL);
+
+  try {
+    ISMRMRD::ISMRMRD_DatasetOptions options;
+    ISMRMRD::ismrmrd_init_dataset_options(&options);
+    options.swmr = ISMRMRD::ISMRMRD_SWMR_READ;
+    ISMRMRD::Dataset d(argv[1], group.c_str(), options, false);
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    std::map<std::pair<uint16_t, uint16_t>, uint32_t> readouts;  // per (repetition, slice)
+    std::vector<ISMRMRD::Acquisition> block;
+    uint32_t seen = 0;
+    uint32_t slices = 0;
+    size_t bytes = 0;
+    bool finished = false;
+
+    while (!finished) {
+      uint32_t available = d.waitForAcquisitions(seen + 1, uint32_t(timeout * 1000));
+      if (available <= seen) {
+        std::printf("no new acquisitions for %g s, stopping\n", timeout);
+        break;
+      }
+
+      // a tail started late on a large file catches up a block at a time
+      while (seen < available && !finished) {
+        uint32_t count = std::min(available - seen, max_block);
+        d.readAcquisitions(seen, count, block);
+        for (size_t n = 0; n < block.size() && !finished; n++) {
+          ISMRMRD::Acquisition &acq = block[n];
+          bytes += acq.getDataSize();
+          if (acq.isFlagSet(ISMRMRD::ISMRMRD_ACQ_IS_NOISE_MEASUREMENT)) {
+            continue;
+          }
+          std::pair<uint16_t, uint16_t> key(acq.idx().repetition, acq.idx().slice);
+          readouts[key]++;
+          if (acq.isFlagSet(ISMRMRD::ISMRMRD_ACQ_LAST_IN_SLICE)) {
+            std::printf("%8.3f s  repetition %u slice %u complete, %u readouts\n", seconds_since(start),
+                        key.first, key.second, readouts[key]);
+            readouts.erase(key);
+            slices++;
+          }
+          finished = acq.isFlagSet(ISMRMRD::ISMRMRD_ACQ_LAST_IN_MEASUREMENT);
+        }
+        seen += count;
+      }
+    }
+
+    double elapsed = seconds_since(start);
+    std::printf("acquisitions:    %u\n", seen);
+    std::printf("slices:          %u\n", slices);
+    std::printf("elapsed:         %.3f s\n", elapsed);
+    std::printf("throughput:      %.1f MB/s\n", elapsed > 0 ? bytes / elapsed / 1e6 : 0.0);
+  } catch (std::exception &e) {
+    std::cout << e.what() << std::endl;
+    return -1;
+  }
+
+  return 0;
+}
@@ -0,0 +1,208 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <string>
+
+#include "ismrmrd/ismrmrd.h"
+#include "ismrmrd/dataset.h"
+
+// Compares the images or arrays of a variable, or the acquisitions when the variable is
+// "data", written with the mantissa_bits option against the full precision originals.
+
+struct ErrorStats
+{
+  ErrorStats() : values(0), sum_squared_error(0), sum_squared_signal(0), max_error(0), max_relative_error(0) {}
+
+  void add(double original, double quantized) {
+    double error = std::fabs(quantized - original);
+    values++;
+    sum_squared_error += error * error;
+    sum_squared_signal += original * original;
+    if (error > max_error) {
+      max_error = error;
+    }
+    // subnormals have fewer mantissa bits to begin with, so only normal values are bounded
+    if (std::isnormal(float(original)) && error / std::fabs(original) > max_relative_error) {
+      max_relative_error = error / std::fabs(original);
+    }
+  }
+
+  size_t values;
+  double sum_squared_error;
+  double sum_squared_signal;
+  double max_error;
+  double max_relative_error;
+};
+
+static bool add_samples(ErrorStats &stats, uint16_t data_type, const void *a, const void *b, size_t bytes)
+{
+  switch (data_type) {
+    case ISMRMRD::ISMRMRD_FLOAT:
+    case ISMRMRD::ISMRMRD_CXFLOAT: {
+      // complex samples are compared one component at a time
+      const float *pa = static_cast<const float *>(a), *pb = static_cast<const float *>(b);
+      for (size_t n = 0; n < bytes / sizeof(float); n++) {
+        stats.add(pa[n], pb[n]);
+      }
+      return true;
+    }
+    case ISMRMRD::ISMRMRD_DOUBLE:
+    case ISMRMRD::ISMRMRD_CXDOUBLE: {
+      const double *pa = static_cast<const double *>(a), *pb = static_cast<const double *>(b);
+      for (size_t n = 0; n < bytes / sizeof(double); n++) {
+        stats.add(pa[n], pb[n]);
+      }
+      return true;
+    }
+    default:
+      // integer samples are never rounded
+      return std::memcmp(a, b, bytes) == 0;
+  }
+}
+
+static bool add_image(ErrorStats &stats, const ISMRMRD::ISMRMRD_Image &a, const ISMRMRD::ISMRMRD_Image &b)
+{
+  size_t bytes = ISMRMRD::ismrmrd_size_of_image_data(&a);
+  if (a.head.data_type != b.head.data_type || bytes != ISMRMRD::ismrmrd_size_of_image_data(&b)) {
+    return false;
+  }
+  return add_samples(stats, a.head.data_type, a.data, b.data, bytes);
+}
+
+static bool add_array(ErrorStats &stats, const ISMRMRD::ISMRMRD_NDArray &a, const ISMRMRD::ISMRMRD_NDArray &b)
+{
+  size_t bytes = ISMRMRD::ismrmrd_size_of_ndarray_data(&a);
+  if (a.data_type != b.data_type || a.ndim != b.ndim || bytes != ISMRMRD::ismrmrd_size_of_ndarray_data(&b) ||
+      !std::equal(a.dims, a.dims + a.ndim, b.dims)) {
+    return false;
+  }
+  return add_samples(stats, a.data_type, a.data, b.data, bytes);
+}
+
+static bool add_acquisition(ErrorStats &stats, const ISMRMRD::ISMRMRD_Acquisition &a,
+                            const ISMRMRD::ISMRMRD_Acquisition &b)
+{
+  size_t bytes = ISMRMRD::ismrmrd_size_of_acquisition_data(&a);
+  size_t traj_bytes = ISMRMRD::ismrmrd_size_of_acquisition_traj(&a);
+  if (bytes != ISMRMRD::ismrmrd_size_of_acquisition_data(&b) ||
+      traj_bytes != ISMRMRD::ismrmrd_size_of_acquisition_traj(&b)) {
+    return false;
+  }
+  // trajectories are never rounded
+  if (traj_bytes > 0 && std::memcmp(a.traj, b.traj, traj_bytes) != 0) {
+    return false;
+  }
+  return add_samples(stats, ISMRMRD::ISMRMRD_CXFLOAT, a.data, b.data, bytes);
+}
+
+// Adds item n of var to the statistics, false when the items don't match
+static bool add_item(ErrorStats &stats, ISMRMRD::ISMRMRD_Dataset &a, ISMRMRD::ISMRMRD_Dataset &b,
+                     const char *var, bool images, uint32_t n)
+{
+  bool matched;
+  if (std::strcmp(var, "data") == 0) {
+    ISMRMRD::ISMRMRD_Acquisition qa, qb;
+    ISMRMRD::ismrmrd_init_acquisition(&qa);
+    ISMRMRD::ismrmrd_init_acquisition(&qb);
+    matched = ISMRMRD::ismrmrd_read_acquisition(&a, n, &qa) == ISMRMRD::ISMRMRD_NOERROR &&
+              ISMRMRD::ismrmrd_read_acquisition(&b, n, &qb) == ISMRMRD::ISMRMRD_NOERROR &&
+              add_acquisition(stats, qa, qb);
+    ISMRMRD::ismrmrd_cleanup_acquisition(&qa);
+    ISMRMRD::ismrmrd_cleanup_acquisition(&qb);
+  } else if (images) {
+    ISMRMRD::ISMRMRD_Image ia, ib;
+    ISMRMRD::ismrmrd_init_image(&ia);
+    ISMRMRD::ismrmrd_init_image(&ib);
+    matched = ISMRMRD::ismrmrd_read_image(&a, var, n, &ia) == ISMRMRD::ISMRMRD_NOERROR &&
+              ISMRMRD::ismrmrd_read_image(&b, var, n, &ib) == ISMRMRD::ISMRMRD_NOERROR &&
+              add_image(stats, ia, ib);
+    ISMRMRD::ismrmrd_cleanup_image(&ia);
+    ISMRMRD::ismrmrd_cleanup_image(&ib);
+  } else {
+    ISMRMRD::ISMRMRD_NDArray aa, ab;
+    ISMRMRD::ismrmrd_init_ndarray(&aa);
+    ISMRMRD::ismrmrd_init_ndarray(&ab);
+    matched = ISMRMRD::ismrmrd_read_array(&a, var, n, &aa) == ISMRMRD::ISMRMRD_NOERROR &&
+              ISMRMRD::ismrmrd_read_array(&b, var, n, &ab) == ISMRMRD::ISMRMRD_NOERROR &&
+              add_array(stats, aa, ab);
+    ISMRMRD::ismrmrd_cleanup_ndarray(&aa);
+    ISMRMRD::ismrmrd_cleanup_ndarray(&ab);
+  }
+  return matched;
+}
+
+int main(int argc, char** argv)
+{
+  if (argc < 4) {
+    std::cout << "Usage: " << std::endl;
+    std::cout << "  " << argv[0] << " <ORIGINAL FILE> <ROUNDED FILE> <VARIABLE> [group]" << std::endl;
+    return -1;
+  }
+  std::string group = (argc > 4) ? argv[4] : "dataset";
+
+  try {
+    ISMRMRD::Dataset original(argv[1], group.c_str(), false);
+    ISMRMRD::Dataset rounded(argv[2], group.c_str(), false);
+
+    // a variable holds either images or arrays, "data" holds the acquisitions
+    const bool acquisitions = std::strcmp(argv[3], "data") == 0;
+    const bool images = !acquisitions && original.getNumberOfImages(argv[3]) > 0;
+    const char *kind = acquisitions ? "acquisitions" : images ? "images" : "arrays";
+    uint32_t count = acquisitions ? original.getNumberOfAcquisitions() :
+                     images ? original.getNumberOfImages(argv[3]) : original.getNumberOfNDArrays(argv[3]);
+    uint32_t rounded_count = acquisitions ? rounded.getNumberOfAcquisitions() :
+                             images ? rounded.getNumberOfImages(argv[3]) : rounded.getNumberOfNDArrays(argv[3]);
+    if (count != rounded_count) {
+      std::cout << "The files hold different numbers of " << kind << std::endl;
+      return 1;
+    }
+    uint16_t bits = rounded.readMantissaBits(argv[3]);
+
+    ErrorStats stats;
+    ISMRMRD::ISMRMRD_Dataset a, b;
+    ISMRMRD::ismrmrd_init_dataset(&a, argv[1], group.c_str());
+    ISMRMRD::ismrmrd_init_dataset(&b, argv[2], group.c_str());
+    bool matched = ISMRMRD::ismrmrd_open_dataset(&a, false) == ISMRMRD::ISMRMRD_NOERROR &&
+                   ISMRMRD::ismrmrd_open_dataset(&b, false) == ISMRMRD::ISMRMRD_NOERROR;
+    for (uint32_t n = 0; n < count && matched; n++) {
+      matched = add_item(stats, a, b, argv[3], images, n);
+      if (!matched) {
+        std::cout << "Item " << n << " of the " << kind << " differs in type, size or unrounded samples"
+                  << std::endl;
+      }
+    }
+    ISMRMRD::ismrmrd_close_dataset(&a);
+    ISMRMRD::ismrmrd_close_dataset(&b);
+    if (!matched) {
+      return 1;
+    }
+
+    double rms = stats.values ? std::sqrt(stats.sum_squared_error / stats.values) : 0;
+    double nrms = stats.sum_squared_signal > 0 ? std::sqrt(stats.sum_squared_error / stats.sum_squared_signal) : 0;
+    std::printf("%-20s%u\n", (std::string(kind) + ":").c_str(), count);
+    std::printf("values:             %zu\n", stats.values);
+    if (bits > 0) {
+      std::printf("mantissa bits:      %u (relative error bound %g)\n", bits, std::ldexp(1.0, -(bits + 1)));
+    } else {
+      std::printf("mantissa bits:      full precision\n");
+    }
+    std::printf("max error:          %g\n", stats.max_error);
+    std::printf("max relative error: %g\n", stats.max_relative_error);
+    std::printf("rms error:          %g\n", rms);
+    std::printf("normalized rms:     %g\n", nrms);
+
+    // the rounding is to nearest, so the bound holds for every normal sample
+    double bound = bits > 0 ? std::ldexp(1.0, -(bits + 1)) : 0;
+    if (stats.max_relative_error > bound) {
+      std::cout << "The error exceeds the recorded precision" << std::endl;
+      return 1;
+    }
+  } catch (std::exception &e) {
+    std::cout << e.what() << std::endl;
+    return -1;
+  }
+
+  return 0;
+}